@@ -0,0 +1,390 @@
+#include "batch.h"
+#include "../parallel/parallel.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__AVX2__)
+#define BATCH_SIMD_WIDTH 8
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCH_SIMD_WIDTH 4
+#include <emmintrin.h>
+#else
+#define BATCH_SIMD_WIDTH 1
+#endif
+
+namespace fantasy
+{
+    // 每个 kernel 按 Ops 模板化, 主体用 VectorOps, 剩余不足一组的元素用 ScalarOps, 两者的运算顺序相同.
+    struct ScalarOps
+    {
+        using Float = float;
+        static constexpr uint32_t width = 1;
+
+        static Float set1(float value) { return value; }
+        static Float load(const float* data) { return *data; }
+        static void store(float* data, Float a) { *data = a; }
+        static Float add(Float a, Float b) { return a + b; }
+        static Float sub(Float a, Float b) { return a - b; }
+        static Float mul(Float a, Float b) { return a * b; }
+        static Float mul_add(Float a, Float b, Float c) { return a * b + c; }
+        static Float min(Float a, Float b) { return b < a ? b : a; }
+        static Float max(Float a, Float b) { return a < b ? b : a; }
+        static float reduce_min(Float a) { return a; }
+        static float reduce_max(Float a) { return a; }
+        static bool any_greater(Float a, Float b) { return a > b; }
+        static uint32_t equal_mask(Float a, Float b) { return a == b ? 1 : 0; }
+    };
+
+#if BATCH_SIMD_WIDTH == 8
+    struct VectorOps
+    {
+        using Float = __m256;
+        static constexpr uint32_t width = 8;
+
+        static Float set1(float value) { return _mm256_set1_ps(value); }
+        static Float load(const float* data) { return _mm256_loadu_ps(data); }
+        static void store(float* data, Float a) { _mm256_storeu_ps(data, a); }
+        static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+        static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+        static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+        static Float mul_add(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+        static Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+        static Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+
+        static float reduce_min(Float a)
+        {
+            __m128 v = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+            v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+            return _mm_cvtss_f32(_mm_min_ss(v, _mm_shuffle_ps(v, v, 1)));
+        }
+
+        static float reduce_max(Float a)
+        {
+            __m128 v = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+            v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+            return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+        }
+
+        static bool any_greater(Float a, Float b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)) != 0; }
+        static uint32_t equal_mask(Float a, Float b) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ))); }
+    };
+#elif BATCH_SIMD_WIDTH == 4
+    struct VectorOps
+    {
+        using Float = __m128;
+        static constexpr uint32_t width = 4;
+
+        static Float set1(float value) { return _mm_set1_ps(value); }
+        static Float load(const float* data) { return _mm_loadu_ps(data); }
+        static void store(float* data, Float a) { _mm_storeu_ps(data, a); }
+        static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+        static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+        static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+        static Float mul_add(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        static Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+        static Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+
+        static float reduce_min(Float a)
+        {
+            const __m128 v = _mm_min_ps(a, _mm_movehl_ps(a, a));
+            return _mm_cvtss_f32(_mm_min_ss(v, _mm_shuffle_ps(v, v, 1)));
+        }
+
+        static float reduce_max(Float a)
+        {
+            const __m128 v = _mm_max_ps(a, _mm_movehl_ps(a, a));
+            return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+        }
+
+        static bool any_greater(Float a, Float b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)) != 0; }
+        static uint32_t equal_mask(Float a, Float b) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpeq_ps(a, b))); }
+    };
+#else
+    using VectorOps = ScalarOps;
+#endif
+
+    // [begin, end) 中可以按 Ops::width 整组处理的末尾.
+    template <typename Ops>
+    static uint64_t group_end(uint64_t begin, uint64_t end)
+    {
+        return begin + (end - begin) / Ops::width * Ops::width;
+    }
+
+    template <typename Ops>
+    static void transform(Float3View in, const float4x4& matrix, Float3Span out, uint64_t begin, uint64_t end, bool translate)
+    {
+        using Float = typename Ops::Float;
+
+        Float m[4][3];
+        for (uint32_t row = 0; row < 4; ++row)
+        {
+            for (uint32_t column = 0; column < 3; ++column)
+            {
+                m[row][column] = Ops::set1(translate || row != 3 ? matrix[row][column] : 0.0f);
+            }
+        }
+
+        for (uint64_t ix = begin; ix < end; ix += Ops::width)
+        {
+            const Float x = Ops::load(in.x + ix);
+            const Float y = Ops::load(in.y + ix);
+            const Float z = Ops::load(in.z + ix);
+
+            Ops::store(out.x + ix, Ops::mul_add(z, m[2][0], Ops::mul_add(y, m[1][0], Ops::mul_add(x, m[0][0], m[3][0]))));
+            Ops::store(out.y + ix, Ops::mul_add(z, m[2][1], Ops::mul_add(y, m[1][1], Ops::mul_add(x, m[0][1], m[3][1]))));
+            Ops::store(out.z + ix, Ops::mul_add(z, m[2][2], Ops::mul_add(y, m[1][2], Ops::mul_add(x, m[0][2], m[3][2]))));
+        }
+    }
+
+    static void transform(Float3View in, const float4x4& matrix, Float3Span out, bool translate)
+    {
+        assert(in.size == out.size);
+
+        const uint64_t end = group_end<VectorOps>(0, in.size);
+        transform<VectorOps>(in, matrix, out, 0, end, translate);
+        transform<ScalarOps>(in, matrix, out, end, in.size, translate);
+    }
+
+    void gather(const float3* data, uint64_t stride, Float3Span out)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        for (uint64_t ix = 0; ix < out.size; ++ix)
+        {
+            const float3& value = *reinterpret_cast<const float3*>(bytes + ix * stride);
+            out.x[ix] = value.x;
+            out.y[ix] = value.y;
+            out.z[ix] = value.z;
+        }
+    }
+
+    void transform_points(Float3View in, const float4x4& matrix, Float3Span out)
+    {
+        transform(in, matrix, out, true);
+    }
+
+    void transform_normals(Float3View in, const float4x4& matrix, Float3Span out)
+    {
+        transform(in, matrix, out, false);
+    }
+
+    Bounds3F transform_bounds(const Bounds3F& box, const float4x4& matrix)
+    {
+#if BATCH_SIMD_WIDTH > 1
+        // 一行放在一个 __m128 中, 第 4 个分量不使用.
+        __m128 lower = _mm_loadu_ps(matrix[3]);
+        __m128 upper = lower;
+        for (uint32_t row = 0; row < 3; ++row)
+        {
+            const __m128 m = _mm_loadu_ps(matrix[row]);
+            const __m128 a = _mm_mul_ps(m, _mm_set1_ps(box._lower[row]));
+            const __m128 b = _mm_mul_ps(m, _mm_set1_ps(box._upper[row]));
+            lower = _mm_add_ps(lower, _mm_min_ps(a, b));
+            upper = _mm_add_ps(upper, _mm_max_ps(a, b));
+        }
+
+        alignas(16) float result[2][4];
+        _mm_store_ps(result[0], lower);
+        _mm_store_ps(result[1], upper);
+        return Bounds3F(result[0][0], result[0][1], result[0][2], result[1][0], result[1][1], result[1][2]);
+#else
+        Bounds3F ret(float3(matrix[3][0], matrix[3][1], matrix[3][2]));
+        for (uint32_t row = 0; row < 3; ++row)
+        {
+            for (uint32_t column = 0; column < 3; ++column)
+            {
+                const float a = matrix[row][column] * box._lower[row];
+                const float b = matrix[row][column] * box._upper[row];
+                ret._lower[column] += std::min(a, b);
+                ret._upper[column] += std::max(a, b);
+            }
+        }
+        return ret;
+#endif
+    }
+
+    void transform_bounds(std::span<const Bounds3F> in, const float4x4& matrix, std::span<Bounds3F> out)
+    {
+        assert(in.size() == out.size());
+        for (uint64_t ix = 0; ix < in.size(); ++ix) out[ix] = transform_bounds(in[ix], matrix);
+    }
+
+    template <typename Ops>
+    static void compute_triangle_bounds(const float* v0, const float* v1, const float* v2, float* out_lower, float* out_upper, uint64_t begin, uint64_t end)
+    {
+        for (uint64_t ix = begin; ix < end; ix += Ops::width)
+        {
+            const typename Ops::Float a = Ops::load(v0 + ix);
+            const typename Ops::Float b = Ops::load(v1 + ix);
+            const typename Ops::Float c = Ops::load(v2 + ix);
+            Ops::store(out_lower + ix, Ops::min(Ops::min(a, b), c));
+            Ops::store(out_upper + ix, Ops::max(Ops::max(a, b), c));
+        }
+    }
+
+    void compute_triangle_bounds(Float3View v0, Float3View v1, Float3View v2, Float3Span out_lower, Float3Span out_upper)
+    {
+        assert(v0.size == v1.size && v0.size == v2.size && v0.size == out_lower.size && v0.size == out_upper.size);
+
+        const float* in[3][3] = { { v0.x, v1.x, v2.x }, { v0.y, v1.y, v2.y }, { v0.z, v1.z, v2.z } };
+        float* lower[3] = { out_lower.x, out_lower.y, out_lower.z };
+        float* upper[3] = { out_upper.x, out_upper.y, out_upper.z };
+
+        const uint64_t end = group_end<VectorOps>(0, v0.size);
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            compute_triangle_bounds<VectorOps>(in[axis][0], in[axis][1], in[axis][2], lower[axis], upper[axis], 0, end);
+            compute_triangle_bounds<ScalarOps>(in[axis][0], in[axis][1], in[axis][2], lower[axis], upper[axis], end, v0.size);
+        }
+    }
+
+    template <typename Ops>
+    static void compute_bounds(const float* data, uint64_t begin, uint64_t end, float& out_min, float& out_max)
+    {
+        typename Ops::Float lower = Ops::set1(out_min);
+        typename Ops::Float upper = Ops::set1(out_max);
+        for (uint64_t ix = begin; ix < end; ix += Ops::width)
+        {
+            const typename Ops::Float value = Ops::load(data + ix);
+            lower = Ops::min(lower, value);
+            upper = Ops::max(upper, value);
+        }
+        out_min = Ops::reduce_min(lower);
+        out_max = Ops::reduce_max(upper);
+    }
+
+    Bounds3F compute_bounds(Float3View points)
+    {
+        Bounds3F ret;
+        const float* data[3] = { points.x, points.y, points.z };
+        const uint64_t end = group_end<VectorOps>(0, points.size);
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            compute_bounds<VectorOps>(data[axis], 0, end, ret._lower[axis], ret._upper[axis]);
+            compute_bounds<ScalarOps>(data[axis], end, points.size, ret._lower[axis], ret._upper[axis]);
+        }
+        return ret;
+    }
+
+    Bounds3F merge_bounds(std::span<const Bounds3F> boxes)
+    {
+        Bounds3F ret;
+        for (const auto& box : boxes)
+        {
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                ret._lower[axis] = std::min(ret._lower[axis], box._lower[axis]);
+                ret._upper[axis] = std::max(ret._upper[axis], box._upper[axis]);
+            }
+        }
+        return ret;
+    }
+
+    Bounds3F parallel_compute_bounds(Float3View points, uint64_t grain_size)
+    {
+        // 没有初始化线程池时串行计算.
+        if (parallel::get_thread_pool() == nullptr || points.size <= grain_size) return compute_bounds(points);
+
+        const uint64_t chunk_num = (points.size + grain_size - 1) / grain_size;
+        std::vector<Bounds3F> boxes(chunk_num);
+        parallel::parallel_for(
+            [&](uint64_t ix)
+            {
+                const uint64_t begin = ix * grain_size;
+                boxes[ix] = compute_bounds(points.sub(begin, std::min(grain_size, points.size - begin)));
+            },
+            chunk_num,
+            1
+        );
+        return merge_bounds(boxes);
+    }
+
+    // 第一个等于 value 的元素, 与逐个比较 "<" 时保留的下标相同.
+    template <typename Ops>
+    static bool find_first(const float* data, uint64_t begin, uint64_t end, float value, uint64_t& out_index)
+    {
+        const typename Ops::Float target = Ops::set1(value);
+        for (uint64_t ix = begin; ix < end; ix += Ops::width)
+        {
+            const uint32_t mask = Ops::equal_mask(Ops::load(data + ix), target);
+            if (mask != 0)
+            {
+                out_index = ix + std::countr_zero(mask);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static uint64_t find_first(const float* data, uint64_t size, float value)
+    {
+        uint64_t index = 0;
+        const uint64_t end = group_end<VectorOps>(0, size);
+        if (!find_first<VectorOps>(data, 0, end, value, index)) find_first<ScalarOps>(data, end, size, value, index);
+        return index;
+    }
+
+    // 逐个扩大球, 只有一组中有点在球外时才逐个处理这一组.
+    template <typename Ops>
+    static void grow_sphere(Float3View points, uint64_t begin, uint64_t end, Sphere& sphere, float& max_len)
+    {
+        using Float = typename Ops::Float;
+
+        for (uint64_t ix = begin; ix < end; ix += Ops::width)
+        {
+            const Float dx = Ops::sub(Ops::load(points.x + ix), Ops::set1(sphere.center.x));
+            const Float dy = Ops::sub(Ops::load(points.y + ix), Ops::set1(sphere.center.y));
+            const Float dz = Ops::sub(Ops::load(points.z + ix), Ops::set1(sphere.center.z));
+            const Float len = Ops::add(Ops::add(Ops::mul(dx, dx), Ops::mul(dy, dy)), Ops::mul(dz, dz));
+            if (!Ops::any_greater(len, Ops::set1(max_len))) continue;
+
+            for (uint64_t jx = ix; jx < ix + Ops::width; ++jx)
+            {
+                const float3 vertex = points[jx];
+                float len = float3(vertex - sphere.center).length_squared();
+                if (len > max_len)
+                {
+                    len = std::sqrt(len);
+                    float t = 0.5 - 0.5 * (sphere.radius / len);
+                    sphere.center = sphere.center + (vertex - sphere.center) * t;
+                    sphere.radius = (sphere.radius + len) * 0.5;
+                    max_len = sphere.radius * sphere.radius;
+                }
+            }
+        }
+    }
+
+    Sphere compute_bounding_sphere(Float3View points)
+    {
+        if (points.size == 0) return Sphere{};
+
+        const Bounds3F box = compute_bounds(points);
+        const float* data[3] = { points.x, points.y, points.z };
+
+        float max_len = 0;
+        uint64_t min_index = 0, max_index = 0;
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            const uint64_t axis_min_index = find_first(data[axis], points.size, box._lower[axis]);
+            const uint64_t axis_max_index = find_first(data[axis], points.size, box._upper[axis]);
+            float len = float3(points[axis_max_index] - points[axis_min_index]).length_squared();
+            if (len > max_len || axis == 0)
+            {
+                max_len = len;
+                min_index = axis_min_index;
+                max_index = axis_max_index;
+            }
+        }
+
+        Sphere sphere;
+        sphere.center = (points[min_index] + points[max_index]) * 0.5f;
+        sphere.radius = float(0.5 * std::sqrt(max_len));
+        max_len = sphere.radius * sphere.radius;
+
+        const uint64_t end = group_end<VectorOps>(0, points.size);
+        grow_sphere<VectorOps>(points, 0, end, sphere, max_len);
+        grow_sphere<ScalarOps>(points, end, points.size, sphere, max_len);
+        return sphere;
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef MATH_BATCH_H
+#define MATH_BATCH_H
+
+#include "bounds.h"
+#include "matrix.h"
+#include "vector.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace fantasy
+{
+    // 按分量分开存放的 float3 数组 (SoA), 只引用外部内存.
+    // sub 取出的子区间可以直接交给 parallel_for_range 的各个区间处理.
+    struct Float3View
+    {
+        const float* x = nullptr;
+        const float* y = nullptr;
+        const float* z = nullptr;
+        uint64_t size = 0;
+
+        float3 operator[](uint64_t index) const { return float3(x[index], y[index], z[index]); }
+
+        Float3View sub(uint64_t begin, uint64_t count) const
+        {
+            assert(begin + count <= size);
+            return Float3View{ x + begin, y + begin, z + begin, count };
+        }
+    };
+
+    struct Float3Span
+    {
+        float* x = nullptr;
+        float* y = nullptr;
+        float* z = nullptr;
+        uint64_t size = 0;
+
+        void set(uint64_t index, const float3& value) { x[index] = value.x; y[index] = value.y; z[index] = value.z; }
+        float3 operator[](uint64_t index) const { return float3(x[index], y[index], z[index]); }
+
+        Float3Span sub(uint64_t begin, uint64_t count) const
+        {
+            assert(begin + count <= size);
+            return Float3Span{ x + begin, y + begin, z + begin, count };
+        }
+
+        operator Float3View() const { return Float3View{ x, y, z, size }; }
+    };
+
+    struct Float3SoA
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+
+        Float3SoA() = default;
+        explicit Float3SoA(uint64_t size) { resize(size); }
+
+        uint64_t size() const { return x.size(); }
+        void resize(uint64_t size) { x.resize(size); y.resize(size); z.resize(size); }
+
+        void set(uint64_t index, const float3& value) { x[index] = value.x; y[index] = value.y; z[index] = value.z; }
+        float3 operator[](uint64_t index) const { return float3(x[index], y[index], z[index]); }
+
+        Float3View view() const { return Float3View{ x.data(), y.data(), z.data(), size() }; }
+        Float3Span span() { return Float3Span{ x.data(), y.data(), z.data(), size() }; }
+    };
+
+    // 从 AoS 的结构体数组中读取 float3 成员, stride 为结构体的字节数, 如 gather(&vertices[0].position, sizeof(Vertex), ...).
+    void gather(const float3* data, uint64_t stride, Float3Span out);
+
+    template <typename T>
+    void gather(std::span<const T> items, float3 T::* member, Float3Span out)
+    {
+        assert(items.size() == out.size);
+        if (!items.empty()) gather(&(items[0].*member), sizeof(T), out);
+    }
+
+    // out[i] = float3(mul(float4(in[i], 1.0f), matrix)), 不做透视除法. in 和 out 可以是同一块内存.
+    void transform_points(Float3View in, const float4x4& matrix, Float3Span out);
+
+    // out[i] = float3(mul(float4(in[i], 0.0f), matrix)), 变换法线时传入 transpose(inverse(world_matrix)), 结果不做归一化.
+    void transform_normals(Float3View in, const float4x4& matrix, Float3Span out);
+
+    // Arvo 的方法, 直接由矩阵各元素与包围盒上下界的乘积取 min/max, 不需要变换 8 个顶点.
+    Bounds3F transform_bounds(const Bounds3F& box, const float4x4& matrix);
+    void transform_bounds(std::span<const Bounds3F> in, const float4x4& matrix, std::span<Bounds3F> out);
+
+    // 三角形 (v0[i], v1[i], v2[i]) 的包围盒.
+    void compute_triangle_bounds(Float3View v0, Float3View v1, Float3View v2, Float3Span out_lower, Float3Span out_upper);
+
+    // 空的输入返回默认构造的 (无效) 包围盒.
+    Bounds3F compute_bounds(Float3View points);
+    Bounds3F merge_bounds(std::span<const Bounds3F> boxes);
+
+    // 按 grain_size 分块求包围盒, 再合并各块的结果. 没有线程池时与 compute_bounds 相同.
+    Bounds3F parallel_compute_bounds(Float3View points, uint64_t grain_size = 64 * 1024);
+
+    // 与 Sphere(const std::vector<float3>&) 的结果相同 (Ritter 的方法).
+    Sphere compute_bounding_sphere(Float3View points);
+}
+
+#endif
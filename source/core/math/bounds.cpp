@@ -112,4 +112,44 @@ namespace fantasy
         }
         return sphere;
     }
-}
\ No newline at end of file
+
+    Frustum::Frustum(const float4x4& view_proj)
+    {
+        // clip = mul(float4(p, 1), view_proj), 平面由矩阵的列组合得到.
+        float4 columns[4];
+        for (uint32_t ix = 0; ix < 4; ++ix)
+        {
+            columns[ix] = float4(view_proj[0][ix], view_proj[1][ix], view_proj[2][ix], view_proj[3][ix]);
+        }
+
+        planes[0] = columns[3] + columns[0];    // left
+        planes[1] = columns[3] - columns[0];    // right
+        planes[2] = columns[3] + columns[1];    // bottom
+        planes[3] = columns[3] - columns[1];    // top
+        planes[4] = columns[2];                 // near
+        planes[5] = columns[3] - columns[2];    // far
+    }
+
+    FrustumCull cull(const Frustum& frustum, const Bounds3F& bounds)
+    {
+        FrustumCull ret = FrustumCull::Inside;
+        for (const auto& plane : frustum.planes)
+        {
+            // 沿平面法线方向最远和最近的顶点.
+            const float3 p(
+                plane.x >= 0.0f ? bounds._upper.x : bounds._lower.x,
+                plane.y >= 0.0f ? bounds._upper.y : bounds._lower.y,
+                plane.z >= 0.0f ? bounds._upper.z : bounds._lower.z
+            );
+            const float3 n(
+                plane.x >= 0.0f ? bounds._lower.x : bounds._upper.x,
+                plane.y >= 0.0f ? bounds._lower.y : bounds._upper.y,
+                plane.z >= 0.0f ? bounds._lower.z : bounds._upper.z
+            );
+
+            if (dot(float3(plane.x, plane.y, plane.z), p) + plane.w < 0.0f) return FrustumCull::Outside;
+            if (dot(float3(plane.x, plane.y, plane.z), n) + plane.w < 0.0f) ret = FrustumCull::Intersect;
+        }
+        return ret;
+    }
+}
@@ -2,6 +2,7 @@
 #define MATH_BOUNDS_H
 
 #include "vector.h"
+#include "matrix.h"
 #include "ray.h"
 #include <cassert>
 #include <cstdint>
@@ -64,7 +65,7 @@ namespace fantasy
 			return _upper;
 		}
 
-		bool operator==(const Bounds2<T>& other)
+		bool operator==(const Bounds2<T>& other) const
 		{
 			return _upper == other._upper && _lower == other._lower;
 		}
@@ -226,12 +227,7 @@ namespace fantasy
 			return _upper != other._upper || _lower != other._lower;
 		}
 
-		Bounds3<T>& operator=(const Bounds3<T>& other)
-		{
-			_lower = other._lower;
-			_upper = other._upper;
-			return *this;
-		}
+		Bounds3<T>& operator=(const Bounds3<T>& other) = default;
 
 		template <typename U>
 		requires std::is_arithmetic_v<U>
@@ -387,11 +383,11 @@ namespace fantasy
 
 			// 公式 $t = \frac {-d - o_x}{d_x}$
 
-			const float min_x = (bounds[dir_is_neg[0]].x - ray.ori.x) / inv_ray_dir.x;
-			float max_x = (bounds[1 - dir_is_neg[0]].x - ray.ori.x) / inv_ray_dir.x;
+			const float min_x = (bounds[dir_is_neg[0]].x - ray.ori.x) * inv_ray_dir.x;
+			float max_x = (bounds[1 - dir_is_neg[0]].x - ray.ori.x) * inv_ray_dir.x;
 			
-			const float min_y = (bounds[dir_is_neg[1]].y - ray.ori.y) / inv_ray_dir.y;
-			float max_y = (bounds[1 - dir_is_neg[1]].y - ray.ori.y) / inv_ray_dir.y;
+			const float min_y = (bounds[dir_is_neg[1]].y - ray.ori.y) * inv_ray_dir.y;
+			float max_y = (bounds[1 - dir_is_neg[1]].y - ray.ori.y) * inv_ray_dir.y;
 
 			// 看 1610 行
 			max_x *= 1 + 2 * gamma(3);
@@ -405,8 +401,8 @@ namespace fantasy
 			if (fT1 > max_y) fT1 = max_y;
 
 			// 同上
-			const float min_z = (bounds[dir_is_neg[2]].z - ray.ori.z) / inv_ray_dir.z;
-			float max_z = (bounds[1 - dir_is_neg[2]].z - ray.ori.z) / inv_ray_dir.z;
+			const float min_z = (bounds[dir_is_neg[2]].z - ray.ori.z) * inv_ray_dir.z;
+			float max_z = (bounds[1 - dir_is_neg[2]].z - ray.ori.z) * inv_ray_dir.z;
 
 			// 看 1610 行
 			max_z *= 1 + 2 * gamma(3);
@@ -488,12 +484,6 @@ namespace fantasy
 					max_len = radius * radius;
 				}
 			}
-
-			for (uint32_t i = 0; i < vertices.size(); i++) 
-			{
-				float len = float3(vertices[i] - center).length();
-				// assert(len - 1e-6 <= radius);
-			}
 		}
 
         float3 center;
@@ -634,6 +624,26 @@ namespace fantasy
 
     Bounds3F create_aabb(const std::vector<float3>& position);
 
+	// 平面为 (normal, d), 法线指向视锥体内部.
+	struct Frustum
+	{
+		Frustum() = default;
+
+		// view_proj 为 mul(float4, matrix) 约定的矩阵, 投影后 z 的范围为 [0, 1], reverse z 同样适用.
+		explicit Frustum(const float4x4& view_proj);
+
+		float4 planes[6];
+	};
+
+	enum class FrustumCull : uint8_t
+	{
+		Outside,
+		Intersect,
+		Inside
+	};
+
+	FrustumCull cull(const Frustum& frustum, const Bounds3F& bounds);
+
 }
 
 
@@ -1,138 +1,85 @@
 #include "Bvh.h"
-#include "bvh/bvh.hpp"
-#include "bvh/leaf_collapser.hpp"
-#include "bvh/locally_ordered_clustering_builder.hpp"
+#include "batch.h"
+#include "bvh_builder.h"
 #include "../parallel/parallel.h"
+#include "../parallel/algorithm.h"
+#include "../tools/morton_code.h"
 
 namespace fantasy 
 {
-    bvh::Vector3<float> ConvertVector(float3 vec)
-    {
-        return { vec.x, vec.y, vec.z };
-    }
-
-    bvh::BoundingBox<float> ConvertBounds(Bounds3F Bounds)
-    {
-        return bvh::BoundingBox<float>{ ConvertVector(Bounds._lower), ConvertVector(Bounds._upper) };
-    }
-
-
-    void Bvh::build(std::span<Bvh::Vertex> vertices, uint32_t triangle_num)
+    void Bvh::build(std::span<Bvh::Vertex> vertices, uint32_t triangle_num, uint32_t max_depth)
     {
+        _nodes.clear();
+        _vertices.clear();
         global_box = Bounds3F();
-        std::vector<bvh::BoundingBox<float>> PrimitiveBoxes(triangle_num);
-        std::vector<bvh::Vector3<float>> PrimitiveCentroids(triangle_num);
+        this->triangle_num = triangle_num;
+        global_box = Bounds3F();
+        if (triangle_num == 0) return;
 
-        for (uint32_t ix = 0; ix < triangle_num; ++ix)
+        Float3SoA lower(triangle_num);
+        Float3SoA upper(triangle_num);
         {
-            Bounds3F PrimitiveBox;
-            uint64_t stVertexIndex = ix * 3;
-            PrimitiveBox = merge(PrimitiveBox, vertices[stVertexIndex].position);
-            PrimitiveBox = merge(PrimitiveBox, vertices[stVertexIndex + 1].position);
-            PrimitiveBox = merge(PrimitiveBox, vertices[stVertexIndex + 2].position);
-
-            global_box = merge(global_box, PrimitiveBox);
-            PrimitiveBoxes[ix] = ConvertBounds(PrimitiveBox);
-            PrimitiveCentroids[ix] = ConvertVector(
-                (vertices[stVertexIndex].position + vertices[stVertexIndex + 1].position + vertices[stVertexIndex + 2].position) / 3.0f
+            // 三角形的 3 个顶点各自按 SoA 读取.
+            Float3SoA triangle_vertices[3];
+            for (uint32_t ix = 0; ix < 3; ++ix)
+            {
+                triangle_vertices[ix].resize(triangle_num);
+                gather(&vertices[ix].position, sizeof(Bvh::Vertex) * 3, triangle_vertices[ix].span());
+            }
+            compute_triangle_bounds(
+                triangle_vertices[0].view(), 
+                triangle_vertices[1].view(), 
+                triangle_vertices[2].view(), 
+                lower.span(), 
+                upper.span()
             );
         }
-        
-        bvh::Bvh<float> Bvh;
-        bvh::LocallyOrderedClusteringBuilder<bvh::Bvh<float>, uint32_t> BvhBuilder(Bvh);
-        BvhBuilder.build(
-            ConvertBounds(global_box), 
-            PrimitiveBoxes.data(), 
-            PrimitiveCentroids.data(), 
-            triangle_num
-        );
-        bvh::LeafCollapser<bvh::Bvh<float>> LeafCollapser(Bvh);
-        LeafCollapser.collapse();
 
+        BvhBuildDesc desc;
+        desc.max_depth = max_depth;
+        BvhBuildResult result = build_binned_sah_bvh(lower.view(), upper.view(), desc);
+        _nodes = std::move(result.nodes);
+        global_box = _nodes[0].box;
 
-        
-        _vertices.clear();
-        _nodes.resize(Bvh.node_count);
-
-        for (size_t ix = 0; ix< Bvh.node_count; ++ix)
+        // 叶子节点的 child_index 即为重排之后的三角形序号.
+        _vertices.resize(uint64_t(triangle_num) * 3);
+        auto ReorderRange = [&](uint64_t begin, uint64_t end)
         {
-            const auto& crNode = Bvh.nodes[ix];
-            _nodes[ix].box = Bounds3F(
-                crNode.bounds[0], crNode.bounds[2], crNode.bounds[4], 
-                crNode.bounds[1], crNode.bounds[3], crNode.bounds[5]
-            );
-
-            if (crNode.is_leaf())
-            {
-                uint32_t dwPrimitiveBegin = static_cast<uint32_t>(_vertices.size()) / 3;
-
-                uint32_t dwCycleEnd = crNode.first_child_or_primitive + crNode.primitive_count;
-                for (size_t ix = crNode.first_child_or_primitive; ix < dwCycleEnd; ++ix)
-                {
-                    uint64_t index = Bvh.primitive_indices[ix] * 3;
-                    _vertices.emplace_back(vertices[index]);
-                    _vertices.emplace_back(vertices[index + 1]);
-                    _vertices.emplace_back(vertices[index + 2]);
-                }
-
-                uint32_t dwPrimitiveEnd = static_cast<uint32_t>(_vertices.size()) / 3;
-
-                assert(dwPrimitiveBegin != dwPrimitiveEnd);
-                _nodes[ix].child_index = dwPrimitiveBegin;
-                _nodes[ix].child_num = dwPrimitiveEnd - dwPrimitiveBegin;
-            }
-            else 
+            for (uint64_t ix = begin; ix < end; ++ix)
             {
-                _nodes[ix].child_index = crNode.first_child_or_primitive;
-                _nodes[ix].child_num = 0;
+                const uint64_t index = uint64_t(result.primitive_indices[ix]) * 3;
+                _vertices[ix * 3] = vertices[index];
+                _vertices[ix * 3 + 1] = vertices[index + 1];
+                _vertices[ix * 3 + 2] = vertices[index + 2];
             }
-        }
-        
-        this->triangle_num = triangle_num;
-
+        };
+        parallel::parallel_for_range(ReorderRange, triangle_num, 16 * 1024);
     }
 
-
-    
-    void Bvh::build(std::span<Bounds3F> boxes, const Bounds3F& global_box)
+    void Bvh::build(std::span<Bounds3F> boxes)
 	{
-		std::vector<bvh::BoundingBox<float>> BvhBoxes(boxes.size());
-		std::vector<bvh::Vector3<float>> BvhCentroids(boxes.size());
-		for (uint32_t ix = 0; ix < boxes.size(); ++ix)
-		{
-			BvhBoxes[ix] = ConvertBounds(boxes[ix]);
-			BvhCentroids[ix] = ConvertVector((boxes[ix]._upper + boxes[ix]._lower) * 0.5f);
-		}
-
-		bvh::Bvh<float> Bvh;
-		bvh::LocallyOrderedClusteringBuilder<bvh::Bvh<float>, uint32_t> BvhBuilder(Bvh);
-		BvhBuilder.build(
-			ConvertBounds(global_box),
-			BvhBoxes.data(),
-			BvhCentroids.data(),
-            boxes.size()
-		);
-
-		_nodes.resize(Bvh.node_count);
-		for (size_t ix = 0; ix < Bvh.node_count; ++ix)
+		_nodes.clear();
+		global_box = Bounds3F();
+		if (boxes.empty()) return;
+
+		Float3SoA lower(boxes.size());
+		Float3SoA upper(boxes.size());
+		gather(&boxes[0]._lower, sizeof(Bounds3F), lower.span());
+		gather(&boxes[0]._upper, sizeof(Bounds3F), upper.span());
+
+		BvhBuildDesc desc;
+		desc.max_leaf_size = 1;
+		BvhBuildResult result = build_binned_sah_bvh(lower.view(), upper.view(), desc);
+
+		// 每个叶子只有一个包围盒, child_index 直接指向 boxes 中的序号.
+		_nodes = std::move(result.nodes);
+		global_box = _nodes[0].box;
+		for (auto& node : _nodes)
 		{
-			const auto& crNode = Bvh.nodes[ix];
-			_nodes[ix].box = Bounds3F(
-				crNode.bounds[0], crNode.bounds[2], crNode.bounds[4],
-				crNode.bounds[1], crNode.bounds[3], crNode.bounds[5]
-			);
-
-			if (crNode.is_leaf())
+			if (node.child_num > 0)
 			{
-                assert(crNode.primitive_count == 1);
-
-				_nodes[ix].child_index = Bvh.primitive_indices[crNode.first_child_or_primitive];
-				_nodes[ix].child_num = 1;
-			}
-			else
-			{
-				_nodes[ix].child_index = crNode.first_child_or_primitive;
-				_nodes[ix].child_num = 0;
+				assert(node.child_num == 1);
+				node.child_index = result.primitive_indices[node.child_index];
 			}
 		}
 	}
@@ -225,7 +172,7 @@ namespace fantasy
 
         uint32_t dwTotalNodes = 0;
         std::vector<std::shared_ptr<FTrianglePrimitive>> pOrderedPrimitives;
-        pOrderedPrimitives.reserve(pPrimitives.size());
+        pOrderedPrimitives.reserve(m_pPrimitives.size());
 
         BvhBuildNode* pRoot = nullptr;
         if (cSplidMethod == ESplitMethod::HLBVH)
@@ -234,10 +181,10 @@ namespace fantasy
         }
         else 
         {
-            pRoot = RecursiveBuild(PrimitiveInfos, 0, pPrimitives.size(), &dwTotalNodes, pOrderedPrimitives);
+            pRoot = RecursiveBuild(PrimitiveInfos, 0, m_pPrimitives.size(), &dwTotalNodes, pOrderedPrimitives);
         }
 
-        pPrimitives.swap(pOrderedPrimitives);
+        m_pPrimitives.swap(pOrderedPrimitives);
         PrimitiveInfos.clear();
 
         _nodes.resize(dwTotalNodes);
@@ -254,7 +201,7 @@ namespace fantasy
 
     bool BvhAccel::intersect(const Ray& ray) const
     {
-        if (!_nodes.empty()) return false;
+        if (_nodes.empty()) return false;
 
         float3 InvDirection(1.0f / ray.dir.x, 1.0f / ray.dir.y, 1.0f / ray.dir.z);
         uint32_t dwDirIsNeg[3] = { InvDirection.x < 0, InvDirection.y < 0, InvDirection.z < 0 };
@@ -287,7 +234,7 @@ namespace fantasy
                     if (dwDirIsNeg[pNode->btAxis])
                     {
                         // Second child first. 
-                        dwNodesToVisitIndex[dwToVisitOffset++] = dwCurrentNodeIndex - 1;
+                        dwNodesToVisitIndex[dwToVisitOffset++] = dwCurrentNodeIndex + 1;
                         dwCurrentNodeIndex = pNode->dwSecondChildOffset;
                     }
                     else 
@@ -370,7 +317,7 @@ namespace fantasy
                     {
                         // Partition primitives through node's midpoint
                         float fDimensionMid = (CentroidBounds._lower[dwDimension] + CentroidBounds._upper[dwDimension]) / 2.0f;
-                        BvhPrimitiveInfo* pMidPrimitiveInfo = std::partition(
+                        BvhPrimitiveInfo* pMidPrimitiveInfo = parallel::partition(
                             &rPrimitiveInfos[dwStart], 
                             &rPrimitiveInfos[dwEnd - 1] + 1, 
                             [dwDimension, fDimensionMid](const BvhPrimitiveInfo& crInfo)
@@ -380,7 +327,7 @@ namespace fantasy
                         );
                         dwMid = pMidPrimitiveInfo - &rPrimitiveInfos[0];
 
-                        if (dwMid != dwStart && dwMid == dwEnd) break;
+                        if (dwMid != dwStart && dwMid != dwEnd) break;
                     }
 
                 case ESplitMethod::EqualCounts:
@@ -459,6 +406,9 @@ namespace fantasy
                                     dwCount1 += Buckets[j].dwPrimitivesCount;
                                 }
                                 fBucketCost[i] = 1 + (dwCount0 * b0.surface_area() + dwCount1 * b1.surface_area()) / GlobalBounds.surface_area();
+
+                                // An empty side merges into an infinite box and 0 * INF is NaN, never pick that split. 
+                                if (dwCount0 == 0 || dwCount1 == 0) fBucketCost[i] = INFINITY;
                             }
 
                             // Find minimum bucket cost to split at that minimizes SAH metric. 
@@ -477,7 +427,7 @@ namespace fantasy
                             float fLeafCost = dwPartPrimsNum;
                             if (dwPartPrimsNum > m_dwMaxPrimitivesInNode || fMinBucketCost < fLeafCost)
                             {
-                                BvhPrimitiveInfo* pMidInfo = std::partition(
+                                BvhPrimitiveInfo* pMidInfo = parallel::partition(
                                     &rPrimitiveInfos[dwStart], 
                                     &rPrimitiveInfos[dwEnd - 1] + 1, 
                                     [=](const BvhPrimitiveInfo& crInfo)
@@ -533,87 +483,6 @@ namespace fantasy
         BvhBuildNode* pBuildNode;
     };
 
-    inline uint32_t LeftShift3(uint32_t dwVal)
-    {
-        // LE(dwVal, (1 << MORTON_BITS_NUM));
-        if (dwVal == (1 << MORTON_BITS_NUM)) dwVal--;
-
-        dwVal = (dwVal | (dwVal << 16)) & 0b00000011000000000000000011111111;
-        // dwVal = ---- --11 ---- ---- ---- ---- 111 1111
-        dwVal = (dwVal | (dwVal << 8)) & 0b00000011000000001111000000001111;
-        // dwVal = ---- --11 ---- ---- 1111 ---- ---- 1111
-        dwVal = (dwVal | (dwVal << 4)) & 0b00000011000011000011000011000011;
-        // dwVal = ---- --1 ---- 11-- --11 ---- 11-- --11
-        dwVal = (dwVal | (dwVal << 2)) & 0b00001001001001001001001001001001;
-        // dwVal = ---- 1--1 --1- -1-- 1--1 --1- -1-- 1--1
-
-        return dwVal;
-    }
-
-    inline uint32_t EncodeMorton3(const float3& crVec)
-    {
-        // GE(crVec.x, 0);
-        // GE(crVec.y, 0);
-        // GE(crVec.z, 0);
-
-        return (LeftShift3(crVec.z) << 2) | (LeftShift3(crVec.y) << 1) | (LeftShift3(crVec.x));
-    }
-
-    static void RadixSort(std::vector<FMortonPrimitive>* pMortonPrimitives)
-    {
-        std::vector<FMortonPrimitive> TempMortonPrims(pMortonPrimitives->size());
-        constexpr uint32_t dwBitsPerPass = 6;
-        constexpr uint32_t dwBitsNum = MORTON_BITS_NUM * 3;
-        constexpr uint32_t dwPassesNum = dwBitsNum / dwBitsPerPass;
-
-        constexpr uint32_t dwBucketsNum = 1 << dwBitsPerPass;
-        constexpr uint32_t dwBitMask = (1 << dwBitsPerPass) - 1;
-
-        for (uint32_t pass = 0; pass < dwPassesNum; ++pass)
-        {
-            // Perform one pass of radix sort, sorting dwBitsPerPass bits. 
-
-            // Low bits which has been sorted.  
-            uint32_t dwLowBit = pass * dwBitsPerPass;
-
-            // Set in and out vector pointers for radix sort pass to avoid extra copying. 
-            std::vector<FMortonPrimitive>& rIn = pass & 1 ? TempMortonPrims : *pMortonPrimitives;
-            std::vector<FMortonPrimitive>& rOut = pass & 1 ? *pMortonPrimitives : TempMortonPrims;
-
-            // Count number of zero bits in array for current radix sort bit. 
-            uint32_t pdwBucketCount[dwBucketsNum] = {0};
-
-            for (const auto& crMortonPrim : rIn)
-            {
-                uint32_t dwBucket = (crMortonPrim.dwMortonCode >> dwLowBit) & dwBitMask;
-                // GE(dwBucket, 0);
-                // LT(dwBucket, dwBucketsNum);
-                pdwBucketCount[dwBucket]++;
-            }
-
-            // Compute starting index in output array for each bucket. 
-            uint32_t pdwOutIndex[dwBucketsNum] = {0};
-            for (uint32_t ix = 1; ix < dwBucketsNum; ++ix)
-            {
-                pdwOutIndex[ix] = pdwOutIndex[ix - 1] + pdwBucketCount[ix - 1];
-            }
-
-            // Store sorted values in output array. 
-            for (const auto& crMortonPrim : rIn)
-            {
-                uint32_t dwBucket = (crMortonPrim.dwMortonCode >> dwLowBit) & dwBitMask;
-                rOut[pdwOutIndex[dwBucket]++] = crMortonPrim;
-            }
-        }   
-        
-        // Copy final result from _tempVector_, if needed
-        if (dwPassesNum & 1) 
-        {
-            std::swap(*pMortonPrimitives, TempMortonPrims);
-        }    
-    }
-
-
     BvhBuildNode* BvhAccel::HLBVHBuild(
         std::vector<BvhPrimitiveInfo>& rPrimitiveInfos,
         uint32_t* pdwTotalNodes,
@@ -628,25 +497,34 @@ namespace fantasy
         }
 
         // Compute Morton indices of primitives. 
-        parallel::initialize();
-        std::vector<FMortonPrimitive> MortonPrimitives(rPrimitiveInfos.size());
-        parallel::parallel_for(
-            [&](uint64_t ix)
-            {
-                // initialize MortonPrimitives[ix] for ixth primitive. 
-                constexpr uint32_t dwMortonScale = 1 << MORTON_BITS_NUM;
+        std::vector<float3> Centroids(rPrimitiveInfos.size());
+        for (uint64_t ix = 0; ix < rPrimitiveInfos.size(); ++ix) Centroids[ix] = rPrimitiveInfos[ix].Centroid;
 
-                MortonPrimitives[ix].child_index = rPrimitiveInfos[ix].stPrimitiveIndex;
-                float3 CentroidOffset = CentroidBounds.offset(rPrimitiveInfos[ix].Centroid);
+        std::vector<uint32_t> MortonCodes(rPrimitiveInfos.size());
+        auto EncodeRange = [&](uint64_t begin, uint64_t end)
+        {
+            morton_encode_3d_30(
+                std::span<const float3>(Centroids).subspan(begin, end - begin), 
+                CentroidBounds, 
+                std::span<uint32_t>(MortonCodes).subspan(begin, end - begin)
+            );
+        };
+        parallel::parallel_for_range(EncodeRange, rPrimitiveInfos.size(), 4096);
 
-                MortonPrimitives[ix].dwMortonCode = EncodeMorton3(CentroidOffset * dwMortonScale);
-            },
-            rPrimitiveInfos.size(),
-            512
-        );
+        std::vector<FMortonPrimitive> MortonPrimitives(rPrimitiveInfos.size());
+        for (uint64_t ix = 0; ix < rPrimitiveInfos.size(); ++ix)
+        {
+            MortonPrimitives[ix].child_index = rPrimitiveInfos[ix].stPrimitiveIndex;
+            MortonPrimitives[ix].dwMortonCode = MortonCodes[ix];
+        }
 
         // Radix sort primitive Morton indices. 
-        RadixSort(&MortonPrimitives);
+        parallel::radix_sort(
+            MortonPrimitives.begin(), 
+            MortonPrimitives.end(), 
+            [](const FMortonPrimitive& crMortonPrim) { return crMortonPrim.dwMortonCode; }, 
+            3 * MORTON_BITS_NUM
+        );
 
         // Create LBVH treelets at bottom of BVH
         std::vector<FLBVHTreelet> TreeletToBuild;
@@ -694,8 +572,6 @@ namespace fantasy
         );
         *pdwTotalNodes = dwAtomicTotal;
 
-        parallel::destroy();
-
         // Create and return SAH BVH from LBVH treelets. 
         std::vector<BvhBuildNode*> pFinishedTreelets; 
         pFinishedTreelets.reserve(TreeletToBuild.size());
@@ -889,6 +765,9 @@ namespace fantasy
                 dwCount1 += Buckets[j].dwPrimitivesCount;
             }
             fBucketCost[i] = 0.125f + (dwCount0 * b0.surface_area() + dwCount1 * b1.surface_area()) / GlobalBounds.surface_area();
+
+            // An empty side merges into an infinite box and 0 * INF is NaN, never pick that split. 
+            if (dwCount0 == 0 || dwCount1 == 0) fBucketCost[i] = INFINITY;
         }
 
         // Find minimum bucket cost to split at that minimizes SAH metric. 
@@ -938,7 +817,7 @@ namespace fantasy
         LinearBvhNode* pLinearNode = &_nodes[*pdwOffset];
         pLinearNode->Bounds = pNode->Bounds;
         
-        uint32_t dwPartOffset = *pdwOffset;
+        uint32_t dwPartOffset = (*pdwOffset)++;
         if (pNode->dwPrimitivesNum > 0)     // Leaf. 
         {
             // FCHECK(pNode->pChildren[0] == nullptr && pNode->pChildren[1] == nullptr);
@@ -3,12 +3,10 @@
 
 #include "bounds.h"
 #include "vector.h"
+#include <atomic>
+#include <memory>
 #include <span>
 #include <vector>
-#include <bvh/bvh.hpp>
-#include <bvh/leaf_collapser.hpp>
-#include <bvh/locally_ordered_clustering_builder.hpp>
-#include <bvh/triangle.hpp>
 
 namespace fantasy 
 {
@@ -29,8 +27,11 @@ namespace fantasy
             float3 normal;
         };
 
-		void build(std::span<Bounds3F> boxes, const Bounds3F& global_box);
-		void build(std::span<Bvh::Vertex> vertices, uint32_t triangle_num);
+		// 需要已经初始化的线程池 (parallel::initialize).
+		// max_depth 为树的最大深度, 默认值对应 bvh_traversal_stack_size, 在 GPU 上遍历时不能超过着色器中的栈大小.
+		// 构建后 global_box 为根节点的包围盒, 为空时是无效的包围盒.
+		void build(std::span<Bounds3F> boxes);
+		void build(std::span<Bvh::Vertex> vertices, uint32_t triangle_num, uint32_t max_depth = 63);
         std::span<const Bvh::Node> GetNodes() const { return _nodes; }
         std::span<const Bvh::Vertex> GetVertices() const { return _vertices; }
 
@@ -44,11 +45,14 @@ namespace fantasy
             _nodes.clear(); _nodes.shrink_to_fit();
             _vertices.clear(); _vertices.shrink_to_fit();
             triangle_num = 0;
+            global_box = Bounds3F();
         }
 
         Bounds3F global_box;
         uint32_t triangle_num = 0;
 
+        friend class BvhTest;
+
     private:
         std::vector<Node> _nodes;
         std::vector<Vertex> _vertices;
@@ -0,0 +1,435 @@
+#include "bvh_builder.h"
+#include "../parallel/parallel.h"
+#include "../parallel/algorithm.h"
+#include "../tools/timer.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <memory>
+
+namespace fantasy
+{
+    static constexpr uint32_t max_bvh_bin_num = 32;
+
+    // 不使用 merge: 两个空包围盒 merge 时会经过交换上下界的构造函数, 得到无穷大的包围盒.
+    static void grow(Bounds3F& box, const Bounds3F& other)
+    {
+        box._lower = min(box._lower, other._lower);
+        box._upper = max(box._upper, other._upper);
+    }
+
+    static void grow(Bounds3F& box, const float3& point)
+    {
+        box._lower = min(box._lower, point);
+        box._upper = max(box._upper, point);
+    }
+
+    // 桶内不再记录质心的包围盒, 子节点的质心范围由父节点的质心包围盒与子节点包围盒相交得到.
+    struct BvhBin
+    {
+        Bounds3F box;
+        uint32_t count = 0;
+    };
+
+    struct BvhBins
+    {
+        BvhBin bins[3][max_bvh_bin_num];
+
+        void reset(uint32_t bin_num)
+        {
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                for (uint32_t ix = 0; ix < bin_num; ++ix) bins[axis][ix] = BvhBin{};
+            }
+        }
+
+        void merge_from(const BvhBins& other, uint32_t bin_num)
+        {
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                for (uint32_t ix = 0; ix < bin_num; ++ix)
+                {
+                    BvhBin& bin = bins[axis][ix];
+                    const BvhBin& other_bin = other.bins[axis][ix];
+                    grow(bin.box, other_bin.box);
+                    bin.count += other_bin.count;
+                }
+            }
+        }
+    };
+
+    // 质心到桶序号的映射, 分桶和划分时使用同一个映射, 保证两者一致.
+    struct BvhBinMapping
+    {
+        float3 lower;
+        float3 scale;
+        uint32_t bin_num = 0;
+
+        BvhBinMapping(const Bounds3F& centroid_box, uint32_t bin_num_) : lower(centroid_box._lower), bin_num(bin_num_)
+        {
+            // 范围为非规格化数时 scale 为无穷大, 乘以 0 得到 NaN, 此时该轴不分桶.
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                const float extent = centroid_box._upper[axis] - centroid_box._lower[axis];
+                const float axis_scale = bin_num * (1.0f - 1e-6f) / extent;
+                scale[axis] = extent > 0.0f && std::isfinite(axis_scale) ? axis_scale : 0.0f;
+            }
+        }
+
+        uint32_t get_bin(float centroid, uint32_t axis) const
+        {
+            return std::min(bin_num - 1, static_cast<uint32_t>((centroid - lower[axis]) * scale[axis]));
+        }
+    };
+
+    struct BvhSplit
+    {
+        uint32_t axis = 0;
+        uint32_t bin = 0;
+        float cost = 0.0f;
+        Bounds3F box[2];
+        Bounds3F centroid_box[2];
+        bool valid = false;
+    };
+
+    class BinnedSahBuilder
+    {
+    public:
+        BinnedSahBuilder(Float3View lower, Float3View upper, const BvhBuildDesc& desc, Bvh::Node* nodes, uint32_t* indices) :
+            _lower(lower), _upper(upper), _desc(desc), _nodes(nodes), _indices(indices)
+        {
+        }
+
+        void build(uint32_t node_index, uint64_t begin, uint64_t end, const Bounds3F& centroid_box, uint32_t depth)
+        {
+            Bvh::Node& node = _nodes[node_index];
+            const uint64_t count = end - begin;
+            const bool parallel = count >= _desc.parallel_threshold;
+
+            // 剩余的深度只够按数量对半分时不再按 SAH 划分, 保证树的深度不超过 max_depth.
+            const bool depth_limited = depth + get_median_split_depth(count) >= _desc.max_depth;
+
+            BvhSplit split;
+            if (count > 1 && !depth_limited) split = find_split(begin, end, centroid_box, node.box, parallel);
+
+            const bool must_split = count > _desc.max_leaf_size;
+            if (!must_split && (!split.valid || _desc.intersect_cost * count * node.box.surface_area() <= split.cost))
+            {
+                make_leaf(node, begin, count, depth);
+                return;
+            }
+
+            uint64_t middle = begin;
+            if (split.valid)
+            {
+                const BvhBinMapping mapping(centroid_box, get_bin_num(count));
+                auto is_left = [&](uint32_t primitive)
+                {
+                    return mapping.get_bin(get_centroid(primitive, split.axis), split.axis) <= split.bin;
+                };
+                uint32_t* mid = parallel ?
+                    parallel::partition(_indices + begin, _indices + end, is_left) :
+                    std::partition(_indices + begin, _indices + end, is_left);
+                middle = mid - _indices;
+            }
+
+            // 质心全部重合, 受深度限制, 或者浮点误差使划分的一侧为空时, 按数量对半分.
+            if (middle == begin || middle == end)
+            {
+                _median_split_num.fetch_add(1, std::memory_order_relaxed);
+
+                middle = begin + count / 2;
+                split = BvhSplit{};
+                for (uint32_t side = 0; side < 2; ++side)
+                {
+                    const uint64_t side_begin = side == 0 ? begin : middle;
+                    const uint64_t side_end = side == 0 ? middle : end;
+                    for (uint64_t ix = side_begin; ix < side_end; ++ix)
+                    {
+                        const uint32_t primitive = _indices[ix];
+                        grow(split.box[side], _lower[primitive]);
+                        grow(split.box[side], _upper[primitive]);
+                        grow(split.centroid_box[side], get_centroid(primitive));
+                    }
+                }
+            }
+            assert(middle > begin && middle < end);
+
+            const uint32_t child_index = _node_num.fetch_add(2, std::memory_order_relaxed);
+            _nodes[child_index].box = split.box[0];
+            _nodes[child_index + 1].box = split.box[1];
+            node.child_index = child_index;
+            node.child_num = 0;
+
+            if (parallel)
+            {
+                parallel::TaskGroup group;
+                group.run([&]() { build(child_index, begin, middle, split.centroid_box[0], depth + 1); });
+                build(child_index + 1, middle, end, split.centroid_box[1], depth + 1);
+                group.wait();
+            }
+            else
+            {
+                build(child_index, begin, middle, split.centroid_box[0], depth + 1);
+                build(child_index + 1, middle, end, split.centroid_box[1], depth + 1);
+            }
+        }
+
+        uint32_t get_node_num() const { return _node_num.load(std::memory_order_relaxed); }
+        uint32_t get_max_depth() const { return _max_depth.load(std::memory_order_relaxed); }
+        uint32_t get_median_split_num() const { return _median_split_num.load(std::memory_order_relaxed); }
+
+        // 一直按数量对半分直到叶子时需要的深度.
+        uint32_t get_median_split_depth(uint64_t count) const
+        {
+            if (count <= _desc.max_leaf_size) return 0;
+            const uint64_t leaf_num = (count + _desc.max_leaf_size - 1) / _desc.max_leaf_size;
+            return static_cast<uint32_t>(std::bit_width(leaf_num - 1));
+        }
+
+    private:
+        // 图元很少的节点用较少的桶, 每个节点重置桶和扫描的固定开销在小节点上占大头.
+        uint32_t get_bin_num(uint64_t count) const
+        {
+            return static_cast<uint32_t>(std::min<uint64_t>(_desc.bin_num, std::max<uint64_t>(count, 4)));
+        }
+
+        // 质心不单独存放, 每次由包围盒计算, 省去 12 字节/图元的内存.
+        float3 get_centroid(uint32_t primitive) const
+        {
+            return (_lower[primitive] + _upper[primitive]) * 0.5f;
+        }
+
+        float get_centroid(uint32_t primitive, uint32_t axis) const
+        {
+            const float* lower = axis == 0 ? _lower.x : axis == 1 ? _lower.y : _lower.z;
+            const float* upper = axis == 0 ? _upper.x : axis == 1 ? _upper.y : _upper.z;
+            return (lower[primitive] + upper[primitive]) * 0.5f;
+        }
+
+        void make_leaf(Bvh::Node& node, uint64_t begin, uint64_t count, uint32_t depth)
+        {
+            node.child_index = static_cast<uint32_t>(begin);
+            node.child_num = static_cast<uint32_t>(count);
+
+            uint32_t max_depth = _max_depth.load(std::memory_order_relaxed);
+            while (depth > max_depth && !_max_depth.compare_exchange_weak(max_depth, depth, std::memory_order_relaxed));
+        }
+
+        void bin(uint64_t begin, uint64_t end, const BvhBinMapping& mapping, BvhBins& bins) const
+        {
+            for (uint64_t ix = begin; ix < end; ++ix)
+            {
+                const uint32_t primitive = _indices[ix];
+                const float3 lower = _lower[primitive];
+                const float3 upper = _upper[primitive];
+                const float3 centroid = (lower + upper) * 0.5f;
+
+                for (uint32_t axis = 0; axis < 3; ++axis)
+                {
+                    BvhBin& bin = bins.bins[axis][mapping.get_bin(centroid[axis], axis)];
+                    bin.box._lower = min(bin.box._lower, lower);
+                    bin.box._upper = max(bin.box._upper, upper);
+                    bin.count++;
+                }
+            }
+        }
+
+        void parallel_bin(uint64_t begin, uint64_t end, const BvhBinMapping& mapping, BvhBins& bins) const
+        {
+            const uint64_t count = end - begin;
+            const uint64_t block_num = parallel::get_algorithm_block_num(count);
+            std::vector<BvhBins> block_bins(block_num);
+            parallel::parallel_for(
+                [&](uint64_t block)
+                {
+                    auto [block_begin, block_end] = parallel::get_algorithm_block_range(block, block_num, count);
+                    bin(begin + block_begin, begin + block_end, mapping, block_bins[block]);
+                },
+                block_num,
+                1
+            );
+            for (const auto& block_bin : block_bins) bins.merge_from(block_bin, mapping.bin_num);
+        }
+
+        // 桶不放在递归的栈上, 串行的节点使用线程局部的桶, 在递归子节点之前用完.
+        BvhSplit find_split(uint64_t begin, uint64_t end, const Bounds3F& centroid_box, const Bounds3F& box, bool parallel) const
+        {
+            const BvhBinMapping mapping(centroid_box, get_bin_num(end - begin));
+            if (parallel)
+            {
+                auto bins = std::make_unique<BvhBins>();
+                parallel_bin(begin, end, mapping, *bins);
+                return find_split(*bins, centroid_box, box, mapping.bin_num);
+            }
+
+            thread_local BvhBins bins;
+            bins.reset(mapping.bin_num);
+            bin(begin, end, mapping, bins);
+            return find_split(bins, centroid_box, box, mapping.bin_num);
+        }
+
+        // 代价为 traversal_cost * A + intersect_cost * (A_left * N_left + A_right * N_right), 与叶子的 intersect_cost * N * A 比较.
+        BvhSplit find_split(const BvhBins& bins, const Bounds3F& centroid_box, const Bounds3F& box, uint32_t bin_num) const
+        {
+            BvhSplit split;
+            const float traversal_cost = _desc.traversal_cost * box.surface_area();
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                const BvhBin* axis_bins = bins.bins[axis];
+
+                // 从右向左累计, right_cost[ix] 为 [ix + 1, bin_num) 的 A * N.
+                float right_cost[max_bvh_bin_num];
+                Bounds3F right_box;
+                uint32_t right_count = 0;
+                for (uint32_t ix = bin_num - 1; ix > 0; --ix)
+                {
+                    grow(right_box, axis_bins[ix].box);
+                    right_count += axis_bins[ix].count;
+                    right_cost[ix - 1] = right_count > 0 ? right_box.surface_area() * right_count : 0.0f;
+                }
+
+                Bounds3F left_box;
+                uint32_t left_count = 0;
+                const uint32_t total_count = right_count + axis_bins[0].count;
+                for (uint32_t ix = 0; ix + 1 < bin_num; ++ix)
+                {
+                    grow(left_box, axis_bins[ix].box);
+                    left_count += axis_bins[ix].count;
+                    if (left_count == 0 || left_count == total_count) continue;
+
+                    const float cost = traversal_cost + _desc.intersect_cost * (left_box.surface_area() * left_count + right_cost[ix]);
+                    if (!split.valid || cost < split.cost)
+                    {
+                        split.valid = true;
+                        split.axis = axis;
+                        split.bin = ix;
+                        split.cost = cost;
+                    }
+                }
+            }
+
+            if (split.valid)
+            {
+                for (uint32_t ix = 0; ix < bin_num; ++ix)
+                {
+                    const BvhBin& bin = bins.bins[split.axis][ix];
+                    const uint32_t side = ix <= split.bin ? 0 : 1;
+                    grow(split.box[side], bin.box);
+                }
+                for (uint32_t side = 0; side < 2; ++side)
+                {
+                    split.centroid_box[side]._lower = max(centroid_box._lower, split.box[side]._lower);
+                    split.centroid_box[side]._upper = min(centroid_box._upper, split.box[side]._upper);
+                }
+            }
+            return split;
+        }
+
+    private:
+        Float3View _lower;
+        Float3View _upper;
+        const BvhBuildDesc& _desc;
+
+        Bvh::Node* _nodes;
+        uint32_t* _indices;
+
+        std::atomic<uint32_t> _node_num = 1;
+        std::atomic<uint32_t> _max_depth = 0;
+        std::atomic<uint32_t> _median_split_num = 0;
+    };
+
+
+    BvhBuildResult build_binned_sah_bvh(Float3View lower, Float3View upper, const BvhBuildDesc& desc)
+    {
+        assert(lower.size == upper.size && desc.bin_num >= 2 && desc.bin_num <= max_bvh_bin_num && desc.max_leaf_size >= 1);
+        assert(parallel::get_thread_pool() != nullptr && "build_binned_sah_bvh needs parallel::initialize().");
+
+        Timer timer;
+        BvhBuildResult result;
+        const uint64_t primitive_num = lower.size;
+        if (primitive_num == 0) return result;
+        assert(primitive_num < (1ull << 31));
+
+        result.primitive_indices.resize(primitive_num);
+        const uint64_t block_num = parallel::get_algorithm_block_num(primitive_num);
+        std::vector<Bounds3F> block_boxes(block_num);
+        std::vector<Bounds3F> block_centroid_boxes(block_num);
+        parallel::parallel_for(
+            [&](uint64_t block)
+            {
+                auto [begin, end] = parallel::get_algorithm_block_range(block, block_num, primitive_num);
+                Bounds3F box;
+                Bounds3F centroid_box;
+                for (uint64_t ix = begin; ix < end; ++ix)
+                {
+                    const float3 primitive_lower = lower[ix];
+                    const float3 primitive_upper = upper[ix];
+                    box._lower = min(box._lower, primitive_lower);
+                    box._upper = max(box._upper, primitive_upper);
+                    grow(centroid_box, (primitive_lower + primitive_upper) * 0.5f);
+                    result.primitive_indices[ix] = static_cast<uint32_t>(ix);
+                }
+                block_boxes[block] = box;
+                block_centroid_boxes[block] = centroid_box;
+            },
+            block_num,
+            1
+        );
+
+        Bounds3F root_box;
+        Bounds3F root_centroid_box;
+        for (uint64_t ix = 0; ix < block_num; ++ix)
+        {
+            grow(root_box, block_boxes[ix]);
+            grow(root_centroid_box, block_centroid_boxes[ix]);
+        }
+
+        // 节点数不超过 2n - 1, 先按上限申请不初始化的内存, 实际只会访问用到的部分.
+        const uint64_t max_node_num = primitive_num * 2 - 1;
+        std::unique_ptr<uint8_t[]> node_storage(new uint8_t[max_node_num * sizeof(Bvh::Node)]);
+        Bvh::Node* nodes = reinterpret_cast<Bvh::Node*>(node_storage.get());
+
+        nodes[0] = Bvh::Node{};
+        nodes[0].box = root_box;
+
+        BinnedSahBuilder builder(lower, upper, desc, nodes, result.primitive_indices.data());
+        assert(builder.get_median_split_depth(primitive_num) <= desc.max_depth);
+        builder.build(0, 0, primitive_num, root_centroid_box, 0);
+
+        const uint32_t node_num = builder.get_node_num();
+        result.nodes.assign(nodes, nodes + node_num);
+        node_storage.reset();
+
+        BvhBuildStats& stats = result.stats;
+        stats.build_time = timer.elapsed();
+        stats.node_num = node_num;
+        stats.max_depth = builder.get_max_depth();
+        stats.median_split_num = builder.get_median_split_num();
+
+        const float root_area = result.nodes[0].box.surface_area();
+        double cost = 0.0;
+        for (const auto& node : result.nodes)
+        {
+            if (node.child_num > 0)
+            {
+                stats.leaf_num++;
+                cost += desc.intersect_cost * node.child_num * node.box.surface_area();
+            }
+            else
+            {
+                cost += desc.traversal_cost * node.box.surface_area();
+            }
+        }
+        stats.sah_cost = root_area > 0.0f ? static_cast<float>(cost / root_area) : 0.0f;
+
+        // 图元序号, 并行划分的临时数组, 以及同时存在的节点缓冲和输出.
+        stats.memory_bytes =
+            primitive_num * sizeof(uint32_t) +
+            (primitive_num >= desc.parallel_threshold ? primitive_num * sizeof(uint32_t) : 0) +
+            uint64_t(node_num) * sizeof(Bvh::Node) * 2;
+
+        return result;
+    }
+}
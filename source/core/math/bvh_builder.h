@@ -0,0 +1,47 @@
+#ifndef MATH_BVH_BUILDER_H
+#define MATH_BVH_BUILDER_H
+
+#include "batch.h"
+#include "bvh.h"
+#include "bvh_traversal.h"
+#include <cstdint>
+#include <vector>
+
+namespace fantasy
+{
+    struct BvhBuildDesc
+    {
+        uint32_t max_leaf_size = 4;             // 图元数超过该值的节点必须继续划分, 为 1 时每个叶子只有一个图元.
+        uint32_t bin_num = 16;                  // 不超过 32.
+        float traversal_cost = 1.0f;
+        float intersect_cost = 1.0f;
+        uint64_t parallel_threshold = 64 * 1024;    // 图元数不少于该值的节点并行分桶和划分, 两个子树并行构建.
+        uint32_t max_depth = bvh_traversal_stack_size - 1;  // 树的最大深度, 剩余的深度只够按数量对半分时不再按 SAH 划分. 不超过 BVH_STACK_SIZE 时 GPU 遍历的栈不会溢出.
+    };
+
+    struct BvhBuildStats
+    {
+        float build_time = 0.0f;        // 秒.
+        float sah_cost = 0.0f;          // 按根节点的表面积归一化.
+        uint64_t memory_bytes = 0;      // 构建过程中临时数组和输出的峰值 (估计), 不包含输入.
+        uint32_t node_num = 0;
+        uint32_t leaf_num = 0;
+        uint32_t max_depth = 0;
+        uint32_t median_split_num = 0;  // 无法按 SAH 划分 (质心重合或划分为空) 或受深度限制时按数量对半分的节点数.
+    };
+
+    // nodes 与 Bvh::Node 的约定相同: 0 为根节点, 内部节点的两个子节点相邻, child_index 为第一个子节点, child_num 为 0;
+    // 叶子节点的图元为 primitive_indices[child_index, child_index + child_num).
+    struct BvhBuildResult
+    {
+        std::vector<Bvh::Node> nodes;
+        std::vector<uint32_t> primitive_indices;
+        BvhBuildStats stats;
+    };
+
+    // 分桶 SAH 构建, lower 和 upper 为每个图元的包围盒.
+    // 需要已经初始化的线程池 (parallel::initialize), 大的节点在线程池中并行处理.
+    BvhBuildResult build_binned_sah_bvh(Float3View lower, Float3View upper, const BvhBuildDesc& desc = BvhBuildDesc{});
+}
+
+#endif
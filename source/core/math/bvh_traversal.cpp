@@ -0,0 +1,510 @@
+#include "bvh_traversal.h"
+#include <algorithm>
+#include <cmath>
+
+namespace fantasy
+{
+    struct BvhRayContext
+    {
+        float3 origin;
+        float3 direction;
+        float3 inv_direction;
+        uint32_t dir_is_neg[3];
+
+        explicit BvhRayContext(const Ray& ray) :
+            origin(ray.ori),
+            direction(ray.dir),
+            inv_direction(1.0f / ray.dir.x, 1.0f / ray.dir.y, 1.0f / ray.dir.z),
+            dir_is_neg{ inv_direction.x < 0.0f, inv_direction.y < 0.0f, inv_direction.z < 0.0f }
+        {
+        }
+    };
+
+    // 与 Bounds3::intersect(ray, inv_ray_dir, dir_is_neg) 相同, 按方向的正负选取进入和离开的面, 不需要再比较交换.
+    // 方向分量为 0 且起点在包围盒的面上时 0 * INF 为 NaN, std::min/max 的初始化列表以第一个元素为初值且 NaN 的比较总为 false,
+    // 所以 NaN 不会被选中, 该轴不参与裁剪, 光线在包围盒的面上时算作相交.
+    // 返回的 distance 用于排序和剪枝, 缩小一点保证不会因为浮点误差剪掉距离相同的节点.
+    static bool intersect_ray_box(const BvhRayContext& ray, const Bounds3F& box, float max_distance, float* distance)
+    {
+        const float tx0 = (box[ray.dir_is_neg[0]].x - ray.origin.x) * ray.inv_direction.x;
+        const float tx1 = (box[1 - ray.dir_is_neg[0]].x - ray.origin.x) * ray.inv_direction.x;
+        const float ty0 = (box[ray.dir_is_neg[1]].y - ray.origin.y) * ray.inv_direction.y;
+        const float ty1 = (box[1 - ray.dir_is_neg[1]].y - ray.origin.y) * ray.inv_direction.y;
+        const float tz0 = (box[ray.dir_is_neg[2]].z - ray.origin.z) * ray.inv_direction.z;
+        const float tz1 = (box[1 - ray.dir_is_neg[2]].z - ray.origin.z) * ray.inv_direction.z;
+
+        const float t_near = std::max({ 0.0f, tx0, ty0, tz0 });
+        const float t_far = std::min({ max_distance, tx1, ty1, tz1 }) * (1.0f + 2.0f * gamma(3));
+        *distance = t_near * (1.0f - 2.0f * gamma(3));
+        return t_near <= t_far;
+    }
+
+    // Möller-Trumbore, 不剔除背面.
+    static bool intersect_ray_triangle(
+        const BvhRayContext& ray,
+        const float3& p0,
+        const float3& p1,
+        const float3& p2,
+        float max_distance,
+        float* distance,
+        float2* barycentric
+    )
+    {
+        const float3 edge1 = p1 - p0;
+        const float3 edge2 = p2 - p0;
+        const float3 p = cross(ray.direction, edge2);
+        const float det = dot(edge1, p);
+        if (det == 0.0f) return false;
+
+        const float inv_det = 1.0f / det;
+        const float3 s = ray.origin - p0;
+        const float u = dot(s, p) * inv_det;
+        if (u < 0.0f || u > 1.0f) return false;
+
+        const float3 q = cross(s, edge1);
+        const float v = dot(ray.direction, q) * inv_det;
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        const float t = dot(edge2, q) * inv_det;
+        if (t < 0.0f || t > max_distance) return false;
+
+        *distance = t;
+        *barycentric = float2(u, v);
+        return true;
+    }
+
+    static float box_distance_squared(const Bounds3F& box, const float3& point)
+    {
+        float result = 0.0f;
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            const float d = std::max({ box._lower[axis] - point[axis], 0.0f, point[axis] - box._upper[axis] });
+            result += d * d;
+        }
+        return result;
+    }
+
+    // Real-Time Collision Detection 5.1.5, barycentric 为 p1, p2 的权重.
+    static float3 closest_point_on_triangle(const float3& point, const float3& p0, const float3& p1, const float3& p2, float2* barycentric)
+    {
+        const float3 ab = p1 - p0;
+        const float3 ac = p2 - p0;
+        const float3 ap = point - p0;
+        const float d1 = dot(ab, ap);
+        const float d2 = dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f)
+        {
+            *barycentric = float2(0.0f, 0.0f);
+            return p0;
+        }
+
+        const float3 bp = point - p1;
+        const float d3 = dot(ab, bp);
+        const float d4 = dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3)
+        {
+            *barycentric = float2(1.0f, 0.0f);
+            return p1;
+        }
+
+        const float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        {
+            const float v = d1 / (d1 - d3);
+            *barycentric = float2(v, 0.0f);
+            return p0 + ab * v;
+        }
+
+        const float3 cp = point - p2;
+        const float d5 = dot(ab, cp);
+        const float d6 = dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6)
+        {
+            *barycentric = float2(0.0f, 1.0f);
+            return p2;
+        }
+
+        const float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        {
+            const float w = d2 / (d2 - d6);
+            *barycentric = float2(0.0f, w);
+            return p0 + ac * w;
+        }
+
+        const float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        {
+            const float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            *barycentric = float2(1.0f - w, w);
+            return p1 + (p2 - p1) * w;
+        }
+
+        const float denom = 1.0f / (va + vb + vc);
+        const float v = vb * denom;
+        const float w = vc * denom;
+        *barycentric = float2(v, w);
+        return p0 + ab * v + ac * w;
+    }
+
+    static bool overlap_box_box(const Bounds3F& a, const Bounds3F& b)
+    {
+        return a._lower.x <= b._upper.x && a._upper.x >= b._lower.x &&
+               a._lower.y <= b._upper.y && a._upper.y >= b._lower.y &&
+               a._lower.z <= b._upper.z && a._upper.z >= b._lower.z;
+    }
+
+    // 分离轴测试 (Akenine-Möller): 包围盒的 3 个轴, 三角形的法线, 以及两者边的 9 个叉积.
+    static bool overlap_triangle_box(const float3& p0, const float3& p1, const float3& p2, const Bounds3F& box)
+    {
+        const float3 center = (box._lower + box._upper) * 0.5f;
+        const float3 half = (box._upper - box._lower) * 0.5f;
+        const float3 v[3] = { p0 - center, p1 - center, p2 - center };
+
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            const float lower = std::min({ v[0][axis], v[1][axis], v[2][axis] });
+            const float upper = std::max({ v[0][axis], v[1][axis], v[2][axis] });
+            if (lower > half[axis] || upper < -half[axis]) return false;
+        }
+
+        const float3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+        const float3 normal = cross(edges[0], edges[1]);
+        const float plane_distance = dot(normal, v[0]);
+        const float plane_radius = half.x * std::abs(normal.x) + half.y * std::abs(normal.y) + half.z * std::abs(normal.z);
+        if (std::abs(plane_distance) > plane_radius) return false;
+
+        for (const float3& edge : edges)
+        {
+            const float3 axes[3] = {
+                float3(0.0f, -edge.z, edge.y),
+                float3(edge.z, 0.0f, -edge.x),
+                float3(-edge.y, edge.x, 0.0f)
+            };
+            for (const float3& axis : axes)
+            {
+                const float d0 = dot(axis, v[0]);
+                const float d1 = dot(axis, v[1]);
+                const float d2 = dot(axis, v[2]);
+                const float radius = half.x * std::abs(axis.x) + half.y * std::abs(axis.y) + half.z * std::abs(axis.z);
+                if (std::min({ d0, d1, d2 }) > radius || std::max({ d0, d1, d2 }) < -radius) return false;
+            }
+        }
+        return true;
+    }
+
+
+    // 前 bvh_traversal_stack_size 个元素放在数组中, 超出时 (树的深度超过该值, 如外部构建的树) 溢出到堆上, 不递归.
+    template <typename T>
+    class BvhTraversalStack
+    {
+    public:
+        bool empty() const { return _size == 0; }
+
+        void push(const T& value)
+        {
+            if (_size < bvh_traversal_stack_size) _data[_size] = value;
+            else _overflow.push_back(value);
+            _size++;
+        }
+
+        const T& top() const { return _size > bvh_traversal_stack_size ? _overflow.back() : _data[_size - 1]; }
+
+        T pop()
+        {
+            const T value = top();
+            if (_size > bvh_traversal_stack_size) _overflow.pop_back();
+            _size--;
+            return value;
+        }
+
+    private:
+        T _data[bvh_traversal_stack_size];
+        std::vector<T> _overflow;
+        uint32_t _size = 0;
+    };
+
+    // 按距离由近到远遍历 root_index 的子树, 距离超过 max_distance 的节点被跳过, visit_leaf 可以缩小 max_distance, 返回 true 时结束遍历.
+    // get_distance(box, max_distance, &distance) 返回 false 表示与该节点不相交. 由 visit_leaf 结束遍历时返回 true.
+    template <typename GetDistance, typename VisitLeaf>
+    static bool traverse_ordered(
+        std::span<const Bvh::Node> nodes, 
+        uint32_t root_index, 
+        float& max_distance, 
+        GetDistance&& get_distance, 
+        VisitLeaf&& visit_leaf
+    )
+    {
+        struct StackEntry
+        {
+            uint32_t node_index;
+            float distance;
+        };
+        BvhTraversalStack<StackEntry> stack;
+
+        float distance;
+        if (!get_distance(nodes[root_index].box, max_distance, &distance)) return false;
+
+        uint32_t node_index = root_index;
+        while (true)
+        {
+            const Bvh::Node& node = nodes[node_index];
+            if (node.child_num > 0)
+            {
+                if (visit_leaf(node)) return true;
+            }
+            else
+            {
+                float distances[2];
+                const bool hit0 = get_distance(nodes[node.child_index].box, max_distance, &distances[0]);
+                const bool hit1 = get_distance(nodes[node.child_index + 1].box, max_distance, &distances[1]);
+                if (hit0 && hit1)
+                {
+                    const uint32_t near_child = distances[1] < distances[0] ? 1 : 0;
+                    const uint32_t far_child = 1 - near_child;
+                    stack.push(StackEntry{ node.child_index + far_child, distances[far_child] });
+                    node_index = node.child_index + near_child;
+                    continue;
+                }
+                else if (hit0 || hit1)
+                {
+                    node_index = node.child_index + (hit0 ? 0 : 1);
+                    continue;
+                }
+            }
+
+            // 出栈时跳过在 visit_leaf 缩小 max_distance 之后已经更远的节点.
+            while (!stack.empty() && stack.top().distance > max_distance) stack.pop();
+            if (stack.empty()) return false;
+            node_index = stack.pop().node_index;
+        }
+    }
+
+    template <typename Overlap, typename VisitLeaf>
+    static void traverse_overlap(std::span<const Bvh::Node> nodes, uint32_t root_index, Overlap&& overlap, VisitLeaf&& visit_leaf)
+    {
+        BvhTraversalStack<uint32_t> stack;
+        if (overlap(nodes[root_index].box)) stack.push(root_index);
+
+        while (!stack.empty())
+        {
+            const Bvh::Node& node = nodes[stack.pop()];
+            if (node.child_num > 0)
+            {
+                visit_leaf(node);
+                continue;
+            }
+            for (uint32_t ix = 0; ix < 2; ++ix)
+            {
+                if (overlap(nodes[node.child_index + ix].box)) stack.push(node.child_index + ix);
+            }
+        }
+    }
+
+
+    bool intersect_closest(const Bvh& bvh, const Ray& ray, BvhRayHit* hit)
+    {
+        const auto nodes = bvh.GetNodes();
+        const auto vertices = bvh.GetVertices();
+        if (nodes.empty() || vertices.empty()) return false;
+
+        const BvhRayContext context(ray);
+        BvhRayHit result;
+        float max_distance = ray.max;
+
+        traverse_ordered(
+            nodes,
+            0,
+            max_distance,
+            [&](const Bounds3F& box, float max_distance, float* distance)
+            {
+                return intersect_ray_box(context, box, max_distance, distance);
+            },
+            [&](const Bvh::Node& node)
+            {
+                for (uint32_t ix = node.child_index; ix < node.child_index + node.child_num; ++ix)
+                {
+                    float distance;
+                    float2 barycentric;
+                    if (intersect_ray_triangle(
+                        context,
+                        vertices[ix * 3].position,
+                        vertices[ix * 3 + 1].position,
+                        vertices[ix * 3 + 2].position,
+                        max_distance,
+                        &distance,
+                        &barycentric
+                    ))
+                    {
+                        max_distance = distance;
+                        result.distance = distance;
+                        result.barycentric = barycentric;
+                        result.triangle_index = ix;
+                    }
+                }
+                return false;
+            }
+        );
+
+        if (result.triangle_index == INVALID_SIZE_32) return false;
+        if (hit != nullptr) *hit = result;
+        return true;
+    }
+
+    bool intersect_any(const Bvh& bvh, const Ray& ray)
+    {
+        const auto nodes = bvh.GetNodes();
+        const auto vertices = bvh.GetVertices();
+        if (nodes.empty() || vertices.empty()) return false;
+
+        const BvhRayContext context(ray);
+        float max_distance = ray.max;
+        bool found = false;
+
+        traverse_ordered(
+            nodes,
+            0,
+            max_distance,
+            [&](const Bounds3F& box, float max_distance, float* distance)
+            {
+                return intersect_ray_box(context, box, max_distance, distance);
+            },
+            [&](const Bvh::Node& node)
+            {
+                for (uint32_t ix = node.child_index; ix < node.child_index + node.child_num; ++ix)
+                {
+                    float distance;
+                    float2 barycentric;
+                    if (intersect_ray_triangle(
+                        context,
+                        vertices[ix * 3].position,
+                        vertices[ix * 3 + 1].position,
+                        vertices[ix * 3 + 2].position,
+                        max_distance,
+                        &distance,
+                        &barycentric
+                    ))
+                    {
+                        found = true;
+                        return true;
+                    }
+                }
+                return false;
+            }
+        );
+        return found;
+    }
+
+    bool find_closest_point(const Bvh& bvh, const float3& point, BvhClosestPoint* result, float max_distance)
+    {
+        const auto nodes = bvh.GetNodes();
+        const auto vertices = bvh.GetVertices();
+        if (nodes.empty() || vertices.empty()) return false;
+
+        // 遍历时比较距离的平方.
+        BvhClosestPoint closest;
+        float max_distance_squared = max_distance * max_distance;
+
+        traverse_ordered(
+            nodes,
+            0,
+            max_distance_squared,
+            [&](const Bounds3F& box, float max_distance_squared, float* distance_squared)
+            {
+                *distance_squared = box_distance_squared(box, point);
+                return *distance_squared <= max_distance_squared;
+            },
+            [&](const Bvh::Node& node)
+            {
+                for (uint32_t ix = node.child_index; ix < node.child_index + node.child_num; ++ix)
+                {
+                    float2 barycentric;
+                    const float3 position = closest_point_on_triangle(
+                        point,
+                        vertices[ix * 3].position,
+                        vertices[ix * 3 + 1].position,
+                        vertices[ix * 3 + 2].position,
+                        &barycentric
+                    );
+                    const float distance_squared = (position - point).length_squared();
+                    if (distance_squared <= max_distance_squared && distance_squared < closest.distance)
+                    {
+                        max_distance_squared = distance_squared;
+                        closest.position = position;
+                        closest.distance = distance_squared;
+                        closest.barycentric = barycentric;
+                        closest.triangle_index = ix;
+                    }
+                }
+                return false;
+            }
+        );
+
+        if (closest.triangle_index == INVALID_SIZE_32) return false;
+        closest.distance = std::sqrt(closest.distance);
+        if (result != nullptr) *result = closest;
+        return true;
+    }
+
+    void overlap_sphere(const Bvh& bvh, const Sphere& sphere, std::vector<uint32_t>& triangle_indices)
+    {
+        const auto nodes = bvh.GetNodes();
+        const auto vertices = bvh.GetVertices();
+        if (nodes.empty()) return;
+
+        const float radius_squared = sphere.radius * sphere.radius;
+        traverse_overlap(
+            nodes,
+            0,
+            [&](const Bounds3F& box) { return box_distance_squared(box, sphere.center) <= radius_squared; },
+            [&](const Bvh::Node& node)
+            {
+                if (vertices.empty())
+                {
+                    triangle_indices.push_back(node.child_index);
+                    return;
+                }
+                for (uint32_t ix = node.child_index; ix < node.child_index + node.child_num; ++ix)
+                {
+                    float2 barycentric;
+                    const float3 position = closest_point_on_triangle(
+                        sphere.center,
+                        vertices[ix * 3].position,
+                        vertices[ix * 3 + 1].position,
+                        vertices[ix * 3 + 2].position,
+                        &barycentric
+                    );
+                    if ((position - sphere.center).length_squared() <= radius_squared) triangle_indices.push_back(ix);
+                }
+            }
+        );
+    }
+
+    void overlap_box(const Bvh& bvh, const Bounds3F& box, std::vector<uint32_t>& triangle_indices)
+    {
+        const auto nodes = bvh.GetNodes();
+        const auto vertices = bvh.GetVertices();
+        if (nodes.empty()) return;
+
+        traverse_overlap(
+            nodes,
+            0,
+            [&](const Bounds3F& node_box) { return overlap_box_box(node_box, box); },
+            [&](const Bvh::Node& node)
+            {
+                if (vertices.empty())
+                {
+                    triangle_indices.push_back(node.child_index);
+                    return;
+                }
+                for (uint32_t ix = node.child_index; ix < node.child_index + node.child_num; ++ix)
+                {
+                    if (overlap_triangle_box(vertices[ix * 3].position, vertices[ix * 3 + 1].position, vertices[ix * 3 + 2].position, box))
+                    {
+                        triangle_indices.push_back(ix);
+                    }
+                }
+            }
+        );
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef MATH_BVH_TRAVERSAL_H
+#define MATH_BVH_TRAVERSAL_H
+
+#include "bvh.h"
+#include "common.h"
+#include "ray.h"
+#include <cstdint>
+#include <vector>
+
+namespace fantasy
+{
+    // 与 sdf_generate_cs.hlsl 的 BVH_STACK_SIZE 的作用相同, 先访问近的子节点, 栈中只存放远的子节点.
+    // 树的深度 (BvhBuildStats::max_depth) 超过该值时 CPU 遍历把多出的部分放在堆上, 结果不变; GPU 遍历没有该回退.
+    static constexpr uint32_t bvh_traversal_stack_size = 64;
+
+    struct BvhRayHit
+    {
+        float distance = INFINITY;                     // 光线参数 t, 交点为 ray(distance).
+        float2 barycentric;                             // (u, v), 交点为 (1 - u - v) * v0 + u * v1 + v * v2.
+        uint32_t triangle_index = INVALID_SIZE_32;      // 三角形的顶点为 Bvh::GetVertices() 中的 [3 * triangle_index, 3 * triangle_index + 3).
+    };
+
+    struct BvhClosestPoint
+    {
+        float3 position;
+        float distance = INFINITY;
+        float2 barycentric;
+        uint32_t triangle_index = INVALID_SIZE_32;
+    };
+
+    // 三角形网格的 Bvh (Bvh::build(vertices, triangle_num)).
+    // 只接受 [0, ray.max] 内的交点, 三角形不区分正反面.
+
+    // 最近的交点.
+    bool intersect_closest(const Bvh& bvh, const Ray& ray, BvhRayHit* hit);
+
+    // 任意交点, 用于遮挡查询.
+    bool intersect_any(const Bvh& bvh, const Ray& ray);
+
+    // 网格上到 point 最近的点, 只查找 max_distance 以内的三角形.
+    bool find_closest_point(const Bvh& bvh, const float3& point, BvhClosestPoint* result, float max_distance = INFINITY);
+
+    // 与球或包围盒相交的三角形, 结果追加到 triangle_indices.
+    // 由包围盒构建的 Bvh (Bvh::build(boxes, global_box)) 没有顶点, 此时追加的是与之相交的 boxes 的序号.
+    void overlap_sphere(const Bvh& bvh, const Sphere& sphere, std::vector<uint32_t>& triangle_indices);
+    void overlap_box(const Bvh& bvh, const Bounds3F& box, std::vector<uint32_t>& triangle_indices);
+}
+
+#endif
@@ -149,15 +149,12 @@ namespace fantasy
 		auto R = normalize(cross(up, L));
 		auto U = cross(L, R);
 
-        float view_matrix[16];
-        float camera_matrix[16] = {
-            R.x,     R.y,     R.z,     0.0f,
-            U.x,     U.y,     U.z,     0.0f,
-            L.x,     L.y,     L.z,     0.0f,
-            pos.x, pos.y, pos.z, 1.0f
-        };
-        if (!inverse_row_major(camera_matrix, view_matrix)) assert(!"Invalid view matrix.");
-        
-        return float4x4(view_matrix);
+        // 相机矩阵的行为 R, U, L, pos, 旋转部分正交, 逆矩阵直接取转置, 不需要通用的求逆.
+        return float4x4(
+            R.x,           U.x,           L.x,           0.0f,
+            R.y,           U.y,           L.y,           0.0f,
+            R.z,           U.z,           L.z,           0.0f,
+            -dot(pos, R),  -dot(pos, U),  -dot(pos, L),  1.0f
+        );
     }
 }
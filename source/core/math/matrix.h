@@ -4,6 +4,35 @@
 #include "vector.h"
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+
+#if defined(MATRIX_SIMD_DISABLE)
+#define MATRIX_SIMD_SSE 0
+#define MATRIX_SIMD_NEON 0
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MATRIX_SIMD_SSE 1
+#define MATRIX_SIMD_NEON 0
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define MATRIX_SIMD_SSE 0
+#define MATRIX_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define MATRIX_SIMD_SSE 0
+#define MATRIX_SIMD_NEON 0
+#endif
+
+#if MATRIX_SIMD_SSE && defined(__AVX__)
+#define MATRIX_SIMD_AVX 1
+#else
+#define MATRIX_SIMD_AVX 0
+#endif
+
+#if MATRIX_SIMD_SSE && (defined(__FMA__) || defined(__AVX2__))
+#define MATRIX_SIMD_FMA 1
+#else
+#define MATRIX_SIMD_FMA 0
+#endif
 
 namespace fantasy 
 {
@@ -717,6 +746,266 @@ namespace fantasy
         return !((*this) == matrix);
     }
 
+
+    // float4x4 和 float4 的 SIMD 实现, 非模板的重载优先于上面的模板.
+    // 定义 MATRIX_SIMD_DISABLE 时使用标量模板.
+    // float4 和 float4x4 的内存布局不变 (会直接上传到 GPU), 所以全部使用非对齐的 load/store.
+    static_assert(sizeof(float4) == 4 * sizeof(float) && sizeof(float4x4) == 16 * sizeof(float));
+
+#if MATRIX_SIMD_SSE
+    namespace simd
+    {
+        template <int x, int y, int z, int w>
+        inline __m128 swizzle(__m128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x)); }
+
+        template <int x, int y, int z, int w>
+        inline __m128 shuffle(__m128 a, __m128 b) { return _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x)); }
+
+        inline __m128 madd(__m128 a, __m128 b, __m128 c)
+        {
+#if MATRIX_SIMD_FMA
+            return _mm_fmadd_ps(a, b, c);
+#else
+            return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+        }
+
+        // vec * matrix, 行向量乘以按行存储的 4 行.
+        inline __m128 transform(__m128 vec, __m128 row0, __m128 row1, __m128 row2, __m128 row3)
+        {
+            __m128 ret = _mm_mul_ps(swizzle<0, 0, 0, 0>(vec), row0);
+            ret = madd(swizzle<1, 1, 1, 1>(vec), row1, ret);
+            ret = madd(swizzle<2, 2, 2, 2>(vec), row2, ret);
+            return madd(swizzle<3, 3, 3, 3>(vec), row3, ret);
+        }
+
+        // 2x2 矩阵按 (m00, m01, m10, m11) 存放在一个寄存器中.
+        inline __m128 mat2_mul(__m128 a, __m128 b)
+        {
+            return _mm_add_ps(_mm_mul_ps(a, swizzle<0, 3, 0, 3>(b)), _mm_mul_ps(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+        }
+
+        // adj(a) * b.
+        inline __m128 mat2_adj_mul(__m128 a, __m128 b)
+        {
+            return _mm_sub_ps(_mm_mul_ps(swizzle<3, 3, 0, 0>(a), b), _mm_mul_ps(swizzle<1, 1, 2, 2>(a), swizzle<2, 3, 0, 1>(b)));
+        }
+
+        // a * adj(b).
+        inline __m128 mat2_mul_adj(__m128 a, __m128 b)
+        {
+            return _mm_sub_ps(_mm_mul_ps(a, swizzle<3, 0, 3, 0>(b)), _mm_mul_ps(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+        }
+    }
+#endif
+
+    inline float4x4 transpose(const float4x4& matrix)
+    {
+#if MATRIX_SIMD_SSE
+        __m128 row0 = _mm_loadu_ps(matrix._data[0]);
+        __m128 row1 = _mm_loadu_ps(matrix._data[1]);
+        __m128 row2 = _mm_loadu_ps(matrix._data[2]);
+        __m128 row3 = _mm_loadu_ps(matrix._data[3]);
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+        float4x4 ret;
+        _mm_storeu_ps(ret._data[0], row0);
+        _mm_storeu_ps(ret._data[1], row1);
+        _mm_storeu_ps(ret._data[2], row2);
+        _mm_storeu_ps(ret._data[3], row3);
+        return ret;
+#elif MATRIX_SIMD_NEON
+        // vld4q 按 4 路交错读取, 第 i 个寄存器正好是第 i 列.
+        const float32x4x4_t columns = vld4q_f32(&matrix._data[0][0]);
+
+        float4x4 ret;
+        vst1q_f32(ret._data[0], columns.val[0]);
+        vst1q_f32(ret._data[1], columns.val[1]);
+        vst1q_f32(ret._data[2], columns.val[2]);
+        vst1q_f32(ret._data[3], columns.val[3]);
+        return ret;
+#else
+        return transpose<float>(matrix);
+#endif
+    }
+
+    inline float4x4 mul(const float4x4& matrix1, const float4x4& matrix2)
+    {
+#if MATRIX_SIMD_AVX
+        // 每次计算两行, matrix2 的每一行在高低两个 128 位中各放一份.
+        const __m256 row0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(matrix2._data[0]));
+        const __m256 row1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(matrix2._data[1]));
+        const __m256 row2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(matrix2._data[2]));
+        const __m256 row3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(matrix2._data[3]));
+
+        float4x4 ret;
+        for (uint32_t ix = 0; ix < 4; ix += 2)
+        {
+            const __m256 rows = _mm256_loadu_ps(matrix1._data[ix]);
+            __m256 result = _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x00), row0);
+#if MATRIX_SIMD_FMA
+            result = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0x55), row1, result);
+            result = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0xaa), row2, result);
+            result = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0xff), row3, result);
+#else
+            result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x55), row1));
+            result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xaa), row2));
+            result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xff), row3));
+#endif
+            _mm256_storeu_ps(ret._data[ix], result);
+        }
+        return ret;
+#elif MATRIX_SIMD_SSE
+        const __m128 row0 = _mm_loadu_ps(matrix2._data[0]);
+        const __m128 row1 = _mm_loadu_ps(matrix2._data[1]);
+        const __m128 row2 = _mm_loadu_ps(matrix2._data[2]);
+        const __m128 row3 = _mm_loadu_ps(matrix2._data[3]);
+
+        float4x4 ret;
+        for (uint32_t ix = 0; ix < 4; ++ix)
+        {
+            _mm_storeu_ps(ret._data[ix], simd::transform(_mm_loadu_ps(matrix1._data[ix]), row0, row1, row2, row3));
+        }
+        return ret;
+#elif MATRIX_SIMD_NEON
+        const float32x4_t row0 = vld1q_f32(matrix2._data[0]);
+        const float32x4_t row1 = vld1q_f32(matrix2._data[1]);
+        const float32x4_t row2 = vld1q_f32(matrix2._data[2]);
+        const float32x4_t row3 = vld1q_f32(matrix2._data[3]);
+
+        float4x4 ret;
+        for (uint32_t ix = 0; ix < 4; ++ix)
+        {
+            const float32x4_t row = vld1q_f32(matrix1._data[ix]);
+            float32x4_t result = vmulq_laneq_f32(row0, row, 0);
+            result = vfmaq_laneq_f32(result, row1, row, 1);
+            result = vfmaq_laneq_f32(result, row2, row, 2);
+            result = vfmaq_laneq_f32(result, row3, row, 3);
+            vst1q_f32(ret._data[ix], result);
+        }
+        return ret;
+#else
+        return mul<float>(matrix1, matrix2);
+#endif
+    }
+
+    inline float4 mul(const float4& vec, const float4x4& matrix)
+    {
+#if MATRIX_SIMD_SSE
+        // vec 通常刚由 float3 逐个分量构造, 按分量组装而不是 16 字节 load, 避免 store forwarding 失败.
+        const __m128 result = simd::transform(
+            _mm_setr_ps(vec.x, vec.y, vec.z, vec.w),
+            _mm_loadu_ps(matrix._data[0]),
+            _mm_loadu_ps(matrix._data[1]),
+            _mm_loadu_ps(matrix._data[2]),
+            _mm_loadu_ps(matrix._data[3])
+        );
+
+        float4 ret;
+        _mm_storeu_ps(&ret.x, result);
+        return ret;
+#elif MATRIX_SIMD_NEON
+        const float32x4_t v = vld1q_f32(&vec.x);
+        float32x4_t result = vmulq_laneq_f32(vld1q_f32(matrix._data[0]), v, 0);
+        result = vfmaq_laneq_f32(result, vld1q_f32(matrix._data[1]), v, 1);
+        result = vfmaq_laneq_f32(result, vld1q_f32(matrix._data[2]), v, 2);
+        result = vfmaq_laneq_f32(result, vld1q_f32(matrix._data[3]), v, 3);
+
+        float4 ret;
+        vst1q_f32(&ret.x, result);
+        return ret;
+#else
+        return mul<float>(vec, matrix);
+#endif
+    }
+
+    inline float4 mul(const float4x4& matrix, const float4& vec)
+    {
+#if MATRIX_SIMD_SSE
+        // 每行与 vec 相乘, 转置之后按列相加得到 4 个点积.
+        const __m128 v = _mm_setr_ps(vec.x, vec.y, vec.z, vec.w);
+        __m128 row0 = _mm_mul_ps(_mm_loadu_ps(matrix._data[0]), v);
+        __m128 row1 = _mm_mul_ps(_mm_loadu_ps(matrix._data[1]), v);
+        __m128 row2 = _mm_mul_ps(_mm_loadu_ps(matrix._data[2]), v);
+        __m128 row3 = _mm_mul_ps(_mm_loadu_ps(matrix._data[3]), v);
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+        float4 ret;
+        _mm_storeu_ps(&ret.x, _mm_add_ps(_mm_add_ps(row0, row1), _mm_add_ps(row2, row3)));
+        return ret;
+#elif MATRIX_SIMD_NEON
+        const float32x4_t v = vld1q_f32(&vec.x);
+        const float32x4x4_t columns = vld4q_f32(&matrix._data[0][0]);
+        float32x4_t result = vmulq_laneq_f32(columns.val[0], v, 0);
+        result = vfmaq_laneq_f32(result, columns.val[1], v, 1);
+        result = vfmaq_laneq_f32(result, columns.val[2], v, 2);
+        result = vfmaq_laneq_f32(result, columns.val[3], v, 3);
+
+        float4 ret;
+        vst1q_f32(&ret.x, result);
+        return ret;
+#else
+        return mul<float>(matrix, vec);
+#endif
+    }
+
+    inline float4x4 inverse(const float4x4& matrix)
+    {
+#if MATRIX_SIMD_SSE
+        // 按 2x2 分块求伴随矩阵:
+        // | A B |
+        // | C D |
+        const __m128 row0 = _mm_loadu_ps(matrix._data[0]);
+        const __m128 row1 = _mm_loadu_ps(matrix._data[1]);
+        const __m128 row2 = _mm_loadu_ps(matrix._data[2]);
+        const __m128 row3 = _mm_loadu_ps(matrix._data[3]);
+
+        const __m128 A = _mm_movelh_ps(row0, row1);
+        const __m128 B = _mm_movehl_ps(row1, row0);
+        const __m128 C = _mm_movelh_ps(row2, row3);
+        const __m128 D = _mm_movehl_ps(row3, row2);
+
+        // (det(A), det(B), det(C), det(D)).
+        const __m128 det_sub = _mm_sub_ps(
+            _mm_mul_ps(simd::shuffle<0, 2, 0, 2>(row0, row2), simd::shuffle<1, 3, 1, 3>(row1, row3)),
+            _mm_mul_ps(simd::shuffle<1, 3, 1, 3>(row0, row2), simd::shuffle<0, 2, 0, 2>(row1, row3))
+        );
+        const __m128 det_A = simd::swizzle<0, 0, 0, 0>(det_sub);
+        const __m128 det_B = simd::swizzle<1, 1, 1, 1>(det_sub);
+        const __m128 det_C = simd::swizzle<2, 2, 2, 2>(det_sub);
+        const __m128 det_D = simd::swizzle<3, 3, 3, 3>(det_sub);
+
+        const __m128 D_C = simd::mat2_adj_mul(D, C);
+        const __m128 A_B = simd::mat2_adj_mul(A, B);
+
+        __m128 X = _mm_sub_ps(_mm_mul_ps(det_D, A), simd::mat2_mul(B, D_C));
+        __m128 W = _mm_sub_ps(_mm_mul_ps(det_A, D), simd::mat2_mul(C, A_B));
+        __m128 Y = _mm_sub_ps(_mm_mul_ps(det_B, C), simd::mat2_mul_adj(D, A_B));
+        __m128 Z = _mm_sub_ps(_mm_mul_ps(det_C, B), simd::mat2_mul_adj(A, D_C));
+
+        // det(M) = det(A) * det(D) + det(B) * det(C) - tr((A#B) * (D#C)).
+        __m128 trace = _mm_mul_ps(A_B, simd::swizzle<0, 2, 1, 3>(D_C));
+        trace = _mm_add_ps(trace, simd::swizzle<1, 0, 3, 2>(trace));
+        trace = _mm_add_ps(trace, simd::swizzle<2, 3, 0, 1>(trace));
+        const __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_A, det_D), _mm_mul_ps(det_B, det_C)), trace);
+        assert(_mm_cvtss_f32(det) != 0.0f && "It is a Singular matrix which can't be used in MatrixInvert");
+
+        const __m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+        X = _mm_mul_ps(X, inv_det);
+        Y = _mm_mul_ps(Y, inv_det);
+        Z = _mm_mul_ps(Z, inv_det);
+        W = _mm_mul_ps(W, inv_det);
+
+        float4x4 ret;
+        _mm_storeu_ps(ret._data[0], simd::shuffle<3, 1, 3, 1>(X, Y));
+        _mm_storeu_ps(ret._data[1], simd::shuffle<2, 0, 2, 0>(X, Y));
+        _mm_storeu_ps(ret._data[2], simd::shuffle<3, 1, 3, 1>(Z, W));
+        _mm_storeu_ps(ret._data[3], simd::shuffle<2, 0, 2, 0>(Z, W));
+        return ret;
+#else
+        return inverse<float>(matrix);
+#endif
+    }
 }
 
 
@@ -26,7 +26,7 @@ namespace fantasy
 
 		Vector2(T _x, T _y) : x(_x), y(_y) {}
 
-		Vector2(const Vector2<T>& vec) : x(vec.x), y(vec.y) {}
+		Vector2(const Vector2<T>& vec) = default;
 
 		template <typename U>
 		requires std::is_arithmetic_v<U>
@@ -36,12 +36,7 @@ namespace fantasy
 		{
 		}
 
-		Vector2& operator=(const Vector2<T>& vec)
-		{
-			x = vec.x;
-			y = vec.y;
-			return *this;
-		}
+		Vector2& operator=(const Vector2<T>& vec) = default;
 
 		template <typename U>
 		requires std::is_arithmetic_v<U>
@@ -176,7 +171,7 @@ namespace fantasy
 
 		explicit Vector3(const Vector4<T>& vec) : x(vec.x), y(vec.y), z(vec.z) {}
 
-		Vector3(const Vector3<T>& vec) : x(vec.x), y(vec.y), z(vec.z) {}
+		Vector3(const Vector3<T>& vec) = default;
 
 		template <typename U>
 		requires std::is_arithmetic_v<U>
@@ -187,13 +182,7 @@ namespace fantasy
 		{
 		}
 
-		Vector3& operator=(const Vector3<T>& vec)
-		{
-			x = vec.x;
-			y = vec.y;
-			z = vec.z;
-			return *this;
-		}
+		Vector3& operator=(const Vector3<T>& vec) = default;
 
 		template <typename U>
 		requires std::is_arithmetic_v<U>
@@ -345,7 +334,7 @@ namespace fantasy
 		
 		Vector4(T _x, T _y, T _z, T _w) : x(_x), y(_y), z(_z), w(_w) {}
 
-		Vector4(const Vector4<T>& vec) : x(vec.x), y(vec.y), z(vec.z), w(vec.w) {}
+		Vector4(const Vector4<T>& vec) = default;
 
 		explicit Vector4(const Vector3<T>& vec, T _w = 1) : x(vec.x), y(vec.y), z(vec.z), w(_w) {}
 
@@ -359,14 +348,7 @@ namespace fantasy
 		{
 		}
 
-		Vector4& operator=(const Vector4<T>& vec)
-		{
-			x = vec.x;
-			y = vec.y;
-			z = vec.z;
-			w = vec.w;
-			return *this;
-		}
+		Vector4& operator=(const Vector4<T>& vec) = default;
 
 		template <typename U>
 		requires std::is_arithmetic_v<U>
@@ -688,7 +670,7 @@ namespace fantasy
 	template <typename T>
 	inline Vector3<T> lerp(const Vector3<T>& vec1, const Vector3<T>& vec2, double f)
 	{
-		double fLerp = (std::min)(1.0f, (std::max)(0.0f, f));
+		double fLerp = (std::min)(1.0, (std::max)(0.0, f));
 		return (1 - fLerp) * vec1 + fLerp * vec2;
 	}
 
@@ -703,7 +685,7 @@ namespace fantasy
 	template <typename T>
 	inline Vector4<T> lerp(double f, const Vector4<T>& vec1, const Vector4<T>& vec2)
 	{
-		double lerp = (std::min)(1.0f, (std::max)(0.0f, f));
+		double lerp = (std::min)(1.0, (std::max)(0.0, f));
 		return Vector4<T>((1 - lerp) * vec1 + lerp * vec2);
 	}
 
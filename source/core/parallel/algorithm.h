@@ -0,0 +1,406 @@
+#ifndef TASK_FLOW_ALGORITHM_H
+#define TASK_FLOW_ALGORITHM_H
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+#include "parallel.h"
+
+namespace fantasy
+{
+    namespace parallel
+    {
+        // 小于这个数量时直接使用串行版本.
+        static constexpr uint64_t algorithm_serial_threshold = 1 << 14;
+
+        // 将 count 分成 block_num 块, 块的数量与线程数相关, 每块不少于 min_block_size 个元素.
+        inline uint64_t get_algorithm_block_num(uint64_t count, uint64_t min_block_size = algorithm_serial_threshold / 4)
+        {
+            const uint64_t max_block_num = 4ull * (get_thread_num() + 1);
+            return std::clamp<uint64_t>(count / min_block_size, 1, max_block_num);
+        }
+
+        inline std::pair<uint64_t, uint64_t> get_algorithm_block_range(uint64_t block, uint64_t block_num, uint64_t count)
+        {
+            return { block * count / block_num, (block + 1) * count / block_num };
+        }
+
+
+        template <typename Iter, typename T, typename Op = std::plus<>>
+        T reduce(Iter first, Iter last, T init, Op op = Op())
+        {
+            const uint64_t count = static_cast<uint64_t>(std::distance(first, last));
+            if (count < algorithm_serial_threshold) return std::reduce(first, last, init, op);
+
+            const uint64_t block_num = get_algorithm_block_num(count);
+            std::vector<T> partials(block_num, init);
+            parallel_for(
+                [&](uint64_t block)
+                {
+                    auto [begin, end] = get_algorithm_block_range(block, block_num, count);
+                    T sum = *(first + begin);
+                    for (uint64_t ix = begin + 1; ix < end; ++ix) sum = op(sum, *(first + ix));
+                    partials[block] = sum;
+                },
+                block_num,
+                1
+            );
+
+            T ret = init;
+            for (const T& partial : partials) ret = op(ret, partial);
+            return ret;
+        }
+
+
+        // 三趟扫描: 每块求和, 串行求块前缀, 每块加上前缀后再扫描.
+        template <bool Inclusive, typename InIter, typename OutIter, typename T, typename Op>
+        OutIter scan_impl(InIter first, InIter last, OutIter out, T init, Op op)
+        {
+            const uint64_t count = static_cast<uint64_t>(std::distance(first, last));
+            if (count < algorithm_serial_threshold)
+            {
+                if constexpr (Inclusive) return std::inclusive_scan(first, last, out, op, init);
+                else return std::exclusive_scan(first, last, out, init, op);
+            }
+
+            const uint64_t block_num = get_algorithm_block_num(count);
+            std::vector<T> block_prefix(block_num, init);
+            parallel_for(
+                [&](uint64_t block)
+                {
+                    if (block + 1 == block_num) return;     // 最后一块的和不需要.
+
+                    auto [begin, end] = get_algorithm_block_range(block, block_num, count);
+                    T sum = *(first + begin);
+                    for (uint64_t ix = begin + 1; ix < end; ++ix) sum = op(sum, *(first + ix));
+                    block_prefix[block + 1] = sum;
+                },
+                block_num,
+                1
+            );
+
+            block_prefix[0] = init;
+            for (uint64_t ix = 1; ix < block_num; ++ix) block_prefix[ix] = op(block_prefix[ix - 1], block_prefix[ix]);
+
+            parallel_for(
+                [&](uint64_t block)
+                {
+                    auto [begin, end] = get_algorithm_block_range(block, block_num, count);
+                    T sum = block_prefix[block];
+                    for (uint64_t ix = begin; ix < end; ++ix)
+                    {
+                        if constexpr (Inclusive)
+                        {
+                            sum = op(sum, *(first + ix));
+                            *(out + ix) = sum;
+                        }
+                        else
+                        {
+                            T value = *(first + ix);
+                            *(out + ix) = sum;
+                            sum = op(sum, value);
+                        }
+                    }
+                },
+                block_num,
+                1
+            );
+            return out + count;
+        }
+
+        template <typename InIter, typename OutIter, typename T, typename Op = std::plus<>>
+        OutIter inclusive_scan(InIter first, InIter last, OutIter out, T init, Op op = Op())
+        {
+            return scan_impl<true>(first, last, out, init, op);
+        }
+
+        template <typename InIter, typename OutIter, typename T, typename Op = std::plus<>>
+        OutIter exclusive_scan(InIter first, InIter last, OutIter out, T init, Op op = Op())
+        {
+            return scan_impl<false>(first, last, out, init, op);
+        }
+
+
+        // 先统计每块满足条件的数量, 求出写入位置后按块并行写入临时数组, 再写回.
+        template <typename Iter, typename Pred>
+        Iter stable_partition(Iter first, Iter last, Pred pred)
+        {
+            using T = typename std::iterator_traits<Iter>::value_type;
+
+            const uint64_t count = static_cast<uint64_t>(std::distance(first, last));
+            if (count < algorithm_serial_threshold) return std::stable_partition(first, last, pred);
+
+            const uint64_t block_num = get_algorithm_block_num(count);
+            std::vector<uint64_t> true_offsets(block_num + 1, 0);
+            parallel_for(
+                [&](uint64_t block)
+                {
+                    auto [begin, end] = get_algorithm_block_range(block, block_num, count);
+                    uint64_t true_num = 0;
+                    for (uint64_t ix = begin; ix < end; ++ix) true_num += pred(*(first + ix)) ? 1 : 0;
+                    true_offsets[block + 1] = true_num;
+                },
+                block_num,
+                1
+            );
+            for (uint64_t ix = 1; ix <= block_num; ++ix) true_offsets[ix] += true_offsets[ix - 1];
+
+            const uint64_t true_num = true_offsets[block_num];
+            std::vector<T> temp(count);
+            parallel_for(
+                [&](uint64_t block)
+                {
+                    auto [begin, end] = get_algorithm_block_range(block, block_num, count);
+                    uint64_t true_pos = true_offsets[block];
+                    uint64_t false_pos = true_num + begin - true_offsets[block];
+                    for (uint64_t ix = begin; ix < end; ++ix)
+                    {
+                        auto&& value = *(first + ix);
+                        if (pred(value)) temp[true_pos++] = std::move(value);
+                        else temp[false_pos++] = std::move(value);
+                    }
+                },
+                block_num,
+                1
+            );
+
+            parallel_for(
+                [&](uint64_t ix) { *(first + ix) = std::move(temp[ix]); },
+                count
+            );
+            return first + true_num;
+        }
+
+        // 数量较少时使用 std::partition (不稳定, 不分配内存), 否则使用并行的 stable_partition.
+        template <typename Iter, typename Pred>
+        Iter partition(Iter first, Iter last, Pred pred)
+        {
+            if (static_cast<uint64_t>(std::distance(first, last)) < algorithm_serial_threshold)
+            {
+                return std::partition(first, last, pred);
+            }
+            return parallel::stable_partition(first, last, pred);
+        }
+
+
+        // LSD 基数排序, 每趟 8 位, 稳定. key_func 返回无符号整数, key_bits 为 key 的有效位数 (如 30 位 Morton 码).
+        template <typename Iter, typename KeyFunc>
+        void radix_sort(Iter first, Iter last, KeyFunc key_func, uint32_t key_bits = 0)
+        {
+            using T = typename std::iterator_traits<Iter>::value_type;
+            using Key = std::decay_t<std::invoke_result_t<KeyFunc&, const T&>>;
+            static_assert(std::is_unsigned_v<Key>, "Radix sort key must be unsigned integer.");
+
+            constexpr uint32_t bits_per_pass = 8;
+            constexpr uint32_t bucket_num = 1 << bits_per_pass;
+
+            const uint64_t count = static_cast<uint64_t>(std::distance(first, last));
+            if (count < 2) return;
+
+            if (key_bits == 0 || key_bits > sizeof(Key) * 8) key_bits = sizeof(Key) * 8;
+            const uint32_t pass_num = (key_bits + bits_per_pass - 1) / bits_per_pass;
+
+            const uint64_t block_num = get_algorithm_block_num(count);
+            std::vector<uint64_t> block_offsets(block_num * bucket_num);
+            std::vector<T> temp(count);
+
+            std::vector<T> source;
+            T* in = nullptr;
+            if constexpr (std::contiguous_iterator<Iter>)
+            {
+                in = std::to_address(first);
+            }
+            else
+            {
+                source.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+                in = source.data();
+            }
+            T* out = temp.data();
+            T* const origin = in;
+
+            for (uint32_t pass = 0; pass < pass_num; ++pass)
+            {
+                const uint32_t low_bit = pass * bits_per_pass;
+
+                parallel_for(
+                    [&](uint64_t block)
+                    {
+                        uint64_t* bucket_count = &block_offsets[block * bucket_num];
+                        std::fill(bucket_count, bucket_count + bucket_num, 0);
+
+                        auto [begin, end] = get_algorithm_block_range(block, block_num, count);
+                        for (uint64_t ix = begin; ix < end; ++ix)
+                        {
+                            bucket_count[(key_func(in[ix]) >> low_bit) & (bucket_num - 1)]++;
+                        }
+                    },
+                    block_num,
+                    1
+                );
+
+                // 每个桶的写入位置按 (桶, 块) 的顺序排列, 保证稳定.
+                uint64_t offset = 0;
+                bool single_bucket = false;
+                for (uint32_t bucket = 0; bucket < bucket_num; ++bucket)
+                {
+                    uint64_t bucket_total = 0;
+                    for (uint64_t block = 0; block < block_num; ++block)
+                    {
+                        uint64_t& block_offset = block_offsets[block * bucket_num + bucket];
+                        const uint64_t block_count = block_offset;
+                        block_offset = offset;
+                        offset += block_count;
+                        bucket_total += block_count;
+                    }
+                    if (bucket_total == count) single_bucket = true;
+                }
+
+                // 所有元素这一趟的位都相同, 不需要移动.
+                if (single_bucket) continue;
+
+                parallel_for(
+                    [&](uint64_t block)
+                    {
+                        uint64_t* bucket_offset = &block_offsets[block * bucket_num];
+                        auto [begin, end] = get_algorithm_block_range(block, block_num, count);
+                        for (uint64_t ix = begin; ix < end; ++ix)
+                        {
+                            out[bucket_offset[(key_func(in[ix]) >> low_bit) & (bucket_num - 1)]++] = std::move(in[ix]);
+                        }
+                    },
+                    block_num,
+                    1
+                );
+                std::swap(in, out);
+            }
+
+            if (in != origin || !std::contiguous_iterator<Iter>)
+            {
+                parallel_for(
+                    [&](uint64_t ix) { *(first + ix) = std::move(in[ix]); },
+                    count
+                );
+            }
+        }
+
+
+        // 二分查找合并结果前 k 个元素中来自 a 的数量, 相等时 a 在前 (稳定).
+        template <typename Iter, typename Comp>
+        uint64_t merge_co_rank(uint64_t k, Iter a, uint64_t a_size, Iter b, uint64_t b_size, Comp& comp)
+        {
+            uint64_t low = k > b_size ? k - b_size : 0;
+            uint64_t high = std::min(k, a_size);
+            while (low < high)
+            {
+                const uint64_t i = low + (high - low) / 2;
+                const uint64_t j = k - i;
+                if (j > 0 && i < a_size && !comp(*(b + (j - 1)), *(a + i))) low = i + 1;
+                else high = i;
+            }
+            return low;
+        }
+
+        // 先并行地对每块做 std::sort, 再逐层两两归并, 每次归并按输出位置切成多段并行.
+        template <typename Iter, typename Comp>
+        void sort(Iter first, Iter last, Comp comp)
+        {
+            using T = typename std::iterator_traits<Iter>::value_type;
+
+            const uint64_t count = static_cast<uint64_t>(std::distance(first, last));
+            if (count < algorithm_serial_threshold)
+            {
+                std::sort(first, last, comp);
+                return;
+            }
+
+            const uint64_t block_num = std::bit_ceil(get_algorithm_block_num(count));
+            const uint64_t block_size = (count + block_num - 1) / block_num;
+            parallel_for(
+                [&](uint64_t block)
+                {
+                    const uint64_t begin = std::min(block * block_size, count);
+                    const uint64_t end = std::min(begin + block_size, count);
+                    std::sort(first + begin, first + end, comp);
+                },
+                block_num,
+                1
+            );
+
+            std::vector<T> buffer(count);
+            bool in_buffer = false;
+            for (uint64_t width = block_size; width < count; width *= 2)
+            {
+                const uint64_t pair_num = (count + 2 * width - 1) / (2 * width);
+                const uint64_t piece_num = std::max<uint64_t>(1, block_num / pair_num);
+
+                auto merge_pieces = [&](auto src, auto dst)
+                {
+                    parallel_for(
+                        [&](uint64_t task)
+                        {
+                            const uint64_t pair = task / piece_num;
+                            const uint64_t piece = task % piece_num;
+
+                            const uint64_t low = pair * 2 * width;
+                            const uint64_t middle = std::min(low + width, count);
+                            const uint64_t high = std::min(low + 2 * width, count);
+                            const uint64_t a_size = middle - low;
+                            const uint64_t b_size = high - middle;
+
+                            const uint64_t k0 = (a_size + b_size) * piece / piece_num;
+                            const uint64_t k1 = (a_size + b_size) * (piece + 1) / piece_num;
+                            const uint64_t i0 = parallel::merge_co_rank(k0, src + low, a_size, src + middle, b_size, comp);
+                            const uint64_t i1 = parallel::merge_co_rank(k1, src + low, a_size, src + middle, b_size, comp);
+
+                            std::merge(
+                                std::make_move_iterator(src + low + i0),
+                                std::make_move_iterator(src + low + i1),
+                                std::make_move_iterator(src + middle + (k0 - i0)),
+                                std::make_move_iterator(src + middle + (k1 - i1)),
+                                dst + low + k0,
+                                comp
+                            );
+                        },
+                        pair_num * piece_num,
+                        1
+                    );
+                };
+
+                if (in_buffer) merge_pieces(buffer.begin(), first);
+                else merge_pieces(first, buffer.begin());
+                in_buffer = !in_buffer;
+            }
+
+            if (in_buffer)
+            {
+                parallel_for(
+                    [&](uint64_t ix) { *(first + ix) = std::move(buffer[ix]); },
+                    count
+                );
+            }
+        }
+
+        // 无符号整数使用基数排序, 其它类型使用比较排序.
+        template <typename Iter>
+        void sort(Iter first, Iter last)
+        {
+            using T = typename std::iterator_traits<Iter>::value_type;
+            if constexpr (std::is_unsigned_v<T>)
+            {
+                parallel::radix_sort(first, last, [](T value) { return value; });
+            }
+            else
+            {
+                parallel::sort(first, last, std::less<>());
+            }
+        }
+    }
+}
+
+#endif
@@ -1,7 +1,6 @@
 #include "parallel.h"
 #include <cassert>
 #include <functional>
-#include <queue>
 #include "thread_pool.h"
 #include "../math/common.h"
 #include "../tools/log.h"
@@ -10,47 +9,11 @@ namespace fantasy
 {
     namespace parallel 
     {
-        template <typename T>
-        class TaskQueue
-        {
-        public:
-            void push(const T& task)
-            {
-                std::unique_lock<std::mutex> lock(_mutex);
-                _queue.push(task);
-                _condition_variable.notify_one();
-            }
-            
-            T pop()
-            {
-                std::unique_lock<std::mutex> lock(_mutex);
-                T msg = _queue.front();
-                _queue.pop();
-                return msg;
-            }
-            
-            void wait()
-            {
-                std::unique_lock<std::mutex> lock(_mutex);
-                _condition_variable.wait(lock, [this]() {
-                    return (!_queue.empty());
-                    });
-            }
-
-        private:
-            std::condition_variable _condition_variable;
-            std::mutex _mutex;
-            std::queue<T> _queue;
-        };
-
-
-
-        static TaskQueue<TaskNode*> node_queue;
         static std::unique_ptr<ThreadPool> thread_pool;
 
-        void initialize()
+        void initialize(const ThreadPoolDesc& desc)
         {
-            thread_pool = std::make_unique<ThreadPool>();
+            thread_pool = std::make_unique<ThreadPool>(desc);
         }
 
         void destroy()
@@ -58,19 +21,19 @@ namespace fantasy
             thread_pool.reset(nullptr);
         }
 
-        void parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size)
+        void parallel_for_range(const RangeFunction& func, uint64_t count, uint64_t grain_size)
         {
-            if (count == 0) return;
-
-            assert(count >= chun_size);
-            thread_pool->parallel_for(func, count, chun_size);
+            thread_pool->parallel_for(func, count, grain_size);
         }
 
-        void parallel_for(std::function<void(uint64_t, uint64_t)> func, uint64_t x, uint64_t y)
+        uint32_t get_thread_num()
         {
-			if (x == 0 || y == 0) return;
+            return thread_pool->get_thread_num();
+        }
 
-            thread_pool->parallel_for(func, x, y);
+        ThreadPool* get_thread_pool()
+        {
+            return thread_pool.get();
         }
 
         bool thread_finished(uint64_t index)
@@ -85,56 +48,67 @@ namespace fantasy
 			return thread_pool->thread_success(index);
         }
 
-        uint64_t begin_thread(std::function<bool()>&& rrFunc)
+        uint64_t begin_thread(std::function<bool()>&& rrFunc, TaskPriority priority)
         {
-            return thread_pool->submit(std::move(rrFunc));
+            return thread_pool->submit(std::move(rrFunc), priority);
         }
 
-        bool run(TaskFlow& flow)
+        void yield()
         {
-            ReturnIfFalse(!flow.empty());
+            thread_pool->yield();
+        }
 
-            uint32_t unfinished_task_count = flow.TotalTaskNum;
+        struct TaskFlowState
+        {
+            std::atomic<uint32_t> counter = 0;
+            std::atomic<bool> success = true;
+        };
 
-            const auto& src_nodes = flow.GetSrcNodes();
-            for (const auto& node : src_nodes)
-            {
-                thread_pool->submit(
-                    [node]() -> bool
-                    {
-                        ReturnIfFalse(node->run());
-                        node_queue.push(node);     // 入队就说明已经完成了
-                        return true;
-                    }
-                );
-            }
-            
-            while (unfinished_task_count > 0)
-            {
-                node_queue.wait();
-                unfinished_task_count--;
-
-                TaskNode* node = node_queue.pop();
-                for (const auto& successor : node->successors)
-                {
-                    successor->unfinished_dependent_task_count--;
-                    if (successor->unfinished_dependent_task_count == 0)
+        // 由完成前驱的线程直接启动后继, 不再经过调用线程.
+        static void launch_task_node(TaskNode* node, TaskFlowState* state)
+        {
+            thread_pool->submit(
+                thread_pool->create_job(
+                    [node, state]()
                     {
-                        thread_pool->submit(
-                            [successor]() -> bool
+                        bool success = false;
+                        {
+                            auto event_scope = thread_pool->create_event_scope("TaskFlow");
+                            success = node->run();
+                        }
+                        if (!success)
+                        {
+                            state->success.store(false, std::memory_order_relaxed);
+                            return;
+                        }
+
+                        for (TaskNode* successor : node->successors)
+                        {
+                            if (successor->unfinished_dependent_task_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
                             {
-                                ReturnIfFalse(successor->run());
-                                node_queue.push(successor);
-                                return true;
+                                launch_task_node(successor, state);
                             }
-                        );
-                        successor->unfinished_dependent_task_count = successor->unfinished_dependent_task_count_back_up;
+                        }
                     }
-                }
+                ),
+                &state->counter
+            );
+        }
+
+        bool run(TaskFlow& flow)
+        {
+            ReturnIfFalse(!flow.empty());
+
+            flow.ResetDependencies();
+
+            TaskFlowState state;
+            for (TaskNode* node : flow.GetSrcNodes())
+            {
+                launch_task_node(node, &state);
             }
 
-            thread_pool->wait_for_idle();
-            return true;
+            thread_pool->wait(state.counter);
+            return state.success.load(std::memory_order_relaxed);
         }
     }
 
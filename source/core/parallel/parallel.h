@@ -2,9 +2,14 @@
 #define TASK_FLOW_H
 
 
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <concepts>
 #include <memory>
 #include <vector>
 #include <functional>
+#include "thread_pool.h"
 
 namespace fantasy 
 {
@@ -13,7 +18,7 @@ namespace fantasy
         std::function<bool()> func;
         std::vector<TaskNode*> successors;
         std::vector<TaskNode*> Dependents;
-        uint32_t unfinished_dependent_task_count = 0;
+        std::atomic<uint32_t> unfinished_dependent_task_count = 0;     // 归零时由完成最后一个前驱的线程启动.
         uint32_t unfinished_dependent_task_count_back_up = 0;
 
 
@@ -103,6 +108,15 @@ namespace fantasy
             }
             return SrcNodes;
         }
+
+        // 恢复每个节点的前驱计数, 同一个 TaskFlow 可以每帧重复运行而不用重新创建节点.
+        void ResetDependencies()
+        {
+            for (const auto& Node : Nodes)
+            {
+                Node->unfinished_dependent_task_count.store(Node->unfinished_dependent_task_count_back_up, std::memory_order_relaxed);
+            }
+        }
         
         bool empty() const
         {
@@ -118,7 +132,7 @@ namespace fantasy
 
     namespace parallel
     {
-        void initialize();
+        void initialize(const ThreadPoolDesc& desc = ThreadPoolDesc{});
         void destroy();
         
         bool run(TaskFlow& InFlow);
@@ -130,11 +144,201 @@ namespace fantasy
             return (run(Arguments), ...);
         }
 
-        uint64_t begin_thread(std::function<bool()>&& rrFunc);
-        void parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size = 1);
-        void parallel_for(std::function<void(uint64_t, uint64_t)> func, uint64_t x, uint64_t y);
+        // 默认在后台优先级执行, 不会占用保留的工作线程.
+        uint64_t begin_thread(std::function<bool()>&& rrFunc, TaskPriority priority = TaskPriority::Background);
         bool thread_finished(uint64_t index);
         bool thread_success(uint64_t index);
+
+        // 后台任务在安全点 (如每个 submesh 处理完后) 调用, 让出时间给等待中的前台任务.
+        void yield();
+
+        // func(begin, end) 处理 [begin, end), 区间按 lazy binary splitting 自适应拆分.
+        void parallel_for_range(const RangeFunction& func, uint64_t count, uint64_t grain_size = 0);
+
+        uint32_t get_thread_num();
+
+        ThreadPool* get_thread_pool();
+
+        // 一组 fork-join 任务, 可以在任意任务中嵌套使用. wait() 时当前线程会执行其它任务, 不会占住工作线程.
+        class TaskGroup
+        {
+        public:
+            TaskGroup() : _pool(get_thread_pool()) {}
+            ~TaskGroup() { wait(); }
+
+            TaskGroup(const TaskGroup&) = delete;
+            TaskGroup& operator=(const TaskGroup&) = delete;
+
+            template <typename F>
+            requires std::invocable<F&>
+            void run(F&& func)
+            {
+                _pool->submit(_pool->create_job(std::forward<F>(func)), &_counter);
+            }
+
+            void wait() { _pool->wait(_counter); }
+
+        private:
+            ThreadPool* _pool = nullptr;
+            std::atomic<uint32_t> _counter = 0;
+        };
+
+        enum class IterationOrder : uint8_t
+        {
+            Linear,
+            MortonTiled     // 以 tile 为单位按 Morton 顺序分配, tile 内按行遍历.
+        };
+
+        // 将 Morton 码还原为各轴的 tile 坐标, 每一位按轴轮流分配, 位数用完的轴不再参与, 所以非正方形区域也不会浪费太多.
+        inline void decode_morton_tile(uint64_t code, const uint32_t (&bits)[3], uint64_t (&out_tile)[3])
+        {
+            out_tile[0] = out_tile[1] = out_tile[2] = 0;
+            for (uint32_t level = 0; code != 0; ++level)
+            {
+                for (uint32_t axis = 0; axis < 3; ++axis)
+                {
+                    if (level < bits[axis])
+                    {
+                        out_tile[axis] |= (code & 1) << level;
+                        code >>= 1;
+                    }
+                }
+            }
+        }
+
+        template <typename F>
+        requires std::invocable<F&, uint64_t>
+        void parallel_for(F&& func, uint64_t count, uint64_t grain_size = 0)
+        {
+            auto range_func = [&func](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t ix = begin; ix < end; ++ix) func(ix);
+            };
+            parallel_for_range(range_func, count, grain_size);
+        }
+
+        template <typename F>
+        requires std::invocable<F&, uint64_t, uint64_t>
+        void parallel_for_2d(F&& func, uint64_t x, uint64_t y, IterationOrder order = IterationOrder::Linear, uint32_t tile_size = 8)
+        {
+            if (x == 0 || y == 0) return;
+
+            if (order == IterationOrder::Linear)
+            {
+                auto range_func = [&func, x](uint64_t begin, uint64_t end)
+                {
+                    uint64_t ix = begin % x;
+                    uint64_t iy = begin / x;
+                    for (uint64_t index = begin; index < end; ++index)
+                    {
+                        func(ix, iy);
+                        if (++ix == x) { ix = 0; ++iy; }
+                    }
+                };
+                parallel_for_range(range_func, x * y);
+                return;
+            }
+
+            const uint64_t tile_x = (x + tile_size - 1) / tile_size;
+            const uint64_t tile_y = (y + tile_size - 1) / tile_size;
+            const uint32_t bits[3] = { 
+                static_cast<uint32_t>(std::bit_width(tile_x - 1)), 
+                static_cast<uint32_t>(std::bit_width(tile_y - 1)), 
+                0 
+            };
+
+            auto range_func = [&func, x, y, tile_x, tile_y, tile_size, &bits](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t code = begin; code < end; ++code)
+                {
+                    uint64_t tile[3];
+                    decode_morton_tile(code, bits, tile);
+                    if (tile[0] >= tile_x || tile[1] >= tile_y) continue;
+
+                    const uint64_t end_x = std::min(tile[0] * tile_size + tile_size, x);
+                    const uint64_t end_y = std::min(tile[1] * tile_size + tile_size, y);
+                    for (uint64_t iy = tile[1] * tile_size; iy < end_y; ++iy)
+                    {
+                        for (uint64_t ix = tile[0] * tile_size; ix < end_x; ++ix)
+                        {
+                            func(ix, iy);
+                        }
+                    }
+                }
+            };
+            parallel_for_range(range_func, 1ull << (bits[0] + bits[1]), 1);
+        }
+
+        template <typename F>
+        requires std::invocable<F&, uint64_t, uint64_t, uint64_t>
+        void parallel_for_3d(F&& func, uint64_t x, uint64_t y, uint64_t z, IterationOrder order = IterationOrder::Linear, uint32_t tile_size = 4)
+        {
+            if (x == 0 || y == 0 || z == 0) return;
+
+            if (order == IterationOrder::Linear)
+            {
+                auto range_func = [&func, x, y](uint64_t begin, uint64_t end)
+                {
+                    uint64_t ix = begin % x;
+                    uint64_t iy = (begin / x) % y;
+                    uint64_t iz = begin / (x * y);
+                    for (uint64_t index = begin; index < end; ++index)
+                    {
+                        func(ix, iy, iz);
+                        if (++ix == x) 
+                        { 
+                            ix = 0; 
+                            if (++iy == y) { iy = 0; ++iz; }
+                        }
+                    }
+                };
+                parallel_for_range(range_func, x * y * z);
+                return;
+            }
+
+            const uint64_t tile_num[3] = {
+                (x + tile_size - 1) / tile_size,
+                (y + tile_size - 1) / tile_size,
+                (z + tile_size - 1) / tile_size
+            };
+            const uint32_t bits[3] = { 
+                static_cast<uint32_t>(std::bit_width(tile_num[0] - 1)), 
+                static_cast<uint32_t>(std::bit_width(tile_num[1] - 1)), 
+                static_cast<uint32_t>(std::bit_width(tile_num[2] - 1))
+            };
+
+            auto range_func = [&func, x, y, z, &tile_num, tile_size, &bits](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t code = begin; code < end; ++code)
+                {
+                    uint64_t tile[3];
+                    decode_morton_tile(code, bits, tile);
+                    if (tile[0] >= tile_num[0] || tile[1] >= tile_num[1] || tile[2] >= tile_num[2]) continue;
+
+                    const uint64_t end_x = std::min(tile[0] * tile_size + tile_size, x);
+                    const uint64_t end_y = std::min(tile[1] * tile_size + tile_size, y);
+                    const uint64_t end_z = std::min(tile[2] * tile_size + tile_size, z);
+                    for (uint64_t iz = tile[2] * tile_size; iz < end_z; ++iz)
+                    {
+                        for (uint64_t iy = tile[1] * tile_size; iy < end_y; ++iy)
+                        {
+                            for (uint64_t ix = tile[0] * tile_size; ix < end_x; ++ix)
+                            {
+                                func(ix, iy, iz);
+                            }
+                        }
+                    }
+                }
+            };
+            parallel_for_range(range_func, 1ull << (bits[0] + bits[1] + bits[2]), 1);
+        }
+
+        template <typename F>
+        requires std::invocable<F&, uint64_t, uint64_t>
+        void parallel_for(F&& func, uint64_t x, uint64_t y)
+        {
+            parallel_for_2d(std::forward<F>(func), x, y);
+        }
     };
 }
 
@@ -0,0 +1,136 @@
+#include "task_profiler.h"
+#include <algorithm>
+#include <fstream>
+#include "../tools/log.h"
+
+namespace fantasy
+{
+    TaskProfiler::TaskProfiler(uint32_t slot_num) : _start_time_ns(now_ns())
+    {
+        // 最后一个 slot 给没有队列的线程.
+        for (uint32_t ix = 0; ix < slot_num + 1; ++ix)
+        {
+            _slots.emplace_back(std::make_unique<Slot>());
+        }
+    }
+
+    void TaskProfiler::add_steal_attempt(uint32_t slot, bool success)
+    {
+        Slot& data = *_slots[clamp_slot(slot)];
+        increase(data.steal_attempt_num);
+        if (success) increase(data.steal_success_num);
+    }
+
+    void TaskProfiler::update_queue_depth(uint32_t slot, uint64_t depth)
+    {
+        std::atomic<uint64_t>& high_water_mark = _slots[clamp_slot(slot)]->queue_high_water_mark;
+        uint64_t current = high_water_mark.load(std::memory_order_relaxed);
+        while (depth > current && !high_water_mark.compare_exchange_weak(current, depth, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void TaskProfiler::add_event(uint32_t slot, const char* name, uint64_t begin_ns, uint64_t end_ns)
+    {
+        Slot& data = *_slots[clamp_slot(slot)];
+        std::lock_guard lock(data.event_mutex);
+        data.events.push_back(Event{ .name = name, .begin_ns = begin_ns, .end_ns = end_ns });
+    }
+
+    std::vector<WorkerCounters> TaskProfiler::get_counters() const
+    {
+        std::vector<WorkerCounters> counters(_slots.size());
+        for (uint32_t ix = 0; ix < _slots.size(); ++ix)
+        {
+            const Slot& data = *_slots[ix];
+            counters[ix].executed_job_num = data.executed_job_num.load(std::memory_order_relaxed);
+            counters[ix].steal_attempt_num = data.steal_attempt_num.load(std::memory_order_relaxed);
+            counters[ix].steal_success_num = data.steal_success_num.load(std::memory_order_relaxed);
+            counters[ix].idle_time_ns = data.idle_time_ns.load(std::memory_order_relaxed);
+            counters[ix].queue_high_water_mark = data.queue_high_water_mark.load(std::memory_order_relaxed);
+        }
+        return counters;
+    }
+
+    void TaskProfiler::reset()
+    {
+        for (auto& slot : _slots)
+        {
+            slot->executed_job_num.store(0, std::memory_order_relaxed);
+            slot->steal_attempt_num.store(0, std::memory_order_relaxed);
+            slot->steal_success_num.store(0, std::memory_order_relaxed);
+            slot->idle_time_ns.store(0, std::memory_order_relaxed);
+            slot->queue_high_water_mark.store(0, std::memory_order_relaxed);
+
+            std::lock_guard lock(slot->event_mutex);
+            slot->events.clear();
+        }
+        _start_time_ns = now_ns();
+    }
+
+    bool TaskProfiler::export_chrome_trace(const std::string& path, const std::vector<std::string>& slot_names) const
+    {
+        std::ofstream output(path, std::ios::out | std::ios::trunc);
+        if (!output.is_open())
+        {
+            LOG_ERROR("Failed to open " + path + " for chrome trace.");
+            return false;
+        }
+
+        auto get_slot_name = [&](uint32_t slot)
+        {
+            if (slot < slot_names.size()) return slot_names[slot];
+            return "Thread " + std::to_string(slot);
+        };
+
+        // Chrome trace 的时间单位是微秒.
+        auto to_us = [this](uint64_t time_ns)
+        {
+            return std::to_string(static_cast<double>(time_ns - std::min(time_ns, _start_time_ns)) / 1000.0);
+        };
+
+        output << "{\n\"traceEvents\": [\n";
+
+        bool first_event = true;
+        auto begin_event = [&]()
+        {
+            if (!first_event) output << ",\n";
+            first_event = false;
+        };
+
+        for (uint32_t ix = 0; ix < _slots.size(); ++ix)
+        {
+            begin_event();
+            output << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << ix
+                   << ", \"args\": {\"name\": \"" << get_slot_name(ix) << "\"}}";
+
+            std::lock_guard lock(_slots[ix]->event_mutex);
+            for (const auto& event : _slots[ix]->events)
+            {
+                begin_event();
+                output << "{\"name\": \"" << event.name << "\", \"cat\": \"task\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << ix
+                       << ", \"ts\": " << to_us(event.begin_ns)
+                       << ", \"dur\": " << std::to_string(static_cast<double>(event.end_ns - event.begin_ns) / 1000.0) << "}";
+            }
+        }
+        output << "\n],\n";
+
+        // 计数器放在 otherData 中, chrome://tracing 和 Perfetto 都会在元数据中显示.
+        output << "\"otherData\": {\n";
+        const auto counters = get_counters();
+        for (uint32_t ix = 0; ix < counters.size(); ++ix)
+        {
+            const auto& counter = counters[ix];
+            output << "\"" << get_slot_name(ix) << "\": \""
+                   << "executed: " << counter.executed_job_num
+                   << ", steal attempts: " << counter.steal_attempt_num
+                   << ", steal successes: " << counter.steal_success_num
+                   << ", idle ms: " << static_cast<double>(counter.idle_time_ns) / 1000000.0
+                   << ", queue high water mark: " << counter.queue_high_water_mark << "\"";
+            output << (ix + 1 == counters.size() ? "\n" : ",\n");
+        }
+        output << "}\n}\n";
+
+        return output.good();
+    }
+}
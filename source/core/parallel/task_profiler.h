@@ -0,0 +1,114 @@
+#ifndef TASK_FLOW_TASK_PROFILER_H
+#define TASK_FLOW_TASK_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    struct WorkerCounters
+    {
+        uint64_t executed_job_num = 0;
+        uint64_t steal_attempt_num = 0;
+        uint64_t steal_success_num = 0;
+        uint64_t idle_time_ns = 0;
+        uint64_t queue_high_water_mark = 0;
+    };
+
+    // 线程池的计数器和任务事件, 默认关闭. 关闭时每个记录点只有一次 relaxed load.
+    // 每个工作线程 (以及有自己队列的非工作线程) 有一个 slot, 其它线程共用最后一个 slot.
+    class TaskProfiler
+    {
+    public:
+        struct Event
+        {
+            const char* name;       // 需要是静态字符串.
+            uint64_t begin_ns;
+            uint64_t end_ns;
+        };
+
+        explicit TaskProfiler(uint32_t slot_num);
+
+        void set_counter_enabled(bool enabled) { _counter_enabled.store(enabled, std::memory_order_relaxed); }
+        void set_event_enabled(bool enabled) { _event_enabled.store(enabled, std::memory_order_relaxed); }
+        bool counter_enabled() const { return _counter_enabled.load(std::memory_order_relaxed); }
+        bool event_enabled() const { return _event_enabled.load(std::memory_order_relaxed); }
+
+        void add_executed_job(uint32_t slot) { increase(_slots[clamp_slot(slot)]->executed_job_num); }
+        void add_steal_attempt(uint32_t slot, bool success);
+        void add_idle_time(uint32_t slot, uint64_t time_ns) { increase(_slots[clamp_slot(slot)]->idle_time_ns, time_ns); }
+        void update_queue_depth(uint32_t slot, uint64_t depth);
+        void add_event(uint32_t slot, const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+        std::vector<WorkerCounters> get_counters() const;
+        void reset();
+
+        // slot_names 为空时使用 "Thread n".
+        bool export_chrome_trace(const std::string& path, const std::vector<std::string>& slot_names = {}) const;
+
+        static uint64_t now_ns()
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()
+            ).count());
+        }
+
+    private:
+        struct alignas(64) Slot
+        {
+            std::atomic<uint64_t> executed_job_num = 0;
+            std::atomic<uint64_t> steal_attempt_num = 0;
+            std::atomic<uint64_t> steal_success_num = 0;
+            std::atomic<uint64_t> idle_time_ns = 0;
+            std::atomic<uint64_t> queue_high_water_mark = 0;
+
+            mutable std::mutex event_mutex;
+            std::vector<Event> events;
+        };
+
+        uint32_t clamp_slot(uint32_t slot) const { return slot < _slots.size() ? slot : static_cast<uint32_t>(_slots.size() - 1); }
+
+        // 共用的 slot 可能被多个线程同时写入, 所以使用 fetch_add.
+        static void increase(std::atomic<uint64_t>& value, uint64_t delta = 1) { value.fetch_add(delta, std::memory_order_relaxed); }
+
+    private:
+        std::atomic<bool> _counter_enabled = false;
+        std::atomic<bool> _event_enabled = false;
+        uint64_t _start_time_ns = 0;
+
+        std::vector<std::unique_ptr<Slot>> _slots;
+    };
+
+
+    // 在作用域结束时记录一个任务事件, 事件关闭时不读取时间.
+    class TaskEventScope
+    {
+    public:
+        TaskEventScope(TaskProfiler& profiler, uint32_t slot, const char* name) :
+            _profiler(profiler.event_enabled() ? &profiler : nullptr), _slot(slot), _name(name)
+        {
+            if (_profiler) _begin_ns = TaskProfiler::now_ns();
+        }
+
+        ~TaskEventScope()
+        {
+            if (_profiler) _profiler->add_event(_slot, _name, _begin_ns, TaskProfiler::now_ns());
+        }
+
+        TaskEventScope(const TaskEventScope&) = delete;
+        TaskEventScope& operator=(const TaskEventScope&) = delete;
+
+    private:
+        TaskProfiler* _profiler;
+        uint32_t _slot;
+        const char* _name;
+        uint64_t _begin_ns = 0;
+    };
+}
+
+#endif
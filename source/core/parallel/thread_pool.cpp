@@ -1,16 +1,104 @@
 #include "thread_pool.h"
+#include <algorithm>
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <utility>
+#include "../math/common.h"
 
-namespace fantasy 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace fantasy
 {
-    ThreadPool::ThreadPool(uint32_t thread_num)
+    static std::atomic<uint64_t> next_pool_id = 0;
+
+    // 用 id 而不是指针判断, 销毁后在同一地址重新创建的线程池不会误用之前的队列序号.
+    static thread_local uint64_t current_pool_id = INVALID_SIZE_64;
+    static thread_local uint32_t current_worker_index = INVALID_SIZE_32;
+    static thread_local uint32_t current_wait_depth = 0;
+    static thread_local TaskPriority current_priority = TaskPriority::Normal;
+
+    struct ExternalThreadSlots
+    {
+        std::mutex mutex;
+        std::vector<uint32_t> free_slots;
+    };
+
+    // 线程退出时归还在各个线程池中占用的队列序号, 已经销毁的线程池跳过.
+    // 线程在多个线程池之间切换时保留之前的序号, 外层 wait() 中缓存的序号因此一直有效.
+    struct ExternalThreadSlotGuard
+    {
+        std::vector<std::pair<std::weak_ptr<ExternalThreadSlots>, uint32_t>> slots;
+
+        ~ExternalThreadSlotGuard()
+        {
+            for (const auto& [weak_slots, slot] : slots)
+            {
+                if (auto external_slots = weak_slots.lock())
+                {
+                    std::lock_guard lock(external_slots->mutex);
+                    external_slots->free_slots.push_back(slot);
+                }
+            }
+        }
+    };
+    static thread_local ExternalThreadSlotGuard external_thread_slot_guard;
+
+    // 同一物理核心上的两个逻辑核心共享执行单元, 工作线程数按物理核心数计算.
+    static uint32_t get_physical_core_num()
     {
-        uint64_t max_thread_num = std::thread::hardware_concurrency() / 4;
-        if (thread_num > 0) max_thread_num = thread_num;
-        
-        for (uint64_t ix = 0; ix < max_thread_num; ++ix)
+#ifdef _WIN32
+        DWORD length = 0;
+        GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+        if (length > 0)
+        {
+            std::vector<uint8_t> buffer(length);
+            if (GetLogicalProcessorInformationEx(
+                RelationProcessorCore, 
+                reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data()), 
+                &length
+            ))
+            {
+                uint32_t core_num = 0;
+                for (DWORD offset = 0; offset < length; ++core_num)
+                {
+                    offset += reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset)->Size;
+                }
+                if (core_num > 0) return core_num;
+            }
+        }
+#endif
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    ThreadPool::ThreadPool(const ThreadPoolDesc& desc) : _id(next_pool_id.fetch_add(1))
+    {
+        _thread_num = desc.thread_num;
+        if (_thread_num == 0) _thread_num = std::max(get_physical_core_num(), 2u) - 1;
+
+        // 至少留一个工作线程执行后台任务.
+        _reserved_thread_num = desc.reserved_thread_num == INVALID_SIZE_32 ? _thread_num / 4 : desc.reserved_thread_num;
+        _reserved_thread_num = std::min(_reserved_thread_num, _thread_num - 1);
+
+        for (auto& queues : _worker_queues)
+        {
+            for (uint32_t ix = 0; ix < _thread_num + external_thread_capacity; ++ix)
+            {
+                queues.emplace_back(std::make_unique<WorkerQueue>());
+            }
+        }
+        _profiler = std::make_unique<TaskProfiler>(_thread_num + external_thread_capacity);
+        _job_blocks.resize(_thread_num + external_thread_capacity);
+
+        _external_thread_slots = std::make_shared<ExternalThreadSlots>();
+        for (uint32_t ix = external_thread_capacity; ix > 0; --ix)
+        {
+            _external_thread_slots->free_slots.push_back(_thread_num + ix - 1);
+        }
+
+        for (uint32_t ix = 0; ix < _thread_num; ++ix)
         {
             _threads.emplace_back(&ThreadPool::worker_thread, this, ix);
         }
@@ -19,10 +107,11 @@ namespace fantasy
     ThreadPool::~ThreadPool()
     {
         {
+            std::lock_guard lock(_sleep_mutex);
             _done = true;
-            _pool_task_queue.condition_variable.notify_all();
         }
-        
+        _sleep_condition.notify_all();
+
         for (auto& thread : _threads)
         {
             if (thread.joinable())
@@ -32,100 +121,374 @@ namespace fantasy
         }
     }
 
-    uint64_t ThreadPool::submit(std::function<bool()> func)
+    void ThreadPool::submit(Job* job, std::atomic<uint32_t>* counter)
     {
-        auto task = std::make_shared<std::packaged_task<bool()>>(func);
-        _futures.emplace_back(task->get_future());
-        _pool_task_queue.push([task]() { (*task)(); });
+        submit(job, counter, current_priority);
+    }
+
+    void ThreadPool::submit(Job* job, std::atomic<uint32_t>* counter, TaskPriority priority)
+    {
+        if (counter)
+        {
+            counter->fetch_add(1, std::memory_order_relaxed);
+            job->counter = counter;
+        }
+
+        const bool background = priority == TaskPriority::Background;
+        std::atomic<int64_t>& queued_job_num = _queued_job_nums[static_cast<uint32_t>(priority)];
+        queued_job_num.fetch_add(1);
+
+        bool pushed = false;
+        const uint32_t index = get_current_index();
+        if (index != INVALID_SIZE_32 && (!background || allow_background(index)))
+        {
+            WorkerQueue& queue = *_worker_queues[static_cast<uint32_t>(priority)][index];
+            pushed = queue.push(job);
+            if (_profiler->counter_enabled()) _profiler->update_queue_depth(index, queue.size());
+        }
+        else
+        {
+            pushed = _global_queues[static_cast<uint32_t>(priority)].try_push(job);
+        }
+
+        if (!pushed)
+        {
+            // 队列已满, 直接在当前线程执行.
+            queued_job_num.fetch_sub(1);
+            execute(job, priority);
+            return;
+        }
 
-        return _futures.size() - 1;
+        if (_sleeping_thread_num.load() > 0)
+        {
+            std::lock_guard lock(_sleep_mutex);
+
+            // 保留的工作线程被唤醒后不会执行后台任务, 所以需要全部唤醒.
+            if (background) _sleep_condition.notify_all();
+            else _sleep_condition.notify_one();
+        }
     }
 
-    void ThreadPool::wait_for_idle(uint32_t index)
+    void ThreadPool::wait(const std::atomic<uint32_t>& counter)
     {
-        while (index-- > 0)
+        // 等待的线程 (包括非工作线程) 执行其它 Job 直到 counter 归零, 所以嵌套的 parallel_for, TaskGroup
+        // 和 TaskFlow 不会占住工作线程, 也不会因为所有线程都在等待而死锁.
+        // 只执行优先级不低于当前任务的 Job, 否则等待 Critical 任务时可能执行一个很长的后台 Job (优先级反转).
+        // 非工作线程不会执行后台 Job, 以免主线程被长时间的资源加载阻塞.
+        const uint32_t index = get_current_index();
+        const bool allow_steal = current_wait_depth < max_wait_steal_depth;
+        TaskPriority lowest_priority = current_priority;
+        if (lowest_priority == TaskPriority::Background && !allow_background(index)) lowest_priority = TaskPriority::Normal;
+
+        current_wait_depth++;
+        while (counter.load(std::memory_order_acquire) != 0)
         {
-            if (_futures.back().get())
+            TaskPriority priority;
+            if (Job* job = get_job(index, allow_steal, lowest_priority, priority))
+            {
+                execute(job, priority);
+            }
+            else if (_profiler->counter_enabled())
             {
-                _futures.pop_back();
+                const uint64_t begin_time = TaskProfiler::now_ns();
+                std::this_thread::yield();
+                _profiler->add_idle_time(index, TaskProfiler::now_ns() - begin_time);
             }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+        current_wait_depth--;
+    }
+
+    uint64_t ThreadPool::submit(std::function<bool()> func, TaskPriority priority)
+    {
+        auto task = std::make_shared<std::packaged_task<bool()>>(std::move(func));
+
+        uint64_t index = 0;
+        {
+            std::lock_guard lock(_future_mutex);
+            index = _next_future_index++;
+            _futures.emplace(index, task->get_future());
+        }
+
+        submit(
+            create_job(
+                [this, task]() 
+                { 
+                    auto event_scope = create_event_scope("Thread");
+                    (*task)(); 
+                }
+            ), 
+            nullptr, 
+            priority
+        );
+        return index;
+    }
+
+    void ThreadPool::yield()
+    {
+        const uint32_t index = get_current_index();
+        if (index == INVALID_SIZE_32 || current_priority != TaskPriority::Background) return;
+
+        TaskPriority priority;
+        while (Job* job = get_job(index, true, TaskPriority::Normal, priority))
+        {
+            execute(job, priority);
+        }
+    }
+
+    bool ThreadPool::export_chrome_trace(const std::string& path) const
+    {
+        std::vector<std::string> slot_names;
+        for (uint32_t ix = 0; ix < _thread_num; ++ix)
+        {
+            slot_names.push_back((ix < _reserved_thread_num ? "Reserved Worker " : "Worker ") + std::to_string(ix));
+        }
+        for (uint32_t ix = 0; ix < external_thread_capacity; ++ix)
+        {
+            slot_names.push_back("External Thread " + std::to_string(ix));
         }
+        slot_names.push_back("Other Threads");
+
+        return _profiler->export_chrome_trace(path, slot_names);
+    }
+
+    TaskPriority ThreadPool::get_current_priority()
+    {
+        return current_priority;
+    }
+
+    TaskPriority ThreadPool::set_current_priority(TaskPriority priority)
+    {
+        return std::exchange(current_priority, priority);
     }
 
     bool ThreadPool::thread_finished(uint64_t index)
     {
-        return _futures[index].wait_for(std::chrono::milliseconds(0)) == std::future_status::ready;
+        std::lock_guard lock(_future_mutex);
+        auto iter = _futures.find(index);
+        if (iter == _futures.end()) return false;
+        return iter->second.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready;
     }
 
     bool ThreadPool::thread_success(uint64_t index)
     {
-        auto iter = std::next(_futures.begin(), index);
-        if (iter->get())
+        std::future<bool> future;
         {
+            std::lock_guard lock(_future_mutex);
+            auto iter = _futures.find(index);
+            if (iter == _futures.end()) return false;
+            future = std::move(iter->second);
             _futures.erase(iter);
-            return true;
         }
-        return false;
+        return future.get();
     }
 
-    void ThreadPool::parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size)
+    void ThreadPool::parallel_for(const RangeFunction& func, uint64_t count, uint64_t grain_size)
     {
-        for (uint64_t ix = 0; ix < count; ix += chun_size)
+        if (count == 0) return;
+
+        if (grain_size == 0)
         {
-            auto task = std::make_shared<std::packaged_task<bool()>>(
-                [&func, ix, count, chun_size]() 
-                {
-                    uint32_t dwEndIndex = std::min(ix + chun_size, count);
-                    for (uint64_t ij = ix; ij < dwEndIndex; ++ij)
-                    {
-                        func(ij);
-                    }
-                    return true;
-                }
-            );
-            _futures.emplace_back(task->get_future());
-            _pool_task_queue.push([task]() { (*task)(); });
+            grain_size = std::clamp<uint64_t>(count / (64ull * (get_thread_num() + 1)), 1, 4096);
         }
 
-        wait_for_idle(count);
+        RangeContext context{ .func = func, .grain_size = grain_size };
+        run_range(&context, 0, count);
+        wait(context.counter);
     }
-    
-    void ThreadPool::parallel_for(std::function<void(uint64_t, uint64_t)> func, uint64_t x, uint64_t y)
+
+    void ThreadPool::run_range(RangeContext* context, uint64_t begin, uint64_t end)
     {
-        for (uint64_t iy = 0; iy < y; ++iy)
+        while (begin < end)
         {
-            auto task = std::make_shared<std::packaged_task<bool()>>(
-                [&func, iy, x]() 
-                {
-                    for (uint64_t ix = 0; ix < x; ++ix)
-                    {
-                        func(ix, iy);
-                    }
-                    return true;
-                }
-            );
-            _futures.emplace_back(task->get_future());
-            _pool_task_queue.push([task]() { (*task)(); });
+            if (end - begin > context->grain_size && local_queue_empty())
+            {
+                const uint64_t middle = begin + (end - begin) / 2;
+                submit(
+                    create_job([this, context, middle, end]() { run_range(context, middle, end); }),
+                    &context->counter
+                );
+                end = middle;
+                continue;
+            }
+
+            const uint64_t chunk_end = std::min(begin + context->grain_size, end);
+            {
+                auto event_scope = create_event_scope("parallel_for");
+                context->func(begin, chunk_end);
+            }
+            begin = chunk_end;
         }
-        wait_for_idle(y);
     }
 
-    void ThreadPool::worker_thread(uint64_t index)
+    bool ThreadPool::local_queue_empty()
     {
-        std::mutex mutex;
-        std::unique_lock<std::mutex> Lock(mutex);
-        while (!_done)
+        // 与 submit() 选择队列的方式相同.
+        const uint32_t index = get_current_index();
+        if (index == INVALID_SIZE_32) return true;
+        if (current_priority == TaskPriority::Background && !allow_background(index)) return true;
+        return _worker_queues[static_cast<uint32_t>(current_priority)][index]->empty();
+    }
+
+    uint32_t ThreadPool::get_current_index()
+    {
+        if (current_pool_id == _id) return current_worker_index;
+
+        current_pool_id = _id;
+        current_worker_index = INVALID_SIZE_32;
+
+        auto& slots = external_thread_slot_guard.slots;
+        std::erase_if(slots, [](const auto& slot) { return slot.first.expired(); });
+        for (const auto& [weak_slots, slot] : slots)
+        {
+            if (weak_slots.lock() == _external_thread_slots) return current_worker_index = slot;
+        }
+
+        // 序号通过 mutex 交接, 之前的线程对队列和 Job 块的修改对新线程可见.
+        std::lock_guard lock(_external_thread_slots->mutex);
+        auto& free_slots = _external_thread_slots->free_slots;
+        if (!free_slots.empty())
+        {
+            current_worker_index = free_slots.back();
+            free_slots.pop_back();
+            slots.emplace_back(_external_thread_slots, current_worker_index);
+        }
+        return current_worker_index;
+    }
+
+    Job* ThreadPool::allocate_job()
+    {
+        const uint32_t index = get_current_index();
+        if (index != INVALID_SIZE_32) return allocate_job(_job_blocks[index]);
+
+        std::lock_guard lock(_shared_job_mutex);
+        return allocate_job(_shared_job_blocks);
+    }
+
+    Job* ThreadPool::allocate_job(JobBlocks& job_blocks)
+    {
+        // 所有块组成一个环, 跳过还未开始执行的 Job. fork-join 中最早提交的 Job 可能一直留在队列底部,
+        // 所以不能直接覆盖. 新增的块不会改变已有 Job 的地址.
+        auto& blocks = job_blocks.blocks;
+        const uint64_t job_num = blocks.size() * job_pool_capacity;
+        for (uint64_t ix = 0; ix < job_num; ++ix)
         {
-            std::function<void()> Task;
-            if (_pool_task_queue.try_pop(Task))
+            const uint64_t index = job_blocks.next_index;
+            job_blocks.next_index = index + 1 == job_num ? 0 : index + 1;
+
+            Job* job = &blocks[index / job_pool_capacity][index % job_pool_capacity];
+            if (job->function.load(std::memory_order_acquire) == nullptr) return job;
+        }
+
+        blocks.emplace_back(std::make_unique<Job[]>(job_pool_capacity));
+        job_blocks.next_index = job_num + 1;
+        return &blocks.back()[0];
+    }
+
+    Job* ThreadPool::get_job(uint32_t index, bool allow_steal, TaskPriority lowest_priority, TaskPriority& priority)
+    {
+        // 按优先级依次查找: 自己的队列 (后进先出), 全局队列, 再从其它线程的队列窃取 (先进先出).
+        // 不允许窃取时只执行自己队列中的 Job, 它们是当前栈上的任务拆分出来的, 栈深度有界.
+        const bool profile = _profiler->counter_enabled();
+        const uint32_t lane_num = static_cast<uint32_t>(lowest_priority) + 1;
+        for (uint32_t lane = 0; lane < lane_num; ++lane)
+        {
+            priority = static_cast<TaskPriority>(lane);
+            std::atomic<int64_t>& queued_job_num = _queued_job_nums[lane];
+
+            Job* job = nullptr;
+            const auto& queues = _worker_queues[lane];
+            if (index != INVALID_SIZE_32 && queues[index]->pop(job))
             {
-                Task();
+                queued_job_num.fetch_sub(1);
+                return job;
             }
-            else
+
+            if (!allow_steal || queued_job_num.load(std::memory_order_relaxed) <= 0) continue;
+
+            if (_global_queues[lane].try_pop(job))
             {
-                _pool_task_queue.condition_variable.wait(Lock);
+                queued_job_num.fetch_sub(1);
+                return job;
+            }
+
+            // 只有可以执行后台任务的工作线程 (序号不小于 _reserved_thread_num) 的后台队列中有 Job.
+            const uint32_t queue_num = priority == TaskPriority::Background ? _thread_num : static_cast<uint32_t>(queues.size());
+            const uint32_t start = index == INVALID_SIZE_32 ? 0 : index + 1;
+            for (uint32_t ix = 0; ix < queue_num; ++ix)
+            {
+                const uint32_t victim = (start + ix) % queue_num;
+                if (victim == index) continue;
+                if (priority == TaskPriority::Background && victim < _reserved_thread_num) continue;
+
+                const bool success = queues[victim]->steal(job);
+                if (profile) _profiler->add_steal_attempt(index, success);
+                if (success)
+                {
+                    queued_job_num.fetch_sub(1);
+                    return job;
+                }
             }
         }
+        return nullptr;
+    }
+
+    void ThreadPool::execute(Job* job, TaskPriority priority)
+    {
+        // Job 中再提交的 Job 继承它的优先级.
+        const TaskPriority last_priority = std::exchange(current_priority, priority);
+
+        if (_profiler->counter_enabled()) _profiler->add_executed_job(get_current_index());
+
+        std::atomic<uint32_t>* counter = job->counter;
+        {
+            auto event_scope = create_event_scope("Job");
+            job->function.load(std::memory_order_relaxed)(job);
+        }
+        if (counter) counter->fetch_sub(1, std::memory_order_release);
+
+        current_priority = last_priority;
+    }
+
+    void ThreadPool::worker_thread(uint32_t index)
+    {
+        current_pool_id = _id;
+        current_worker_index = index;
+
+        const bool background = allow_background(index);
+        const TaskPriority lowest_priority = background ? TaskPriority::Background : TaskPriority::Normal;
+        while (true)
+        {
+            TaskPriority priority;
+            if (Job* job = get_job(index, true, lowest_priority, priority))
+            {
+                execute(job, priority);
+                continue;
+            }
+
+            const uint64_t sleep_begin_time = _profiler->counter_enabled() ? TaskProfiler::now_ns() : 0;
+
+            std::unique_lock lock(_sleep_mutex);
+            _sleeping_thread_num.fetch_add(1);
+            _sleep_condition.wait(
+                lock, 
+                [this, background]() 
+                { 
+                    return _done || 
+                        _queued_job_nums[static_cast<uint32_t>(TaskPriority::Critical)].load() > 0 || 
+                        _queued_job_nums[static_cast<uint32_t>(TaskPriority::Normal)].load() > 0 || 
+                        (background && _queued_job_nums[static_cast<uint32_t>(TaskPriority::Background)].load() > 0); 
+                }
+            );
+            _sleeping_thread_num.fetch_sub(1);
+
+            if (sleep_begin_time != 0) _profiler->add_idle_time(index, TaskProfiler::now_ns() - sleep_begin_time);
+
+            if (_done) break;
+        }
     }
 
-}
\ No newline at end of file
+}
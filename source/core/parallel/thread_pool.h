@@ -1,42 +1,234 @@
 ﻿#ifndef TASK_FLOW_THREAD_POOL_H
 #define TASK_FLOW_THREAD_POOL_H
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "thread_queue.h"
+#include "task_profiler.h"
+#include "../math/common.h"
 
-namespace fantasy 
+namespace fantasy
 {
+    // 一个 Job 占一条缓存行, 可调用对象直接构造在 data 中, 提交时不需要堆分配.
+    struct alignas(64) Job
+    {
+        static constexpr uint32_t data_size = 48;
+
+        std::atomic<void (*)(Job*)> function = nullptr;    // 开始执行后置空, 这个位置可以重新分配.
+        std::atomic<uint32_t>* counter = nullptr;           // Job 执行完后减一.
+        alignas(16) uint8_t data[data_size];
+    };
+    static_assert(sizeof(Job) == 64);
+
+    // 不持有所有权的区间函数引用, 每个子区间只有一次间接调用.
+    class RangeFunction
+    {
+    public:
+        template <typename F>
+        requires (!std::is_same_v<std::decay_t<F>, RangeFunction>)
+        RangeFunction(F& func) : 
+            _object(const_cast<void*>(static_cast<const void*>(&func))),
+            _function([](void* object, uint64_t begin, uint64_t end) { (*static_cast<F*>(object))(begin, end); })
+        {
+        }
+
+        void operator()(uint64_t begin, uint64_t end) const { _function(_object, begin, end); }
+
+    private:
+        void* _object = nullptr;
+        void (*_function)(void*, uint64_t, uint64_t) = nullptr;
+    };
+
+
+    enum class TaskPriority : uint8_t
+    {
+        Critical,       // 当前帧必须完成的任务, 最先执行.
+        Normal,
+        Background,     // 资源加载等长时间任务, 不会在保留的工作线程上执行.
+
+        Count
+    };
+
+    struct ThreadPoolDesc
+    {
+        // 为 0 时为物理核心数减一 (留给主线程).
+        uint32_t thread_num = 0;
+
+        // 只执行 Critical 和 Normal 任务的工作线程数, 为 INVALID_SIZE_32 时为 thread_num / 4.
+        uint32_t reserved_thread_num = INVALID_SIZE_32;
+    };
+
+    // 非工作线程的空闲队列序号, 见 ThreadPool::get_current_index().
+    struct ExternalThreadSlots;
+
     class ThreadPool
     {
     public:
-        ThreadPool(uint32_t thread_num = 0);
+        // 每个队列序号按块分配 Job, 一块中的 Job 都还未开始执行时再分配一块.
+        static constexpr uint32_t job_pool_capacity = 4096;
+        static constexpr uint32_t worker_queue_capacity = 4096;
+        static constexpr uint32_t global_queue_capacity = 4096;
+
+        // 非工作线程 (如主线程) 第一次提交 Job 时分配一个自己的队列, 等待时和工作线程一样按 LIFO 执行, 栈深度有界.
+        // 线程退出时归还队列序号, 同时存在超出这个数量的非工作线程时, 多出的线程只使用全局队列.
+        static constexpr uint32_t external_thread_capacity = 4;
+
+        // 等待中窃取的 Job 会叠在当前栈上, 嵌套超过这个深度后只执行自己队列中的 Job.
+        static constexpr uint32_t max_wait_steal_depth = 8;
+
+        ThreadPool(const ThreadPoolDesc& desc = ThreadPoolDesc{});
         ~ThreadPool();
 
-        uint64_t submit(std::function<bool()> func);
-        void wait_for_idle(uint32_t index = 1);
+        template <typename F>
+        Job* create_job(F&& func)
+        {
+            using Func = std::decay_t<F>;
+            static_assert(sizeof(Func) <= Job::data_size, "Job capture is too large, capture by reference instead.");
+            static_assert(alignof(Func) <= 16, "Job capture alignment is too large.");
+
+            Job* job = allocate_job();
+            job->function.store(
+                [](Job* job)
+                {
+                    // 先移出 Job 再执行, 嵌套的任务可能执行很久, 这个位置可以先给创建 Job 的线程重新使用.
+                    Func* stored_func = std::launder(reinterpret_cast<Func*>(job->data));
+                    Func func(std::move(*stored_func));
+                    stored_func->~Func();
+                    job->function.store(nullptr, std::memory_order_release);
+                    func();
+                }, 
+                std::memory_order_relaxed
+            );
+            job->counter = nullptr;
+            new (job->data) Func(std::forward<F>(func));
+            return job;
+        }
+
+        // counter 不为空时会先加一, Job 执行完后减一, 配合 wait() 使用.
+        // 不指定优先级时继承当前线程的优先级 (见 TaskPriorityScope), 所以后台任务拆分出的子任务仍在后台执行.
+        void submit(Job* job, std::atomic<uint32_t>* counter = nullptr);
+        void submit(Job* job, std::atomic<uint32_t>* counter, TaskPriority priority);
+        void wait(const std::atomic<uint32_t>& counter);
+
+        // 长时间运行的任务 (如资源加载), 返回的 id 用于查询状态.
+        uint64_t submit(std::function<bool()> func, TaskPriority priority = TaskPriority::Background);
+
+        // 后台任务在安全点调用, 先执行完等待中的 Critical 和 Normal 任务再返回.
+        void yield();
 
         bool thread_finished(uint64_t index);
         bool thread_success(uint64_t index);
 
-        void parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size = 1);
-        void parallel_for(std::function<void(uint64_t, uint64_t)> func, uint64_t x, uint64_t y);
+        // Lazy binary splitting: 只有在本线程队列为空 (其它线程可能空闲) 时才把剩余区间对半拆出去.
+        // grain_size 为 0 时根据 count 和线程数自动选择.
+        void parallel_for(const RangeFunction& func, uint64_t count, uint64_t grain_size = 0);
+
+        uint32_t get_thread_num() const { return _thread_num; }
+        uint32_t get_reserved_thread_num() const { return _reserved_thread_num; }
+
+        static TaskPriority get_current_priority();
+        static TaskPriority set_current_priority(TaskPriority priority);
+
+        // 计数器和任务事件默认关闭, 通过 get_profiler().set_counter_enabled() / set_event_enabled() 打开.
+        TaskProfiler& get_profiler() { return *_profiler; }
+        bool export_chrome_trace(const std::string& path) const;
+
+        // 在当前线程记录一个任务事件, name 需要是静态字符串.
+        TaskEventScope create_event_scope(const char* name)
+        {
+            return TaskEventScope(*_profiler, _profiler->event_enabled() ? get_current_index() : INVALID_SIZE_32, name);
+        }
 
     private:
-        void worker_thread(uint64_t index);
+        void worker_thread(uint32_t index);
+
+        struct RangeContext
+        {
+            RangeFunction func;
+            uint64_t grain_size;
+            std::atomic<uint32_t> counter = 0;
+        };
+        void run_range(RangeContext* context, uint64_t begin, uint64_t end);
+        bool local_queue_empty();
+        uint32_t get_current_index();
+
+        // Job 的内存属于线程池, 提交 Job 的线程退出后, 还在队列中或被窃取的 Job 仍然有效.
+        struct JobBlocks
+        {
+            std::vector<std::unique_ptr<Job[]>> blocks;
+            uint64_t next_index = 0;
+        };
+        static Job* allocate_job(JobBlocks& job_blocks);
+        Job* allocate_job();
+        // 只查找优先级不低于 lowest_priority 的队列.
+        Job* get_job(uint32_t index, bool allow_steal, TaskPriority lowest_priority, TaskPriority& priority);
+        void execute(Job* job, TaskPriority priority);
+
+        bool allow_background(uint32_t index) const { return index >= _reserved_thread_num && index < _thread_num; }
 
     private:
+        using WorkerQueue = WorkStealingQueue<Job*, worker_queue_capacity>;
+
         std::atomic<bool> _done = false;
 
+        uint64_t _id = 0;
+        uint32_t _thread_num = 0;
+        uint32_t _reserved_thread_num = 0;
         std::vector<std::thread> _threads;
-        std::vector<std::future<bool>> _futures;
-        ConcurrentQueue<std::function<void()>> _pool_task_queue;
+
+        // 每个优先级一组, 工作线程和非工作线程提交的 Job, 前 _thread_num 个属于工作线程.
+        // 拆分出的子任务留在本线程的队列中, 所以各个优先级的 parallel_for 都只在本线程队列为空时才拆分,
+        // 嵌套超过 max_wait_steal_depth 后也能执行自己拆分出的 Job.
+        // 不能执行后台任务的线程提交的 Background Job 放入全局队列, 由其它线程执行.
+        std::array<std::vector<std::unique_ptr<WorkerQueue>>, static_cast<uint32_t>(TaskPriority::Count)> _worker_queues;
+        std::shared_ptr<ExternalThreadSlots> _external_thread_slots;
+
+        // 每个队列序号一组, 只由占用该序号的线程分配. 没有队列的线程共用 _shared_job_blocks.
+        std::vector<JobBlocks> _job_blocks;
+        JobBlocks _shared_job_blocks;
+        std::mutex _shared_job_mutex;
+
+        // 没有队列的线程提交的 Job.
+        std::array<BoundedQueue<Job*, global_queue_capacity>, static_cast<uint32_t>(TaskPriority::Count)> _global_queues;
+
+        // 每个优先级已提交还未取出的 Job 数, 为 0 时 get_job() 跳过该优先级的全局队列和窃取.
+        std::array<std::atomic<int64_t>, static_cast<uint32_t>(TaskPriority::Count)> _queued_job_nums = {};
+
+        std::unique_ptr<TaskProfiler> _profiler;
+        std::atomic<uint32_t> _sleeping_thread_num = 0;
+        std::mutex _sleep_mutex;
+        std::condition_variable _sleep_condition;
+
+        std::mutex _future_mutex;
+        uint64_t _next_future_index = 0;
+        std::unordered_map<uint64_t, std::future<bool>> _futures;
     };
 
+    // 作用域内当前线程提交的 Job (包括 parallel_for 拆分出的子区间) 使用指定优先级.
+    class TaskPriorityScope
+    {
+    public:
+        explicit TaskPriorityScope(TaskPriority priority) : _last_priority(ThreadPool::set_current_priority(priority)) {}
+        ~TaskPriorityScope() { ThreadPool::set_current_priority(_last_priority); }
+
+        TaskPriorityScope(const TaskPriorityScope&) = delete;
+        TaskPriorityScope& operator=(const TaskPriorityScope&) = delete;
+
+    private:
+        TaskPriority _last_priority;
+    };
 
 }
 
 
-#endif
\ No newline at end of file
+#endif
@@ -1,107 +1,338 @@
 ﻿#ifndef TASK_FLOW_CONCURRENT_QUEUE_H
 #define TASK_FLOW_CONCURRENT_QUEUE_H
 
-#include <memory>
-#include <mutex>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
 
 namespace fantasy 
 {
-    template <typename T>
-    class ConcurrentQueue
+    // 用于队列的阻塞等待, 没有等待线程时 notify() 不会修改共享变量, 也不会进入内核.
+    class QueueEvent
     {
-        struct Node
+    public:
+        template <typename F>
+        void wait_until(F&& predicate)
+        {
+            while (!predicate())
+            {
+                _waiting_num.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                const uint32_t epoch = _epoch.load();
+                if (predicate())
+                {
+                    _waiting_num.fetch_sub(1);
+                    return;
+                }
+                _epoch.wait(epoch);
+                _waiting_num.fetch_sub(1);
+            }
+        }
+
+        void notify()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_waiting_num.load(std::memory_order_relaxed) > 0)
+            {
+                _epoch.fetch_add(1);
+                _epoch.notify_all();
+            }
+        }
+
+    private:
+        std::atomic<uint32_t> _epoch = 0;
+        std::atomic<uint32_t> _waiting_num = 0;
+    };
+
+
+    // 有界无锁环形队列, 默认为多生产者多消费者 (Vyukov MPMC).
+    // SingleProducerConsumer 为 true 时只允许一个生产者线程和一个消费者线程.
+    template <typename T, uint32_t Capacity, bool SingleProducerConsumer = false>
+    class BoundedQueue
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be power of 2.");
+
+        struct Cell
         {
-            std::shared_ptr<T> value;
-            std::unique_ptr<Node> next;
+            std::atomic<uint64_t> sequence;
+            T value;
         };
-    public:
-        ConcurrentQueue() : _head(std::make_unique<Node>()), _tail(_head.get()) {}     // 开头的DummyHead可以使Push()只访问尾节点
 
     public:
-        bool empty() const
+        BoundedQueue()
         {
-            std::lock_guard lock_guard(_head_mutex);
-            return _head.get() == get_tail();
+            for (uint64_t ix = 0; ix < Capacity; ++ix)
+            {
+                _cells[ix].sequence.store(ix, std::memory_order_relaxed);
+            }
         }
 
-        void push(T val)
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        template <typename U>
+        bool try_push(U&& value)
         {
-            std::shared_ptr<T> value = std::make_shared<T>(std::forward<T>(val));
-            std::unique_ptr<Node> new_node = std::make_unique<Node>();
-            Node* new_tail = new_node.get();
+            uint64_t pos = _push_pos.load(std::memory_order_relaxed);
+            Cell* cell = nullptr;
+            while (true)
             {
-                std::lock_guard lock_guard(_tail_mutex);
-                _tail->value = value;
-                _tail->next = std::move(new_node);
-                _tail = new_tail;
+                cell = &_cells[pos & (Capacity - 1)];
+                const uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+                const int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+
+                if (diff == 0)
+                {
+                    if (_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                }
+                else if (diff < 0)
+                {
+                    return false;   // 已满.
+                }
+                else
+                {
+                    pos = _push_pos.load(std::memory_order_relaxed);
+                }
             }
-            condition_variable.notify_one();
+
+            cell->value = std::forward<U>(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            _push_event.notify();
+            return true;
         }
 
-        bool try_pop(T& out_val)
+        bool try_pop(T& out_value)
         {
-            return try_pop_impl(out_val) != nullptr;
+            uint64_t pos = _pop_pos.load(std::memory_order_relaxed);
+            Cell* cell = nullptr;
+            while (true)
+            {
+                cell = &_cells[pos & (Capacity - 1)];
+                const uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+                const int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos + 1);
+
+                if (diff == 0)
+                {
+                    if (_pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                }
+                else if (diff < 0)
+                {
+                    return false;   // 为空.
+                }
+                else
+                {
+                    pos = _pop_pos.load(std::memory_order_relaxed);
+                }
+            }
+
+            out_value = std::move(cell->value);
+            cell->sequence.store(pos + Capacity, std::memory_order_release);
+            _pop_event.notify();
+            return true;
         }
 
-        std::shared_ptr<T> try_pop()
+        // 队列已满时阻塞.
+        template <typename U>
+        void wait_push(U&& value)
         {
-            std::unique_ptr<Node> popped_head = try_pop_impl();
-            return popped_head ? popped_head->value : nullptr;
+            _pop_event.wait_until([&]() { return try_push(std::forward<U>(value)); });
         }
 
-    private:
-        Node* get_tail() const
+        // 队列为空时阻塞.
+        void wait_pop(T& out_value)
         {
-            std::lock_guard lock_guard(_tail_mutex);
-            return _tail;
+            _push_event.wait_until([&]() { return try_pop(out_value); });
         }
 
-        std::unique_ptr<Node> pop()
+        bool empty() const
         {
-            std::unique_ptr<Node> ret = std::move(_head);
-            _head = std::move(ret->next);
-            return ret;
+            return size() == 0;
         }
 
+        // 只是一个近似值.
+        uint32_t size() const
+        {
+            const uint64_t push_pos = _push_pos.load(std::memory_order_relaxed);
+            const uint64_t pop_pos = _pop_pos.load(std::memory_order_relaxed);
+            return push_pos > pop_pos ? static_cast<uint32_t>(push_pos - pop_pos) : 0;
+        }
+
+        static constexpr uint32_t capacity() { return Capacity; }
 
     private:
-        std::unique_ptr<Node> try_pop_impl(T& out_val)
+        alignas(64) std::atomic<uint64_t> _push_pos = 0;
+        alignas(64) std::atomic<uint64_t> _pop_pos = 0;
+        alignas(64) QueueEvent _push_event;
+        alignas(64) QueueEvent _pop_event;
+        alignas(64) std::array<Cell, Capacity> _cells;
+    };
+
+    template <typename T, uint32_t Capacity>
+    class BoundedQueue<T, Capacity, true>
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be power of 2.");
+
+    public:
+        BoundedQueue() = default;
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        template <typename U>
+        bool try_push(U&& value)
         {
-            std::lock_guard lock_guard(_head_mutex);
+            const uint64_t push_pos = _push_pos.load(std::memory_order_relaxed);
+            if (push_pos - _cached_pop_pos >= Capacity)
+            {
+                _cached_pop_pos = _pop_pos.load(std::memory_order_acquire);
+                if (push_pos - _cached_pop_pos >= Capacity) return false;
+            }
 
-            if (_head.get() == get_tail())
+            _values[push_pos & (Capacity - 1)] = std::forward<U>(value);
+            _push_pos.store(push_pos + 1, std::memory_order_release);
+            _push_event.notify();
+            return true;
+        }
+
+        bool try_pop(T& out_value)
+        {
+            const uint64_t pop_pos = _pop_pos.load(std::memory_order_relaxed);
+            if (pop_pos == _cached_push_pos)
             {
-                return nullptr;
+                _cached_push_pos = _push_pos.load(std::memory_order_acquire);
+                if (pop_pos == _cached_push_pos) return false;
             }
 
-            out_val = std::move(*_head->value);
+            out_value = std::move(_values[pop_pos & (Capacity - 1)]);
+            _pop_pos.store(pop_pos + 1, std::memory_order_release);
+            _pop_event.notify();
+            return true;
+        }
 
-            return pop();
+        template <typename U>
+        void wait_push(U&& value)
+        {
+            _pop_event.wait_until([&]() { return try_push(std::forward<U>(value)); });
         }
 
+        void wait_pop(T& out_value)
+        {
+            _push_event.wait_until([&]() { return try_pop(out_value); });
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
 
-        std::unique_ptr<Node> try_pop_impl()
+        uint32_t size() const
         {
-            std::lock_guard lock_guard(_head_mutex);
+            const uint64_t push_pos = _push_pos.load(std::memory_order_relaxed);
+            const uint64_t pop_pos = _pop_pos.load(std::memory_order_relaxed);
+            return push_pos > pop_pos ? static_cast<uint32_t>(push_pos - pop_pos) : 0;
+        }
+
+        static constexpr uint32_t capacity() { return Capacity; }
+
+    private:
+        // 生产者独占的缓存行.
+        alignas(64) std::atomic<uint64_t> _push_pos = 0;
+        uint64_t _cached_pop_pos = 0;
+
+        // 消费者独占的缓存行.
+        alignas(64) std::atomic<uint64_t> _pop_pos = 0;
+        uint64_t _cached_push_pos = 0;
 
-            if (_head.get() == get_tail())
+        alignas(64) QueueEvent _push_event;
+        alignas(64) QueueEvent _pop_event;
+        alignas(64) std::array<T, Capacity> _values;
+    };
+
+
+    // Chase-Lev 工作窃取队列, 容量固定.
+    // 只有拥有者线程可以调用 push()/pop() (后进先出), 其它线程通过 steal() 从另一端取 (先进先出).
+    template <typename T, uint32_t Capacity>
+    class WorkStealingQueue
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be power of 2.");
+        static_assert(std::is_trivially_copyable_v<T>, "WorkStealingQueue only holds trivially copyable values.");
+
+    public:
+        bool push(T value)
+        {
+            const int64_t bottom = _bottom.load(std::memory_order_relaxed);
+            const int64_t top = _top.load(std::memory_order_acquire);
+            if (bottom - top >= static_cast<int64_t>(Capacity)) return false;
+
+            _buffer[bottom & (Capacity - 1)].store(value, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        bool pop(T& out_value)
+        {
+            const int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t top = _top.load(std::memory_order_relaxed);
+
+            if (top > bottom)
             {
-                return nullptr;
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return false;
             }
 
-            return pop();
+            out_value = _buffer[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (top != bottom) return true;
+
+            // 只剩最后一个元素, 和 steal() 竞争.
+            const bool success = _top.compare_exchange_strong(
+                top, 
+                top + 1, 
+                std::memory_order_seq_cst, 
+                std::memory_order_relaxed
+            );
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return success;
         }
 
+        bool steal(T& out_value)
+        {
+            int64_t top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t bottom = _bottom.load(std::memory_order_acquire);
 
-    private:
-        std::unique_ptr<Node> _head;
-        Node* _tail;
+            if (top >= bottom) return false;
 
-        mutable std::mutex _head_mutex;
-        mutable std::mutex _tail_mutex;
+            T value = _buffer[top & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return false;
+            }
+            out_value = value;
+            return true;
+        }
 
-    public:
-        std::condition_variable condition_variable;
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        // 只是一个近似值.
+        uint32_t size() const
+        {
+            const int64_t bottom = _bottom.load(std::memory_order_relaxed);
+            const int64_t top = _top.load(std::memory_order_relaxed);
+            return bottom > top ? static_cast<uint32_t>(bottom - top) : 0;
+        }
+
+    private:
+        alignas(64) std::atomic<int64_t> _top = 0;
+        alignas(64) std::atomic<int64_t> _bottom = 0;
+        alignas(64) std::array<std::atomic<T>, Capacity> _buffer;
     };
 
 }
@@ -1,100 +1,323 @@
 #include "bit_allocator.h"
 #include "../math/common.h"
 #include "../tools/log.h"
-#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <cassert>
 
 namespace fantasy
 {
+    static const uint64_t full_word = ~0ull;
+
+    // [begin, end) 在所在 word 内的掩码, begin 和 end 位于同一个 word.
+    static uint64_t get_word_mask(uint64_t begin, uint64_t end)
+    {
+        const uint64_t count = end - begin;
+        const uint64_t mask = count == 64 ? full_word : ((1ull << count) - 1);
+        return mask << (begin & 63);
+    }
+
     BitSetAllocator::BitSetAllocator(uint64_t size, bool multi_thread) : _multi_threaded(multi_thread)
     {
-        _allocateds.resize(align(size, 32ull) / 32ull, 0);
+        resize(size);
     }
 
     uint32_t BitSetAllocator::allocate()
     {
-        if (_multi_threaded) _mutex.lock();
-
-        uint32_t ret = 0;
-        
-        uint32_t id = _next_avaiable >> 5;
-        uint32_t bit_index =  _next_avaiable & 31;
-        uint32_t find_index = 0;
-        for (uint32_t ix = 0; ix < _allocateds.size(); ++ix)
+        const uint32_t top = static_cast<uint32_t>(_levels.size() - 1);
+        while (true)
         {
-            const uint32_t pos = (id + ix) % _allocateds.size();
+            if (_levels[top].words[0].load() == full_word) return INVALID_SIZE_32;
 
-            for (uint32_t jx = bit_index; jx < 32; ++jx)
+            // 从顶层沿未满的位向下找到叶子 word.
+            // 上层的位可能因并发已经过时, 遇到已满的 word 时修正上层的位后重新查找.
+            uint64_t index = 0;
+            bool found = true;
+            for (uint32_t level = top; level > 0; --level)
             {
-                if (!(_allocateds[pos] & (1 << jx)))
+                const uint64_t word = _levels[level].words[index].load();
+                if (word == full_word)
                 {
-                    ret = pos;
-                    _next_avaiable = (id << 5) + jx + 1;
-                    _allocateds[pos] |= (1 << jx);
-                    find_index = jx;
+                    mark_full(level + 1, index);
+                    found = false;
                     break;
                 }
+                index = index * 64 + std::countr_one(word);
             }
-            bit_index = 0;
+            if (!found) continue;
+
+            std::atomic<uint64_t>& leaf = _levels[0].words[index];
+            uint64_t word = leaf.load();
+            while (word != full_word)
+            {
+                const uint64_t bit = ~word & (word + 1);
+                if (compare_exchange(leaf, word, word | bit))
+                {
+                    if ((word | bit) == full_word) mark_full(1, index);
+                    return static_cast<uint32_t>(index * 64 + std::countr_zero(bit));
+                }
+            }
+            mark_full(1, index);
         }
+    }
+
+    uint32_t BitSetAllocator::allocate_range(uint32_t count)
+    {
+        if (count == 0) return INVALID_SIZE_32;
+        if (count == 1) return allocate();
 
-        if (_multi_threaded) _mutex.unlock();
+        while (true)
+        {
+            const uint64_t index = find_range(count);
+            if (index == INVALID_SIZE_64) return INVALID_SIZE_32;
 
-        return (ret << 5) + find_index;
+            // 查找和占用之间区间可能被其它线程占用, 此时重新查找.
+            if (set_bits(index, count, true)) return static_cast<uint32_t>(index);
+        }
     }
 
     bool BitSetAllocator::release(uint32_t index)
     {
-        uint32_t id = index >> 5;
-        uint32_t bit_index =  index & 31;
-        if (id < static_cast<uint32_t>(_allocateds.size()))
-        {
-            if (_multi_threaded) _mutex.lock();
+        return release_range(index, 1);
+    }
 
-            _allocateds[id] &= ~(1 << bit_index);
-            _next_avaiable = std::min(_next_avaiable, index);   
-            
-            if (_multi_threaded) _mutex.unlock();
-        }
-        else
+    bool BitSetAllocator::release_range(uint32_t index, uint32_t count)
+    {
+        if (static_cast<uint64_t>(index) + count > _size)
         {
             LOG_ERROR("invalid bit set Index.");
             return false;
         }
-        return true;
+        return clear_bits(index, count);
     }
 
     void BitSetAllocator::resize(uint64_t size)
     {
-        _allocateds.clear();
-        _allocateds.resize(align(size, 32ull) / 32ull, 0);
-    }
+        const uint64_t leaf_word_count = std::max<uint64_t>((size + 63) / 64, 1);
+
+        std::unique_ptr<std::atomic<uint64_t>[]> leaf_words = std::make_unique<std::atomic<uint64_t>[]>(leaf_word_count);
+        for (uint64_t ix = 0; ix < leaf_word_count; ++ix)
+        {
+            // 旧容量之外的位是填充位, 需要清除.
+            uint64_t word = 0;
+            if (!_levels.empty() && ix * 64 < _size)
+            {
+                word = _levels[0].words[ix].load() & get_word_mask(ix * 64, std::min(_size, ix * 64 + 64));
+            }
+
+            // 新容量之外的位标记为已分配, 这样已满的 word 总是 full_word.
+            if (ix * 64 + 64 > size) word |= ~get_word_mask(ix * 64, std::max(size, ix * 64)) & full_word;
 
+            leaf_words[ix].store(word, std::memory_order_relaxed);
+        }
+
+        _size = size;
+        _levels.clear();
+        _levels.push_back(Level{ .words = std::move(leaf_words), .word_count = leaf_word_count });
+        build_levels(leaf_word_count);
+    }
 
     uint64_t BitSetAllocator::get_capacity() const
     {
-        return _allocateds.size() * 32ull;
+        return _size;
     }
 
-    
     void BitSetAllocator::set_true(uint32_t index)
     {
-        uint32_t id = index >> 5;
-        uint32_t bit_index =  index & 31;
-        _allocateds[id] |= (1 << bit_index);
+        assert(index < _size);
+        set_bits(index, 1, false);
     }
 
     void BitSetAllocator::set_false(uint32_t index)
     {
-        uint32_t id = index >> 5;
-        uint32_t bit_index =  index & 31;
-        _allocateds[id] &= ~(1 << bit_index);
+        assert(index < _size);
+        clear_bits(index, 1);
     }
 
-    bool BitSetAllocator::operator[](uint32_t index)
+    bool BitSetAllocator::operator[](uint32_t index) const
     {
-        uint32_t id = index >> 5;
-        uint32_t bit_index =  index & 31;
-        return static_cast<bool>((_allocateds[id] >> bit_index) & 1);
+        assert(index < _size);
+        return static_cast<bool>((_levels[0].words[index >> 6].load(std::memory_order_relaxed) >> (index & 63)) & 1);
+    }
+
+    void BitSetAllocator::build_levels(uint64_t leaf_word_count)
+    {
+        uint64_t child_count = leaf_word_count;
+        while (child_count > 1)
+        {
+            const Level& child = _levels.back();
+
+            Level level;
+            level.word_count = (child_count + 63) / 64;
+            level.words = std::make_unique<std::atomic<uint64_t>[]>(level.word_count);
+            for (uint64_t ix = 0; ix < level.word_count; ++ix)
+            {
+                uint64_t word = 0;
+                for (uint64_t jx = 0; jx < 64; ++jx)
+                {
+                    const uint64_t child_index = ix * 64 + jx;
+                    if (child_index >= child_count || child.words[child_index].load(std::memory_order_relaxed) == full_word)
+                    {
+                        word |= 1ull << jx;
+                    }
+                }
+                level.words[ix].store(word, std::memory_order_relaxed);
+            }
+
+            child_count = level.word_count;
+            _levels.push_back(std::move(level));
+        }
     }
 
-}
\ No newline at end of file
+    uint64_t BitSetAllocator::find_range(uint32_t count) const
+    {
+        const Level& leaf = _levels[0];
+
+        uint64_t run_start = 0;
+        uint64_t run_length = 0;
+        for (uint64_t ix = 0; ix < leaf.word_count; ++ix)
+        {
+            // 第 1 层的 word 已满时跳过对应的 64 个叶子 word.
+            if ((ix & 63) == 0 && _levels.size() > 1 && _levels[1].words[ix >> 6].load() == full_word)
+            {
+                run_length = 0;
+                ix += 63;
+                continue;
+            }
+
+            const uint64_t free = ~leaf.words[ix].load();
+            if (run_length == 0) run_start = ix * 64;
+
+            if (free == full_word)
+            {
+                run_length += 64;
+                if (run_length >= count) return run_start;
+                continue;
+            }
+
+            // 接上前一个 word 末尾的空闲区间.
+            if (run_length + std::countr_one(free) >= count) return run_start;
+
+            // 在 word 内查找, starts 的第 i 位表示从 i 开始至少有 length 个连续空闲位.
+            if (count <= 64)
+            {
+                uint64_t starts = free;
+                for (uint32_t length = 1; length < count && starts != 0;)
+                {
+                    const uint32_t shift = std::min(length, count - length);
+                    starts &= starts >> shift;
+                    length += shift;
+                }
+                if (starts != 0) return ix * 64 + std::countr_zero(starts);
+            }
+
+            run_length = std::countl_one(free);
+            run_start = ix * 64 + 64 - run_length;
+        }
+        return INVALID_SIZE_64;
+    }
+
+    bool BitSetAllocator::set_bits(uint64_t index, uint64_t count, bool fail_if_set)
+    {
+        const uint64_t end = index + count;
+        for (uint64_t begin = index; begin < end;)
+        {
+            const uint64_t word_index = begin >> 6;
+            const uint64_t word_end = std::min(end, (word_index + 1) * 64);
+            const uint64_t mask = get_word_mask(begin, word_end);
+
+            std::atomic<uint64_t>& leaf = _levels[0].words[word_index];
+            uint64_t word = leaf.load();
+            if (fail_if_set)
+            {
+                do
+                {
+                    if (word & mask)
+                    {
+                        // 回滚已经占用的部分.
+                        if (begin > index) clear_bits(index, begin - index);
+                        return false;
+                    }
+                } while (!compare_exchange(leaf, word, word | mask));
+            }
+            else
+            {
+                word = fetch_or(leaf, mask);
+            }
+
+            if (word != full_word && (word | mask) == full_word) mark_full(1, word_index);
+            begin = word_end;
+        }
+        return true;
+    }
+
+    bool BitSetAllocator::clear_bits(uint64_t index, uint64_t count)
+    {
+        bool all_set = true;
+
+        const uint64_t end = index + count;
+        for (uint64_t begin = index; begin < end;)
+        {
+            const uint64_t word_index = begin >> 6;
+            const uint64_t word_end = std::min(end, (word_index + 1) * 64);
+            const uint64_t mask = get_word_mask(begin, word_end);
+
+            const uint64_t word = fetch_and(_levels[0].words[word_index], ~mask);
+            if (word == full_word) mark_not_full(1, word_index);
+            if ((word & mask) != mask) all_set = false;
+
+            begin = word_end;
+        }
+        return all_set;
+    }
+
+    void BitSetAllocator::mark_full(uint32_t level, uint64_t child_index)
+    {
+        if (level >= _levels.size()) return;
+
+        const uint64_t bit = 1ull << (child_index & 63);
+        const uint64_t word = fetch_or(_levels[level].words[child_index >> 6], bit);
+        if (word != full_word && (word | bit) == full_word) mark_full(level + 1, child_index >> 6);
+
+        // 设置之前下层可能已经有位被释放, 释放者看到的上层位还未设置, 所以这里需要重新检查.
+        if (_multi_threaded && _levels[level - 1].words[child_index].load() != full_word)
+        {
+            mark_not_full(level, child_index);
+        }
+    }
+
+    void BitSetAllocator::mark_not_full(uint32_t level, uint64_t child_index)
+    {
+        if (level >= _levels.size()) return;
+
+        const uint64_t bit = 1ull << (child_index & 63);
+        const uint64_t word = fetch_and(_levels[level].words[child_index >> 6], ~bit);
+        if (word == full_word) mark_not_full(level + 1, child_index >> 6);
+    }
+
+    uint64_t BitSetAllocator::fetch_or(std::atomic<uint64_t>& word, uint64_t mask) const
+    {
+        if (_multi_threaded) return word.fetch_or(mask);
+
+        const uint64_t old = word.load(std::memory_order_relaxed);
+        word.store(old | mask, std::memory_order_relaxed);
+        return old;
+    }
+
+    uint64_t BitSetAllocator::fetch_and(std::atomic<uint64_t>& word, uint64_t mask) const
+    {
+        if (_multi_threaded) return word.fetch_and(mask);
+
+        const uint64_t old = word.load(std::memory_order_relaxed);
+        word.store(old & mask, std::memory_order_relaxed);
+        return old;
+    }
+
+    bool BitSetAllocator::compare_exchange(std::atomic<uint64_t>& word, uint64_t& expected, uint64_t desired) const
+    {
+        if (_multi_threaded) return word.compare_exchange_weak(expected, desired);
+
+        word.store(desired, std::memory_order_relaxed);
+        return true;
+    }
+}
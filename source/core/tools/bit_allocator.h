@@ -2,35 +2,66 @@
 #define TOOLS_BIT_ALLOCATOR_H
 
 
-#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <vector>
-#include <cassert>
-#include <mutex>
 
 namespace fantasy
 {
+    // 分层位图分配器, 第 0 层每一位对应一个 slot, 上层每一位表示下层对应的 word 是否已满.
+    // 分配时从顶层沿未满的位向下查找, 每层只需要一次 find-first-set, 不随占用率线性增长.
+    // multi_thread 为 true 时 allocate/release 通过 CAS 实现无锁, resize 不能与其它操作并发.
     class BitSetAllocator
     {
     public:
         BitSetAllocator(uint64_t size, bool multi_thread = true);
 
+        // 没有空闲位时返回 INVALID_SIZE_32.
         uint32_t allocate();
+
+        // 分配 count 个连续的位, 返回第一位的序号, 用于 descriptor table 等连续的区间.
+        uint32_t allocate_range(uint32_t count);
+
+        // 释放未分配的位时返回 false.
         bool release(uint32_t index);
-        
+        bool release_range(uint32_t index, uint32_t count);
+
+        // 保留 [0, min(旧容量, size)) 内已分配的位.
         void resize(uint64_t size);
         uint64_t get_capacity() const;
 
         void set_true(uint32_t index);
         void set_false(uint32_t index);
 
-        bool operator[](uint32_t index);
+        bool operator[](uint32_t index) const;
+
+    private:
+        struct Level
+        {
+            std::unique_ptr<std::atomic<uint64_t>[]> words;
+            uint64_t word_count = 0;
+        };
+
+        void build_levels(uint64_t leaf_word_count);
+
+        uint64_t find_range(uint32_t count) const;
+        bool set_bits(uint64_t index, uint64_t count, bool fail_if_set);
+        bool clear_bits(uint64_t index, uint64_t count);
+
+        void mark_full(uint32_t level, uint64_t child_index);
+        void mark_not_full(uint32_t level, uint64_t child_index);
+
+        uint64_t fetch_or(std::atomic<uint64_t>& word, uint64_t mask) const;
+        uint64_t fetch_and(std::atomic<uint64_t>& word, uint64_t mask) const;
+        bool compare_exchange(std::atomic<uint64_t>& word, uint64_t& expected, uint64_t desired) const;
 
     private:
-        std::mutex _mutex;
         bool _multi_threaded;
-        
-        uint32_t _next_avaiable = 0;   // 记录下一个可能未被分配的位
-        std::vector<uint32_t> _allocateds;
+        uint64_t _size = 0;
+
+        // _levels.back() 只有一个 word.
+        std::vector<Level> _levels;
     };
 }
 
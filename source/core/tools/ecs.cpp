@@ -1,10 +1,171 @@
 #include "ecs.h"
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <memory>
+#include <new>
 
 
 namespace fantasy 
 {
+    namespace
+    {
+        std::array<ComponentInfo, MAX_COMPONENT_TYPE_NUM> component_infos;
+        std::atomic<uint32_t> component_type_num = 0;
+        std::atomic<uint32_t> query_num = 0;
+        std::atomic<uint32_t> event_type_num = 0;
+
+        thread_local const SystemAccess* current_system_access = nullptr;
+
+        bool tick_system(EntitySystemInterface* system, const SystemAccess& access, float delta)
+        {
+            const SystemAccess* last_access = current_system_access;
+            current_system_access = &access;
+            bool success = system->tick(delta);
+            current_system_access = last_access;
+            return success;
+        }
+    }
+
+    uint32_t ComponentRegistry::register_component(const ComponentInfo& info)
+    {
+        const uint32_t id = component_type_num.fetch_add(1, std::memory_order_relaxed);
+        if (id >= MAX_COMPONENT_TYPE_NUM)
+        {
+            // ComponentMask 和 Archetype 的列索引都是定长数组, 无法继续运行, release 下同样终止.
+            LOG_CRITICAL("Component type num exceeds MAX_COMPONENT_TYPE_NUM.");
+            std::abort();
+        }
+        component_infos[id] = info;
+        return id;
+    }
+
+    const ComponentInfo& ComponentRegistry::get_info(uint32_t id)
+    {
+        return component_infos[id];
+    }
+
+    uint32_t ComponentRegistry::get_component_type_num()
+    {
+        return std::min(component_type_num.load(std::memory_order_relaxed), MAX_COMPONENT_TYPE_NUM);
+    }
+
+    uint32_t EntityQueryRegistry::allocate_id()
+    {
+        return query_num.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t EventTypeRegistry::allocate_id()
+    {
+        return event_type_num.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t EventTypeRegistry::get_event_type_num()
+    {
+        return event_type_num.load(std::memory_order_relaxed);
+    }
+
+
+    Archetype::Archetype(const ComponentMask& mask) : _mask(mask)
+    {
+        _column_indices.fill(INVALID_SIZE_32);
+
+        uint32_t row_size = sizeof(Entity*);
+        _chunk_alignment = alignof(Entity*);
+        for (uint32_t id = 0; id < MAX_COMPONENT_TYPE_NUM; ++id)
+        {
+            if (!mask.test(id)) continue;
+
+            const ComponentInfo& info = ComponentRegistry::get_info(id);
+            _column_indices[id] = static_cast<uint32_t>(_column_component_ids.size());
+            _column_component_ids.push_back(id);
+            _column_sizes.push_back(info.size);
+
+            row_size += info.size + sizeof(ComponentTicks);
+            _chunk_alignment = std::max(_chunk_alignment, info.alignment);
+        }
+
+        _chunk_capacity = std::max(1u, chunk_byte_size / row_size);
+
+        uint32_t offset = sizeof(Entity*) * _chunk_capacity;
+        for (uint32_t column = 0; column < _column_component_ids.size(); ++column)
+        {
+            const uint32_t alignment = ComponentRegistry::get_info(_column_component_ids[column]).alignment;
+            offset = (offset + alignment - 1) / alignment * alignment;
+            _column_offsets.push_back(offset);
+            offset += _column_sizes[column] * _chunk_capacity;
+        }
+
+        offset = (offset + alignof(ComponentTicks) - 1) / alignof(ComponentTicks) * alignof(ComponentTicks);
+        for (uint32_t column = 0; column < _column_component_ids.size(); ++column)
+        {
+            _tick_offsets.push_back(offset);
+            offset += sizeof(ComponentTicks) * _chunk_capacity;
+        }
+        _chunk_size = offset;
+    }
+
+    Archetype::~Archetype()
+    {
+        for (uint32_t row = 0; row < _entity_num; ++row)
+        {
+            for (uint32_t column = 0; column < _column_component_ids.size(); ++column)
+            {
+                ComponentRegistry::get_info(_column_component_ids[column]).destruct(get_component(column, row));
+            }
+        }
+
+        for (uint8_t* chunk : _chunks)
+        {
+            ::operator delete(chunk, std::align_val_t(_chunk_alignment));
+        }
+    }
+
+    uint32_t Archetype::allocate_row(Entity* entity)
+    {
+        if (_entity_num == _chunks.size() * _chunk_capacity)
+        {
+            _chunks.push_back(static_cast<uint8_t*>(::operator new(_chunk_size, std::align_val_t(_chunk_alignment))));
+            _chunk_changed_ticks.resize(_chunks.size() * get_column_num(), 0);
+        }
+
+        const uint32_t row = _entity_num++;
+        set_entity(row, entity);
+        return row;
+    }
+
+    Entity* Archetype::remove_row(uint32_t row)
+    {
+        const uint32_t last_row = _entity_num - 1;
+
+        Entity* moved_entity = nullptr;
+        if (row != last_row)
+        {
+            for (uint32_t column = 0; column < _column_component_ids.size(); ++column)
+            {
+                ComponentRegistry::get_info(_column_component_ids[column]).relocate(
+                    get_component(column, row),
+                    get_component(column, last_row)
+                );
+                set_ticks(column, row, get_ticks(column, last_row));
+            }
+            moved_entity = get_entity(last_row);
+            set_entity(row, moved_entity);
+        }
+        _entity_num--;
+
+        // 保留一个空 chunk, 避免在边界上反复分配.
+        while (_chunks.size() > get_chunk_num() + 1)
+        {
+            ::operator delete(_chunks.back(), std::align_val_t(_chunk_alignment));
+            _chunks.pop_back();
+        }
+        _chunk_changed_ticks.resize(_chunks.size() * get_column_num());
+
+        return moved_entity;
+    }
+
+
     Entity::Entity(World* world, uint64_t stID) : _world(world), _index(stID)
     {
     }
@@ -23,15 +184,86 @@ namespace fantasy
 
     void Entity::remove_all()
     {
-        for (const auto& [type_index, component] : _components)
+        const uint32_t component_type_num = ComponentRegistry::get_component_type_num();
+        for (uint32_t id = 0; id < component_type_num; ++id)
         {
-            component->removed(this);
+            if (_mask.test(id)) ComponentRegistry::get_info(id).broadcast_removed(this, get_component_data(id));
         }
 
-		{
-			std::lock_guard lock(_component_mutex);
-            _components.clear();   
-		}
+        if (_is_staged)
+        {
+            std::lock_guard lock(_component_mutex);
+            for (const auto& component : _staged_components)
+            {
+                const ComponentInfo& info = ComponentRegistry::get_info(component.id);
+                info.destruct(component.data);
+                ::operator delete(component.data, std::align_val_t(info.alignment));
+            }
+            _staged_components.clear();
+            _mask.reset();
+        }
+        else if (_archetype)
+        {
+            _world->remove_all_components(this);
+        }
+    }
+
+    void* Entity::get_component_data(uint32_t id) const
+    {
+        if (_is_staged)
+        {
+            for (const auto& component : _staged_components)
+            {
+                if (component.id == id) return component.data;
+            }
+            return nullptr;
+        }
+        return _archetype->get_component(_archetype->get_column_index(id), _row);
+    }
+
+    void* Entity::add_component(uint32_t id)
+    {
+        if (!_is_staged) return _world->add_component(this, id);
+
+        const ComponentInfo& info = ComponentRegistry::get_info(id);
+        void* data = ::operator new(info.size, std::align_val_t(info.alignment));
+        {
+            std::lock_guard lock(_component_mutex);
+            _staged_components.push_back(StagedComponent{ .id = id, .data = data });
+            _mask.set(id);
+        }
+        return data;
+    }
+
+    void Entity::remove_component(uint32_t id)
+    {
+        if (!_is_staged) 
+        {
+            _world->remove_component(this, id);
+            return;
+        }
+
+        std::lock_guard lock(_component_mutex);
+        for (auto iter = _staged_components.begin(); iter != _staged_components.end(); ++iter)
+        {
+            if (iter->id == id)
+            {
+                const ComponentInfo& info = ComponentRegistry::get_info(id);
+                info.destruct(iter->data);
+                ::operator delete(iter->data, std::align_val_t(info.alignment));
+                _staged_components.erase(iter);
+                break;
+            }
+        }
+        _mask.reset(id);
+    }
+
+
+    // 延迟加入的实体在加入 World 时统一记录为新增.
+    void Entity::mark_component_changed(uint32_t id)
+    {
+        if (_is_staged || !_archetype) return;
+        _archetype->set_changed_tick(_archetype->get_column_index(id), _row, _world->get_change_tick());
     }
 
 
@@ -39,108 +271,234 @@ namespace fantasy
     {
         for (auto& system : _systems) assert(system->destroy());
 
-        for (auto& entity : _entities)
+        reset();
+        for (Entity* entity : _delay_entities) free_entity(entity);
+        _delay_entities.clear();
+
+        for (auto& system : _systems) system.reset();
+
+        for (auto& queue : _event_queues) delete queue.exchange(nullptr);
+    }
+
+    Entity* World::allocate_entity()
+    {
+        uint32_t index = _free_slot_head;
+        if (index != INVALID_SIZE_32)
         {
-            if (!entity->is_pending_destroy())
+            _free_slot_head = _entity_slots[index].next_free_slot;
+            _entity_slots[index].next_free_slot = INVALID_SIZE_32;
+        }
+        else 
+        {
+            assert(_entity_slots.size() <= EntityHandle::max_index);
+
+            index = static_cast<uint32_t>(_entity_slots.size());
+            _entity_slots.emplace_back();
+            if (index / entity_block_size >= _entity_blocks.size())
             {
-                entity->_is_pending_destroy = true;
+                _entity_blocks.emplace_back(std::make_unique<EntityBlock>());
             }
         }
-        _entities.clear();
 
-        for (auto& system : _systems) system.reset();
+        uint8_t* data = _entity_blocks[index / entity_block_size]->data + sizeof(Entity) * (index % entity_block_size);
+        Entity* entity = new (data) Entity(this, index);
+        entity->_generation = _entity_slots[index].generation;
+        _alive_entity_num++;
+        return entity;
     }
 
-    Entity* World::create_entity()
+    void World::free_entity(Entity* entity)
     {
-        uint64_t index = _entities.size();
-        _entities.emplace_back(std::make_unique<Entity>(this, index));
+        const uint32_t index = static_cast<uint32_t>(entity->_index);
+
+        // 析构时会发送 OnComponentRemoved, 此时实体仍然可以通过句柄找到.
+        entity->~Entity();
+
+        EntitySlot& slot = _entity_slots[index];
+        slot.entity = nullptr;
+        slot.generation++;
+        slot.next_free_slot = _free_slot_head;
+        _free_slot_head = index;
+        _alive_entity_num--;
+    }
 
-        return _entities.back().get();
+    Entity* World::create_entity()
+    {
+        Entity* entity = allocate_entity();
+        _entity_slots[entity->_index].entity = entity;
+        return entity;
     }
 
     bool World::destroy_entity(Entity* entity, bool immediately)
     {
-        auto CompareFunc = [&entity](const auto& crpEntity) -> bool
+        ReturnIfFalse(
+            entity && 
+            entity->_world == this && 
+            entity->_index < _entity_slots.size() && 
+            _entity_slots[entity->_index].entity == entity
+        );
+
+        if (!entity->is_pending_destroy())
         {
-            return crpEntity.get() == entity;
-        };
+            entity->_is_pending_destroy = true;
+            if (!immediately) _pending_destroy_entities.push_back(entity->get_handle());
+        }
 
-        ReturnIfFalse(entity && std::find_if(_entities.begin(), _entities.end(), CompareFunc) != _entities.end());
+        if (immediately) free_entity(entity);
+        return true;
+    }
+
+    // 延迟加入的实体已经占用 slot, 但在 add_delay_entity 之前不会被遍历到.
+    Entity* World::create_entity_delay()
+    {
+        Entity* entity = allocate_entity();
+        entity->_is_staged = true;
+        _delay_entities.push_back(entity);
+        return entity;
+    }
 
-        if (entity->is_pending_destroy())
+    void World::add_delay_entity(Entity* entity)
+    {
+        commit_staged_components(entity);
+
+        _delay_entities.erase(std::remove(_delay_entities.begin(), _delay_entities.end(), entity), _delay_entities.end());
+        _entity_slots[entity->_index].entity = entity;
+    }
+
+    bool World::tick(float delta)
+    {
+        prune_removed_components();
+        cleanup();
+        flush_events();
+
+        if (parallel::get_thread_pool() == nullptr)
         {
-			if (immediately) 
+            // 串行执行时同样检查 parallel_each 的访问是否已经声明.
+            for (const auto& system : _systems)
             {
-                _entities.erase(std::remove_if(_entities.begin(), _entities.end(), CompareFunc), _entities.end());
+                tick_system(system.get(), system->get_access(), delta);
             }
             return true;
         }
 
-        entity->_is_pending_destroy = true;
-        
-        if (immediately) 
+        if (_system_schedule_dirty) build_system_schedule();
+
+        _tick_delta = delta;
+        for (auto& stage : _system_stages)
         {
-            _entities.erase(std::remove_if(_entities.begin(), _entities.end(), CompareFunc), _entities.end());
+            if (stage.exclusive_system) 
+            {
+                stage.exclusive_system->tick(delta);
+            }
+            else 
+            {
+                parallel::run(stage.flow);
+            }
         }
         return true;
     }
 
-    Entity* World::create_entity_delay()
+    bool World::flush_events()
     {
-        uint64_t index = _delay_entities.size();
-        _delay_entities.emplace_back(std::make_unique<Entity>(this, index));
+        static const std::vector<IEventSubscriber*> empty_subscribers;
 
-        return _delay_entities.back().get();
+        bool success = true;
+        const uint32_t event_type_num = std::min(EventTypeRegistry::get_event_type_num(), MAX_EVENT_TYPE_NUM);
+        for (uint32_t id = 0; id < event_type_num; ++id)
+        {
+            EventQueueInterface* queue = _event_queues[id].load(std::memory_order_acquire);
+            if (queue == nullptr) continue;
+
+            // 没有订阅者时事件直接丢弃.
+            success &= queue->flush(this, id < _subscribers.size() ? _subscribers[id] : empty_subscribers);
+        }
+        return success;
     }
 
-    void World::add_delay_entity(Entity* entity)
+    void World::build_system_schedule()
     {
-        uint64_t index = entity->_index;
-        entity->_index = _entities.size();
-        _entities.emplace_back(std::move(_delay_entities[index]));
+        _system_stages.clear();
+
+        std::vector<std::pair<EntitySystemInterface*, SystemAccess>> stage_systems;
+        auto flush_stage = [&]()
+        {
+            if (stage_systems.empty()) return;
+
+            SystemStage& stage = _system_stages.emplace_back();
+
+            std::vector<Task> tasks;
+            for (const auto& [system, access] : stage_systems)
+            {
+                tasks.push_back(stage.flow.Emplace(
+                    [this, system, access]() -> bool 
+                    { 
+                        // 与串行执行时一样, 单个 system 的失败不影响其它 system.
+                        tick_system(system, access, _tick_delta);
+                        return true;
+                    }
+                ));
+            }
+
+            // 按注册顺序, 后注册的 system 依赖之前与它冲突的 system.
+            for (uint32_t ix = 0; ix < stage_systems.size(); ++ix)
+            {
+                for (uint32_t jx = 0; jx < ix; ++jx)
+                {
+                    if (stage_systems[ix].second.conflict(stage_systems[jx].second)) tasks[jx].precede(tasks[ix]);
+                }
+            }
+            stage_systems.clear();
+        };
+
+        for (const auto& system : _systems)
+        {
+            SystemAccess access = system->get_access();
+            if (access.exclusive)
+            {
+                flush_stage();
+                _system_stages.emplace_back().exclusive_system = system.get();
+            }
+            else 
+            {
+                stage_systems.emplace_back(system.get(), access);
+            }
+        }
+        flush_stage();
+
+        _system_schedule_dirty = false;
     }
 
-    bool World::tick(float delta)
+    bool World::check_system_access(const SystemAccess& access)
     {
-        cleanup();
-        for (const auto& system : _systems)
+        if (current_system_access && !current_system_access->contain(access))
         {
-            system->tick(delta);
+            LOG_ERROR("World::parallel_each accesses components which are not declared by the running system.");
+            return false;
         }
         return true;
     }
 
     void World::cleanup()
     {
-        _entities.erase(
-            std::remove_if(
-                _entities.begin(), 
-                _entities.end(), 
-                [this](auto& crpEntity)
-                {
-                    if (crpEntity->is_pending_destroy())
-                    {
-                        crpEntity.reset();
-                        return true;
-                    }
-                    return false;
-                }
-            ),
-            _entities.end()
-        );
+        for (const auto& handle : _pending_destroy_entities)
+        {
+            // 已经被立即销毁的实体句柄会过期.
+            if (Entity* entity = get_entity(handle)) free_entity(entity);
+        }
+        _pending_destroy_entities.clear();
     }
 
     bool World::reset()
     {
-        for (auto& entity : _entities)
+        for (uint64_t ix = 0; ix < _entity_slots.size(); ++ix)
         {
-            if (!entity->is_pending_destroy())
+            if (Entity* entity = _entity_slots[ix].entity)
             {
                 entity->_is_pending_destroy = true;
+                free_entity(entity);
             }
         }
-        _entities.clear();
+        _pending_destroy_entities.clear();
         return true;
     }
 
@@ -154,6 +512,7 @@ namespace fantasy
         }
 
         _systems.emplace_back(system);
+        _system_schedule_dirty = true;
         return system;
     }
 
@@ -172,6 +531,7 @@ namespace fantasy
             ), 
             _systems.end()
         );
+        _system_schedule_dirty = true;
         return true;
     }
 
@@ -192,6 +552,7 @@ namespace fantasy
         {
             disabled_systems.push_back(std::move(*iter));
             _systems.erase(iter);
+            _system_schedule_dirty = true;
         }
     }
 
@@ -212,7 +573,185 @@ namespace fantasy
         {
             _systems.push_back(std::move(*iter));
             disabled_systems.erase(iter);
+            _system_schedule_dirty = true;
+        }
+    }
+
+    Archetype* World::get_archetype(const ComponentMask& mask)
+    {
+        auto iter = _archetype_map.find(mask);
+        if (iter != _archetype_map.end()) return iter->second.get();
+
+        auto archetype = std::make_unique<Archetype>(mask);
+        Archetype* ret = archetype.get();
+        _archetypes.push_back(ret);
+        _archetype_map[mask] = std::move(archetype);
+        return ret;
+    }
+
+    void World::update_query(EntityQuery& query)
+    {
+        for (; query.checked_archetype_num < _archetypes.size(); ++query.checked_archetype_num)
+        {
+            Archetype* archetype = _archetypes[query.checked_archetype_num];
+            if ((archetype->get_mask() & query.mask) == query.mask)
+            {
+                query.archetypes.push_back(archetype);
+            }
+        }
+    }
+
+    void World::move_entity(Entity* entity, Archetype* archetype)
+    {
+        Archetype* src_archetype = entity->_archetype;
+        const uint32_t src_row = entity->_row;
+        const uint32_t dst_row = archetype->allocate_row(entity);
+
+        if (src_archetype)
+        {
+            for (uint32_t column = 0; column < src_archetype->get_column_num(); ++column)
+            {
+                const uint32_t id = src_archetype->get_column_component_id(column);
+                const uint32_t dst_column = archetype->get_column_index(id);
+                void* src_data = src_archetype->get_component(column, src_row);
+
+                if (dst_column != INVALID_SIZE_32)
+                {
+                    ComponentRegistry::get_info(id).relocate(archetype->get_component(dst_column, dst_row), src_data);
+                    archetype->set_ticks(dst_column, dst_row, src_archetype->get_ticks(column, src_row));
+                }
+                else 
+                {
+                    ComponentRegistry::get_info(id).destruct(src_data);
+                }
+            }
+
+            if (Entity* moved_entity = src_archetype->remove_row(src_row))
+            {
+                moved_entity->_row = src_row;
+            }
+        }
+
+        entity->_archetype = archetype;
+        entity->_row = dst_row;
+        entity->_mask = archetype->get_mask();
+    }
+
+    void* World::add_component(Entity* entity, uint32_t id)
+    {
+        Archetype* archetype = nullptr;
+        if (Archetype* src_archetype = entity->_archetype)
+        {
+            Archetype*& edge = src_archetype->get_add_edge(id);
+            if (!edge)
+            {
+                ComponentMask mask = src_archetype->get_mask();
+                mask.set(id);
+                edge = get_archetype(mask);
+                edge->get_remove_edge(id) = src_archetype;
+            }
+            archetype = edge;
+        }
+        else 
+        {
+            ComponentMask mask;
+            mask.set(id);
+            archetype = get_archetype(mask);
+        }
+
+        move_entity(entity, archetype);
+
+        const uint32_t column = archetype->get_column_index(id);
+        const uint32_t tick = get_change_tick();
+        archetype->set_ticks(column, entity->_row, ComponentTicks{ .added = tick, .changed = tick });
+        return archetype->get_component(column, entity->_row);
+    }
+
+    void World::remove_component(Entity* entity, uint32_t id)
+    {
+        Archetype* src_archetype = entity->_archetype;
+        
+        ComponentMask mask = src_archetype->get_mask();
+        mask.reset(id);
+        if (mask.none())
+        {
+            remove_all_components(entity);
+            return;
+        }
+
+        Archetype*& edge = src_archetype->get_remove_edge(id);
+        if (!edge)
+        {
+            edge = get_archetype(mask);
+            edge->get_add_edge(id) = src_archetype;
+        }
+        move_entity(entity, edge);
+        record_removed_component(entity, id);
+    }
+
+    void World::remove_all_components(Entity* entity)
+    {
+        Archetype* archetype = entity->_archetype;
+        for (uint32_t column = 0; column < archetype->get_column_num(); ++column)
+        {
+            const uint32_t id = archetype->get_column_component_id(column);
+            ComponentRegistry::get_info(id).destruct(archetype->get_component(column, entity->_row));
+            record_removed_component(entity, id);
+        }
+
+        if (Entity* moved_entity = archetype->remove_row(entity->_row))
+        {
+            moved_entity->_row = entity->_row;
+        }
+
+        entity->_archetype = nullptr;
+        entity->_row = INVALID_SIZE_32;
+        entity->_mask.reset();
+    }
+
+    void World::commit_staged_components(Entity* entity)
+    {
+        std::lock_guard lock(entity->_component_mutex);
+        entity->_is_staged = false;
+        if (entity->_staged_components.empty()) return;
+
+        Archetype* archetype = get_archetype(entity->_mask);
+        const uint32_t row = archetype->allocate_row(entity);
+        const uint32_t tick = get_change_tick();
+        for (const auto& component : entity->_staged_components)
+        {
+            const ComponentInfo& info = ComponentRegistry::get_info(component.id);
+            const uint32_t column = archetype->get_column_index(component.id);
+            info.relocate(archetype->get_component(column, row), component.data);
+            archetype->set_ticks(column, row, ComponentTicks{ .added = tick, .changed = tick });
+            ::operator delete(component.data, std::align_val_t(info.alignment));
+        }
+        entity->_staged_components.clear();
+
+        entity->_archetype = archetype;
+        entity->_row = row;
+    }
+
+    void World::record_removed_component(Entity* entity, uint32_t id)
+    {
+        if (id >= _removed_components.size()) _removed_components.resize(id + 1);
+        _removed_components[id].push_back(RemovedComponent{ .entity = entity->get_handle(), .tick = get_change_tick() });
+    }
+
+    // 每帧开始时推进 change tick, 并丢弃 removed_component_keep_frame_num 帧之前的删除记录.
+    void World::prune_removed_components()
+    {
+        uint32_t& oldest_tick = _frame_change_ticks[_frame_index++ % removed_component_keep_frame_num];
+        for (auto& removed_components : _removed_components)
+        {
+            auto iter = std::find_if(
+                removed_components.begin(), 
+                removed_components.end(), 
+                [oldest_tick](const RemovedComponent& removed) { return removed.tick >= oldest_tick; }
+            );
+            removed_components.erase(removed_components.begin(), iter);
         }
+        oldest_tick = advance_change_tick() + 1;
     }
 
 	EntityView<>::EntityView(const EntityIterator<>& begin, const EntityIterator<>& end) :
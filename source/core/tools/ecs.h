@@ -1,19 +1,171 @@
 ﻿#ifndef CORE_ECS_H
 #define CORE_ECS_H
 #include "../math/common.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <concepts>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <tuple>
 #include <type_traits>
-#include <typeindex>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include "log.h"
+#include "../parallel/parallel.h"
 
 namespace fantasy
 {
     class World;
 	class Entity;
 
+	static constexpr uint32_t MAX_COMPONENT_TYPE_NUM = 128;
+
+	using ComponentMask = std::bitset<MAX_COMPONENT_TYPE_NUM>;
+
+	// 用于 World::parallel_each 和 SystemAccess, 声明对组件的只读或读写访问.
+	template <typename T>
+	struct Read
+	{
+		using ComponentType = T;
+		using PointerType = const T*;
+		static constexpr bool is_write = false;
+	};
+
+	template <typename T>
+	struct Write
+	{
+		using ComponentType = T;
+		using PointerType = T*;
+		static constexpr bool is_write = true;
+	};
+
+	// 组件的增加和修改记录, 与组件一起存放在 Archetype 的 chunk 中.
+	struct ComponentTicks
+	{
+		uint32_t added = 0;
+		uint32_t changed = 0;
+	};
+
+	// World::each 的变化过滤器, 只遍历在 last_tick 之后增加, 修改或删除了组件 T 的实体.
+	// Added 和 Changed 可以与普通组件类型混用, 对应的参数为 T*. Removed 单独使用, 参数为实体句柄.
+	template <typename T>
+	struct Added
+	{
+		using ComponentType = T;
+	};
+
+	template <typename T>
+	struct Changed
+	{
+		using ComponentType = T;
+	};
+
+	template <typename T>
+	struct Removed
+	{
+		using ComponentType = T;
+	};
+
+	// PointerType 为 func 对应参数的类型, is_write 为 true 的组件在遍历时记录修改.
+	template <typename T>
+	struct QueryParam
+	{
+		using ComponentType = T;
+		using PointerType = T*;
+		static constexpr bool is_write = false;
+		static constexpr bool is_change_filter = false;
+		static constexpr bool is_removed_filter = false;
+		static bool pass(const ComponentTicks& ticks, uint32_t last_tick) { return true; }
+	};
+
+	template <typename T>
+	struct QueryParam<Added<T>>
+	{
+		using ComponentType = T;
+		using PointerType = T*;
+		static constexpr bool is_write = false;
+		static constexpr bool is_change_filter = true;
+		static constexpr bool is_removed_filter = false;
+		static bool pass(const ComponentTicks& ticks, uint32_t last_tick) { return ticks.added > last_tick; }
+	};
+
+	template <typename T>
+	struct QueryParam<Changed<T>>
+	{
+		using ComponentType = T;
+		using PointerType = T*;
+		static constexpr bool is_write = false;
+		static constexpr bool is_change_filter = true;
+		static constexpr bool is_removed_filter = false;
+		static bool pass(const ComponentTicks& ticks, uint32_t last_tick) { return ticks.changed > last_tick; }
+	};
+
+	template <typename T>
+	struct QueryParam<Removed<T>>
+	{
+		using ComponentType = T;
+		using PointerType = T*;
+		static constexpr bool is_write = false;
+		static constexpr bool is_change_filter = false;
+		static constexpr bool is_removed_filter = true;
+		static bool pass(const ComponentTicks& ticks, uint32_t last_tick) { return false; }
+	};
+
+	// Read<T> 和 Write<T> 也可以用于 World::each, Write<T> 遍历到的实体会记录组件 T 的修改.
+	template <typename T>
+	struct QueryParam<Read<T>>
+	{
+		using ComponentType = T;
+		using PointerType = const T*;
+		static constexpr bool is_write = false;
+		static constexpr bool is_change_filter = false;
+		static constexpr bool is_removed_filter = false;
+		static bool pass(const ComponentTicks&, uint32_t) { return true; }
+	};
+
+	template <typename T>
+	struct QueryParam<Write<T>>
+	{
+		using ComponentType = T;
+		using PointerType = T*;
+		static constexpr bool is_write = true;
+		static constexpr bool is_change_filter = false;
+		static constexpr bool is_removed_filter = false;
+		static bool pass(const ComponentTicks&, uint32_t) { return true; }
+	};
+
+	// system 对组件的访问声明, 调度时互相冲突的 system 不会同时执行.
+	// exclusive 的 system 独占 World (可以增删实体和组件), 在调用 World::tick 的线程上执行.
+	struct SystemAccess
+	{
+		ComponentMask read_mask{};
+		ComponentMask write_mask{};
+		bool exclusive = false;
+
+		template <typename... Accesses>
+		static SystemAccess create();
+
+		bool conflict(const SystemAccess& other) const
+		{
+			if (exclusive || other.exclusive) return true;
+			return (write_mask & (other.read_mask | other.write_mask)).any() || (read_mask & other.write_mask).any();
+		}
+
+		// other 中的访问是否都已经声明.
+		bool contain(const SystemAccess& other) const
+		{
+			if (exclusive) return true;
+			return (other.read_mask & ~(read_mask | write_mask)).none() && (other.write_mask & ~write_mask).none();
+		}
+	};
+
     struct EntitySystemInterface
 	{
 		virtual ~EntitySystemInterface() = default;
@@ -21,6 +173,9 @@ namespace fantasy
 		virtual bool initialize(World* world) = 0;
 		virtual bool destroy() = 0;
 		virtual bool tick(float time_delta) = 0;
+
+		// 默认独占 World, 声明了访问的 system 会和其它不冲突的 system 并行执行.
+		virtual SystemAccess get_access() const { return SystemAccess{ .exclusive = true }; }
 	};
 
 	struct IEventSubscriber
@@ -34,6 +189,161 @@ namespace fantasy
 		virtual ~EventSubscriber() = default;
 
 		virtual bool publish(World* world, const T& event) = 0;
+
+		// World::publish 的延迟事件在 World::flush_events 时按类型一次性发送, 默认逐个调用 publish.
+		virtual bool publish_batch(World* world, std::span<const T> events)
+		{
+			for (const auto& event : events)
+			{
+				ReturnIfFalse(publish(world, event));
+			}
+			return true;
+		}
+	};
+
+	// 事件类型 id, 用于索引订阅者和延迟事件队列.
+	class EventTypeRegistry
+	{
+	public:
+		template <typename T>
+		static uint32_t get_id()
+		{
+			static const uint32_t id = allocate_id();
+			return id;
+		}
+
+		static uint32_t get_event_type_num();
+
+	private:
+		static uint32_t allocate_id();
+	};
+
+	struct EventQueueInterface
+	{
+		virtual ~EventQueueInterface() = default;
+
+		virtual bool flush(World* world, const std::vector<IEventSubscriber*>& subscribers) = 0;
+	};
+
+	// 多个线程可以无锁地 push, flush 只在一个线程中调用.
+	// 事件存放在两组缓冲区中, push 写入当前缓冲区, flush 切换缓冲区后发送旧缓冲区中的事件.
+	// 每组缓冲区由大小翻倍的块组成, 块在 flush 后保留复用, 稳定后 push 不再分配内存.
+	template <typename T>
+	class EventQueue : public EventQueueInterface
+	{
+	public:
+		static constexpr uint32_t first_block_size = 64;
+		static constexpr uint32_t max_block_num = 26;		// 共约 40 亿个事件.
+
+		~EventQueue() override
+		{
+			for (auto& buffer : _buffers)
+			{
+				const uint32_t event_num = buffer.event_num.load(std::memory_order_relaxed);
+				for (uint32_t ix = 0; ix < event_num; ++ix) get_event(buffer, ix)->~T();
+				for (auto& block : buffer.blocks) delete[] block.load(std::memory_order_relaxed);
+			}
+		}
+
+		void push(T&& event)
+		{
+			// 先登记为当前缓冲区的写入者, flush 会等待旧缓冲区的写入者全部完成.
+			uint64_t state = _state.load(std::memory_order_relaxed);
+			uint32_t buffer_index = 0;
+			do
+			{
+				buffer_index = static_cast<uint32_t>(state >> active_buffer_shift);
+			} 
+			while (!_state.compare_exchange_weak(state, state + get_writer_increment(buffer_index), std::memory_order_acquire, std::memory_order_relaxed));
+
+			Buffer& buffer = _buffers[buffer_index];
+			const uint32_t slot = buffer.event_num.fetch_add(1, std::memory_order_relaxed);
+			new (get_slot(buffer, slot)) T(std::move(event));
+
+			_state.fetch_sub(get_writer_increment(buffer_index), std::memory_order_release);
+		}
+
+		bool flush(World* world, const std::vector<IEventSubscriber*>& subscribers) override
+		{
+			const uint64_t state = _state.fetch_xor(1ull << active_buffer_shift, std::memory_order_acq_rel);
+			const uint32_t buffer_index = static_cast<uint32_t>(state >> active_buffer_shift);
+			const uint64_t writer_mask = get_writer_increment(buffer_index) * writer_count_mask;
+			while ((_state.load(std::memory_order_acquire) & writer_mask) != 0)
+			{
+				std::this_thread::yield();
+			}
+
+			Buffer& buffer = _buffers[buffer_index];
+			const uint32_t event_num = buffer.event_num.load(std::memory_order_relaxed);
+			if (event_num == 0) return true;
+
+			// 按 slot 的顺序即 push 的顺序.
+			_batch.clear();
+			for (uint32_t ix = 0; ix < event_num; ++ix)
+			{
+				T* event = get_event(buffer, ix);
+				_batch.emplace_back(std::move(*event));
+				event->~T();
+			}
+			buffer.event_num.store(0, std::memory_order_relaxed);
+
+			for (auto* subscriber : subscribers)
+			{
+				ReturnIfFalse(static_cast<EventSubscriber<T>*>(subscriber)->publish_batch(world, std::span<const T>(_batch)));
+			}
+			return true;
+		}
+
+	private:
+		struct alignas(T) Storage
+		{
+			uint8_t data[sizeof(T)];
+		};
+
+		struct Buffer
+		{
+			std::atomic<uint32_t> event_num = 0;
+			std::array<std::atomic<Storage*>, max_block_num> blocks = {};
+		};
+
+		// _state 的低 62 位是两组缓冲区各自的写入者数量, 最高位是当前缓冲区.
+		static constexpr uint32_t active_buffer_shift = 63;
+		static constexpr uint64_t writer_count_mask = (1ull << 31) - 1;
+
+		static uint64_t get_writer_increment(uint32_t buffer_index) { return 1ull << (31 * buffer_index); }
+
+		// 第 k 块有 first_block_size << k 个 slot, 从 first_block_size * (2^k - 1) 开始.
+		static void* get_slot(Buffer& buffer, uint32_t slot)
+		{
+			const uint32_t block_index = std::bit_width(slot / first_block_size + 1) - 1;
+			const uint32_t offset = slot - first_block_size * ((1u << block_index) - 1);
+			assert(block_index < max_block_num);
+
+			std::atomic<Storage*>& block = buffer.blocks[block_index];
+			Storage* storage = block.load(std::memory_order_acquire);
+			if (storage == nullptr)
+			{
+				Storage* new_storage = new Storage[static_cast<uint64_t>(first_block_size) << block_index];
+				if (block.compare_exchange_strong(storage, new_storage, std::memory_order_acq_rel, std::memory_order_acquire))
+				{
+					storage = new_storage;
+				}
+				else 
+				{
+					delete[] new_storage;
+				}
+			}
+			return storage[offset].data;
+		}
+
+		static T* get_event(Buffer& buffer, uint32_t slot)
+		{
+			return std::launder(reinterpret_cast<T*>(get_slot(buffer, slot)));
+		}
+
+		std::atomic<uint64_t> _state = 0;
+		std::array<Buffer, 2> _buffers;
+		std::vector<T> _batch;
 	};
 
 
@@ -45,7 +355,7 @@ namespace fantasy
 			Entity* entity;
 			T* component;
 		};
-		
+
 		template <typename T>
 		struct OnComponentRemoved
 		{
@@ -54,13 +364,212 @@ namespace fantasy
 		};
 	}
 
-	struct ComponentContainerInterface
+
+	// 类型擦除后的组件操作, 由 ComponentRegistry::get_id<T>() 在第一次使用 T 时注册.
+	struct ComponentInfo
+	{
+		uint32_t size = 0;
+		uint32_t alignment = 0;
+
+		void (*relocate)(void* dst, void* src) = nullptr;		// 移动构造到 dst 并析构 src.
+		void (*destruct)(void* data) = nullptr;
+		bool (*broadcast_removed)(Entity* entity, void* data) = nullptr;
+	};
+
+	// 组件 id 是连续的小整数, 用于 ComponentMask 和 Archetype 的列索引, 不再需要 typeid 和哈希查找.
+	class ComponentRegistry
+	{
+	public:
+		template <typename T>
+		static uint32_t get_id()
+		{
+			static const uint32_t id = register_component(create_info<T>());
+			return id;
+		}
+
+		static const ComponentInfo& get_info(uint32_t id);
+		static uint32_t get_component_type_num();
+
+	private:
+		template <typename T>
+		static ComponentInfo create_info();
+
+		static uint32_t register_component(const ComponentInfo& info);
+	};
+
+
+	// 组件集合相同的实体存放在同一个 Archetype 中.
+	// 数据按 chunk 分配, 每个 chunk 内每种组件连续存放 (SoA), chunk 不会因为扩容而移动.
+	// 实体的组件集合改变时会移动到另一个 Archetype, 删除时由最后一行填补空位, 所以组件指针只在没有结构性修改时有效.
+	class Archetype
+	{
+	public:
+		static constexpr uint32_t chunk_byte_size = 16 * 1024;
+
+		explicit Archetype(const ComponentMask& mask);
+		~Archetype();
+
+		Archetype(const Archetype&) = delete;
+		Archetype& operator=(const Archetype&) = delete;
+
+		const ComponentMask& get_mask() const { return _mask; }
+		uint32_t get_entity_num() const { return _entity_num; }
+		uint32_t get_chunk_capacity() const { return _chunk_capacity; }
+		uint32_t get_chunk_num() const { return (_entity_num + _chunk_capacity - 1) / _chunk_capacity; }
+		uint32_t get_chunk_entity_num(uint32_t chunk) const { return std::min(_chunk_capacity, _entity_num - chunk * _chunk_capacity); }
+
+		uint32_t get_column_num() const { return static_cast<uint32_t>(_column_component_ids.size()); }
+		uint32_t get_column_component_id(uint32_t column) const { return _column_component_ids[column]; }
+		uint32_t get_column_index(uint32_t component_id) const { return _column_indices[component_id]; }
+
+		Entity* const* get_chunk_entities(uint32_t chunk) const
+		{
+			return reinterpret_cast<Entity* const*>(_chunks[chunk]);
+		}
+
+		void* get_chunk_column(uint32_t column, uint32_t chunk) const
+		{
+			return _chunks[chunk] + _column_offsets[column];
+		}
+
+		void* get_component(uint32_t column, uint32_t row) const
+		{
+			return _chunks[row / _chunk_capacity] + _column_offsets[column] +
+				   static_cast<uint64_t>(row % _chunk_capacity) * _column_sizes[column];
+		}
+
+		Entity* get_entity(uint32_t row) const
+		{
+			return get_chunk_entities(row / _chunk_capacity)[row % _chunk_capacity];
+		}
+
+		ComponentTicks* get_chunk_ticks(uint32_t column, uint32_t chunk) const
+		{
+			return reinterpret_cast<ComponentTicks*>(_chunks[chunk] + _tick_offsets[column]);
+		}
+
+		ComponentTicks& get_ticks(uint32_t column, uint32_t row) const
+		{
+			return get_chunk_ticks(column, row / _chunk_capacity)[row % _chunk_capacity];
+		}
+
+		// chunk 内该列最大的 changed tick, 不大于 last_tick 的 chunk 在变化过滤时整体跳过.
+		uint32_t get_chunk_changed_tick(uint32_t column, uint32_t chunk)
+		{
+			return std::atomic_ref<uint32_t>(_chunk_changed_ticks[chunk * get_column_num() + column]).load(std::memory_order_relaxed);
+		}
+
+		// 并行的 system 可能同时修改同一个 chunk 中不同行的组件, 所以 chunk 的 tick 使用原子操作更新.
+		void update_chunk_changed_tick(uint32_t column, uint32_t chunk, uint32_t tick)
+		{
+			std::atomic_ref<uint32_t> chunk_tick(_chunk_changed_ticks[chunk * get_column_num() + column]);
+			uint32_t current = chunk_tick.load(std::memory_order_relaxed);
+			while (current < tick && !chunk_tick.compare_exchange_weak(current, tick, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		void set_ticks(uint32_t column, uint32_t row, const ComponentTicks& ticks)
+		{
+			get_ticks(column, row) = ticks;
+			update_chunk_changed_tick(column, row / _chunk_capacity, ticks.changed);
+		}
+
+		void set_changed_tick(uint32_t column, uint32_t row, uint32_t tick)
+		{
+			get_ticks(column, row).changed = tick;
+			update_chunk_changed_tick(column, row / _chunk_capacity, tick);
+		}
+
+		// 新行的组件未构造, tick 未初始化, 都由调用者设置.
+		uint32_t allocate_row(Entity* entity);
+
+		// row 的组件需要已经析构或移走, 最后一行的组件和 tick 会被移动到 row, 返回被移动的实体 (没有移动则返回 nullptr).
+		Entity* remove_row(uint32_t row);
+
+		Archetype*& get_add_edge(uint32_t component_id) { return _add_edges[component_id]; }
+		Archetype*& get_remove_edge(uint32_t component_id) { return _remove_edges[component_id]; }
+
+	private:
+		void set_entity(uint32_t row, Entity* entity)
+		{
+			reinterpret_cast<Entity**>(_chunks[row / _chunk_capacity])[row % _chunk_capacity] = entity;
+		}
+
+	private:
+		ComponentMask _mask;
+		std::vector<uint32_t> _column_component_ids;
+		std::vector<uint32_t> _column_sizes;
+		std::vector<uint32_t> _column_offsets;		// 每个 chunk 开头是实体指针数组, 之后依次是每一列.
+		std::vector<uint32_t> _tick_offsets;		// 所有列之后是每一列的 ComponentTicks 数组.
+		std::array<uint32_t, MAX_COMPONENT_TYPE_NUM> _column_indices;
+
+		uint32_t _chunk_capacity = 0;
+		uint32_t _chunk_size = 0;
+		uint32_t _chunk_alignment = 0;
+		uint32_t _entity_num = 0;
+		std::vector<uint8_t*> _chunks;
+		std::vector<uint32_t> _chunk_changed_ticks;		// 按 chunk * get_column_num() + column 索引.
+
+		// Archetype 图的边, 记录增加或删除一个组件后的 Archetype.
+		std::array<Archetype*, MAX_COMPONENT_TYPE_NUM> _add_edges = {};
+		std::array<Archetype*, MAX_COMPONENT_TYPE_NUM> _remove_edges = {};
+	};
+
+	// 缓存匹配的 Archetype, 每次使用时只检查新创建的 Archetype.
+	struct EntityQuery
+	{
+		ComponentMask mask;
+		std::vector<Archetype*> archetypes;
+		uint64_t checked_archetype_num = 0;
+	};
+
+	class EntityQueryRegistry
+	{
+	public:
+		template <typename... ComponentTypes>
+		static uint32_t get_id()
+		{
+			static const uint32_t id = allocate_id();
+			return id;
+		}
+
+	private:
+		static uint32_t allocate_id();
+	};
+
+
+	// 低位是 slot 下标, 高位是 generation. slot 被回收时 generation 加一, 之前的句柄因此失效.
+	// 所有位都为 1 表示无效句柄.
+	template <typename T, uint32_t IndexBits>
+	struct GenerationalHandle
 	{
-		virtual bool removed(Entity* entity) = 0;
+		static_assert(std::is_unsigned_v<T> && IndexBits < sizeof(T) * 8, "Invalid generational handle layout.");
+
+		static constexpr uint32_t index_bits = IndexBits;
+		static constexpr uint32_t generation_bits = sizeof(T) * 8 - IndexBits;
+		static constexpr T index_mask = (T(1) << index_bits) - 1;
+		static constexpr T generation_mask = (T(1) << generation_bits) - 1;
+		static constexpr uint32_t max_index = static_cast<uint32_t>(index_mask) - 1;
 
-		virtual ~ComponentContainerInterface() = default;
+		T value = static_cast<T>(-1);
+
+		GenerationalHandle() = default;
+		GenerationalHandle(uint32_t index, uint32_t generation) :
+			value(static_cast<T>(index & index_mask) | (static_cast<T>(generation & generation_mask) << index_bits))
+		{
+		}
+
+		uint32_t get_index() const { return static_cast<uint32_t>(value & index_mask); }
+		uint32_t get_generation() const { return static_cast<uint32_t>((value >> index_bits) & generation_mask); }
+		bool is_valid() const { return value != static_cast<T>(-1); }
+
+		bool operator==(const GenerationalHandle& other) const = default;
 	};
 
+	using EntityHandle = GenerationalHandle<uint64_t, 32>;
+	using EntityHandle32 = GenerationalHandle<uint32_t, 20>;		// 最多约 100 万个实体, generation 只有 12 位.
+
 
 	template <typename... ComponentTypes>
 	struct EntityIterator
@@ -113,7 +622,7 @@ namespace fantasy
 			ReturnIfFalse(_world == iterator._world);
 			if (is_end()) return iterator.is_end();
 			return _entity_index == iterator._entity_index;
-		}		
+		}
 
 		bool operator!=(const EntityIterator<>& iterator) const
 		{
@@ -155,6 +664,9 @@ namespace fantasy
 		World* get_world() const;
 		uint64_t get_id() const;
 		bool is_pending_destroy() const;
+
+		template <typename HandleType = EntityHandle>
+		HandleType get_handle() const { return HandleType(static_cast<uint32_t>(_index), _generation); }
 		void remove_all();
 
 
@@ -168,8 +680,7 @@ namespace fantasy
 		template <typename T>
 		bool contain() const
 		{
-			auto type_index = std::type_index(typeid(T));
-			return _components.find(type_index) != _components.end();
+			return _mask.test(ComponentRegistry::get_id<T>());
 		}
 
 		template <typename T, typename U, typename... Types>
@@ -189,30 +700,54 @@ namespace fantasy
 		template <typename T>
 		bool remove()
 		{
-			auto iter = _components.find(std::type_index(typeid(T)));
-			if (iter != _components.end())
-			{
-				iter->second->removed(this);
+			const uint32_t id = ComponentRegistry::get_id<T>();
+			if (!_mask.test(id)) return false;
 
-				{
-					std::lock_guard lock(_component_mutex);
-					_components.erase(iter);
-				}
+			ComponentRegistry::get_info(id).broadcast_removed(this, get_component_data(id));
+			remove_component(id);
+			return true;
+		}
 
-				return true;
-			}
-			return false;
+		// 通过指针直接修改组件后调用, 使 Changed<T> 能遍历到该实体. assign 会自动记录.
+		template <typename T>
+		bool mark_changed()
+		{
+			const uint32_t id = ComponentRegistry::get_id<T>();
+			if (!_mask.test(id)) return false;
+
+			mark_component_changed(id);
+			return true;
 		}
 
+		const ComponentMask& get_component_mask() const { return _mask; }
+
 	private:
 		friend class World;
 
+		// 延迟加入 World 的实体在其它线程中创建组件, 组件先放在实体自己的内存中, 加入 World 时再移入 Archetype.
+		struct StagedComponent
+		{
+			uint32_t id;
+			void* data;
+		};
+
+		void* get_component_data(uint32_t id) const;
+		void* add_component(uint32_t id);
+		void remove_component(uint32_t id);
+		void mark_component_changed(uint32_t id);
+
 		std::mutex _component_mutex;
-		std::unordered_map<std::type_index, std::unique_ptr<ComponentContainerInterface>> _components;
+		std::vector<StagedComponent> _staged_components;
 		World* _world;
 
-		uint64_t _index = INVALID_SIZE_64;	// Index in world.
+		ComponentMask _mask;
+		Archetype* _archetype = nullptr;
+		uint32_t _row = INVALID_SIZE_32;
+
+		uint64_t _index = INVALID_SIZE_64;	// Slot index in world.
+		uint32_t _generation = 0;
 		bool _is_pending_destroy = false;	// 设定为 true, 意味着已经(需要) broadcast 一次 event::OnAnyEntityDestroyed
+		bool _is_staged = false;
 	};
 
 
@@ -226,13 +761,20 @@ namespace fantasy
 		Entity* create_entity();
 		bool destroy_entity(Entity* entity, bool bImmediately = false);
 
+		template <typename T, uint32_t IndexBits>
+		bool destroy_entity(GenerationalHandle<T, IndexBits> handle, bool immediately = false)
+		{
+			Entity* entity = get_entity(handle);
+			return entity != nullptr && destroy_entity(entity, immediately);
+		}
+
 		Entity* create_entity_delay();
 		void add_delay_entity(Entity* entity);
 
-		Entity* get_global_entity() { return _entities[0].get(); }
+		Entity* get_global_entity() { return _entity_slots[0].entity; }
 
 		bool tick(float delta);
-		
+
 		void cleanup();
 		bool reset();
 
@@ -248,58 +790,49 @@ namespace fantasy
 		{
 			assert(subscriber != nullptr);
 
-			auto type_index = std::type_index(typeid(T));
-			auto iter = _subscribers.find(type_index);
-			if (iter == _subscribers.end())
-			{
-				std::vector<IEventSubscriber*> vec;
-				vec.emplace_back(subscriber);
-
-				_subscribers[type_index] = std::move(vec);
-			}
-			else 
-			{
-				iter->second.emplace_back(subscriber);
-			}
+			const uint32_t id = EventTypeRegistry::get_id<T>();
+			if (id >= _subscribers.size()) _subscribers.resize(id + 1);
+			_subscribers[id].emplace_back(subscriber);
 		}
 
 		template <typename T>
 		void unsubscribe(EventSubscriber<T>* subscriber)
 		{
-			auto type_index = std::type_index(typeid(T));
-			auto iter = _subscribers.find(type_index);
-			if (iter != _subscribers.end())
+			const uint32_t id = EventTypeRegistry::get_id<T>();
+			if (id < _subscribers.size())
 			{
-				iter->second.erase(std::remove(iter->second.begin(), iter->second.end(), subscriber), iter->second.end());
-				if (iter->second.size() == 0)
-				{
-					_subscribers.erase(iter);
-				}
+				auto& subscribers = _subscribers[id];
+				subscribers.erase(
+					std::remove(subscribers.begin(), subscribers.end(), static_cast<IEventSubscriber*>(subscriber)), 
+					subscribers.end()
+				);
 			}
 		}
 
+		// system 通过多继承实现多个 EventSubscriber, 所以比较完整对象的地址.
 		void unsubscribe_all(void* system)
 		{
-			for (auto& subscriber : _subscribers)
+			for (auto& subscribers : _subscribers)
 			{
-				subscriber.second.erase(std::remove(subscriber.second.begin(), subscriber.second.end(), system), subscriber.second.end());
-				
-				if (subscriber.second.empty())
-				{
-					_subscribers.erase(subscriber.first);
-				}
+				subscribers.erase(
+					std::remove_if(
+						subscribers.begin(), 
+						subscribers.end(), 
+						[system](IEventSubscriber* subscriber) { return dynamic_cast<void*>(subscriber) == system; }
+					), 
+					subscribers.end()
+				);
 			}
-
 		}
 
-
+		// 立即在当前线程调用订阅者, 用于需要同步结果或事件中的指针只在调用期间有效的情况.
 		template <typename T>
 		bool broadcast(const T& event)
 		{
-			auto iter = _subscribers.find(std::type_index(typeid(T)));
-			if (iter != _subscribers.end())
+			const uint32_t id = EventTypeRegistry::get_id<T>();
+			if (id < _subscribers.size())
 			{
-				for (const auto& subscriber : iter->second)
+				for (const auto& subscriber : _subscribers[id])
 				{
 					ReturnIfFalse(static_cast<EventSubscriber<T>*>(subscriber)->publish(this, event));
 				}
@@ -307,30 +840,165 @@ namespace fantasy
 			return true;
 		}
 
+		// 可以在任意线程调用, 事件在下一次 flush_events (World::tick 开始时) 于调用 tick 的线程上批量发送.
+		// flush 期间发布的事件留到下一次 flush.
+		template <typename T>
+		void publish(T event)
+		{
+			const uint32_t id = EventTypeRegistry::get_id<T>();
+			assert(id < MAX_EVENT_TYPE_NUM);
+
+			EventQueueInterface* queue = _event_queues[id].load(std::memory_order_acquire);
+			if (queue == nullptr)
+			{
+				EventQueueInterface* new_queue = new EventQueue<T>();
+				if (_event_queues[id].compare_exchange_strong(queue, new_queue, std::memory_order_acq_rel, std::memory_order_acquire))
+				{
+					queue = new_queue;
+				}
+				else 
+				{
+					delete new_queue;
+				}
+			}
+			static_cast<EventQueue<T>*>(queue)->push(std::move(event));
+		}
+
+		bool flush_events();
+
+		// 组件的增加和修改会记录当前的 change tick, World::tick 每帧推进一次.
+		// 增量更新的使用者先调用 advance_change_tick 取得本次的 tick, 遍历 last_tick 之后的变化, 再把取得的 tick 保存为下一次的 last_tick.
+		// 遍历期间发生的修改使用更大的 tick, 会在下一次遍历到.
+		uint32_t get_change_tick() const { return _change_tick.load(std::memory_order_relaxed); }
+		uint32_t advance_change_tick() { return _change_tick.fetch_add(1, std::memory_order_relaxed); }
+
 		template <typename... ComponentTypes>
 		EntityView<ComponentTypes...> get_entity_view(bool include_pending_destroy = false)
 		{
 			return EntityView<ComponentTypes...>(
-				EntityIterator<ComponentTypes...>(this, 0, false, include_pending_destroy), 
+				EntityIterator<ComponentTypes...>(this, 0, false, include_pending_destroy),
 				EntityIterator<ComponentTypes...>(this, get_entity_num(), true, include_pending_destroy)
 			);
 		}
 
-		template <typename... ComponentTypes>
-		bool each(typename std::common_type<std::function<bool(Entity*, ComponentTypes*...)>>::type func, bool include_pending_destroy = false)
+		// 只遍历包含全部组件的 Archetype, 按 chunk 取出各列的指针后顺序访问.
+		// func 中不能对正在遍历的实体做增删组件等结构性修改.
+		// 参数为 Write<T> 时遍历到的实体记录组件 T 的修改, Read<T> 对应 const T*; 普通类型 T 不记录, 修改后需要调用 Entity::mark_changed.
+		template <typename... ComponentTypes, typename F>
+		requires (!(QueryParam<ComponentTypes>::is_change_filter || ...)) && 
+				 (!(QueryParam<ComponentTypes>::is_removed_filter || ...)) && 
+				 std::invocable<F&, Entity*, typename QueryParam<ComponentTypes>::PointerType...>
+		bool each(F&& func, bool include_pending_destroy = false)
 		{
-			auto view = get_entity_view<ComponentTypes...>();
-			for (auto* entity : view)
+			if constexpr (sizeof...(ComponentTypes) == 0)
+			{
+				return all(std::forward<F>(func), include_pending_destroy);
+			}
+			else
 			{
-				ReturnIfFalse(func(entity, entity->template get_component<ComponentTypes>()...));
+				return each_impl<ComponentTypes...>(func, 0, include_pending_destroy);
+			}
+		}
+
+		// 参数中的 Added<T>/Changed<T> 只匹配组件 T 在 last_tick 之后增加/修改过的实体, 多个过滤器需要同时满足.
+		// 没有变化的 chunk 整体跳过, 开销与变化的 chunk 数量相关, 而不是实体总数.
+		template <typename... Params, typename F>
+		requires (QueryParam<Params>::is_change_filter || ...) && 
+				 (!(QueryParam<Params>::is_removed_filter || ...)) && 
+				 std::invocable<F&, Entity*, typename QueryParam<Params>::PointerType...>
+		bool each(F&& func, uint32_t last_tick, bool include_pending_destroy = false)
+		{
+			return each_impl<Params...>(func, last_tick, include_pending_destroy);
+		}
+
+		// 遍历 last_tick 之后删除了组件 T 的实体 (包括被销毁的实体), 按删除的顺序.
+		// 实体可能已被销毁, 句柄需要通过 get_entity 检查. 删除记录只保留 removed_component_keep_frame_num 帧.
+		template <typename Param, typename F>
+		requires QueryParam<Param>::is_removed_filter && std::invocable<F&, EntityHandle>
+		bool each(F&& func, uint32_t last_tick)
+		{
+			const uint32_t id = ComponentRegistry::get_id<typename QueryParam<Param>::ComponentType>();
+			if (id >= _removed_components.size()) return true;
+
+			const auto& removed_components = _removed_components[id];
+			auto iter = std::upper_bound(
+				removed_components.begin(), 
+				removed_components.end(), 
+				last_tick, 
+				[](uint32_t tick, const RemovedComponent& removed) { return tick < removed.tick; }
+			);
+			for (; iter != removed_components.end(); ++iter)
+			{
+				ReturnIfFalse(func(iter->entity));
 			}
 			return true;
 		}
 
+		// 以 chunk 为单位分给线程池, func 的参数为 Read<T> 对应 const T*, Write<T> 对应 T*.
+		// Write<T> 遍历到的实体记录组件 T 的修改, 之后的 Changed<T> 能遍历到.
+		// 在 system 中调用时, 访问必须包含在该 system 的 get_access() 声明中.
+		template <typename... Accesses, typename F>
+		requires (sizeof...(Accesses) > 0) && std::invocable<F&, Entity*, typename Accesses::PointerType...>
+		bool parallel_each(F&& func, bool include_pending_destroy = false)
+		{
+			static const SystemAccess access = SystemAccess::create<Accesses...>();
+			if (!check_system_access(access)) return false;
+
+			const EntityQuery& query = get_query<typename Accesses::ComponentType...>();
+
+			std::vector<std::pair<Archetype*, uint32_t>> chunks;
+			for (Archetype* archetype : query.archetypes)
+			{
+				for (uint32_t chunk = 0; chunk < archetype->get_chunk_num(); ++chunk) chunks.emplace_back(archetype, chunk);
+			}
+
+			const uint32_t change_tick = get_change_tick();
+			std::atomic<bool> success = true;
+			auto chunk_func = [&](uint64_t index)
+			{
+				[&]<size_t... Index>(std::index_sequence<Index...>)
+				{
+					const auto& [archetype, chunk] = chunks[index];
+
+					const uint32_t columns[] = { 
+						archetype->get_column_index(ComponentRegistry::get_id<typename Accesses::ComponentType>())... 
+					};
+					Entity* const* entities = archetype->get_chunk_entities(chunk);
+					std::tuple<typename Accesses::PointerType...> arrays = {
+						static_cast<typename Accesses::PointerType>(archetype->get_chunk_column(columns[Index], chunk))...
+					};
+					ComponentTicks* ticks[] = { archetype->get_chunk_ticks(columns[Index], chunk)... };
+
+					const uint32_t entity_num = archetype->get_chunk_entity_num(chunk);
+					bool chunk_changed = false;
+					for (uint32_t ix = 0; ix < entity_num; ++ix)
+					{
+						if (entities[ix]->is_pending_destroy() && !include_pending_destroy) continue;
+						mark_write_changed<Accesses...>(archetype, chunk, columns, ticks, ix, change_tick, chunk_changed);
+						if (!func(entities[ix], std::get<Index>(arrays) + ix...))
+						{
+							success.store(false, std::memory_order_relaxed);
+							return;
+						}
+					}
+				}(std::index_sequence_for<Accesses...>{});
+			};
+
+			if (parallel::get_thread_pool() == nullptr || chunks.size() <= 1)
+			{
+				for (uint64_t ix = 0; ix < chunks.size(); ++ix) chunk_func(ix);
+			}
+			else 
+			{
+				parallel::parallel_for(chunk_func, chunks.size(), 1);
+			}
+			return success.load(std::memory_order_relaxed);
+		}
+
 		EntityView<> get_entity_view(bool include_pending_destroy = false)
 		{
 			return EntityView<>(
-				EntityIterator<>(this, 0, false, include_pending_destroy), 
+				EntityIterator<>(this, 0, false, include_pending_destroy),
 				EntityIterator<>(this, get_entity_num(), true, include_pending_destroy)
 			);
 		}
@@ -345,23 +1013,222 @@ namespace fantasy
 			return true;
 		}
 
-		uint64_t get_entity_num() const { return _entities.size(); }
-		Entity* get_entity(uint64_t index) const { return _entities[index].get(); }
+		// slot 的数量, 空闲和延迟加入的 slot 的 get_entity 返回 nullptr.
+		uint64_t get_entity_num() const { return _entity_slots.size(); }
+		uint64_t get_alive_entity_num() const { return _alive_entity_num; }
+		Entity* get_entity(uint64_t index) const { return _entity_slots[index].entity; }
+
+		// 句柄过期 (实体已被销毁, slot 可能已被复用) 时返回 nullptr.
+		// include_delay 为 true 时也返回还未调用 add_delay_entity 的实体.
+		template <typename T, uint32_t IndexBits>
+		Entity* get_entity(GenerationalHandle<T, IndexBits> handle, bool include_delay = false) const
+		{
+			if (!handle.is_valid() || handle.get_index() >= _entity_slots.size()) return nullptr;
+
+			const EntitySlot& slot = _entity_slots[handle.get_index()];
+			if ((slot.generation & GenerationalHandle<T, IndexBits>::generation_mask) != handle.get_generation()) return nullptr;
+			if (slot.entity != nullptr || !include_delay) return slot.entity;
+
+			for (Entity* entity : _delay_entities)
+			{
+				if (entity->_index == handle.get_index()) return entity;
+			}
+			return nullptr;
+		}
+
+		template <typename T, uint32_t IndexBits>
+		bool is_alive(GenerationalHandle<T, IndexBits> handle) const { return get_entity(handle) != nullptr; }
+
+		uint64_t get_archetype_num() const { return _archetypes.size(); }
+
+		template <typename... ComponentTypes>
+		const EntityQuery& get_query()
+		{
+			const uint32_t id = EntityQueryRegistry::get_id<ComponentTypes...>();
+
+			// 并行执行的 system 会同时获取 query, 期间不会创建新的 Archetype, 所以返回后可以不加锁遍历.
+			std::lock_guard lock(_query_mutex);
+			if (id >= _queries.size()) _queries.resize(id + 1);
+
+			if (!_queries[id])
+			{
+				_queries[id] = std::make_unique<EntityQuery>();
+				(_queries[id]->mask.set(ComponentRegistry::get_id<ComponentTypes>()), ...);
+			}
+			update_query(*_queries[id]);
+			return *_queries[id];
+		}
 
 	private:
-		std::vector<std::unique_ptr<Entity>> _entities;
-		std::vector<std::unique_ptr<Entity>> _delay_entities;
+		friend class Entity;
+
+		// 记录 Write<T> 访问的第 row 行的修改, chunk 的 tick 在第一次访问时更新.
+		template <typename... Params>
+		static void mark_write_changed(
+			Archetype* archetype, 
+			uint32_t chunk, 
+			const uint32_t* columns, 
+			ComponentTicks* const* ticks, 
+			uint32_t row, 
+			uint32_t change_tick, 
+			bool& chunk_changed
+		)
+		{
+			if constexpr ((QueryParam<Params>::is_write || ...))
+			{
+				[&]<size_t... Index>(std::index_sequence<Index...>)
+				{
+					((QueryParam<Params>::is_write ? void(ticks[Index][row].changed = change_tick) : void()), ...);
+					if (!chunk_changed)
+					{
+						((QueryParam<Params>::is_write ? archetype->update_chunk_changed_tick(columns[Index], chunk, change_tick) : void()), ...);
+						chunk_changed = true;
+					}
+				}(std::index_sequence_for<Params...>{});
+			}
+		}
+
+		template <typename... Params, typename F>
+		bool each_impl(F& func, uint32_t last_tick, bool include_pending_destroy)
+		{
+			const uint32_t change_tick = get_change_tick();
+			const EntityQuery& query = get_query<typename QueryParam<Params>::ComponentType...>();
+			for (Archetype* archetype : query.archetypes)
+			{
+				const uint32_t columns[] = { 
+					archetype->get_column_index(ComponentRegistry::get_id<typename QueryParam<Params>::ComponentType>())... 
+				};
+
+				for (uint32_t chunk = 0; chunk < archetype->get_chunk_num(); ++chunk)
+				{
+					const bool success = [&]<size_t... Index>(std::index_sequence<Index...>) -> bool
+					{
+						constexpr bool has_change_filter = (QueryParam<Params>::is_change_filter || ...);
+
+						if constexpr (has_change_filter)
+						{
+							if (
+								!((!QueryParam<Params>::is_change_filter || archetype->get_chunk_changed_tick(columns[Index], chunk) > last_tick) && ...)
+							)
+							{
+								return true;
+							}
+						}
+
+						Entity* const* entities = archetype->get_chunk_entities(chunk);
+						std::tuple<typename QueryParam<Params>::PointerType...> arrays = {
+							static_cast<typename QueryParam<Params>::PointerType>(archetype->get_chunk_column(columns[Index], chunk))...
+						};
+						ComponentTicks* ticks[] = { archetype->get_chunk_ticks(columns[Index], chunk)... };
+
+						const uint32_t entity_num = archetype->get_chunk_entity_num(chunk);
+						bool chunk_changed = false;
+						for (uint32_t ix = 0; ix < entity_num; ++ix)
+						{
+							if constexpr (has_change_filter)
+							{
+								if (!(QueryParam<Params>::pass(ticks[Index][ix], last_tick) && ...)) continue;
+							}
+							if (entities[ix]->is_pending_destroy() && !include_pending_destroy) continue;
+							mark_write_changed<Params...>(archetype, chunk, columns, ticks, ix, change_tick, chunk_changed);
+							ReturnIfFalse(func(entities[ix], std::get<Index>(arrays) + ix...));
+						}
+						return true;
+					}(std::index_sequence_for<Params...>{});
+
+					ReturnIfFalse(success);
+				}
+			}
+			return true;
+		}
+
+		Archetype* get_archetype(const ComponentMask& mask);
+		void update_query(EntityQuery& query);
+
+		// 把实体移动到 archetype, 两者都有的组件移动过去, 旧 Archetype 独有的组件被析构.
+		void move_entity(Entity* entity, Archetype* archetype);
+		void* add_component(Entity* entity, uint32_t id);
+		void remove_component(Entity* entity, uint32_t id);
+		void remove_all_components(Entity* entity);
+		void commit_staged_components(Entity* entity);
+		void record_removed_component(Entity* entity, uint32_t id);
+		void prune_removed_components();
+
+		Entity* allocate_entity();
+		void free_entity(Entity* entity);
+
+		// 正在执行的 system 没有声明 access 中的访问时返回 false.
+		static bool check_system_access(const SystemAccess& access);
+
+		void build_system_schedule();
+
+	private:
+		// 独占的 system 单独作为一个阶段, 相邻的非独占 system 按访问冲突建立依赖后用 TaskFlow 并行执行.
+		struct SystemStage
+		{
+			EntitySystemInterface* exclusive_system = nullptr;
+			TaskFlow flow;
+		};
+
+		std::vector<SystemStage> _system_stages;
+		bool _system_schedule_dirty = true;
+		float _tick_delta = 0.0f;
+
+		std::mutex _query_mutex;
+		std::unordered_map<ComponentMask, std::unique_ptr<Archetype>> _archetype_map;
+		std::vector<Archetype*> _archetypes;		// 按创建顺序, 用于增量更新 EntityQuery.
+		std::vector<std::unique_ptr<EntityQuery>> _queries;
+
+		// 实体按 slot 下标放在固定大小的块中, 地址不变. 释放的 slot 通过 next_free_slot 串成空闲链表, 创建和销毁都是 O(1).
+		struct EntitySlot
+		{
+			Entity* entity = nullptr;		// 只在实体存活并已加入 World 时不为空.
+			uint32_t generation = 0;
+			uint32_t next_free_slot = INVALID_SIZE_32;
+		};
+
+		static constexpr uint32_t entity_block_size = 1024;
+
+		struct EntityBlock
+		{
+			alignas(Entity) uint8_t data[sizeof(Entity) * entity_block_size];
+		};
+
+		std::vector<EntitySlot> _entity_slots;
+		std::vector<std::unique_ptr<EntityBlock>> _entity_blocks;
+		uint32_t _free_slot_head = INVALID_SIZE_32;
+		uint64_t _alive_entity_num = 0;
+
+		std::atomic<uint32_t> _change_tick = 1;		// 从 1 开始, last_tick 为 0 时遍历所有组件.
+
+		struct RemovedComponent
+		{
+			EntityHandle entity;
+			uint32_t tick;
+		};
+
+		// 按组件 id 索引, 每个数组按 tick 递增. 只保留最近几帧的记录, 每帧至少遍历一次的使用者不会漏掉.
+		static constexpr uint32_t removed_component_keep_frame_num = 2;
+		std::vector<std::vector<RemovedComponent>> _removed_components;
+		std::array<uint32_t, removed_component_keep_frame_num> _frame_change_ticks = {};
+		uint64_t _frame_index = 0;
+
+		std::vector<EntityHandle> _pending_destroy_entities;
+		std::vector<Entity*> _delay_entities;
 		std::vector<std::unique_ptr<EntitySystemInterface>> _systems;
 		std::vector<std::unique_ptr<EntitySystemInterface>> disabled_systems;
-		std::unordered_map<std::type_index, std::vector<IEventSubscriber*>> _subscribers;
+		std::vector<std::vector<IEventSubscriber*>> _subscribers;		// 按 EventTypeRegistry 的 id 索引.
+
+		static constexpr uint32_t MAX_EVENT_TYPE_NUM = 256;
+		std::array<std::atomic<EventQueueInterface*>, MAX_EVENT_TYPE_NUM> _event_queues = {};
 	};
 
 
 	template <typename... ComponentTypes>
 	EntityIterator<ComponentTypes...>::EntityIterator(World* world, uint64_t component_index, bool is_last_component, bool include_pending_destroy) :
-		_world(world), 
-		_entity_index(component_index), 
-		_is_last_entity(is_last_component), 
+		_world(world),
+		_entity_index(component_index),
+		_is_last_entity(is_last_component),
 		_include_pending_destroy(is_last_component)
 	{
 		if (_entity_index == world->get_entity_num() - 1) _is_last_entity = true;
@@ -414,63 +1281,91 @@ namespace fantasy
 		}
 	}
 
+	template <typename... Accesses>
+	SystemAccess SystemAccess::create()
+	{
+		SystemAccess access;
+		((Accesses::is_write ? access.write_mask : access.read_mask).set(ComponentRegistry::get_id<typename Accesses::ComponentType>()), ...);
+		return access;
+	}
+
 	template <typename T>
-	struct TComponentContainer : public ComponentContainerInterface
+	ComponentInfo ComponentRegistry::create_info()
 	{
-		TComponentContainer() = default;
-		TComponentContainer(const T& data) : _data(data) 
-		{
-		}
+		static_assert(std::is_move_constructible_v<T>, "Component must be move constructible.");
 
-		bool removed(Entity* entity) override
+		ComponentInfo info;
+		info.size = static_cast<uint32_t>(sizeof(T));
+		info.alignment = static_cast<uint32_t>(alignof(T));
+		info.relocate = [](void* dst, void* src)
 		{
-			return entity->get_world()->broadcast<event::OnComponentRemoved<T>>(event::OnComponentRemoved<T>{ entity, &_data });
-		}
-
-		T _data;
-	};
+			T* src_component = static_cast<T*>(src);
+			new (dst) T(std::move(*src_component));
+			src_component->~T();
+		};
+		info.destruct = [](void* data)
+		{
+			static_cast<T*>(data)->~T();
+		};
+		info.broadcast_removed = [](Entity* entity, void* data)
+		{
+			return entity->get_world()->broadcast<event::OnComponentRemoved<T>>(
+				event::OnComponentRemoved<T>{ entity, static_cast<T*>(data) }
+			);
+		};
+		return info;
+	}
 
 	template <typename T>
 	T* Entity::get_component() const
 	{
-		auto iter = _components.find(std::type_index(typeid(T)));
-		if (iter != _components.end())
-		{
-			return &(reinterpret_cast<TComponentContainer<T>*>(iter->second.get())->_data);
-		}
-		return nullptr;
+		const uint32_t id = ComponentRegistry::get_id<T>();
+		if (!_mask.test(id)) return nullptr;
+		return static_cast<T*>(get_component_data(id));
 	}
 
 	template <typename T, typename... Args>
 	requires std::is_constructible_v<T, Args...>
 	T* Entity::assign(Args&&... arguments)
 	{
-		auto type_index = std::type_index(typeid(T));
-		auto iter = _components.find(type_index);
-		if (iter != _components.end())
+		const uint32_t id = ComponentRegistry::get_id<T>();
+		if (_mask.test(id))
 		{
-			auto* container = reinterpret_cast<TComponentContainer<T>*>(iter->second.get());
-			container->_data = T(arguments...);
-			if (!_world->broadcast<event::OnComponentAssigned<T>>(event::OnComponentAssigned<T>{ this, &container->_data })) return nullptr;
-			return &container->_data;
+			T* component = static_cast<T*>(get_component_data(id));
+			*component = T(std::forward<Args>(arguments)...);
+			mark_component_changed(id);
+			if (!_world->broadcast<event::OnComponentAssigned<T>>(event::OnComponentAssigned<T>{ this, component })) return nullptr;
+			return get_component<T>();
 		}
 		else
 		{
-			std::unique_ptr<TComponentContainer<T>> pContainer = std::make_unique<TComponentContainer<T>>(T(arguments...));
-
-			T* ret = &pContainer->_data;
-			if (!_world->broadcast<event::OnComponentAssigned<T>>(event::OnComponentAssigned<T>{ this, ret })) return nullptr;
-
+			T* component = new (add_component(id)) T(std::forward<Args>(arguments)...);
+			if (!_world->broadcast<event::OnComponentAssigned<T>>(event::OnComponentAssigned<T>{ this, component }))
 			{
-				std::lock_guard Lock(_component_mutex);
-				_components[type_index] = std::move(pContainer);
+				// 与之前一样, 订阅者失败时不保留该组件, 也不发送 OnComponentRemoved.
+				if (_mask.test(id)) remove_component(id);
+				return nullptr;
 			}
 
-			return ret;
+			// 订阅者可能给实体增加了其它组件, 组件已被移动, 需要重新获取.
+			return get_component<T>();
 		}
 	}
 }
 
+namespace std
+{
+	template <typename T, uint32_t IndexBits>
+	struct hash<fantasy::GenerationalHandle<T, IndexBits>>
+	{
+		std::size_t operator()(const fantasy::GenerationalHandle<T, IndexBits>& handle) const noexcept
+		{
+			return std::hash<T>()(handle.value);
+		}
+	};
+}
+
+
 
 
 
@@ -479,4 +1374,4 @@ namespace fantasy
 
 
 
-#endif
\ No newline at end of file
+#endif
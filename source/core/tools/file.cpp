@@ -0,0 +1,429 @@
+#include "file.h"
+#include "log.h"
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fantasy
+{
+	namespace serialization
+	{
+		static const uint64_t prime0 = 0x9e3779b185ebca87ull;
+		static const uint64_t prime1 = 0xc2b2ae3d27d4eb4full;
+		static const uint64_t prime2 = 0x165667b19e3779f9ull;
+		static const uint64_t prime3 = 0x85ebca77c2b2ae63ull;
+		static const uint64_t prime4 = 0x27d4eb2f165667c5ull;
+
+		static uint64_t rotate_left(uint64_t value, uint32_t shift)
+		{
+			return (value << shift) | (value >> (64 - shift));
+		}
+
+		static uint64_t read_u64(const uint8_t* data)
+		{
+			uint64_t value;
+			std::memcpy(&value, data, sizeof(uint64_t));
+			return value;
+		}
+
+		static uint32_t read_u32(const uint8_t* data)
+		{
+			uint32_t value;
+			std::memcpy(&value, data, sizeof(uint32_t));
+			return value;
+		}
+
+		static uint64_t checksum_round(uint64_t hash, uint64_t input)
+		{
+			hash += input * prime1;
+			hash = rotate_left(hash, 31);
+			return hash * prime0;
+		}
+
+		static uint64_t checksum_merge(uint64_t hash, uint64_t lane)
+		{
+			hash ^= checksum_round(0, lane);
+			return hash * prime0 + prime3;
+		}
+
+		static uint64_t align_offset(uint64_t offset, uint64_t alignment)
+		{
+			assert((alignment & (alignment - 1)) == 0 && alignment <= 64);
+			return (offset + alignment - 1) & ~(alignment - 1);
+		}
+
+		uint64_t compute_checksum(const void* data, uint64_t size, uint64_t seed)
+		{
+			const uint8_t* current = static_cast<const uint8_t*>(data);
+			const uint8_t* end = current + size;
+
+			uint64_t hash;
+			if (size >= 32)
+			{
+				// 4 条互不依赖的累加链, 每次处理 32 字节.
+				uint64_t lanes[4] = { seed + prime0 + prime1, seed + prime1, seed, seed - prime0 };
+				for (; current + 32 <= end; current += 32)
+				{
+					lanes[0] = checksum_round(lanes[0], read_u64(current));
+					lanes[1] = checksum_round(lanes[1], read_u64(current + 8));
+					lanes[2] = checksum_round(lanes[2], read_u64(current + 16));
+					lanes[3] = checksum_round(lanes[3], read_u64(current + 24));
+				}
+
+				hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+				for (uint64_t lane : lanes) hash = checksum_merge(hash, lane);
+			}
+			else
+			{
+				hash = seed + prime4;
+			}
+
+			hash += size;
+
+			for (; current + 8 <= end; current += 8)
+			{
+				hash ^= checksum_round(0, read_u64(current));
+				hash = rotate_left(hash, 27) * prime0 + prime3;
+			}
+			if (current + 4 <= end)
+			{
+				hash ^= static_cast<uint64_t>(read_u32(current)) * prime0;
+				hash = rotate_left(hash, 23) * prime1 + prime2;
+				current += 4;
+			}
+			for (; current < end; ++current)
+			{
+				hash ^= (*current) * prime4;
+				hash = rotate_left(hash, 11) * prime0;
+			}
+
+			hash ^= hash >> 33;
+			hash *= prime1;
+			hash ^= hash >> 29;
+			hash *= prime2;
+			hash ^= hash >> 32;
+			return hash;
+		}
+
+
+		BinaryOutput::BinaryOutput(const std::string& file_name, uint32_t version, uint64_t parameter_hash) :
+			_file_name(file_name)
+		{
+			_header.version = version;
+			_header.parameter_hash = parameter_hash;
+		}
+
+		void BinaryOutput::begin_chunk(uint32_t tag)
+		{
+			end_chunk();
+
+			// payload 前面是 64 字节的 ArchiveHeader, 所以 payload 内的对齐与文件内的对齐一致.
+			_payload.resize(align_offset(_payload.size(), chunk_alignment), 0);
+			_chunk_offset = _payload.size();
+
+			ChunkHeader chunk_header{ .tag = tag };
+			_payload.resize(_chunk_offset + sizeof(ChunkHeader));
+			std::memcpy(_payload.data() + _chunk_offset, &chunk_header, sizeof(ChunkHeader));
+
+			_chunk_opened = true;
+			_header.chunk_num++;
+		}
+
+		void BinaryOutput::save_binary_data(const void* data, uint64_t size, uint64_t alignment)
+		{
+			assert(!_finished);
+			if (!_chunk_opened) begin_chunk(default_chunk_tag);
+
+			const uint64_t offset = align_offset(_payload.size(), alignment);
+			_payload.resize(offset + size, 0);
+			if (size > 0) std::memcpy(_payload.data() + offset, data, size);
+		}
+
+		void BinaryOutput::end_chunk()
+		{
+			if (!_chunk_opened) return;
+
+			ChunkHeader chunk_header;
+			std::memcpy(&chunk_header, _payload.data() + _chunk_offset, sizeof(ChunkHeader));
+			chunk_header.size = _payload.size() - _chunk_offset - sizeof(ChunkHeader);
+			chunk_header.checksum = compute_checksum(_payload.data() + _chunk_offset + sizeof(ChunkHeader), chunk_header.size);
+			std::memcpy(_payload.data() + _chunk_offset, &chunk_header, sizeof(ChunkHeader));
+
+			// ArchiveHeader 的 checksum 依次合并每个 chunk 头.
+			_header.checksum = compute_checksum(&chunk_header, sizeof(ChunkHeader), _header.checksum);
+			_chunk_opened = false;
+		}
+
+		bool BinaryOutput::finish()
+		{
+			if (_finished) return true;
+
+			// 失败时保留数据, 可以再次调用.
+			end_chunk();
+			_header.payload_size = _payload.size();
+
+			const std::string temp_file_name = _file_name + ".tmp";
+			{
+				std::ofstream output(temp_file_name, std::ios::binary | std::ios::trunc);
+				if (!output.is_open())
+				{
+					LOG_ERROR("Failed to open " + temp_file_name + " for writing.");
+					return false;
+				}
+				output.write(reinterpret_cast<const char*>(&_header), sizeof(ArchiveHeader));
+				output.write(reinterpret_cast<const char*>(_payload.data()), static_cast<std::streamsize>(_payload.size()));
+				if (!output.good())
+				{
+					LOG_ERROR("Failed to write " + temp_file_name + ".");
+					output.close();
+					std::error_code error;
+					std::filesystem::remove(temp_file_name, error);
+					return false;
+				}
+			}
+
+			std::error_code error;
+			std::filesystem::rename(temp_file_name, _file_name, error);
+			if (error)
+			{
+				LOG_ERROR("Failed to replace " + _file_name + ": " + error.message());
+				std::filesystem::remove(temp_file_name, error);
+				return false;
+			}
+
+			_finished = true;
+			_payload.clear();
+			_payload.shrink_to_fit();
+			return true;
+		}
+
+
+		MappedFile::MappedFile(const std::string& file_name)
+		{
+#ifdef _WIN32
+			HANDLE file = CreateFileA(
+				file_name.c_str(), 
+				GENERIC_READ, 
+				FILE_SHARE_READ | FILE_SHARE_DELETE, 
+				nullptr, 
+				OPEN_EXISTING, 
+				FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 
+				nullptr
+			);
+			if (file == INVALID_HANDLE_VALUE) return;
+			_file_handle = file;
+
+			LARGE_INTEGER file_size;
+			if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return;
+
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr) return;
+			_mapping_handle = mapping;
+
+			_data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (_data) _size = static_cast<uint64_t>(file_size.QuadPart);
+#else
+			const int file = ::open(file_name.c_str(), O_RDONLY);
+			if (file < 0) return;
+
+			struct stat file_stat;
+			if (::fstat(file, &file_stat) == 0 && file_stat.st_size > 0)
+			{
+				void* data = ::mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+				if (data != MAP_FAILED)
+				{
+					_data = static_cast<const uint8_t*>(data);
+					_size = static_cast<uint64_t>(file_stat.st_size);
+				}
+			}
+			
+			// 映射建立之后不再需要文件描述符.
+			::close(file);
+#endif
+		}
+
+		MappedFile::~MappedFile()
+		{
+#ifdef _WIN32
+			if (_data) UnmapViewOfFile(_data);
+			if (_mapping_handle) CloseHandle(_mapping_handle);
+			if (_file_handle) CloseHandle(_file_handle);
+#else
+			if (_data) ::munmap(const_cast<uint8_t*>(_data), static_cast<size_t>(_size));
+#endif
+		}
+
+
+		BinaryInput::BinaryInput(const std::string& file_name, uint32_t version, uint64_t parameter_hash, ChecksumMode checksum_mode)
+		{
+			_valid = validate(file_name, version, parameter_hash);
+			if (_valid && checksum_mode == ChecksumMode::Full)
+			{
+				for (uint32_t ix = 0; ix < _chunks.size() && _valid; ++ix) _valid = verify_chunk(ix);
+				if (!_valid) LOG_WARN(file_name + " is corrupt.");
+			}
+
+			if (!_valid)
+			{
+				_file.reset();
+				_chunks.clear();
+				_data = nullptr;
+				_size = 0;
+				return;
+			}
+
+			_cursor = _chunk_end = sizeof(ArchiveHeader);
+
+			// 默认从第一个 chunk 开始读取.
+			if (!_chunks.empty()) set_chunk(0);
+		}
+
+		bool BinaryInput::validate(const std::string& file_name, uint32_t version, uint64_t parameter_hash)
+		{
+			_file = std::make_shared<MappedFile>(file_name);
+			if (!_file->is_valid()) return false;
+
+			_data = _file->data();
+			_size = _file->size();
+			if (_size < sizeof(ArchiveHeader))
+			{
+				LOG_WARN(file_name + " is not a valid archive.");
+				return false;
+			}
+
+			ArchiveHeader header;
+			std::memcpy(&header, _data, sizeof(ArchiveHeader));
+			if (header.magic != ArchiveHeader::magic_number || header.format != ArchiveHeader::format_version)
+			{
+				LOG_WARN(file_name + " is not a valid archive or was written by an older format.");
+				return false;
+			}
+			if (header.version != version || header.parameter_hash != parameter_hash)
+			{
+				LOG_INFO(file_name + " is stale.");
+				return false;
+			}
+			if (header.payload_size != _size - sizeof(ArchiveHeader))
+			{
+				LOG_WARN(file_name + " is corrupt.");
+				return false;
+			}
+
+			// 检查 chunk 链完整, 之后的读取只需要检查当前 chunk 的边界. 只读取 chunk 头, 数据所在的页不会被读入.
+			uint64_t checksum = 0;
+			uint64_t offset = sizeof(ArchiveHeader);
+			for (uint32_t ix = 0; ix < header.chunk_num; ++ix)
+			{
+				offset = align_offset(offset, chunk_alignment);
+				if (offset + sizeof(ChunkHeader) > _size)
+				{
+					LOG_WARN(file_name + " is corrupt.");
+					return false;
+				}
+
+				ChunkHeader chunk_header;
+				std::memcpy(&chunk_header, _data + offset, sizeof(ChunkHeader));
+				offset += sizeof(ChunkHeader);
+				if (chunk_header.size > _size - offset)
+				{
+					LOG_WARN(file_name + " is corrupt.");
+					return false;
+				}
+
+				checksum = compute_checksum(&chunk_header, sizeof(ChunkHeader), checksum);
+				_chunks.push_back(Chunk{ 
+					.tag = chunk_header.tag, 
+					.offset = offset, 
+					.size = chunk_header.size, 
+					.checksum = chunk_header.checksum 
+				});
+				offset += chunk_header.size;
+			}
+
+			if (checksum != header.checksum)
+			{
+				LOG_WARN(file_name + " is corrupt.");
+				return false;
+			}
+			return true;
+		}
+
+		void BinaryInput::set_chunk(uint32_t index)
+		{
+			_chunk_index = index;
+			_cursor = _chunks[index].offset;
+			_chunk_end = _chunks[index].offset + _chunks[index].size;
+		}
+
+		bool BinaryInput::verify_chunk(uint32_t index)
+		{
+			Chunk& chunk = _chunks[index];
+			if (!chunk.verified) chunk.verified = compute_checksum(_data + chunk.offset, chunk.size) == chunk.checksum;
+			return chunk.verified;
+		}
+
+		bool BinaryInput::open_chunk(uint32_t tag)
+		{
+			if (!_valid) return false;
+
+			for (uint32_t ix = 0; ix < _chunks.size(); ++ix)
+			{
+				if (_chunks[ix].tag == tag)
+				{
+					set_chunk(ix);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool BinaryInput::next_chunk()
+		{
+			if (!_valid || _chunk_index + 1 >= _chunks.size()) return false;
+
+			set_chunk(_chunk_index + 1);
+			return true;
+		}
+
+		const uint8_t* BinaryInput::read_bytes(uint64_t size, uint64_t alignment)
+		{
+			if (_failed || !_valid) return nullptr;
+
+			if (_chunk_index == INVALID_SIZE_32 || !verify_chunk(_chunk_index))
+			{
+				if (_chunk_index != INVALID_SIZE_32) LOG_WARN("Archive chunk checksum mismatch.");
+				_failed = true;
+				return nullptr;
+			}
+
+			const uint64_t offset = align_offset(_cursor, alignment);
+			if (offset > _chunk_end || size > _chunk_end - offset)
+			{
+				_failed = true;
+				return nullptr;
+			}
+
+			_cursor = offset + size;
+			return _data + offset;
+		}
+
+		void BinaryInput::load_binary_data(void* out_data, uint64_t size, uint64_t alignment)
+		{
+			if (size == 0) return;
+
+			const uint8_t* data = read_bytes(size, alignment);
+			if (data) std::memcpy(out_data, data, size);
+			else std::memset(out_data, 0, size);
+		}
+	}
+}
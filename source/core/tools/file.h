@@ -1,8 +1,15 @@
 #ifndef CORE_FILE_H
 #define CORE_FILE_H
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <new>
+#include <span>
 #include <string>
-#include <fstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../math/common.h"
 
 namespace fantasy
 {
@@ -42,119 +49,284 @@ namespace fantasy
 
 	namespace serialization
 	{
+		// 缓存文件格式:
+		// ArchiveHeader | ChunkHeader | 数据 | ChunkHeader | 数据 | ...
+		// 每个 chunk 的数据从 16 字节对齐的位置开始, 数组按元素的对齐填充, 读取时整块 memcpy.
+		// ArchiveHeader 中的 checksum 覆盖所有 ChunkHeader, 每个 ChunkHeader 中的 checksum 覆盖该 chunk 的数据,
+		// 所以打开文件时只需要读取 chunk 头, 数据在第一次读取时才校验.
+		struct ArchiveHeader
+		{
+			static constexpr uint32_t magic_number = 0x41535446;	// "FTSA".
+			static constexpr uint32_t format_version = 2;
+
+			uint32_t magic = magic_number;
+			uint32_t format = format_version;
+			uint32_t version = 0;			// 缓存内容的版本, 由使用者决定.
+			uint32_t chunk_num = 0;
+			uint64_t parameter_hash = 0;	// 生成缓存时的构建参数.
+			uint64_t payload_size = 0;
+			uint64_t checksum = 0;
+			uint8_t reserved[24] = {};
+		};
+		static_assert(sizeof(ArchiveHeader) == 64);
+
+		struct ChunkHeader
+		{
+			uint32_t tag = 0;
+			uint32_t reserved = 0;
+			uint64_t size = 0;
+			uint64_t checksum = 0;
+			uint64_t reserved1 = 0;
+		};
+		static_assert(sizeof(ChunkHeader) == 32);
+
+		static constexpr uint64_t chunk_alignment = 16;
+
+		constexpr uint32_t make_chunk_tag(char a, char b, char c, char d)
+		{
+			return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+		}
+
+		static constexpr uint32_t default_chunk_tag = make_chunk_tag('D', 'A', 'T', 'A');
+
+		// xxHash64 算法.
+		uint64_t compute_checksum(const void* data, uint64_t size, uint64_t seed = 0);
+
+		// 把构建参数合并为一个哈希, 参数需要是可平凡复制的类型.
+		template <typename... Args>
+		uint64_t hash_parameters(Args... arguments)
+		{
+			uint64_t hash = 0;
+			((hash = compute_checksum(&arguments, sizeof(Args), hash)), ...);
+			return hash;
+		}
+
+		// 可以整块读写的类型. std::pair 不是可平凡复制的, 但两个成员都是时内存布局同样固定.
+		template <typename T>
+		struct is_bulk_serializable : std::is_trivially_copyable<T> {};
+
+		template <typename T0, typename T1>
+		struct is_bulk_serializable<std::pair<T0, T1>> : 
+			std::bool_constant<std::is_trivially_copyable_v<T0> && std::is_trivially_copyable_v<T1>> {};
+
+
+		// 所有数据先写入内存, finish 时计算 checksum 并一次写入临时文件, 之后替换目标文件.
+		// 必须显式调用 finish, 没有调用就析构时丢弃数据, 中途失败不会留下不完整的缓存.
 		class BinaryOutput
 		{
 		public:
-			BinaryOutput(const std::string& file_name) : _output(file_name, std::ios::binary) {}
-			~BinaryOutput() { _output.close(); }
+			BinaryOutput(const std::string& file_name, uint32_t version = 0, uint64_t parameter_hash = 0);
 
 			template <typename... Args>
-			void operator()(Args&&... arguments)
+			void operator()(const Args&... arguments)
 			{
 				(process(arguments), ...);
 			}
 
-		public:
-			void save_binary_data(const void* data, int64_t size)
+			// 结束上一个 chunk 并开始新的 chunk, 没有调用时写入 default_chunk_tag.
+			// 分别读取的大块数据 (如每个 mesh 的 SDF) 各放一个 chunk, 读取时只校验用到的 chunk.
+			void begin_chunk(uint32_t tag);
+
+			void save_binary_data(const void* data, uint64_t size, uint64_t alignment = 1);
+
+			template <typename T>
+			void save_span(std::span<const T> data)
 			{
-				if (_output.is_open())
-				{
-					_output.write(static_cast<const char*>(data), size);
-					_output.write("\n", 1);
-				}
+				static_assert(is_bulk_serializable<T>::value);
+				save_binary_data(data.data(), data.size_bytes(), alignof(T));
 			}
 
+			bool finish();
+
 		private:
 			template <typename T>
-			void process(T&& value)
+			void process(const T& value)
 			{
-				process_impl(value);
+				static_assert(is_bulk_serializable<T>::value);
+				save_binary_data(&value, sizeof(T), alignof(T));
 			}
 
 			template <typename T>
-			void process_impl(const std::vector<T>& value)
+			void process(const std::vector<T>& value)
 			{
-				uint64_t size = value.size();
-				save_binary_data(&size, sizeof(uint64_t));
-				for (const T& element : value)
+				process(static_cast<uint64_t>(value.size()));
+				if constexpr (is_bulk_serializable<T>::value)
+				{
+					save_span(std::span<const T>(value));
+				}
+				else
 				{
-					process_impl(element);
+					for (const T& element : value) process(element);
 				}
 			}
 
-			void process_impl(const std::string& value)
+			void process(const std::string& value)
 			{
-				uint64_t size = value.size();
-				save_binary_data(&size, sizeof(uint64_t));
-				save_binary_data(value.data(), static_cast<int64_t>(size));
+				process(static_cast<uint64_t>(value.size()));
+				save_binary_data(value.data(), value.size());
 			}
 
-			void process_impl(uint64_t value) { save_binary_data(&value, sizeof(uint64_t)); }
-			void process_impl(uint32_t value) { save_binary_data(&value, sizeof(uint32_t)); }
-			void process_impl(float value) { save_binary_data(&value, sizeof(float)); }
+			void end_chunk();
 
 		private:
-			std::ofstream _output;
+			std::string _file_name;
+			ArchiveHeader _header;
+			std::vector<uint8_t> _payload;
+			uint64_t _chunk_offset = 0;
+			bool _chunk_opened = false;
+			bool _finished = false;
 		};
 
+		// 只读的文件映射, 起始地址按页对齐. 页面由系统按需读入, 内存紧张时可以直接丢弃, 不占用堆内存.
+		// Windows 下映射存在时不能替换文件, 重新生成缓存之前需要释放同一文件的映射.
+		class MappedFile
+		{
+		public:
+			explicit MappedFile(const std::string& file_name);
+			~MappedFile();
+
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			bool is_valid() const { return _data != nullptr; }
+			const uint8_t* data() const { return _data; }
+			uint64_t size() const { return _size; }
+
+		private:
+			const uint8_t* _data = nullptr;
+			uint64_t _size = 0;
+#ifdef _WIN32
+			void* _file_handle = nullptr;
+			void* _mapping_handle = nullptr;
+#endif
+		};
+
+		enum class ChecksumMode : uint8_t
+		{
+			Lazy,		// 第一次从某个 chunk 读取时校验整个 chunk, 没有读取的 chunk 不会被读入内存.
+			Full		// 打开时校验所有 chunk.
+		};
+
+		// 打开时映射整个文件, 检查 magic, 版本, 构建参数, chunk 头和它们的 checksum, 任何一项不符都视为无效.
+		// chunk 数据的 checksum 不符或读取越过 chunk 末尾时读取失败, 之后的读取全部返回 0, 调用者最后检查 good() 即可.
+		// read_span 直接返回文件映射中的数据, 需要长期持有时保存 get_file() 返回的映射.
 		class BinaryInput
 		{
 		public:
-			BinaryInput(const std::string& file_name) : _input(file_name, std::ios::binary) {}
-			~BinaryInput() noexcept { _input.close(); }
+			BinaryInput(
+				const std::string& file_name, 
+				uint32_t version = 0, 
+				uint64_t parameter_hash = 0, 
+				ChecksumMode checksum_mode = ChecksumMode::Lazy
+			);
+
+			bool is_valid() const { return _valid; }
+			bool good() const { return _valid && !_failed; }
+
+			const std::shared_ptr<MappedFile>& get_file() const { return _file; }
 
 			template <typename... Args>
-			void operator()(Args&&... arguments)
+			void operator()(Args&... arguments)
 			{
 				(process(arguments), ...);
 			}
 
-		public:
-			void load_binary_data(void* out_data, int64_t size)
+			// 定位到 tag 对应的第一个 chunk 的开头, 没有 open_chunk 时从第一个 chunk 开始读取.
+			bool open_chunk(uint32_t tag);
+
+			// 按文件中的顺序定位到下一个 chunk 的开头.
+			bool next_chunk();
+
+			void load_binary_data(void* out_data, uint64_t size, uint64_t alignment = 1);
+
+			// 返回当前 chunk 中的一段数据, 在文件映射释放之前有效.
+			const uint8_t* read_bytes(uint64_t size, uint64_t alignment = 1);
+
+			template <typename T>
+			std::span<const T> read_span(uint64_t count)
 			{
-				if (_input.is_open())
-				{
-					_input.read(static_cast<char*>(out_data), size);
-					char new_line;
-					_input.read(&new_line, 1);
-				}
+				static_assert(is_bulk_serializable<T>::value);
+
+				if (count > (_chunk_end - _cursor) / sizeof(T)) _failed = true;
+				if (_failed) return {};
+
+				const uint8_t* data = read_bytes(count * sizeof(T), alignof(T));
+				return data ? std::span<const T>(reinterpret_cast<const T*>(data), count) : std::span<const T>();
 			}
 
 		private:
 			template <typename T>
-			void process(T&& value)
+			void process(T& out)
 			{
-				process_impl(value);
+				static_assert(is_bulk_serializable<T>::value);
+				load_binary_data(&out, sizeof(T), alignof(T));
 			}
 
+			// 读取 std::vector 写入的数组, 不复制.
 			template <typename T>
-			void process_impl(std::vector<T>& out)
+			void process(std::span<const T>& out)
 			{
 				uint64_t size = 0;
-				load_binary_data(&size, sizeof(uint64_t));
+				process(size);
+				out = read_span<T>(size);
+			}
+
+			template <typename T>
+			void process(std::vector<T>& out)
+			{
+				uint64_t size = 0;
+				process(size);
+
+				// 元素数量超过 chunk 剩余的字节数时文件已经损坏, 不能按它分配内存.
+				if (size > _chunk_end - _cursor) _failed = true;
+				if (_failed) size = 0;
 
 				out.resize(size);
-				for (T& element : out)
+				if constexpr (is_bulk_serializable<T>::value)
+				{
+					load_binary_data(out.data(), size * sizeof(T), alignof(T));
+				}
+				else
 				{
-					process_impl(element);
+					for (T& element : out) process(element);
 				}
 			}
 
-			void process_impl(std::string& out)
+			void process(std::string& out)
 			{
 				uint64_t size = 0;
-				load_binary_data(&size, sizeof(uint64_t));
+				process(size);
+
+				if (size > _chunk_end - _cursor) _failed = true;
+				if (_failed) size = 0;
 
 				out.resize(size);
-				load_binary_data(out.data(), static_cast<int64_t>(size));
+				load_binary_data(out.data(), size);
 			}
 
-			void process_impl(uint64_t& OutValue) { load_binary_data(&OutValue, sizeof(uint64_t)); }
-			void process_impl(uint32_t& OutValue) { load_binary_data(&OutValue, sizeof(uint32_t)); }
-			void process_impl(float& OutValue) { load_binary_data(&OutValue, sizeof(float)); }
+			bool validate(const std::string& file_name, uint32_t version, uint64_t parameter_hash);
+			void set_chunk(uint32_t index);
+			bool verify_chunk(uint32_t index);
 
 		private:
-			std::ifstream _input;
+			struct Chunk
+			{
+				uint32_t tag = 0;
+				bool verified = false;
+				uint64_t offset = 0;	// 数据在文件中的位置.
+				uint64_t size = 0;
+				uint64_t checksum = 0;
+			};
+
+			std::shared_ptr<MappedFile> _file;
+			const uint8_t* _data = nullptr;
+			uint64_t _size = 0;
+			uint64_t _cursor = 0;
+			uint64_t _chunk_end = 0;
+			std::vector<Chunk> _chunks;
+			uint32_t _chunk_index = INVALID_SIZE_32;
+			bool _valid = false;
+			bool _failed = false;
 		};
 	}
 }
@@ -0,0 +1,608 @@
+#ifndef CORE_TOOLS_FLAT_HASH_MAP_H
+#define CORE_TOOLS_FLAT_HASH_MAP_H
+
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "hash_table.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLAT_HASH_MAP_SSE2 1
+#include <emmintrin.h>
+#else
+#define FLAT_HASH_MAP_SSE2 0
+#endif
+
+namespace fantasy
+{
+    namespace flat_hash
+    {
+        // 每个槽位有一个控制字节, 空和删除是负数, 占用时是哈希值的低 7 位 (h2).
+        static constexpr int8_t ctrl_empty = -128;
+        static constexpr int8_t ctrl_deleted = -2;
+
+        inline uint64_t h1(uint64_t hash) { return hash >> 7; }
+        inline int8_t h2(uint64_t hash) { return static_cast<int8_t>(hash & 0x7f); }
+
+        // 组内匹配结果, 每个槽位对应一位 (SSE2) 或一个字节的最高位 (便携实现).
+        template <uint32_t Shift>
+        struct BitMask
+        {
+            uint64_t mask;
+
+            explicit operator bool() const { return mask != 0; }
+            uint32_t lowest() const { return static_cast<uint32_t>(std::countr_zero(mask)) >> Shift; }
+            uint32_t trailing_zeros() const { return static_cast<uint32_t>(std::countr_zero(mask)) >> Shift; }
+            uint32_t leading_zeros(uint32_t width) const
+            {
+                return static_cast<uint32_t>(std::countl_zero(mask << (64 - (width << Shift)))) >> Shift;
+            }
+
+            BitMask& operator++() { mask &= mask - 1; return *this; }
+            uint32_t operator*() const { return lowest(); }
+            BitMask begin() const { return *this; }
+            BitMask end() const { return BitMask{ 0 }; }
+            bool operator!=(const BitMask& other) const { return mask != other.mask; }
+        };
+
+#if FLAT_HASH_MAP_SSE2
+        // 一次比较 16 个控制字节.
+        struct Group
+        {
+            static constexpr uint32_t width = 16;
+
+            __m128i ctrl;
+
+            explicit Group(const int8_t* pos) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+            BitMask<0> match(int8_t hash) const
+            {
+                return BitMask<0>{ static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(hash), ctrl))) };
+            }
+
+            BitMask<0> match_empty() const
+            {
+                return match(ctrl_empty);
+            }
+
+            // 空和删除的控制字节都小于 -1.
+            BitMask<0> match_empty_or_deleted() const
+            {
+                return BitMask<0>{ static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl))) };
+            }
+        };
+#else
+        // 没有 SSE2 时用 64 位整数一次比较 8 个控制字节.
+        struct Group
+        {
+            static constexpr uint32_t width = 8;
+            static constexpr uint64_t lsbs = 0x0101010101010101ull;
+            static constexpr uint64_t msbs = 0x8080808080808080ull;
+
+            uint64_t ctrl;
+
+            explicit Group(const int8_t* pos) { std::memcpy(&ctrl, pos, sizeof(ctrl)); }
+
+            // 可能有误报, 由调用者比较键值排除.
+            BitMask<3> match(int8_t hash) const
+            {
+                const uint64_t x = ctrl ^ (lsbs * static_cast<uint8_t>(hash));
+                return BitMask<3>{ (x - lsbs) & ~x & msbs };
+            }
+
+            // 只有空的控制字节最高位为 1 且次高位为 0.
+            BitMask<3> match_empty() const
+            {
+                return BitMask<3>{ (ctrl & ~(ctrl << 6)) & msbs };
+            }
+
+            BitMask<3> match_empty_or_deleted() const
+            {
+                return BitMask<3>{ (ctrl & ~(ctrl << 7)) & msbs };
+            }
+        };
+#endif
+    }
+
+
+    // Swiss table 风格的开放寻址哈希表, 元素直接存放在连续数组中.
+    // 控制字节按组用 SIMD 比较, 查找时大多数情况只需要比较一组控制字节和一次键值.
+    // 负载因子不超过 7/8, reserve 之后插入不会重新分配. 插入和 rehash 会使迭代器和元素指针失效.
+    // Policy 提供 slot_type, key_type 和 get_key.
+    template <typename Policy, typename Hash, typename KeyEqual>
+    class FlatHashTable
+    {
+    public:
+        using key_type = typename Policy::key_type;
+        using value_type = typename Policy::slot_type;
+        using size_type = uint64_t;
+        using hasher = Hash;
+        using key_equal = KeyEqual;
+
+        template <bool IsConst>
+        class Iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = typename Policy::slot_type;
+            using difference_type = std::ptrdiff_t;
+            using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+            using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+
+            Iterator() = default;
+            Iterator(const int8_t* ctrl, pointer slot, const int8_t* ctrl_end) : _ctrl(ctrl), _slot(slot), _ctrl_end(ctrl_end)
+            {
+                skip_empty();
+            }
+
+            // 允许 iterator 转换为 const_iterator.
+            template <bool OtherConst>
+            requires (IsConst && !OtherConst)
+            Iterator(const Iterator<OtherConst>& other) : _ctrl(other._ctrl), _slot(other._slot), _ctrl_end(other._ctrl_end)
+            {
+            }
+
+            reference operator*() const { return *_slot; }
+            pointer operator->() const { return _slot; }
+
+            Iterator& operator++()
+            {
+                ++_ctrl;
+                ++_slot;
+                skip_empty();
+                return *this;
+            }
+
+            Iterator operator++(int)
+            {
+                Iterator ret = *this;
+                ++(*this);
+                return ret;
+            }
+
+            bool operator==(const Iterator& other) const { return _slot == other._slot; }
+            bool operator!=(const Iterator& other) const { return _slot != other._slot; }
+
+        private:
+            friend class FlatHashTable;
+            template <bool> friend class Iterator;
+
+            void skip_empty()
+            {
+                while (_ctrl != _ctrl_end && *_ctrl < 0)
+                {
+                    ++_ctrl;
+                    ++_slot;
+                }
+            }
+
+            const int8_t* _ctrl = nullptr;
+            pointer _slot = nullptr;
+            const int8_t* _ctrl_end = nullptr;
+        };
+
+        using iterator = Iterator<false>;
+        using const_iterator = Iterator<true>;
+
+        // Hash 和 KeyEqual 都有 is_transparent 时, find/contains/erase 可以使用其它类型的键, 不需要构造 key_type.
+        template <typename K>
+        using lookup_key_t = std::conditional_t<
+            requires { typename Hash::is_transparent; typename KeyEqual::is_transparent; },
+            K,
+            key_type
+        >;
+
+    public:
+        FlatHashTable() = default;
+
+        explicit FlatHashTable(size_type capacity) { reserve(capacity); }
+
+        FlatHashTable(std::initializer_list<value_type> values)
+        {
+            reserve(values.size());
+            for (const auto& value : values) insert(value);
+        }
+
+        FlatHashTable(const FlatHashTable& other)
+        {
+            reserve(other._size);
+            for (const auto& value : other) emplace_unique(Policy::get_key(value), value);
+        }
+
+        FlatHashTable(FlatHashTable&& other) noexcept { swap(other); }
+
+        FlatHashTable& operator=(const FlatHashTable& other)
+        {
+            if (this != &other)
+            {
+                FlatHashTable copy(other);
+                swap(copy);
+            }
+            return *this;
+        }
+
+        FlatHashTable& operator=(FlatHashTable&& other) noexcept
+        {
+            if (this != &other)
+            {
+                destroy();
+                swap(other);
+            }
+            return *this;
+        }
+
+        ~FlatHashTable() { destroy(); }
+
+        void swap(FlatHashTable& other) noexcept
+        {
+            std::swap(_ctrl, other._ctrl);
+            std::swap(_slots, other._slots);
+            std::swap(_capacity, other._capacity);
+            std::swap(_size, other._size);
+            std::swap(_growth_left, other._growth_left);
+        }
+
+        iterator begin() { return iterator(_ctrl, _slots, _ctrl + _capacity); }
+        iterator end() { return iterator(_ctrl + _capacity, _slots + _capacity, _ctrl + _capacity); }
+        const_iterator begin() const { return const_iterator(_ctrl, _slots, _ctrl + _capacity); }
+        const_iterator end() const { return const_iterator(_ctrl + _capacity, _slots + _capacity, _ctrl + _capacity); }
+        const_iterator cbegin() const { return begin(); }
+        const_iterator cend() const { return end(); }
+
+        bool empty() const { return _size == 0; }
+        size_type size() const { return _size; }
+        size_type capacity() const { return _capacity; }
+
+        void clear()
+        {
+            if (_capacity == 0) return;
+
+            destroy_slots();
+            std::memset(_ctrl, flat_hash::ctrl_empty, _capacity + flat_hash::Group::width - 1);
+            _size = 0;
+            _growth_left = max_load(_capacity);
+        }
+
+        // 保证插入 count 个元素之前不会 rehash.
+        void reserve(size_type count)
+        {
+            if (count <= _size + _growth_left) return;
+
+            size_type capacity = flat_hash::Group::width;
+            while (max_load(capacity) < count) capacity *= 2;
+            rehash(capacity);
+        }
+
+        template <typename K = key_type>
+        iterator find(const K& key)
+        {
+            const uint64_t index = find_index(static_cast<const lookup_key_t<K>&>(key));
+            return index == INVALID_SIZE_64 ? end() : iterator_at(index);
+        }
+
+        template <typename K = key_type>
+        const_iterator find(const K& key) const
+        {
+            return const_cast<FlatHashTable*>(this)->find(key);
+        }
+
+        template <typename K = key_type>
+        bool contains(const K& key) const
+        {
+            return find_index(static_cast<const lookup_key_t<K>&>(key)) != INVALID_SIZE_64;
+        }
+
+        template <typename K = key_type>
+        size_type count(const K& key) const
+        {
+            return contains(key) ? 1 : 0;
+        }
+
+        std::pair<iterator, bool> insert(const value_type& value)
+        {
+            return emplace_unique(Policy::get_key(value), value);
+        }
+
+        std::pair<iterator, bool> insert(value_type&& value)
+        {
+            return emplace_unique(Policy::get_key(value), std::move(value));
+        }
+
+        template <typename... Args>
+        std::pair<iterator, bool> emplace(Args&&... arguments)
+        {
+            // 需要先构造出元素才能拿到键值, 已存在时会丢弃.
+            value_type value(std::forward<Args>(arguments)...);
+            return emplace_unique(Policy::get_key(value), std::move(value));
+        }
+
+        template <typename K = key_type>
+        size_type erase(const K& key)
+        {
+            const uint64_t index = find_index(static_cast<const lookup_key_t<K>&>(key));
+            if (index == INVALID_SIZE_64) return 0;
+
+            erase_index(index);
+            return 1;
+        }
+
+        iterator erase(const_iterator iter)
+        {
+            const uint64_t index = static_cast<uint64_t>(iter._slot - _slots);
+            erase_index(index);
+            return iterator_at(index + 1);
+        }
+
+        iterator erase(iterator iter)
+        {
+            return erase(const_iterator(iter));
+        }
+
+    protected:
+        // 在键不存在时用 arguments 构造元素.
+        template <typename K, typename... Args>
+        std::pair<iterator, bool> emplace_unique(const K& key, Args&&... arguments)
+        {
+            const uint64_t hash = Hash()(key);
+
+            uint64_t index = find_index(key, hash);
+            if (index != INVALID_SIZE_64) return { iterator_at(index), false };
+
+            index = prepare_insert(hash);
+            new (_slots + index) value_type(std::forward<Args>(arguments)...);
+            return { iterator_at(index), true };
+        }
+
+        iterator iterator_at(uint64_t index) { return iterator(_ctrl + index, _slots + index, _ctrl + _capacity); }
+
+    private:
+        static size_type max_load(size_type capacity) { return capacity - capacity / 8; }
+
+        template <typename K>
+        uint64_t find_index(const K& key) const
+        {
+            return find_index(key, Hash()(key));
+        }
+
+        // 三角数步长的按组探测, 容量是 2 的幂时会遍历所有组.
+        template <typename K>
+        uint64_t find_index(const K& key, uint64_t hash) const
+        {
+            if (_capacity == 0) return INVALID_SIZE_64;
+
+            const uint64_t mask = _capacity - 1;
+            uint64_t offset = flat_hash::h1(hash) & mask;
+            uint64_t step = 0;
+            while (true)
+            {
+                const flat_hash::Group group(_ctrl + offset);
+                for (uint32_t ix : group.match(flat_hash::h2(hash)))
+                {
+                    const uint64_t index = (offset + ix) & mask;
+                    if (KeyEqual()(Policy::get_key(_slots[index]), key)) return index;
+                }
+                if (group.match_empty()) return INVALID_SIZE_64;
+
+                step += flat_hash::Group::width;
+                offset = (offset + step) & mask;
+            }
+        }
+
+        uint64_t find_first_non_full(uint64_t hash) const
+        {
+            const uint64_t mask = _capacity - 1;
+            uint64_t offset = flat_hash::h1(hash) & mask;
+            uint64_t step = 0;
+            while (true)
+            {
+                const flat_hash::Group group(_ctrl + offset);
+                if (auto empty_mask = group.match_empty_or_deleted()) return (offset + empty_mask.lowest()) & mask;
+
+                step += flat_hash::Group::width;
+                offset = (offset + step) & mask;
+            }
+        }
+
+        uint64_t prepare_insert(uint64_t hash)
+        {
+            uint64_t index = _capacity == 0 ? INVALID_SIZE_64 : find_first_non_full(hash);
+            if (index == INVALID_SIZE_64 || (_growth_left == 0 && _ctrl[index] != flat_hash::ctrl_deleted))
+            {
+                // 删除标记较多时原容量 rehash 即可回收.
+                rehash(_size * 2 < max_load(_capacity) ? _capacity : std::max<size_type>(_capacity * 2, flat_hash::Group::width));
+                index = find_first_non_full(hash);
+            }
+
+            if (_ctrl[index] == flat_hash::ctrl_empty) _growth_left--;
+            set_ctrl(index, flat_hash::h2(hash));
+            _size++;
+            return index;
+        }
+
+        // 前 width - 1 个控制字节在末尾有一份拷贝, 从任意位置读取一组都不需要回绕.
+        void set_ctrl(uint64_t index, int8_t value)
+        {
+            _ctrl[index] = value;
+            _ctrl[((index - (flat_hash::Group::width - 1)) & (_capacity - 1)) + (flat_hash::Group::width - 1)] = value;
+        }
+
+        void erase_index(uint64_t index)
+        {
+            _slots[index].~value_type();
+            _size--;
+
+            // 所在的连续占用区间小于一组时, 探测不会越过该槽位, 可以直接标记为空.
+            const uint64_t index_before = (index - flat_hash::Group::width) & (_capacity - 1);
+            const auto empty_after = flat_hash::Group(_ctrl + index).match_empty();
+            const auto empty_before = flat_hash::Group(_ctrl + index_before).match_empty();
+            const bool was_never_full =
+                empty_after && empty_before &&
+                empty_after.trailing_zeros() + empty_before.leading_zeros(flat_hash::Group::width) < flat_hash::Group::width;
+
+            set_ctrl(index, was_never_full ? flat_hash::ctrl_empty : flat_hash::ctrl_deleted);
+            if (was_never_full) _growth_left++;
+        }
+
+        void rehash(size_type capacity)
+        {
+            int8_t* old_ctrl = _ctrl;
+            value_type* old_slots = _slots;
+            const size_type old_capacity = _capacity;
+
+            _capacity = capacity;
+            _ctrl = new int8_t[capacity + flat_hash::Group::width - 1];
+            _slots = static_cast<value_type*>(::operator new(sizeof(value_type) * capacity, std::align_val_t(alignof(value_type))));
+            std::memset(_ctrl, flat_hash::ctrl_empty, capacity + flat_hash::Group::width - 1);
+            _growth_left = max_load(capacity) - _size;
+
+            for (size_type ix = 0; ix < old_capacity; ++ix)
+            {
+                if (old_ctrl[ix] < 0) continue;
+
+                const uint64_t hash = Hash()(Policy::get_key(old_slots[ix]));
+                const uint64_t index = find_first_non_full(hash);
+                set_ctrl(index, flat_hash::h2(hash));
+                new (_slots + index) value_type(std::move(old_slots[ix]));
+                old_slots[ix].~value_type();
+            }
+
+            if (old_capacity != 0)
+            {
+                delete[] old_ctrl;
+                ::operator delete(old_slots, std::align_val_t(alignof(value_type)));
+            }
+        }
+
+        void destroy_slots()
+        {
+            if constexpr (!std::is_trivially_destructible_v<value_type>)
+            {
+                for (size_type ix = 0; ix < _capacity; ++ix)
+                {
+                    if (_ctrl[ix] >= 0) _slots[ix].~value_type();
+                }
+            }
+        }
+
+        void destroy()
+        {
+            if (_capacity == 0) return;
+
+            destroy_slots();
+            delete[] _ctrl;
+            ::operator delete(_slots, std::align_val_t(alignof(value_type)));
+            _ctrl = nullptr;
+            _slots = nullptr;
+            _capacity = 0;
+            _size = 0;
+            _growth_left = 0;
+        }
+
+    private:
+        int8_t* _ctrl = nullptr;
+        value_type* _slots = nullptr;
+        size_type _capacity = 0;
+        size_type _size = 0;
+        size_type _growth_left = 0;
+    };
+
+
+    template <typename K, typename V>
+    struct FlatHashMapPolicy
+    {
+        using key_type = K;
+        using slot_type = std::pair<const K, V>;
+
+        static const K& get_key(const slot_type& slot) { return slot.first; }
+    };
+
+    template <typename K>
+    struct FlatHashSetPolicy
+    {
+        using key_type = K;
+        using slot_type = K;
+
+        static const K& get_key(const slot_type& slot) { return slot; }
+    };
+
+    // rehash 时键值通过拷贝构造移动 (pair 中的键是 const), 以 std::string 为键时最好先 reserve.
+    template <typename K, typename V, typename Hash = MurmurHash<K>, typename KeyEqual = std::equal_to<>>
+    class FlatHashMap : public FlatHashTable<FlatHashMapPolicy<K, V>, Hash, KeyEqual>
+    {
+        using Base = FlatHashTable<FlatHashMapPolicy<K, V>, Hash, KeyEqual>;
+
+    public:
+        using mapped_type = V;
+        using typename Base::iterator;
+        using typename Base::const_iterator;
+        using Base::Base;
+
+        template <typename... Args>
+        std::pair<iterator, bool> try_emplace(const K& key, Args&&... arguments)
+        {
+            return Base::emplace_unique(
+                key,
+                std::piecewise_construct,
+                std::forward_as_tuple(key),
+                std::forward_as_tuple(std::forward<Args>(arguments)...)
+            );
+        }
+
+        template <typename... Args>
+        std::pair<iterator, bool> try_emplace(K&& key, Args&&... arguments)
+        {
+            return Base::emplace_unique(
+                key,
+                std::piecewise_construct,
+                std::forward_as_tuple(std::move(key)),
+                std::forward_as_tuple(std::forward<Args>(arguments)...)
+            );
+        }
+
+        template <typename M>
+        std::pair<iterator, bool> insert_or_assign(const K& key, M&& value)
+        {
+            auto result = try_emplace(key, std::forward<M>(value));
+            if (!result.second) result.first->second = std::forward<M>(value);
+            return result;
+        }
+
+        V& operator[](const K& key) { return try_emplace(key).first->second; }
+        V& operator[](K&& key) { return try_emplace(std::move(key)).first->second; }
+
+        template <typename Q = K>
+        V& at(const Q& key)
+        {
+            auto iter = Base::find(key);
+            assert(iter != Base::end());
+            return iter->second;
+        }
+
+        template <typename Q = K>
+        const V& at(const Q& key) const
+        {
+            auto iter = Base::find(key);
+            assert(iter != Base::end());
+            return iter->second;
+        }
+    };
+
+    template <typename K, typename Hash = MurmurHash<K>, typename KeyEqual = std::equal_to<>>
+    class FlatHashSet : public FlatHashTable<FlatHashSetPolicy<K>, Hash, KeyEqual>
+    {
+        using Base = FlatHashTable<FlatHashSetPolicy<K>, Hash, KeyEqual>;
+
+    public:
+        using Base::Base;
+    };
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include "frame_allocator.h"
+#include <algorithm>
+#include <bit>
+
+namespace fantasy
+{
+    static uint64_t align_offset(uint64_t offset, uint64_t alignment)
+    {
+        assert(std::has_single_bit(alignment) && alignment <= ArenaBlock::alignment);
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    LinearArena::LinearArena(uint64_t block_size) : _block_size(block_size)
+    {
+    }
+
+    void* LinearArena::allocate_slow(uint64_t size, uint64_t alignment)
+    {
+        while (true)
+        {
+            if (_current_block < _blocks.size())
+            {
+                ArenaBlock& block = _blocks[_current_block];
+                const uint64_t begin = align_offset(_offset, alignment);
+                if (begin + size <= block.size)
+                {
+                    _stats.allocation_num++;
+                    _stats.used_bytes += begin + size - _offset;
+                    _offset = begin + size;
+                    return block.data.get() + begin;
+                }
+
+                // 回退之后保留的块.
+                if (_current_block + 1 < _blocks.size())
+                {
+                    _current_block++;
+                    _offset = 0;
+                    continue;
+                }
+            }
+
+            const uint64_t block_size = std::max(_blocks.empty() ? _block_size : _blocks.back().size * 2, size);
+            _blocks.push_back(ArenaBlock::create(block_size));
+            _stats.heap_allocation_num++;
+            _stats.capacity += block_size;
+
+            _current_block = static_cast<uint32_t>(_blocks.size() - 1);
+            _offset = 0;
+        }
+    }
+
+    void LinearArena::rewind(const Marker& marker)
+    {
+        assert(marker.block < _current_block || (marker.block == _current_block && marker.offset <= _offset));
+
+        _current_block = marker.block;
+        _offset = marker.offset;
+
+        // 回退到起点时合并块, 下一轮只需要一个块.
+        if (_current_block == 0 && _offset == 0) merge_blocks();
+    }
+
+    void LinearArena::reset()
+    {
+        _current_block = 0;
+        _offset = 0;
+        merge_blocks();
+
+        _stats = ArenaStats{};
+        for (const auto& block : _blocks) _stats.capacity += block.size;
+    }
+
+    void LinearArena::merge_blocks()
+    {
+        if (_blocks.size() <= 1) return;
+
+        uint64_t total_size = 0;
+        for (const auto& block : _blocks) total_size += block.size;
+
+        _blocks.clear();
+        _blocks.push_back(ArenaBlock::create(total_size));
+        _stats.heap_allocation_num++;
+    }
+
+
+    FrameAllocator::FrameAllocator(uint64_t block_size)
+    {
+        for (auto& arena : _arenas)
+        {
+            arena.blocks[0] = ArenaBlock::create(block_size);
+            arena.block_num = 1;
+        }
+    }
+
+    void* FrameAllocator::allocate(uint64_t size, uint64_t alignment)
+    {
+        Arena& arena = _arenas[_frame_index % FLIGHT_FRAME_NUM];
+
+        uint64_t cursor = arena.cursor.load(std::memory_order_acquire);
+        while (true)
+        {
+            // cursor 中的块在发布 cursor 之前已经创建, 之后直到 reset 都不会改变.
+            const uint32_t block_index = static_cast<uint32_t>(cursor >> block_shift);
+            const ArenaBlock& block = arena.blocks[block_index];
+
+            const uint64_t begin = align_offset(cursor & offset_mask, alignment);
+            if (begin + size <= block.size)
+            {
+                const uint64_t new_cursor = (static_cast<uint64_t>(block_index) << block_shift) | (begin + size);
+                if (arena.cursor.compare_exchange_weak(cursor, new_cursor, std::memory_order_acquire))
+                {
+                    if (counter_enabled()) arena.allocation_num.fetch_add(1, std::memory_order_relaxed);
+                    return block.data.get() + begin;
+                }
+                continue;
+            }
+
+            {
+                std::lock_guard lock(_grow_mutex);
+
+                // 其它线程已经换了新块时直接重试.
+                const uint64_t current_cursor = arena.cursor.load(std::memory_order_relaxed);
+                if ((current_cursor >> block_shift) == block_index)
+                {
+                    assert(block_index + 1 < max_block_num);
+
+                    arena.retired_bytes += current_cursor & offset_mask;
+
+                    arena.blocks[block_index + 1] = ArenaBlock::create(std::max(block.size * 2, size));
+                    arena.block_num = block_index + 2;
+                    arena.heap_allocation_num++;
+                    arena.cursor.store(static_cast<uint64_t>(block_index + 1) << block_shift, std::memory_order_release);
+                }
+            }
+            cursor = arena.cursor.load(std::memory_order_acquire);
+        }
+    }
+
+    void FrameAllocator::begin_frame()
+    {
+        _last_frame_stats = get_stats(_arenas[_frame_index % FLIGHT_FRAME_NUM]);
+        _frame_index++;
+        reset(_arenas[_frame_index % FLIGHT_FRAME_NUM]);
+    }
+
+    ArenaStats FrameAllocator::get_frame_stats() const
+    {
+        return get_stats(_arenas[_frame_index % FLIGHT_FRAME_NUM]);
+    }
+
+    void FrameAllocator::reset(Arena& arena)
+    {
+        arena.retired_bytes = 0;
+        arena.heap_allocation_num = 0;
+
+        // 上一次使用了多个块时合并为一个, 同样的负载下一次不再需要申请新块.
+        if (arena.block_num > 1)
+        {
+            uint64_t total_size = 0;
+            for (uint32_t ix = 0; ix < arena.block_num; ++ix)
+            {
+                total_size += arena.blocks[ix].size;
+                arena.blocks[ix] = ArenaBlock{};
+            }
+            arena.blocks[0] = ArenaBlock::create(total_size);
+            arena.block_num = 1;
+            arena.heap_allocation_num++;
+        }
+
+        arena.cursor.store(0, std::memory_order_relaxed);
+        arena.allocation_num.store(0, std::memory_order_relaxed);
+    }
+
+    ArenaStats FrameAllocator::get_stats(const Arena& arena) const
+    {
+        ArenaStats stats;
+        stats.allocation_num = arena.allocation_num.load(std::memory_order_relaxed);
+        stats.used_bytes = arena.retired_bytes + (arena.cursor.load(std::memory_order_relaxed) & offset_mask);
+        stats.heap_allocation_num = arena.heap_allocation_num;
+        for (uint32_t ix = 0; ix < arena.block_num; ++ix) stats.capacity += arena.blocks[ix].size;
+        return stats;
+    }
+
+
+    FrameAllocator& get_frame_allocator()
+    {
+        static FrameAllocator allocator;
+        return allocator;
+    }
+
+    LinearArena& get_scratch_arena()
+    {
+        thread_local LinearArena arena;
+        return arena;
+    }
+}
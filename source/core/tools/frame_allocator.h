@@ -0,0 +1,232 @@
+#ifndef CORE_TOOLS_FRAME_ALLOCATOR_H
+#define CORE_TOOLS_FRAME_ALLOCATOR_H
+
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace fantasy
+{
+    struct ArenaStats
+    {
+        uint64_t allocation_num = 0;        // 由 arena 分配, 不经过全局堆的次数.
+        uint64_t used_bytes = 0;            // 包含对齐的填充.
+        uint64_t heap_allocation_num = 0;   // arena 自身向全局堆申请新块的次数.
+        uint64_t capacity = 0;
+    };
+
+    // arena 的内存块, 起始地址按 cache line 对齐.
+    struct ArenaBlock
+    {
+        static constexpr uint64_t alignment = 64;
+
+        struct Deleter
+        {
+            void operator()(uint8_t* data) const { ::operator delete[](data, std::align_val_t(alignment)); }
+        };
+
+        std::unique_ptr<uint8_t[], Deleter> data;
+        uint64_t size = 0;
+
+        static ArenaBlock create(uint64_t size)
+        {
+            ArenaBlock block;
+            block.data.reset(static_cast<uint8_t*>(::operator new[](size, std::align_val_t(alignment))));
+            block.size = size;
+            return block;
+        }
+    };
+
+
+    // 单线程的线性分配器, 只能按 marker 整体回退, 单独的 deallocate 不回收内存.
+    // 空间不足时申请一个更大的新块, reset 时把本轮用到的块合并为一个, 稳定之后不再访问全局堆.
+    class LinearArena
+    {
+    public:
+        struct Marker
+        {
+            uint32_t block = 0;
+            uint64_t offset = 0;
+        };
+
+        explicit LinearArena(uint64_t block_size = 64 * 1024);
+
+        // alignment 不能超过 ArenaBlock::alignment.
+        void* allocate(uint64_t size, uint64_t alignment = alignof(std::max_align_t))
+        {
+            assert((alignment & (alignment - 1)) == 0 && alignment <= ArenaBlock::alignment);
+
+            if (_current_block < _blocks.size())
+            {
+                const uint64_t begin = (_offset + alignment - 1) & ~(alignment - 1);
+                if (begin + size <= _blocks[_current_block].size)
+                {
+                    _stats.allocation_num++;
+                    _stats.used_bytes += begin + size - _offset;
+                    _offset = begin + size;
+                    return _blocks[_current_block].data.get() + begin;
+                }
+            }
+            return allocate_slow(size, alignment);
+        }
+
+        Marker get_marker() const { return Marker{ _current_block, _offset }; }
+        void rewind(const Marker& marker);
+        void reset();
+
+        // 从上次 reset 开始的统计.
+        const ArenaStats& get_stats() const { return _stats; }
+
+    private:
+        void* allocate_slow(uint64_t size, uint64_t alignment);
+        void merge_blocks();
+
+    private:
+        uint64_t _block_size;
+        std::vector<ArenaBlock> _blocks;
+        uint32_t _current_block = 0;
+        uint64_t _offset = 0;
+        ArenaStats _stats;
+    };
+
+
+    // 按帧回收的线程安全线性分配器, FLIGHT_FRAME_NUM 个 arena 轮流使用.
+    // 分配的内存在之后的 FLIGHT_FRAME_NUM - 1 次 begin_frame 之内有效, 可以直接交给 GPU 仍在使用的命令.
+    // allocate 只有一次 CAS, 当前块用完时加锁申请新块.
+    class FrameAllocator
+    {
+    public:
+        explicit FrameAllocator(uint64_t block_size = 1024 * 1024);
+
+        void* allocate(uint64_t size, uint64_t alignment = alignof(std::max_align_t));
+
+        // 分配次数的计数默认关闭, 开启后每次分配多一次 fetch_add.
+        void set_counter_enabled(bool enabled) { _counter_enabled.store(enabled, std::memory_order_relaxed); }
+        bool counter_enabled() const { return _counter_enabled.load(std::memory_order_relaxed); }
+
+        // 切换到下一个 arena 并清空, 不能与 allocate 并发.
+        // 调用者需要保证该 arena 上一次使用时 (FLIGHT_FRAME_NUM 帧之前) 提交的 GPU 命令已经完成.
+        void begin_frame();
+
+        uint64_t get_frame_index() const { return _frame_index; }
+
+        // 当前帧和上一个完整帧的统计.
+        ArenaStats get_frame_stats() const;
+        const ArenaStats& get_last_frame_stats() const { return _last_frame_stats; }
+
+    private:
+        // 块的大小每次翻倍, 32 个块足够使用.
+        static constexpr uint32_t max_block_num = 32;
+        static constexpr uint32_t block_shift = 40;
+        static constexpr uint64_t offset_mask = (1ull << block_shift) - 1;
+
+        struct Arena
+        {
+            // 高位是当前块的序号, 低 block_shift 位是块内偏移, 切换块时偏移同时归零, 避免 ABA.
+            std::atomic<uint64_t> cursor = 0;
+            std::array<ArenaBlock, max_block_num> blocks;
+            uint32_t block_num = 0;
+
+            // 已经换下的块中使用的字节数, 换块之后旧块的偏移不会再改变.
+            uint64_t retired_bytes = 0;
+            uint64_t heap_allocation_num = 0;
+
+            alignas(64) std::atomic<uint64_t> allocation_num = 0;
+        };
+
+        void reset(Arena& arena);
+        ArenaStats get_stats(const Arena& arena) const;
+
+    private:
+        uint64_t _frame_index = 0;
+        std::atomic<bool> _counter_enabled = false;
+        std::array<Arena, FLIGHT_FRAME_NUM> _arenas;
+        std::mutex _grow_mutex;
+        ArenaStats _last_frame_stats;
+    };
+
+    FrameAllocator& get_frame_allocator();
+
+    // 当前线程的临时 arena, 配合 ScratchScope 使用, 作用域结束时回退.
+    LinearArena& get_scratch_arena();
+
+    class ScratchScope
+    {
+    public:
+        ScratchScope() : _arena(get_scratch_arena()), _marker(_arena.get_marker()) {}
+        ~ScratchScope() { _arena.rewind(_marker); }
+
+        ScratchScope(const ScratchScope&) = delete;
+        ScratchScope& operator=(const ScratchScope&) = delete;
+
+        LinearArena& get_arena() { return _arena; }
+
+    private:
+        LinearArena& _arena;
+        LinearArena::Marker _marker;
+    };
+
+
+    // STL 分配器, deallocate 不回收内存. 容器不能跨帧保存, 需要在下一帧重新创建.
+    template <typename T>
+    class FrameStlAllocator
+    {
+    public:
+        using value_type = T;
+
+        FrameStlAllocator() = default;
+        template <typename U> FrameStlAllocator(const FrameStlAllocator<U>&) {}
+
+        T* allocate(std::size_t count)
+        {
+            return static_cast<T*>(get_frame_allocator().allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, std::size_t) {}
+
+        template <typename U> bool operator==(const FrameStlAllocator<U>&) const { return true; }
+    };
+
+    // 容器需要在 arena 回退之前销毁.
+    template <typename T>
+    class ArenaStlAllocator
+    {
+    public:
+        using value_type = T;
+
+        ArenaStlAllocator(LinearArena& arena) : _arena(&arena) {}
+        template <typename U> ArenaStlAllocator(const ArenaStlAllocator<U>& other) : _arena(other.get_arena()) {}
+
+        T* allocate(std::size_t count)
+        {
+            return static_cast<T*>(_arena->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, std::size_t) {}
+
+        LinearArena* get_arena() const { return _arena; }
+
+        template <typename U> bool operator==(const ArenaStlAllocator<U>& other) const { return _arena == other.get_arena(); }
+
+    private:
+        LinearArena* _arena;
+    };
+
+    template <typename T>
+    using FrameVector = std::vector<T, FrameStlAllocator<T>>;
+
+    template <typename T>
+    using ScratchVector = std::vector<T, ArenaStlAllocator<T>>;
+}
+
+
+
+
+#endif
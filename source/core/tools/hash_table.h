@@ -2,7 +2,11 @@
 #define TOOLS_HASH_TABLE_H
 
 
+#include <cstring>
 #include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 #include "../math/vector.h"
 
@@ -74,6 +78,17 @@ namespace fantasy
         return hash;
     }
 
+    // MurmurHash3 的 64 位 finalizer, 输出的每一位都与输入的所有位相关.
+    inline uint64_t murmur_mix_64(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
     inline uint32_t hash(const float3& vec)
 	{
 		union 
@@ -87,6 +102,73 @@ namespace fantasy
 		z.f = (vec.z == 0.0f ? 0 : vec.z);
 		return murmur_mix(murmur_add(murmur_add(x.u, y.u), z.u));
 	}
+
+    inline uint32_t murmur_hash(std::string_view str)
+    {
+        uint32_t hash = 0;
+        uint64_t ix = 0;
+        for (; ix + 4 <= str.size(); ix += 4)
+        {
+            uint32_t element;
+            std::memcpy(&element, str.data() + ix, sizeof(uint32_t));
+            hash = murmur_add(hash, element);
+        }
+
+        uint32_t tail = 0;
+        for (uint64_t jx = 0; ix + jx < str.size(); ++jx)
+        {
+            tail |= static_cast<uint32_t>(static_cast<uint8_t>(str[ix + jx])) << (jx * 8);
+        }
+        return murmur_mix(murmur_add(hash, tail) ^ static_cast<uint32_t>(str.size()));
+    }
+
+    // FlatHashMap 默认的哈希策略, 整数, 指针, 枚举, float3 和字符串使用 murmur_* 函数.
+    // 字符串的哈希支持 std::string, std::string_view 和 const char* 的异构查找.
+    // 结果最后经过 murmur_mix_64, FlatHashTable 用高 57 位定位分组, 32 位的哈希值会使大于 2^25 的容量只用到前面一部分.
+    template <typename T>
+    struct MurmurHash
+    {
+        uint64_t operator()(const T& value) const
+        {
+            if constexpr (std::is_same_v<T, float3>)
+            {
+                return murmur_mix_64(hash(value));
+            }
+            else if constexpr (std::is_pointer_v<T>)
+            {
+                return MurmurHash<uintptr_t>()(reinterpret_cast<uintptr_t>(value));
+            }
+            else if constexpr (std::is_enum_v<T>)
+            {
+                return MurmurHash<std::underlying_type_t<T>>()(static_cast<std::underlying_type_t<T>>(value));
+            }
+            else if constexpr (std::is_integral_v<T> && sizeof(T) <= sizeof(uint32_t))
+            {
+                return murmur_mix_64(static_cast<uint32_t>(value));
+            }
+            else if constexpr (std::is_integral_v<T>)
+            {
+                return murmur_mix_64(static_cast<uint64_t>(value));
+            }
+            else
+            {
+                return murmur_mix_64(std::hash<T>()(value));
+            }
+        }
+    };
+
+    template <>
+    struct MurmurHash<std::string>
+    {
+        using is_transparent = void;
+
+        uint64_t operator()(std::string_view str) const { return murmur_mix_64(murmur_hash(str)); }
+    };
+
+    template <>
+    struct MurmurHash<std::string_view> : public MurmurHash<std::string>
+    {
+    };
 }
 
 
@@ -1,76 +1,448 @@
 #ifndef CORE_TOOLS_LRU_CACHE_H
 #define CORE_TOOLS_LRU_CACHE_H
 
+#include <algorithm>
 #include <cstdint>
 #include <cassert>
-#include <unordered_map>
 #include <utility>
+#include <vector>
+#include "hash_table.h"
+#include "../math/common.h"
 
-namespace fantasy 
+namespace fantasy
 {
-    template <typename T>
-    class LruCache 
+    enum class LruSlotState : uint8_t
+    {
+        Evictable,
+        Protected,      // 最近几帧访问过, 只在没有 Evictable 的槽位时淘汰.
+        Pinned          // 不会被淘汰.
+    };
+
+    // 槽位之间的双向链接, 由淘汰策略持有, 按槽位下标索引.
+    struct LruLinks
+    {
+        std::vector<uint32_t> prev;
+        std::vector<uint32_t> next;
+
+        void resize(uint32_t capacity)
+        {
+            prev.assign(capacity, INVALID_SIZE_32);
+            next.assign(capacity, INVALID_SIZE_32);
+        }
+    };
+
+    // 侵入式链表, 头部是最近使用的槽位.
+    struct LruList
+    {
+        uint32_t head = INVALID_SIZE_32;
+        uint32_t tail = INVALID_SIZE_32;
+        uint32_t size = 0;
+
+        void push_front(LruLinks& links, uint32_t slot)
+        {
+            links.prev[slot] = INVALID_SIZE_32;
+            links.next[slot] = head;
+            if (head != INVALID_SIZE_32) links.prev[head] = slot;
+            else tail = slot;
+            head = slot;
+            size++;
+        }
+
+        void remove(LruLinks& links, uint32_t slot)
+        {
+            const uint32_t prev = links.prev[slot];
+            const uint32_t next = links.next[slot];
+            if (prev != INVALID_SIZE_32) links.next[prev] = next;
+            else head = next;
+            if (next != INVALID_SIZE_32) links.prev[next] = prev;
+            else tail = prev;
+            size--;
+        }
+
+        // 从尾部开始找第一个没有被 pin 的槽位.
+        // 链表按访问顺序排列, 如果它处于保护的帧内, 之后的槽位也都是, 所以不需要继续查找.
+        template <typename F>
+        uint32_t find_back(const LruLinks& links, F&& get_state) const
+        {
+            for (uint32_t slot = tail; slot != INVALID_SIZE_32; slot = links.prev[slot])
+            {
+                if (get_state(slot) != LruSlotState::Pinned) return slot;
+            }
+            return INVALID_SIZE_32;
+        }
+    };
+
+
+    // 淘汰策略只维护槽位的顺序, 槽位由 LruCache 分配. on_remove 的 evicted 表示是否是被淘汰, 而不是直接删除.
+    // select_victim 优先返回 Evictable 的槽位, 其次是 Protected 的槽位, 都没有则返回 INVALID_SIZE_32.
+    // 选中的槽位随后会被 on_remove 移除.
+
+    // 严格的 LRU.
+    class LruPolicy
     {
     public:
-        LruCache(uint32_t capacity = 0) : _capacity(capacity)
+        void resize(uint32_t capacity) { _links.resize(capacity); _list = LruList{}; }
+
+        void on_insert(uint32_t slot, uint64_t) { _list.push_front(_links, slot); }
+        void on_remove(uint32_t slot, uint64_t, bool) { _list.remove(_links, slot); }
+
+        void on_access(uint32_t slot)
         {
+            if (_list.head == slot) return;
+            _list.remove(_links, slot);
+            _list.push_front(_links, slot);
         }
 
-        bool check_cache(uint64_t key, T& out_element)
+        template <typename F>
+        uint32_t select_victim(F&& get_state) { return _list.find_back(_links, get_state); }
+
+    private:
+        LruLinks _links;
+        LruList _list;
+    };
+
+    // CLOCK (second chance), 访问时只设置引用位, 不移动链接.
+    class ClockPolicy
+    {
+    public:
+        void resize(uint32_t capacity)
+        {
+            _states.assign(capacity, State_Empty);
+            _hand = 0;
+        }
+
+        void on_insert(uint32_t slot, uint64_t) { _states[slot] = State_Referenced; }
+        void on_remove(uint32_t slot, uint64_t, bool) { _states[slot] = State_Empty; }
+        void on_access(uint32_t slot) { _states[slot] = State_Referenced; }
+
+        // 最多转两圈, 第一圈清除引用位. 一圈内没有遇到 Evictable 的槽位时直接返回第一个 Protected 的槽位.
+        // 槽位没有访问顺序, 所以当前帧使用的元素超过容量时每次淘汰都需要转一圈, 这种情况应该使用 LruPolicy.
+        template <typename F>
+        uint32_t select_victim(F&& get_state)
         {
-            auto iter = _map.find(key);
-            if (iter != _map.end())
+            const uint32_t capacity = static_cast<uint32_t>(_states.size());
+            uint32_t protected_slot = INVALID_SIZE_32;
+            bool found_evictable = false;
+            for (uint32_t ix = 0; ix < capacity * 2; ++ix)
             {
-                out_element = iter->second->second;
-                _list.splice(_list.begin(), _list, iter->second);
-                return true;
+                if (ix == capacity && !found_evictable) break;
+
+                const uint32_t slot = _hand;
+                _hand = _hand + 1 == capacity ? 0 : _hand + 1;
+                if (_states[slot] == State_Empty) continue;
+
+                const LruSlotState state = get_state(slot);
+                if (state == LruSlotState::Pinned) continue;
+                if (state == LruSlotState::Protected)
+                {
+                    if (protected_slot == INVALID_SIZE_32) protected_slot = slot;
+                    continue;
+                }
+
+                found_evictable = true;
+                if (_states[slot] == State_Referenced)
+                {
+                    _states[slot] = State_Unreferenced;
+                    continue;
+                }
+                return slot;
             }
-            return false;
+            return protected_slot;
+        }
+
+    private:
+        enum State : uint8_t
+        {
+            State_Empty,
+            State_Unreferenced,
+            State_Referenced
+        };
+
+        std::vector<State> _states;
+        uint32_t _hand = 0;
+    };
+
+    // 固定容量的缓存, 所有内存在 resize 时分配, 插入和访问都不会分配内存.
+    // 元素放在连续数组中, 键到槽位的索引使用线性探测的开放寻址表.
+    // 被 pin 的元素不会被淘汰. 最近 protected_frame_num 帧内访问过的元素只在没有其它可淘汰元素时才会被淘汰.
+    template <typename T, typename Policy = LruPolicy>
+    class LruCache
+    {
+    public:
+        LruCache(uint32_t capacity = 0) { resize(capacity); }
+
+        // 会清空缓存.
+        void resize(uint32_t capacity)
+        {
+            _capacity = capacity;
+            _keys.assign(capacity, 0);
+            _values.assign(capacity, T{});
+            _frames.assign(capacity, 0);
+            _pin_counts.assign(capacity, 0);
+            _index.assign(next_power_of_2(std::max(capacity * 2, 2u)), INVALID_SIZE_32);
+            _index_mask = static_cast<uint32_t>(_index.size() - 1);
+            reset();
         }
 
-        T evict()
+        void reset()
+        {
+            std::fill(_index.begin(), _index.end(), INVALID_SIZE_32);
+            std::fill(_pin_counts.begin(), _pin_counts.end(), 0);
+
+            _free_slots.resize(_capacity);
+            for (uint32_t ix = 0; ix < _capacity; ++ix) _free_slots[ix] = _capacity - ix - 1;
+            _size = 0;
+            _policy.resize(_capacity);
+        }
+
+        uint32_t capacity() const { return _capacity; }
+        uint32_t size() const { return _size; }
+
+        // 命中时更新淘汰顺序和访问帧.
+        bool check_cache(uint64_t key, T& out_element)
         {
-            if (_list.empty()) assert(!"Lru is empty.");
+            const uint32_t slot = find_slot(key);
+            if (slot == INVALID_SIZE_32) return false;
 
-            auto [key, value] = _list.back();
-            _list.pop_back();
-            _map.erase(key);
+            touch(slot);
+            out_element = _values[slot];
+            return true;
+        }
 
-            return value;
+        // 不更新淘汰顺序.
+        const T* find(uint64_t key) const
+        {
+            const uint32_t slot = find_slot(key);
+            return slot == INVALID_SIZE_32 ? nullptr : &_values[slot];
         }
 
-        void insert(uint64_t key, const T& value) 
+        // 已经存在时更新值并视为一次访问. 缓存已满时先淘汰一个元素, 所有元素都被 pin 时返回 false.
+        bool insert(uint64_t key, const T& value)
         {
-            auto map_iter = _map.find(key);
-            if(map_iter == _map.end())
+            uint32_t slot = find_slot(key);
+            if (slot != INVALID_SIZE_32)
             {
-                _list.push_front(std::make_pair(key, value));
-                _map.insert(std::make_pair(key, _list.begin()));
-                if(_list.size() > _capacity)
+                _values[slot] = value;
+                touch(slot);
+                return true;
+            }
+
+            if (_free_slots.empty())
+            {
+                T evicted;
+                if (!evict(evicted)) return false;
+            }
+
+            slot = _free_slots.back();
+            _free_slots.pop_back();
+
+            _keys[slot] = key;
+            _values[slot] = value;
+            _frames[slot] = _frame_index;
+            _pin_counts[slot] = 0;
+            insert_index(key, slot);
+            _policy.on_insert(slot, key);
+            _size++;
+            return true;
+        }
+
+        // 按策略淘汰一个元素, 空闲的槽位留给之后的 insert.
+        bool evict(T& out_element)
+        {
+            const uint32_t slot = _policy.select_victim(
+                [this](uint32_t slot)
                 {
-                    _map.erase(_list.back().first);
-                    _list.pop_back();
+                    if (_pin_counts[slot] != 0) return LruSlotState::Pinned;
+                    return _frame_index - _frames[slot] < _protected_frame_num ? LruSlotState::Protected : LruSlotState::Evictable;
                 }
+            );
+            if (slot == INVALID_SIZE_32) return false;
+
+            out_element = std::move(_values[slot]);
+            remove_slot(slot, true);
+            return true;
+        }
+
+        bool remove(uint64_t key)
+        {
+            const uint32_t slot = find_slot(key);
+            if (slot == INVALID_SIZE_32) return false;
+
+            remove_slot(slot, false);
+            return true;
+        }
+
+        // pin 可以嵌套, 需要相同次数的 unpin.
+        bool pin(uint64_t key)
+        {
+            const uint32_t slot = find_slot(key);
+            if (slot == INVALID_SIZE_32) return false;
+            _pin_counts[slot]++;
+            return true;
+        }
+
+        bool unpin(uint64_t key)
+        {
+            const uint32_t slot = find_slot(key);
+            if (slot == INVALID_SIZE_32 || _pin_counts[slot] == 0) return false;
+            _pin_counts[slot]--;
+            return true;
+        }
+
+        void begin_frame() { _frame_index++; }
+        void set_protected_frame_num(uint32_t frame_num) { _protected_frame_num = frame_num; }
+
+    private:
+        static uint32_t hash_key(uint64_t key)
+        {
+            return murmur_mix(murmur_add(static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32)));
+        }
+
+        void touch(uint32_t slot)
+        {
+            _frames[slot] = _frame_index;
+            _policy.on_access(slot);
+        }
+
+        uint32_t find_slot(uint64_t key) const
+        {
+            for (uint32_t ix = hash_key(key) & _index_mask; _index[ix] != INVALID_SIZE_32; ix = (ix + 1) & _index_mask)
+            {
+                if (_keys[_index[ix]] == key) return _index[ix];
             }
-            else if (_list.front().second != value)
+            return INVALID_SIZE_32;
+        }
+
+        void insert_index(uint64_t key, uint32_t slot)
+        {
+            uint32_t ix = hash_key(key) & _index_mask;
+            while (_index[ix] != INVALID_SIZE_32) ix = (ix + 1) & _index_mask;
+            _index[ix] = slot;
+        }
+
+        // 删除后把之后同一探测链上的元素向前移动, 不需要墓碑.
+        void erase_index(uint64_t key)
+        {
+            uint32_t ix = hash_key(key) & _index_mask;
+            while (_keys[_index[ix]] != key) ix = (ix + 1) & _index_mask;
+
+            uint32_t next = (ix + 1) & _index_mask;
+            while (_index[next] != INVALID_SIZE_32)
             {
-                _list.splice(_list.begin(), _list, map_iter->second);
+                const uint32_t home = hash_key(_keys[_index[next]]) & _index_mask;
+                if (((next - home) & _index_mask) >= ((next - ix) & _index_mask))
+                {
+                    _index[ix] = _index[next];
+                    ix = next;
+                }
+                next = (next + 1) & _index_mask;
             }
+            _index[ix] = INVALID_SIZE_32;
         }
 
-        void reset()
+        void remove_slot(uint32_t slot, bool evicted)
         {
-            _map.clear();
-            _list.clear();
+            erase_index(_keys[slot]);
+            _policy.on_remove(slot, _keys[slot], evicted);
+            _pin_counts[slot] = 0;
+            _free_slots.push_back(slot);
+            _size--;
         }
 
     private:
-        uint32_t _capacity;
-        std::list<std::pair<uint64_t, T>> _list;
-        std::unordered_map<uint64_t,  const typename std::list<std::pair<uint64_t, T>>::iterator> _map;
+        uint32_t _capacity = 0;
+        uint32_t _size = 0;
+
+        std::vector<uint64_t> _keys;
+        std::vector<T> _values;
+        std::vector<uint64_t> _frames;
+        std::vector<uint32_t> _pin_counts;
+        std::vector<uint32_t> _free_slots;
+
+        std::vector<uint32_t> _index;       // 槽位下标, INVALID_SIZE_32 表示空.
+        uint32_t _index_mask = 0;
+
+        uint64_t _frame_index = 0;
+        uint32_t _protected_frame_num = 0;
+
+        Policy _policy;
     };
 
+    // 2Q: 第一次访问的元素进入 FIFO 队列 a1, 再次访问时移入 LRU 队列 am, 只访问一次的扫描不会冲掉 am 中经常使用的元素.
+    // a1 超过容量的 1/4 时优先淘汰 a1, 被淘汰的键记录在容量一半的 ghost 队列中, 之后再次插入时直接进入 am.
+    class TwoQueuePolicy
+    {
+    public:
+        void resize(uint32_t capacity)
+        {
+            _links.resize(capacity);
+            _in_am.assign(capacity, false);
+            _a1 = LruList{};
+            _am = LruList{};
+            _a1_max_size = std::max(1u, capacity / 4);
+            _ghost_keys.resize(std::max(1u, capacity / 2));
+        }
+
+        void on_insert(uint32_t slot, uint64_t key)
+        {
+            _in_am[slot] = _ghost_keys.remove(key);
+            (_in_am[slot] ? _am : _a1).push_front(_links, slot);
+        }
 
+        void on_remove(uint32_t slot, uint64_t key, bool evicted)
+        {
+            if (_in_am[slot])
+            {
+                _am.remove(_links, slot);
+            }
+            else
+            {
+                _a1.remove(_links, slot);
+                if (evicted) _ghost_keys.insert(key, true);
+            }
+        }
+
+        void on_access(uint32_t slot)
+        {
+            if (_in_am[slot])
+            {
+                if (_am.head == slot) return;
+                _am.remove(_links, slot);
+            }
+            else
+            {
+                _a1.remove(_links, slot);
+                _in_am[slot] = true;
+            }
+            _am.push_front(_links, slot);
+        }
+
+        template <typename F>
+        uint32_t select_victim(F&& get_state)
+        {
+            const uint32_t a1_slot = _a1.find_back(_links, get_state);
+            const uint32_t am_slot = _am.find_back(_links, get_state);
+            const uint32_t candidates[] = { _a1.size > _a1_max_size ? a1_slot : INVALID_SIZE_32, am_slot, a1_slot };
+
+            uint32_t protected_slot = INVALID_SIZE_32;
+            for (uint32_t slot : candidates)
+            {
+                if (slot == INVALID_SIZE_32) continue;
+                if (get_state(slot) == LruSlotState::Evictable) return slot;
+                if (protected_slot == INVALID_SIZE_32) protected_slot = slot;
+            }
+            return protected_slot;
+        }
+
+    private:
+        LruLinks _links;
+        std::vector<bool> _in_am;
+        LruList _a1;
+        LruList _am;
+        uint32_t _a1_max_size = 1;
+
+        LruCache<bool> _ghost_keys;     // 不会被访问, 所以 LRU 就是 FIFO.
+    };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,317 @@
+#include "morton_code.h"
+#include <cassert>
+#include <utility>
+
+#if defined(__AVX2__)
+#define MORTON_CODE_SIMD_WIDTH 8
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MORTON_CODE_SIMD_WIDTH 4
+#include <emmintrin.h>
+#else
+#define MORTON_CODE_SIMD_WIDTH 1
+#endif
+
+namespace fantasy
+{
+    static_assert(sizeof(float3) == 3 * sizeof(float));
+
+#if MORTON_CODE_SIMD_WIDTH == 8
+    namespace simd
+    {
+        using Float = __m256;
+        using Int = __m256i;
+
+        static Float set1(float value) { return _mm256_set1_ps(value); }
+        static Int set1(uint32_t value) { return _mm256_set1_epi32(static_cast<int32_t>(value)); }
+        static Int set1_64(uint64_t value) { return _mm256_set1_epi64x(static_cast<int64_t>(value)); }
+        static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+        static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+        static Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+        static Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+        static Int to_int(Float a) { return _mm256_cvttps_epi32(a); }
+        static Int bit_and(Int a, Int b) { return _mm256_and_si256(a, b); }
+        static Int bit_andnot(Int a, Int b) { return _mm256_andnot_si256(a, b); }
+        static Int bit_or(Int a, Int b) { return _mm256_or_si256(a, b); }
+        static Int bit_xor(Int a, Int b) { return _mm256_xor_si256(a, b); }
+        static Int equal_zero(Int a) { return _mm256_cmpeq_epi32(a, _mm256_setzero_si256()); }
+        template <int Shift> static Int shift_left(Int a) { return _mm256_slli_epi32(a, Shift); }
+        template <int Shift> static Int shift_left_64(Int a) { return _mm256_slli_epi64(a, Shift); }
+
+        // 8 个 float3 的 AoS 转为 SoA, 两个 128 位通道分别处理前后 4 个点.
+        static void load(const float3* points, Float& x, Float& y, Float& z)
+        {
+            const float* data = reinterpret_cast<const float*>(points);
+            const Float a0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(data)), _mm_loadu_ps(data + 12), 1);
+            const Float a1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(data + 4)), _mm_loadu_ps(data + 16), 1);
+            const Float a2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(data + 8)), _mm_loadu_ps(data + 20), 1);
+
+            const Float t = _mm256_shuffle_ps(a1, a2, _MM_SHUFFLE(1, 0, 3, 2));
+            x = _mm256_shuffle_ps(a0, t, _MM_SHUFFLE(3, 0, 3, 0));
+            y = _mm256_shuffle_ps(
+                _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(0, 0, 1, 1)),
+                _mm256_shuffle_ps(a1, a2, _MM_SHUFFLE(2, 2, 3, 3)),
+                _MM_SHUFFLE(2, 0, 2, 0)
+            );
+            z = _mm256_shuffle_ps(
+                _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(1, 1, 2, 2)),
+                _mm256_shuffle_ps(a2, a2, _MM_SHUFFLE(3, 3, 0, 0)),
+                _MM_SHUFFLE(2, 0, 2, 0)
+            );
+        }
+
+        // 32 位通道零扩展为前后两组 64 位通道.
+        static void widen(Int a, Int& low, Int& high)
+        {
+            low = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(a));
+            high = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(a, 1));
+        }
+
+        static void store(uint32_t* out, Int a) { _mm256_storeu_si256(reinterpret_cast<Int*>(out), a); }
+        static void store_64(uint64_t* out, Int a) { _mm256_storeu_si256(reinterpret_cast<Int*>(out), a); }
+    }
+#elif MORTON_CODE_SIMD_WIDTH == 4
+    namespace simd
+    {
+        using Float = __m128;
+        using Int = __m128i;
+
+        static Float set1(float value) { return _mm_set1_ps(value); }
+        static Int set1(uint32_t value) { return _mm_set1_epi32(static_cast<int32_t>(value)); }
+        static Int set1_64(uint64_t value) { return _mm_set1_epi64x(static_cast<int64_t>(value)); }
+        static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+        static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+        static Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+        static Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+        static Int to_int(Float a) { return _mm_cvttps_epi32(a); }
+        static Int bit_and(Int a, Int b) { return _mm_and_si128(a, b); }
+        static Int bit_andnot(Int a, Int b) { return _mm_andnot_si128(a, b); }
+        static Int bit_or(Int a, Int b) { return _mm_or_si128(a, b); }
+        static Int bit_xor(Int a, Int b) { return _mm_xor_si128(a, b); }
+        static Int equal_zero(Int a) { return _mm_cmpeq_epi32(a, _mm_setzero_si128()); }
+        template <int Shift> static Int shift_left(Int a) { return _mm_slli_epi32(a, Shift); }
+        template <int Shift> static Int shift_left_64(Int a) { return _mm_slli_epi64(a, Shift); }
+
+        // 4 个 float3 的 AoS 转为 SoA.
+        static void load(const float3* points, Float& x, Float& y, Float& z)
+        {
+            const float* data = reinterpret_cast<const float*>(points);
+            const Float a0 = _mm_loadu_ps(data);
+            const Float a1 = _mm_loadu_ps(data + 4);
+            const Float a2 = _mm_loadu_ps(data + 8);
+
+            const Float t = _mm_shuffle_ps(a1, a2, _MM_SHUFFLE(1, 0, 3, 2));
+            x = _mm_shuffle_ps(a0, t, _MM_SHUFFLE(3, 0, 3, 0));
+            y = _mm_shuffle_ps(
+                _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(0, 0, 1, 1)),
+                _mm_shuffle_ps(a1, a2, _MM_SHUFFLE(2, 2, 3, 3)),
+                _MM_SHUFFLE(2, 0, 2, 0)
+            );
+            z = _mm_shuffle_ps(
+                _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(1, 1, 2, 2)),
+                _mm_shuffle_ps(a2, a2, _MM_SHUFFLE(3, 3, 0, 0)),
+                _MM_SHUFFLE(2, 0, 2, 0)
+            );
+        }
+
+        static void widen(Int a, Int& low, Int& high)
+        {
+            low = _mm_unpacklo_epi32(a, _mm_setzero_si128());
+            high = _mm_unpackhi_epi32(a, _mm_setzero_si128());
+        }
+
+        static void store(uint32_t* out, Int a) { _mm_storeu_si128(reinterpret_cast<Int*>(out), a); }
+        static void store_64(uint64_t* out, Int a) { _mm_storeu_si128(reinterpret_cast<Int*>(out), a); }
+    }
+#endif
+
+#if MORTON_CODE_SIMD_WIDTH > 1
+    namespace simd
+    {
+        static constexpr uint32_t width = MORTON_CODE_SIMD_WIDTH;
+
+        struct Quantizer
+        {
+            Float lower[3];
+            Float scale[3];
+            Float max_cell;
+
+            explicit Quantizer(const MortonQuantizer& quantizer) : max_cell(set1(quantizer.max_cell))
+            {
+                for (uint32_t ix = 0; ix < 3; ++ix)
+                {
+                    lower[ix] = set1(quantizer.lower[ix]);
+                    scale[ix] = set1(quantizer.scale[ix]);
+                }
+            }
+
+            // 与 MortonQuantizer::operator() 的运算顺序一致, 结果逐位相同.
+            void operator()(const float3* points, Int (&out)[3]) const
+            {
+                Float position[3];
+                load(points, position[0], position[1], position[2]);
+                for (uint32_t ix = 0; ix < 3; ++ix)
+                {
+                    const Float value = mul(sub(position[ix], lower[ix]), scale[ix]);
+                    out[ix] = to_int(min(max(value, set1(0.0f)), max_cell));
+                }
+            }
+        };
+
+        // 与 morton_code_3d_30 相同.
+        static Int morton_code_3d_30(Int x)
+        {
+            x = bit_and(x, set1(0x000003ffu));
+            x = bit_and(bit_xor(x, shift_left<16>(x)), set1(0x030000ffu));
+            x = bit_and(bit_xor(x, shift_left<8>(x)), set1(0x0300f00fu));
+            x = bit_and(bit_xor(x, shift_left<4>(x)), set1(0x030c30c3u));
+            x = bit_and(bit_xor(x, shift_left<2>(x)), set1(0x09249249u));
+            return x;
+        }
+
+        // 与 morton_code_3d 相同, 每个 64 位通道一个坐标.
+        static Int morton_code_3d(Int x)
+        {
+            x = bit_and(bit_xor(x, shift_left_64<32>(x)), set1_64(0x001f00000000ffffull));
+            x = bit_and(bit_xor(x, shift_left_64<16>(x)), set1_64(0x001f0000ff0000ffull));
+            x = bit_and(bit_xor(x, shift_left_64<8>(x)), set1_64(0x100f00f00f00f00full));
+            x = bit_and(bit_xor(x, shift_left_64<4>(x)), set1_64(0x10c30c30c30c30c3ull));
+            x = bit_and(bit_xor(x, shift_left_64<2>(x)), set1_64(0x1249249249249249ull));
+            return x;
+        }
+
+        static Int morton_encode_3d_30(const Int (&x)[3])
+        {
+            return bit_or(
+                morton_code_3d_30(x[0]),
+                bit_or(shift_left<1>(morton_code_3d_30(x[1])), shift_left<2>(morton_code_3d_30(x[2])))
+            );
+        }
+
+        // 输出前后两组 64 位通道.
+        static void morton_encode_3d(const Int (&x)[3], Int& low, Int& high)
+        {
+            Int spread_low[3];
+            Int spread_high[3];
+            for (uint32_t ix = 0; ix < 3; ++ix)
+            {
+                // 量化结果不超过 21 位, 不需要再截断.
+                widen(x[ix], spread_low[ix], spread_high[ix]);
+                spread_low[ix] = morton_code_3d(spread_low[ix]);
+                spread_high[ix] = morton_code_3d(spread_high[ix]);
+            }
+            low = bit_or(spread_low[0], bit_or(shift_left_64<1>(spread_low[1]), shift_left_64<2>(spread_low[2])));
+            high = bit_or(spread_high[0], bit_or(shift_left_64<1>(spread_high[1]), shift_left_64<2>(spread_high[2])));
+        }
+
+        // hilbert_axes_to_transpose 的无分支版本, 每个通道一个点.
+        // 每组的运算都依赖上一步的 x[0], 同时变换 N 组互不依赖的点以隐藏指令延迟.
+        template <uint32_t N>
+        static void hilbert_axes_to_transpose(Int (&x)[N][3], uint32_t bits)
+        {
+            for (uint32_t q = 1u << (bits - 1); q > 1; q >>= 1)
+            {
+                const Int q_mask = set1(q);
+                const Int p = set1(q - 1);
+                for (uint32_t ix = 0; ix < 3; ++ix)
+                {
+                    for (uint32_t jx = 0; jx < N; ++jx)
+                    {
+                        // x[ix] & q 为 0 时交换 x[0] 和 x[ix] 的低位, 否则翻转 x[0] 的低位.
+                        const Int is_zero = equal_zero(bit_and(x[jx][ix], q_mask));
+                        x[jx][0] = bit_xor(x[jx][0], bit_andnot(is_zero, p));
+                        const Int t = bit_and(bit_and(bit_xor(x[jx][0], x[jx][ix]), p), is_zero);
+                        x[jx][0] = bit_xor(x[jx][0], t);
+                        x[jx][ix] = bit_xor(x[jx][ix], t);
+                    }
+                }
+            }
+
+            for (uint32_t jx = 0; jx < N; ++jx)
+            {
+                x[jx][1] = bit_xor(x[jx][1], x[jx][0]);
+                x[jx][2] = bit_xor(x[jx][2], x[jx][1]);
+
+                Int t = set1(0u);
+                for (uint32_t q = 1u << (bits - 1); q > 1; q >>= 1)
+                {
+                    const Int is_zero = equal_zero(bit_and(x[jx][2], set1(q)));
+                    t = bit_xor(t, bit_andnot(is_zero, set1(q - 1)));
+                }
+                for (uint32_t ix = 0; ix < 3; ++ix) x[jx][ix] = bit_xor(x[jx][ix], t);
+            }
+        }
+    }
+#endif
+
+    template <uint32_t Bits, bool Hilbert, typename Code>
+    static void encode_3d(std::span<const float3> points, const Bounds3F& bounds, std::span<Code> out_codes)
+    {
+        assert(out_codes.size() >= points.size());
+
+        const MortonQuantizer quantizer(bounds, Bits);
+        uint64_t ix = 0;
+
+#if MORTON_CODE_SIMD_WIDTH > 1
+        // 每次读取 width * group 个 float3, 最后一组之后的点由标量版本处理, 避免越界读取.
+        constexpr uint32_t group = Hilbert ? 4 : 1;
+        const simd::Quantizer simd_quantizer(quantizer);
+        for (; ix + simd::width * group <= points.size(); ix += simd::width * group)
+        {
+            simd::Int cells[group][3];
+            for (uint32_t jx = 0; jx < group; ++jx) simd_quantizer(points.data() + ix + jx * simd::width, cells[jx]);
+
+            if constexpr (Hilbert)
+            {
+                simd::hilbert_axes_to_transpose(cells, Bits);
+                for (uint32_t jx = 0; jx < group; ++jx) std::swap(cells[jx][0], cells[jx][2]);
+            }
+
+            for (uint32_t jx = 0; jx < group; ++jx)
+            {
+                Code* out = out_codes.data() + ix + jx * simd::width;
+                if constexpr (Bits == 10)
+                {
+                    simd::store(out, simd::morton_encode_3d_30(cells[jx]));
+                }
+                else
+                {
+                    simd::Int low, high;
+                    simd::morton_encode_3d(cells[jx], low, high);
+                    simd::store_64(out, low);
+                    simd::store_64(out + simd::width / 2, high);
+                }
+            }
+        }
+#endif
+
+        for (; ix < points.size(); ++ix)
+        {
+            const uint3 cell = quantizer(points[ix]);
+            if constexpr (Hilbert && Bits == 10) out_codes[ix] = hilbert_encode_3d_30(cell);
+            else if constexpr (Hilbert) out_codes[ix] = hilbert_encode_3d(cell);
+            else if constexpr (Bits == 10) out_codes[ix] = morton_encode_3d_30(cell);
+            else out_codes[ix] = morton_encode_3d(cell);
+        }
+    }
+
+    void morton_encode_3d(std::span<const float3> points, const Bounds3F& bounds, std::span<uint64_t> out_codes)
+    {
+        encode_3d<21, false>(points, bounds, out_codes);
+    }
+
+    void morton_encode_3d_30(std::span<const float3> points, const Bounds3F& bounds, std::span<uint32_t> out_codes)
+    {
+        encode_3d<10, false>(points, bounds, out_codes);
+    }
+
+    void hilbert_encode_3d(std::span<const float3> points, const Bounds3F& bounds, std::span<uint64_t> out_codes)
+    {
+        encode_3d<21, true>(points, bounds, out_codes);
+    }
+
+    void hilbert_encode_3d_30(std::span<const float3> points, const Bounds3F& bounds, std::span<uint32_t> out_codes)
+    {
+        encode_3d<10, true>(points, bounds, out_codes);
+    }
+}
@@ -1,12 +1,21 @@
 #ifndef CORE_TOOLS_MORTON_CODE_H
 #define CORE_TOOLS_MORTON_CODE_H
 #include <cstdint>
+#include <span>
 
+#include "../math/bounds.h"
 #include "../math/vector.h"
 
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define MORTON_CODE_BMI2 1
+#include <immintrin.h>
+#else
+#define MORTON_CODE_BMI2 0
+#endif
+
 namespace fantasy 
 {
-    static uint32_t morton_code(uint32_t x)
+    inline uint32_t morton_code(uint32_t x)
     {
         x &= 0x0000ffff;
         x = (x ^ (x << 8)) & 0x00ff00ff;
@@ -16,18 +25,18 @@ namespace fantasy
         return x;
     }
 
-    static uint32_t morton_encode(uint32_t x,uint32_t y)
+    inline uint32_t morton_encode(uint32_t x,uint32_t y)
     {
         uint32_t Morton = morton_code(x) | (morton_code(y) << 1);
         return Morton;
     }
 
-    static uint32_t morton_encode(uint2 value)
+    inline uint32_t morton_encode(uint2 value)
     {
         return morton_encode(value.x, value.y);
     }
 
-    static uint32_t reverse_morton_code(uint32_t x)
+    inline uint32_t reverse_morton_code(uint32_t x)
     {
         x &= 0x55555555;
         x = (x ^ (x >> 1)) & 0x33333333;
@@ -37,7 +46,7 @@ namespace fantasy
         return x;
     }
 
-    static uint2 morton_decode(uint32_t Morton)
+    inline uint2 morton_decode(uint32_t Morton)
     {
         uint2 ret;
         ret.x = reverse_morton_code(Morton);
@@ -45,6 +54,272 @@ namespace fantasy
         return ret;
     }
 
+    // 32 位整数的每一位之间插入一个 0, 用于 64 位的 2D morton code.
+    inline uint64_t morton_code_64(uint32_t x)
+    {
+        uint64_t ret = x;
+        ret = (ret ^ (ret << 16)) & 0x0000ffff0000ffffull;
+        ret = (ret ^ (ret << 8)) & 0x00ff00ff00ff00ffull;
+        ret = (ret ^ (ret << 4)) & 0x0f0f0f0f0f0f0f0full;
+        ret = (ret ^ (ret << 2)) & 0x3333333333333333ull;
+        ret = (ret ^ (ret << 1)) & 0x5555555555555555ull;
+        return ret;
+    }
+
+    inline uint32_t reverse_morton_code_64(uint64_t x)
+    {
+        x &= 0x5555555555555555ull;
+        x = (x ^ (x >> 1)) & 0x3333333333333333ull;
+        x = (x ^ (x >> 2)) & 0x0f0f0f0f0f0f0f0full;
+        x = (x ^ (x >> 4)) & 0x00ff00ff00ff00ffull;
+        x = (x ^ (x >> 8)) & 0x0000ffff0000ffffull;
+        x = (x ^ (x >> 16)) & 0x00000000ffffffffull;
+        return static_cast<uint32_t>(x);
+    }
+
+    // 21 位整数的每一位之间插入两个 0, 用于 64 位的 3D morton code.
+    inline uint64_t morton_code_3d(uint32_t x)
+    {
+        uint64_t ret = x & 0x1fffff;
+        ret = (ret ^ (ret << 32)) & 0x001f00000000ffffull;
+        ret = (ret ^ (ret << 16)) & 0x001f0000ff0000ffull;
+        ret = (ret ^ (ret << 8)) & 0x100f00f00f00f00full;
+        ret = (ret ^ (ret << 4)) & 0x10c30c30c30c30c3ull;
+        ret = (ret ^ (ret << 2)) & 0x1249249249249249ull;
+        return ret;
+    }
+
+    inline uint32_t reverse_morton_code_3d(uint64_t x)
+    {
+        x &= 0x1249249249249249ull;
+        x = (x ^ (x >> 2)) & 0x10c30c30c30c30c3ull;
+        x = (x ^ (x >> 4)) & 0x100f00f00f00f00full;
+        x = (x ^ (x >> 8)) & 0x001f0000ff0000ffull;
+        x = (x ^ (x >> 16)) & 0x001f00000000ffffull;
+        x = (x ^ (x >> 32)) & 0x00000000001fffffull;
+        return static_cast<uint32_t>(x);
+    }
+
+    inline uint64_t morton_encode_64(uint32_t x, uint32_t y)
+    {
+#if MORTON_CODE_BMI2
+        return _pdep_u64(x, 0x5555555555555555ull) | _pdep_u64(y, 0xaaaaaaaaaaaaaaaaull);
+#else
+        return morton_code_64(x) | (morton_code_64(y) << 1);
+#endif
+    }
+
+    inline uint64_t morton_encode_64(uint2 value)
+    {
+        return morton_encode_64(value.x, value.y);
+    }
+
+    inline uint2 morton_decode_64(uint64_t morton)
+    {
+#if MORTON_CODE_BMI2
+        return uint2(
+            static_cast<uint32_t>(_pext_u64(morton, 0x5555555555555555ull)), 
+            static_cast<uint32_t>(_pext_u64(morton, 0xaaaaaaaaaaaaaaaaull))
+        );
+#else
+        return uint2(reverse_morton_code_64(morton), reverse_morton_code_64(morton >> 1));
+#endif
+    }
+
+    // 每轴 21 位, 共 63 位.
+    inline uint64_t morton_encode_3d(uint32_t x, uint32_t y, uint32_t z)
+    {
+#if MORTON_CODE_BMI2
+        return _pdep_u64(x, 0x1249249249249249ull) | _pdep_u64(y, 0x2492492492492492ull) | _pdep_u64(z, 0x4924924924924924ull);
+#else
+        return morton_code_3d(x) | (morton_code_3d(y) << 1) | (morton_code_3d(z) << 2);
+#endif
+    }
+
+    inline uint64_t morton_encode_3d(uint3 value)
+    {
+        return morton_encode_3d(value.x, value.y, value.z);
+    }
+
+    inline uint3 morton_decode_3d(uint64_t morton)
+    {
+#if MORTON_CODE_BMI2
+        return uint3(
+            static_cast<uint32_t>(_pext_u64(morton, 0x1249249249249249ull)), 
+            static_cast<uint32_t>(_pext_u64(morton, 0x2492492492492492ull)), 
+            static_cast<uint32_t>(_pext_u64(morton, 0x4924924924924924ull))
+        );
+#else
+        return uint3(reverse_morton_code_3d(morton), reverse_morton_code_3d(morton >> 1), reverse_morton_code_3d(morton >> 2));
+#endif
+    }
+
+    // 10 位整数的每一位之间插入两个 0, 用于 32 位的 3D morton code.
+    inline uint32_t morton_code_3d_30(uint32_t x)
+    {
+        x &= 0x000003ff;
+        x = (x ^ (x << 16)) & 0x030000ff;
+        x = (x ^ (x << 8)) & 0x0300f00f;
+        x = (x ^ (x << 4)) & 0x030c30c3;
+        x = (x ^ (x << 2)) & 0x09249249;
+        return x;
+    }
+
+    inline uint32_t reverse_morton_code_3d_30(uint32_t x)
+    {
+        x &= 0x09249249;
+        x = (x ^ (x >> 2)) & 0x030c30c3;
+        x = (x ^ (x >> 4)) & 0x0300f00f;
+        x = (x ^ (x >> 8)) & 0x030000ff;
+        x = (x ^ (x >> 16)) & 0x000003ff;
+        return x;
+    }
+
+    // 每轴 10 位, 共 30 位.
+    inline uint32_t morton_encode_3d_30(uint32_t x, uint32_t y, uint32_t z)
+    {
+#if MORTON_CODE_BMI2
+        return _pdep_u32(x, 0x09249249) | _pdep_u32(y, 0x12492492) | _pdep_u32(z, 0x24924924);
+#else
+        return morton_code_3d_30(x) | (morton_code_3d_30(y) << 1) | (morton_code_3d_30(z) << 2);
+#endif
+    }
+
+    inline uint32_t morton_encode_3d_30(uint3 value)
+    {
+        return morton_encode_3d_30(value.x, value.y, value.z);
+    }
+
+    inline uint3 morton_decode_3d_30(uint32_t morton)
+    {
+#if MORTON_CODE_BMI2
+        return uint3(_pext_u32(morton, 0x09249249), _pext_u32(morton, 0x12492492), _pext_u32(morton, 0x24924924));
+#else
+        return uint3(reverse_morton_code_3d_30(morton), reverse_morton_code_3d_30(morton >> 1), reverse_morton_code_3d_30(morton >> 2));
+#endif
+    }
+
+    // Skilling 的 hilbert 变换, 将每轴 bits 位的坐标原地转换为转置形式, 
+    // 转置形式按 morton 交错后 (x[0] 在每组 3 位的最高位) 即为 hilbert index.
+    // 分支按坐标的位随机跳转, 改为掩码运算.
+    inline void hilbert_axes_to_transpose(uint32_t (&x)[3], uint32_t bits)
+    {
+        for (uint32_t q = 1u << (bits - 1); q > 1; q >>= 1)
+        {
+            const uint32_t p = q - 1;
+            for (uint32_t ix = 0; ix < 3; ++ix)
+            {
+                // x[ix] & q 不为 0 时翻转 x[0] 的低位, 否则交换 x[0] 和 x[ix] 的低位.
+                const uint32_t flip = 0u - ((x[ix] & q) != 0);
+                x[0] ^= p & flip;
+                const uint32_t t = (x[0] ^ x[ix]) & p & ~flip;
+                x[0] ^= t;
+                x[ix] ^= t;
+            }
+        }
+
+        x[1] ^= x[0];
+        x[2] ^= x[1];
+
+        uint32_t t = 0;
+        for (uint32_t q = 1u << (bits - 1); q > 1; q >>= 1)
+        {
+            t ^= (q - 1) & (0u - ((x[2] & q) != 0));
+        }
+        for (uint32_t ix = 0; ix < 3; ++ix) x[ix] ^= t;
+    }
+
+    inline void hilbert_transpose_to_axes(uint32_t (&x)[3], uint32_t bits)
+    {
+        uint32_t t = x[2] >> 1;
+        x[2] ^= x[1];
+        x[1] ^= x[0];
+        x[0] ^= t;
+
+        for (uint32_t q = 2; q != (1u << bits); q <<= 1)
+        {
+            const uint32_t p = q - 1;
+            for (int32_t ix = 2; ix >= 0; --ix)
+            {
+                const uint32_t flip = 0u - ((x[ix] & q) != 0);
+                x[0] ^= p & flip;
+                t = (x[0] ^ x[ix]) & p & ~flip;
+                x[0] ^= t;
+                x[ix] ^= t;
+            }
+        }
+    }
+
+    // 每轴 21 位, 共 63 位.
+    inline uint64_t hilbert_encode_3d(uint3 value)
+    {
+        uint32_t x[3] = { value.x, value.y, value.z };
+        hilbert_axes_to_transpose(x, 21);
+        return morton_encode_3d(x[2], x[1], x[0]);
+    }
+
+    inline uint3 hilbert_decode_3d(uint64_t hilbert)
+    {
+        const uint3 transpose = morton_decode_3d(hilbert);
+        uint32_t x[3] = { transpose.z, transpose.y, transpose.x };
+        hilbert_transpose_to_axes(x, 21);
+        return uint3(x[0], x[1], x[2]);
+    }
+
+    // 每轴 10 位, 共 30 位.
+    inline uint32_t hilbert_encode_3d_30(uint3 value)
+    {
+        uint32_t x[3] = { value.x, value.y, value.z };
+        hilbert_axes_to_transpose(x, 10);
+        return morton_encode_3d_30(x[2], x[1], x[0]);
+    }
+
+    inline uint3 hilbert_decode_3d_30(uint32_t hilbert)
+    {
+        const uint3 transpose = morton_decode_3d_30(hilbert);
+        uint32_t x[3] = { transpose.z, transpose.y, transpose.x };
+        hilbert_transpose_to_axes(x, 10);
+        return uint3(x[0], x[1], x[2]);
+    }
+
+    // 将 bounds 内的点量化为每轴 bits 位的整数坐标, bounds 之外的点截断到边界.
+    struct MortonQuantizer
+    {
+        float3 lower;
+        float3 scale;
+        float max_cell;
+
+        MortonQuantizer(const Bounds3F& bounds, uint32_t bits) : 
+            lower(bounds._lower), max_cell(static_cast<float>((1u << bits) - 1))
+        {
+            const float3 extent = bounds._upper - bounds._lower;
+            for (uint32_t ix = 0; ix < 3; ++ix)
+            {
+                scale[ix] = extent[ix] > 0.0f ? static_cast<float>(1u << bits) / extent[ix] : 0.0f;
+            }
+        }
+
+        uint3 operator()(const float3& point) const
+        {
+            uint3 ret;
+            for (uint32_t ix = 0; ix < 3; ++ix)
+            {
+                // 与 SIMD 版本的 max/min 一致, NaN 量化为 0.
+                float value = (point[ix] - lower[ix]) * scale[ix];
+                value = value > 0.0f ? value : 0.0f;
+                value = value < max_cell ? value : max_cell;
+                ret[ix] = static_cast<uint32_t>(value);
+            }
+            return ret;
+        }
+    };
+
+    // 批量编码, points 按 bounds 量化后编码, out_codes 的大小不能小于 points.
+    // 根据编译选项使用 AVX2 (每次 8 个点) 或 SSE2 (每次 4 个点), 剩余的点使用标量版本.
+    void morton_encode_3d(std::span<const float3> points, const Bounds3F& bounds, std::span<uint64_t> out_codes);
+    void morton_encode_3d_30(std::span<const float3> points, const Bounds3F& bounds, std::span<uint32_t> out_codes);
+    void hilbert_encode_3d(std::span<const float3> points, const Bounds3F& bounds, std::span<uint64_t> out_codes);
+    void hilbert_encode_3d_30(std::span<const float3> points, const Bounds3F& bounds, std::span<uint32_t> out_codes);
 }
 
 
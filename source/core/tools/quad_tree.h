@@ -2,308 +2,491 @@
 #define CORE_TOOLS_QUAD_TREE_H
 
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cassert>
 #include <cstdint>
-#include <memory>
+#include <numeric>
+#include <span>
+#include <type_traits>
 #include <vector>
-#include <cassert>
 #include "../math/bounds.h"
 #include "../math/vector.h"
+#include "flat_hash_map.h"
+#include "morton_code.h"
 
 
-namespace fantasy 
+namespace fantasy
 {
-    template<typename T>
-    class Quadtree
+    // 线性四叉树/八叉树, 节点以 morton 定位码 (最高位为哨兵位, 其下为各层的 morton code) 为键.
+    // 节点和对象分别存放在两个池中, 以下标相互引用, 节点定位码到下标的映射用于按单元格直接查找.
+    // 松散树: 对象存放在中心所在且单元格尺寸不小于对象的最深节点中, 跨越节点边界的小对象不会堆积在上层节点.
+    // 超出 world_bounds 的对象存放在根节点. 每个节点记录子树中对象包围盒的并集, 查询以此裁剪, 结果没有浮点误差.
+    // build 按 morton 序创建节点和对象, 查询时顺序访问内存; insert/remove 为增量修改, 复用池中的空闲位置.
+    template <typename T, uint32_t Dim>
+    requires (Dim == 2 || Dim == 3)
+    class LinearTree
     {
     public:
-        Quadtree(const Bounds2F& rect) :
-            _bottom_rect(rect), _root(std::make_unique<Node>())
+        using BoundsType = std::conditional_t<Dim == 2, Bounds2F, Bounds3F>;
+        using PointType = std::conditional_t<Dim == 2, float2, float3>;
+        using CellType = std::conditional_t<Dim == 2, uint2, uint3>;
+
+        static constexpr uint32_t child_num = 1u << Dim;
+
+        // 定位码为 64 位, 需要留出一位哨兵位.
+        static constexpr uint32_t max_depth_limit = 63 / Dim;
+
+        struct Item
+        {
+            BoundsType bounds;
+            T value;
+        };
+
+    public:
+        LinearTree(const BoundsType& world_bounds, uint32_t max_depth = 8) :
+            _world_bounds(world_bounds), _max_depth(max_depth)
         {
+            assert(max_depth <= max_depth_limit);
+
+            const PointType size = world_bounds._upper - world_bounds._lower;
+            for (uint32_t ix = 0; ix < Dim; ++ix)
+            {
+                _cell_scale[ix] = static_cast<float>(1ull << max_depth) / size[ix];
+            }
+            clear();
         }
 
-        Quadtree(const Bounds2F& bottom_rect, const Bounds2F& top_rect) :
-            _bottom_rect(bottom_rect), _top_rect(top_rect)
+        void clear()
         {
-            
+            _nodes.clear();
+            _objects.clear();
+            _free_nodes.clear();
+            _free_objects.clear();
+            _node_map.clear();
+            _object_count = 0;
+
+            create_node(1, INVALID_SIZE_32);
         }
 
-        void add(const T& value)
+        // 批量构建, 按定位码排序后依次创建节点和对象, 节点和同一节点的对象在池中都是连续的.
+        // out_handles 不为空时输出每个 item 对应的 handle.
+        void build(std::span<const Item> items, std::vector<uint32_t>* out_handles = nullptr)
         {
-            add(_root.get(), 0, _bottom_rect, value);
+            std::vector<uint64_t> keys(items.size());
+            for (uint64_t ix = 0; ix < items.size(); ++ix) keys[ix] = get_key(items[ix].bounds);
+
+            std::vector<uint32_t> order(items.size());
+            std::iota(order.begin(), order.end(), 0u);
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return key_less(keys[a], keys[b]); });
+
+            build_sorted(items, keys, order, out_handles);
         }
 
-        void remove(const T& value)
+        // keys 为 get_key 的结果, order 为 items 按 key_less 排序后的下标.
+        void build_sorted(
+            std::span<const Item> items,
+            std::span<const uint64_t> keys,
+            std::span<const uint32_t> order,
+            std::vector<uint32_t>* out_handles = nullptr
+        )
         {
-            remove(_root.get(), _bottom_rect, value);
+            clear();
+            _objects.reserve(items.size());
+            _node_map.reserve(items.size());
+            if (out_handles) out_handles->resize(items.size());
+
+            // 排序后相同定位码的对象相邻, 不需要每次都查找节点.
+            uint64_t last_key = 0;
+            uint32_t last_node = INVALID_SIZE_32;
+            for (uint32_t index : order)
+            {
+                if (keys[index] != last_key)
+                {
+                    last_key = keys[index];
+                    last_node = get_or_create_node(last_key);
+                }
+                const uint32_t handle = insert_object(last_node, items[index].bounds, items[index].value);
+                if (out_handles) (*out_handles)[index] = handle;
+            }
         }
 
-        std::vector<T> query(const Bounds2F& rect) const
+        uint32_t insert(const BoundsType& bounds, const T& value)
         {
-            auto values = std::vector<T>();
-            query(_root.get(), _bottom_rect, rect, values);
-            return values;
+            return insert_object(get_or_create_node(get_key(bounds)), bounds, value);
         }
 
-        std::vector<std::pair<T, T>> findAllIntersections() const
+        bool remove(uint32_t handle)
         {
-            auto intersections = std::vector<std::pair<T, T>>();
-            findAllIntersections(_root.get(), intersections);
-            return intersections;
+            if (handle >= _objects.size() || _objects[handle].node == INVALID_SIZE_32) return false;
+
+            Object& object = _objects[handle];
+            Node& node = _nodes[object.node];
+            if (object.prev != INVALID_SIZE_32) _objects[object.prev].next = object.next;
+            else node.first_object = object.next;
+            if (object.next != INVALID_SIZE_32) _objects[object.next].prev = object.prev;
+            node.object_count--;
+
+            const uint32_t node_index = object.node;
+            object = Object{};
+            _free_objects.push_back(handle);
+            _object_count--;
+
+            release_empty_nodes(node_index);
+            return true;
         }
 
-    private:
-        static constexpr auto Threshold = std::size_t(16);
-        static constexpr auto MaxDepth = std::size_t(8);
+        // 包围盒改变后重新插入, handle 可能改变.
+        uint32_t update(uint32_t handle, const BoundsType& bounds)
+        {
+            T value = std::move(_objects[handle].value);
+            remove(handle);
+            return insert(bounds, value);
+        }
 
-        struct Node
+        const T& get(uint32_t handle) const { return _objects[handle].value; }
+        const BoundsType& get_bounds(uint32_t handle) const { return _objects[handle].bounds; }
+
+        uint64_t size() const { return _object_count; }
+        uint64_t get_node_count() const { return _nodes.size() - _free_nodes.size(); }
+        const BoundsType& get_world_bounds() const { return _world_bounds; }
+        uint32_t get_max_depth() const { return _max_depth; }
+
+        // func(const T& value, uint32_t handle).
+        template <typename F>
+        void query(const BoundsType& box, F&& func) const
         {
-            std::array<std::unique_ptr<Node>, 4> children;
-            std::vector<T> value;
-        };
+            traverse(
+                [&](const BoundsType& bounds)
+                {
+                    if (!overlap(bounds, box)) return FrustumCull::Outside;
+                    return contain(box, bounds) ? FrustumCull::Inside : FrustumCull::Intersect;
+                },
+                func
+            );
+        }
 
-        Bounds2F _top_rect;
-        Bounds2F _bottom_rect;
-        std::unique_ptr<Node> _root;
+        template <typename F>
+        void query(const PointType& point, F&& func) const
+        {
+            BoundsType box;
+            box._lower = point;
+            box._upper = point;
+            query(box, func);
+        }
 
-        bool is_leaf(const Node* node) const
+        template <typename F>
+        requires (Dim == 3)
+        void query(const Frustum& frustum, F&& func) const
         {
-            return node->children[0] == nullptr;
+            traverse([&](const BoundsType& bounds) { return cull(frustum, bounds); }, func);
         }
 
-        Bounds2F compute_child_bounds(const Bounds2F& rect, uint32_t ix) const
+        // 访问中心位于 depth 层 cell 单元格内且尺寸不超过该单元格的对象.
+        // 通过定位码直接找到节点, 不需要从根节点向下查找, 可用于 virtual shadow map 的 tile 和 SDF chunk 等按格子组织的数据.
+        template <typename F>
+        void query_cell(uint32_t depth, const CellType& cell, F&& func) const
         {
-            float2 origin = rect._lower;
-            float2 child_size = float2(rect.width(), rect.height()) / 2.0f;
-            switch (ix)
+            assert(depth <= _max_depth);
+
+            auto iter = _node_map.find(encode(cell) | (1ull << (Dim * depth)));
+            if (iter == _node_map.end()) return;
+
+            std::array<uint32_t, max_depth_limit * (child_num - 1) + 1> stack;
+            uint32_t stack_top = 0;
+            stack[stack_top++] = iter->second;
+            while (stack_top > 0)
             {
-            case 0: // Top Left
-                return Bounds2F(origin, child_size);
-            
-            case 1: // Top Right
-                return Bounds2F(float2(origin.x + child_size.x, origin.y), child_size);
-            
-            case 2: // Bottom Left
-                return Bounds2F(float2(origin.x, origin.y + child_size.y), child_size);
-            
-            case 3: // Bottom Right
-                return Bounds2F(origin + child_size, child_size);
-            default:
-                assert(!"Invalid child index");
-                return Bounds2F();
+                const Node& node = _nodes[stack[--stack_top]];
+                for (uint32_t ix = node.first_object; ix != INVALID_SIZE_32; ix = _objects[ix].next)
+                {
+                    func(_objects[ix].value, ix);
+                }
+                for (uint32_t ix = 0; ix < child_num; ++ix)
+                {
+                    if (node.children[ix] != INVALID_SIZE_32) stack[stack_top++] = node.children[ix];
+                }
             }
         }
 
-        int getQuadrant(const Bounds2F& bounds, const Bounds2F& valueBox) const
+        // 批量查询, 第 ix 个查询的结果为 out_values[out_ranges[ix].x, out_ranges[ix].x + out_ranges[ix].y).
+        // 查询按中心点的 morton 序执行, 相邻的查询访问相同的节点, 缓存命中率更高.
+        template <typename Q>
+        void query(std::span<const Q> queries, std::vector<T>& out_values, std::vector<uint2>& out_ranges) const
         {
-            auto center = bounds.center();
-            // West
-            if (valueBox._upper.x < center.x)
+            std::vector<std::pair<uint64_t, uint32_t>> order(queries.size());
+            for (uint32_t ix = 0; ix < queries.size(); ++ix)
             {
-                // North West
-                if (valueBox._upper.y < center.y)
-                    return 0;
-                // South West
-                else if (valueBox._lower.y >= center.y)
-                    return 2;
-                // Not contained in any quadrant
-                else
-                    return -1;
+                // 视锥体查询保持原来的顺序.
+                uint64_t code = 0;
+                if constexpr (!std::is_same_v<Q, Frustum>) code = encode(get_cell(get_query_center(queries[ix])));
+                order[ix] = std::make_pair(code, ix);
             }
-            // East
-            else if (valueBox._lower.x >= center.x)
+            std::sort(order.begin(), order.end());
+
+            out_values.clear();
+            out_ranges.resize(queries.size());
+            for (const auto& [code, index] : order)
             {
-                // North East
-                if (valueBox._upper.y < center.y)
-                    return 1;
-                // South East
-                else if (valueBox._lower.y >= center.y)
-                    return 3;
-                // Not contained in any quadrant
-                else
-                    return -1;
+                const uint32_t begin = static_cast<uint32_t>(out_values.size());
+                query(queries[index], [&](const T& value, uint32_t) { out_values.push_back(value); });
+                out_ranges[index] = uint2(begin, static_cast<uint32_t>(out_values.size()) - begin);
             }
-            // Not contained in any quadrant
-            else
-                return -1;
         }
 
-        void add(Node* node, std::size_t depth, const Bounds2F& rect, const T& value)
+        template <typename Q>
+        std::vector<T> query(const Q& query_shape) const
         {
-            assert(node != nullptr);
-            assert(rect.contain(mGetBox(value)));
-            if (is_leaf(node))
-            {
-                // Insert the value in this node if possible
-                if (depth >= MaxDepth || node->value.size() < Threshold)
-                    node->value.push_back(value);
-                // Otherwise, we split and we try again
-                else
-                {
-                    split(node, rect);
-                    add(node, depth, rect, value);
-                }
-            }
-            else
+            std::vector<T> ret;
+            query(query_shape, [&](const T& value, uint32_t) { ret.push_back(value); });
+            return ret;
+        }
+
+        // 单元格尺寸不小于 bounds 的最深一层中, bounds 中心所在节点的定位码.
+        uint64_t get_key(const BoundsType& bounds) const
+        {
+            if (!contain(_world_bounds, bounds)) return 1;
+
+            float extent = 0.0f;
+            for (uint32_t ix = 0; ix < Dim; ++ix)
             {
-                auto i = getQuadrant(rect, mGetBox(value));
-                // Add the value in a child if the value is entirely contained in it
-                if (i != -1)
-                    add(node->children[static_cast<std::size_t>(i)].get(), depth + 1, compute_child_bounds(rect, i), value);
-                // Otherwise, we add the value in the current node
-                else
-                    node->value.push_back(value);
+                extent = std::max(extent, (bounds._upper[ix] - bounds._lower[ix]) * _cell_scale[ix]);
             }
+
+            const uint64_t cell_num = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(extent)), 1);
+            const uint32_t level = std::min(static_cast<uint32_t>(std::bit_width(cell_num - 1)), _max_depth);
+            const uint32_t depth = _max_depth - level;
+            const uint64_t code = encode(get_cell((bounds._lower + bounds._upper) * 0.5f)) >> (Dim * level);
+            return code | (1ull << (Dim * depth));
+        }
+
+        // 按 morton 序比较, 祖先节点排在子孙节点之前.
+        bool key_less(uint64_t key0, uint64_t key1) const
+        {
+            const uint32_t depth0 = get_depth(key0);
+            const uint32_t depth1 = get_depth(key1);
+            const uint64_t code0 = (key0 ^ (1ull << (Dim * depth0))) << (Dim * (_max_depth - depth0));
+            const uint64_t code1 = (key1 ^ (1ull << (Dim * depth1))) << (Dim * (_max_depth - depth1));
+            return code0 != code1 ? code0 < code1 : depth0 < depth1;
+        }
+
+        static uint32_t get_depth(uint64_t key)
+        {
+            return (static_cast<uint32_t>(std::bit_width(key)) - 1) / Dim;
+        }
+
+    private:
+        struct Node
+        {
+            uint64_t key = 0;
+            uint32_t parent = INVALID_SIZE_32;
+            uint32_t first_object = INVALID_SIZE_32;
+            uint32_t object_count = 0;
+            uint32_t children[child_num];
+
+            // 子树中所有对象包围盒的并集, 删除对象时不收缩.
+            BoundsType bounds;
+        };
+
+        struct Object
+        {
+            BoundsType bounds;
+            T value{};
+            uint32_t node = INVALID_SIZE_32;
+            uint32_t prev = INVALID_SIZE_32;
+            uint32_t next = INVALID_SIZE_32;
+        };
+
+        static uint64_t encode(const CellType& cell)
+        {
+            if constexpr (Dim == 2) return morton_encode_64(cell);
+            else return morton_encode_3d(cell);
         }
 
-        void split(Node* node, const Bounds2F& rect)
+        CellType get_cell(const PointType& point) const
         {
-            assert(node != nullptr);
-            assert(isLeaf(node) && "Only leaves can be split");
-            // Create children
-            for (auto& child : node->children)
-                child = std::make_unique<Node>();
-            // Assign values to children
-            auto newValues = std::vector<T>(); // New values for this node
-            for (const auto& value : node->value)
+            const uint32_t max_cell = static_cast<uint32_t>((1ull << _max_depth) - 1);
+
+            CellType cell;
+            for (uint32_t ix = 0; ix < Dim; ++ix)
             {
-                auto i = getQuadrant(rect,  (value));
-                if (i != -1)
-                    node->children[static_cast<std::size_t>(i)]->values.push_back(value);
-                else
-                    newValues.push_back(value);
+                const float position = (point[ix] - _world_bounds._lower[ix]) * _cell_scale[ix];
+                cell[ix] = position <= 0.0f ? 0 : std::min(static_cast<uint32_t>(position), max_cell);
             }
-            node->value = std::move(newValues);
+            return cell;
         }
 
-        bool remove(Node* node, const Bounds2F& rect, const T& value)
+        static PointType get_query_center(const BoundsType& box) { return (box._lower + box._upper) * 0.5f; }
+        static PointType get_query_center(const PointType& point) { return point; }
+
+        // test 返回包围盒与查询的关系, 节点包围盒完全在查询内部时子树中的对象和节点都不再检查.
+        template <typename Test, typename F>
+        void traverse(Test&& test, F&& func) const
         {
-            assert(node != nullptr);
-            assert(rect.contains(mGetBox(value)));
-            if (is_leaf(node))
+            struct StackEntry
             {
-                // Remove the value from node
-                removeValue(node, value);
-                return true;
-            }
-            else
+                uint32_t node;
+                bool inside;
+            };
+            std::array<StackEntry, max_depth_limit * (child_num - 1) + 1> stack;
+            uint32_t stack_top = 0;
+            stack[stack_top++] = StackEntry{ 0, false };
+
+            while (stack_top > 0)
             {
-                // Remove the value in a child if the value is entirely contained in it
-                auto i = getQuadrant(rect, mGetBox(value));
-                if (i != -1)
+                const StackEntry entry = stack[--stack_top];
+                const Node& node = _nodes[entry.node];
+
+                bool inside = entry.inside;
+                if (!inside)
+                {
+                    const FrustumCull result = test(node.bounds);
+                    if (result == FrustumCull::Outside) continue;
+                    inside = result == FrustumCull::Inside;
+                }
+
+                for (uint32_t ix = node.first_object; ix != INVALID_SIZE_32; ix = _objects[ix].next)
+                {
+                    if (inside || test(_objects[ix].bounds) != FrustumCull::Outside) func(_objects[ix].value, ix);
+                }
+
+                for (uint32_t child : node.children)
                 {
-                    if (remove(node->children[static_cast<std::size_t>(i)].get(), compute_child_bounds(rect, i), value))
-                        return tryMerge(node);
+                    if (child != INVALID_SIZE_32) stack[stack_top++] = StackEntry{ child, inside };
                 }
-                // Otherwise, we remove the value from the current node
-                else
-                    removeValue(node, value);
-                return false;
             }
         }
 
-        void removeValue(Node* node, const T& value)
+        static bool overlap(const BoundsType& bounds0, const BoundsType& bounds1)
         {
-            // Find the value in node->values
-            auto it = std::find_if(std::begin(node->value), std::end(node->value),
-                [this, &value](const auto& rhs){ return mEqual(value, rhs); });
-            assert(it != std::end(node->values) && "Trying to remove a value that is not present in the node");
-            // Swap with the last element and pop back
-            *it = std::move(node->value.back());
-            node->value.pop_back();
+            for (uint32_t ix = 0; ix < Dim; ++ix)
+            {
+                if (bounds0._lower[ix] > bounds1._upper[ix] || bounds0._upper[ix] < bounds1._lower[ix]) return false;
+            }
+            return true;
         }
 
-        bool tryMerge(Node* node)
+        // outer 是否包含 inner.
+        static bool contain(const BoundsType& outer, const BoundsType& inner)
         {
-            assert(node != nullptr);
-            assert(!isLeaf(node) && "Only interior nodes can be merged");
-            auto nbValues = node->value.size();
-            for (const auto& child : node->children)
-            {
-                if (!is_leaf(child.get()))
-                    return false;
-                nbValues += child->values.size();
-            }
-            if (nbValues <= Threshold)
+            for (uint32_t ix = 0; ix < Dim; ++ix)
             {
-                node->value.reserve(nbValues);
-                // Merge the values of all the children
-                for (const auto& child : node->children)
-                {
-                    for (const auto& value : child->values)
-                        node->value.push_back(value);
-                }
-                // Remove the children
-                for (auto& child : node->children)
-                    child.reset();
-                return true;
+                if (inner._lower[ix] < outer._lower[ix] || inner._upper[ix] > outer._upper[ix]) return false;
             }
-            else
-                return false;
+            return true;
         }
 
-        void query(Node* node, const Bounds2F& rect, const Bounds2F& queryBox, std::vector<T>& values) const
+        uint32_t create_node(uint64_t key, uint32_t parent)
         {
-            assert(node != nullptr);
-            assert(queryBox.intersects(rect));
-            for (const auto& value : node->value)
+            uint32_t index;
+            if (!_free_nodes.empty())
             {
-                if (intersect(queryBox, mGetBox(value)))
-                    values.push_back(value);
+                index = _free_nodes.back();
+                _free_nodes.pop_back();
             }
-            if (!is_leaf(node))
+            else
             {
-                for (auto i = std::size_t(0); i < node->children.size(); ++i)
-                {
-                    auto childBox = compute_child_bounds(rect, static_cast<int>(i));
-                    if (intersect(queryBox, childBox))
-                        query(node->children[i].get(), childBox, queryBox, values);
-                }
+                index = static_cast<uint32_t>(_nodes.size());
+                _nodes.emplace_back();
             }
+
+            Node& node = _nodes[index];
+            node = Node{};
+            node.key = key;
+            node.parent = parent;
+            std::fill(std::begin(node.children), std::end(node.children), INVALID_SIZE_32);
+
+            _node_map[key] = index;
+            return index;
+        }
+
+        // 先创建祖先节点, 按 morton 序调用时节点池中的顺序为先序遍历的顺序.
+        uint32_t get_or_create_node(uint64_t key)
+        {
+            auto iter = _node_map.find(key);
+            if (iter != _node_map.end()) return iter->second;
+
+            const uint32_t parent = get_or_create_node(key >> Dim);
+            const uint32_t index = create_node(key, parent);
+            _nodes[parent].children[key & (child_num - 1)] = index;
+            return index;
         }
 
-        void findAllIntersections(Node* node, std::vector<std::pair<T, T>>& intersections) const
+        uint32_t insert_object(uint32_t node_index, const BoundsType& bounds, const T& value)
         {
-            // Find intersections between values stored in this node
-            // Make sure to not report the same intersection twice
-            for (auto i = std::size_t(0); i < node->value.size(); ++i)
+            uint32_t handle;
+            if (!_free_objects.empty())
             {
-                for (auto j = std::size_t(0); j < i; ++j)
-                {
-                    if (mGetBox(node->value[i]).intersects(mGetBox(node->value[j])))
-                        intersections.emplace_back(node->value[i], node->value[j]);
-                }
+                handle = _free_objects.back();
+                _free_objects.pop_back();
             }
-            if (!is_leaf(node))
+            else
             {
-                // Values in this node can intersect values in descendants
-                for (const auto& child : node->children)
-                {
-                    for (const auto& value : node->value)
-                        findIntersectionsInDescendants(child.get(), value, intersections);
-                }
-                // Find intersections in children
-                for (const auto& child : node->children)
-                    findAllIntersections(child.get(), intersections);
+                handle = static_cast<uint32_t>(_objects.size());
+                _objects.emplace_back();
             }
-        }
 
-        void findIntersectionsInDescendants(Node* node, const T& value, std::vector<std::pair<T, T>>& intersections) const
-        {
-            // Test against the values stored in this node
-            for (const auto& other : node->value)
+            Node& node = _nodes[node_index];
+            Object& object = _objects[handle];
+            object.bounds = bounds;
+            object.value = value;
+            object.node = node_index;
+            object.prev = INVALID_SIZE_32;
+            object.next = node.first_object;
+            if (node.first_object != INVALID_SIZE_32) _objects[node.first_object].prev = handle;
+            node.first_object = handle;
+            node.object_count++;
+
+            for (uint32_t ix = node_index; ix != INVALID_SIZE_32; ix = _nodes[ix].parent)
             {
-                if (mGetBox(value).intersects(mGetBox(other)))
-                    intersections.emplace_back(value, other);
+                if (contain(_nodes[ix].bounds, bounds)) break;
+                _nodes[ix].bounds = merge(_nodes[ix].bounds, bounds);
             }
-            // Test against values stored into descendants of this node
-            if (!is_leaf(node))
+
+            _object_count++;
+            return handle;
+        }
+
+        // 从 node_index 向上释放没有对象也没有子节点的节点, 根节点不释放.
+        void release_empty_nodes(uint32_t node_index)
+        {
+            while (node_index != 0)
             {
-                for (const auto& child : node->children)
-                    findIntersectionsInDescendants(child.get(), value, intersections);
+                Node& node = _nodes[node_index];
+                if (node.object_count != 0) return;
+                for (uint32_t child : node.children)
+                {
+                    if (child != INVALID_SIZE_32) return;
+                }
+
+                const uint32_t parent = node.parent;
+                _nodes[parent].children[node.key & (child_num - 1)] = INVALID_SIZE_32;
+                _node_map.erase(node.key);
+                _free_nodes.push_back(node_index);
+                node_index = parent;
             }
         }
+
+    private:
+        BoundsType _world_bounds;
+        uint32_t _max_depth;
+        PointType _cell_scale;
+
+        std::vector<Node> _nodes;
+        std::vector<Object> _objects;
+        std::vector<uint32_t> _free_nodes;
+        std::vector<uint32_t> _free_objects;
+        FlatHashMap<uint64_t, uint32_t> _node_map;
+        uint64_t _object_count = 0;
     };
 
+    template <typename T>
+    using Quadtree = LinearTree<T, 2>;
+
+    template <typename T>
+    using Octree = LinearTree<T, 3>;
 }
 
 
@@ -319,4 +502,4 @@ namespace fantasy
 
 
 
-#endif
\ No newline at end of file
+#endif
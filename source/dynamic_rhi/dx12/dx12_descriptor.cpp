@@ -64,39 +64,23 @@ namespace fantasy
     
     uint32_t DX12DescriptorHeap::allocate_descriptors(uint32_t count)
     {
-        std::lock_guard lock(_mutex);
-        
-        uint32_t found_index = 0;
-        uint32_t available_count = 0;
-        bool found = false;
-
-        for (uint32_t ix = _descriptor_search_start_index; ix < _descriptor_count; ix++)
         {
-            if (_allocated_descriptors[ix]) available_count = 0;
-            else available_count += 1;
-
-            if (available_count == count)
-            {
-                found_index = ix - count + 1;
-                found = true;
-                break;
-            }
-        }
+            std::shared_lock lock(_mutex);
 
-        if (!found)
-        {
-            found_index = _descriptor_count;
-            ReturnIfFalse(resize_heap(_descriptor_count + count));
+            const uint32_t index = _allocated_descriptors.allocate_range(count);
+            if (index != INVALID_SIZE_32) return index;
         }
 
-        for (uint32_t ix = found_index; ix < found_index + count; ix++)
+        std::lock_guard lock(_mutex);
+
+        // 获取独占锁之前其它线程可能已经扩容或释放.
+        uint32_t index = _allocated_descriptors.allocate_range(count);
+        if (index == INVALID_SIZE_32)
         {
-            _allocated_descriptors.set_true(ix);
+            ReturnIfFalse(resize_heap(_descriptor_count + count));
+            index = _allocated_descriptors.allocate_range(count);
         }
-
-        _descriptor_search_start_index = (found_index + count) % _descriptor_count;
-
-        return found_index;
+        return index;
     }
     
     void DX12DescriptorHeap::release_descriptor(uint32_t index)
@@ -108,22 +92,11 @@ namespace fantasy
     {
         if (count == 0) return;
 
-        std::lock_guard lock(_mutex);
-
-        for (uint32_t ix = base_index; ix < base_index + count; ix++)
-        {
-            if (!_allocated_descriptors[ix])
-            {
-                LOG_WARN("Attempted to release an un-allocated descriptor");
-                return;
-            }
-
-            _allocated_descriptors.set_false(ix);
-        }
+        std::shared_lock lock(_mutex);
 
-        if (_descriptor_search_start_index > base_index)
+        if (!_allocated_descriptors.release_range(base_index, count))
         {
-            _descriptor_search_start_index = base_index;
+            LOG_WARN("Attempted to release an un-allocated descriptor");
         }
     }
 
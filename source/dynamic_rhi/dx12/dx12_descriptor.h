@@ -3,7 +3,7 @@
 
 
 #include <cstdint>
-#include <mutex>
+#include <shared_mutex>
 
 #include "dx12_forward.h"
 #include "../../core/tools/bit_allocator.h"
@@ -46,13 +46,12 @@ namespace fantasy
         D3D12_GPU_DESCRIPTOR_HANDLE _d3d12_start_gpu_handle = { 0 };
         D3D12_CPU_DESCRIPTOR_HANDLE _d3d12_start_shader_visible_cpu_handle = { 0 };
         
-        std::mutex _mutex;
+        // 分配和释放由 BitSetAllocator 保证线程安全, 只有扩容时需要独占.
+        std::shared_mutex _mutex;
 
         uint32_t _descriptor_stride = 0;
         uint32_t _descriptor_count = 0;
        
-        uint32_t _descriptor_search_start_index = 0;
-       
         BitSetAllocator _allocated_descriptors;
     };
 
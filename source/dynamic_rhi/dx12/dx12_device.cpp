@@ -1,4 +1,5 @@
 #include "dx12_device.h"
+#include "../../core/tools/frame_allocator.h"
 #include <combaseapi.h>
 #include <cstdint>
 #include <d3d12.h>
@@ -355,11 +356,14 @@ namespace fantasy
         {
             ID3D12Heap* heap = tile_mappings[ix].heap ? check_cast<DX12Heap*>(tile_mappings[ix].heap)->d3d12_heap.Get() : nullptr;
 
+            ScratchScope scratch;
+            LinearArena& arena = scratch.get_arena();
+
             uint32_t regions_num = static_cast<uint32_t>(tile_mappings[ix].regions.size());
-            std::vector<D3D12_TILED_RESOURCE_COORDINATE> d3d12_resource_coordiantes(regions_num);
-            std::vector<D3D12_TILE_REGION_SIZE> d3d12_region_sizes(regions_num);
-            std::vector<UINT> heap_start_offsets(regions_num);
-            std::vector<UINT> range_tile_counts(regions_num);
+            ScratchVector<D3D12_TILED_RESOURCE_COORDINATE> d3d12_resource_coordiantes(regions_num, arena);
+            ScratchVector<D3D12_TILE_REGION_SIZE> d3d12_region_sizes(regions_num, arena);
+            ScratchVector<UINT> heap_start_offsets(regions_num, arena);
+            ScratchVector<UINT> range_tile_counts(regions_num, arena);
 
             for (uint32_t jx = 0; jx < regions_num; ++jx)
             {
@@ -400,9 +404,10 @@ namespace fantasy
                 range_tile_counts[jx] = d3d12_region_sizes[jx].NumTiles;
             }
 
-            std::vector<D3D12_TILE_RANGE_FLAGS> d3d12_tile_range_flags(
+            ScratchVector<D3D12_TILE_RANGE_FLAGS> d3d12_tile_range_flags(
                 regions_num, 
-                heap ? D3D12_TILE_RANGE_FLAG_NONE : D3D12_TILE_RANGE_FLAG_NULL
+                heap ? D3D12_TILE_RANGE_FLAG_NONE : D3D12_TILE_RANGE_FLAG_NULL,
+                arena
             );
             get_queue(execution_queue_type)->d3d12_cmdqueue->UpdateTileMappings(
                 d3d12_texture, 
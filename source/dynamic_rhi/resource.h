@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cstdint>
 #include <memory>
+#include <span>
 #include <vector>
 #include <windows.h>
 #include <string>
@@ -92,7 +93,8 @@ namespace fantasy
             uint64_t byte_offset = 0;
         };
         
-        std::vector<Region> regions;
+        // 由调用者持有, 只在 update_texture_tile_mappings 调用期间使用.
+        std::span<const Region> regions;
 
         HeapInterface* heap = nullptr;
     };
@@ -3,7 +3,7 @@
 
 #include "Resource.h"
 #include <memory>
-#include <unordered_map>
+#include "../core/tools/flat_hash_map.h"
 #include <vector>
 
  namespace fantasy 
@@ -64,8 +64,8 @@
         BufferState* get_buffer_state_track(BufferInterface* buffer);
 
     public:
-        std::unordered_map<TextureInterface*, std::unique_ptr<TextureState>> texture_states;
-        std::unordered_map<BufferInterface*, std::unique_ptr<BufferState>> buffer_states;
+        FlatHashMap<TextureInterface*, std::unique_ptr<TextureState>> texture_states;
+        FlatHashMap<BufferInterface*, std::unique_ptr<BufferState>> buffer_states;
     
     private:
 
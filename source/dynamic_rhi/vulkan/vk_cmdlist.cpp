@@ -1110,17 +1110,16 @@ namespace fantasy
 
     void VKCommandList::set_binding_resource_state(BindingSetInterface* binding_set_)
     {
-        std::vector<BindingSetItem> binding_items;
-
+        // 直接遍历绑定项, 不复制 (复制会增减每个资源的引用计数).
+        std::span<const BindingSetItem> binding_items;
         if (binding_set_->is_bindless())
         {
-            const auto& bindings = check_cast<VKBindlessSet*>(binding_set_)->binding_items;
-            binding_items.insert(binding_items.end(), bindings.begin(), bindings.end());
+            binding_items = check_cast<VKBindlessSet*>(binding_set_)->binding_items;
         }
         else 
         {
             const auto& bindings = binding_set_->get_desc().binding_items;
-            binding_items.insert(binding_items.end(), bindings.begin(), bindings.end());
+            binding_items = std::span<const BindingSetItem>(bindings.data(), bindings.size());
         }
 
         for (const auto& binding : binding_items)
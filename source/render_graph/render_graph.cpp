@@ -1,6 +1,7 @@
 #include "render_graph.h"
 #include "render_pass.h"
 #include "render_resource_cache.h"
+#include "../core/tools/frame_allocator.h"
 #include <cstdint>
 
 #include <d3d12.h>
@@ -338,6 +339,7 @@ namespace fantasy
         _present_func();
 
 		_resource_cache->frame_index++;
+		get_frame_allocator().begin_frame();
 
         return true;
     }
@@ -35,7 +35,7 @@ namespace fantasy
 
     std::shared_ptr<ResourceInterface> RenderResourceCache::require(const char* name)
     {
-        auto iter = _resource_names.find(std::string(name));
+        auto iter = _resource_names.find(name);
         if (iter != _resource_names.end())
         {
             return iter->second.resource;
@@ -54,9 +54,8 @@ namespace fantasy
 			return true;
 		}
 
-		if (_data_names.find(std::string(name)) == _data_names.end())
+		if (_data_names.try_emplace(name, data, element_num).second)
 		{
-			_data_names[std::string(name)] = std::make_pair(data, element_num);
 			return true;
 		}
 
@@ -72,7 +71,7 @@ namespace fantasy
 			return false;
 		}
 
-		auto iter = _data_names.find(std::string(name));
+		auto iter = _data_names.find(name);
 
 		if (iter == _data_names.end())
 		{
@@ -4,8 +4,8 @@
 #include <cstdint>
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include "../core/tools/ecs.h"
+#include "../core/tools/flat_hash_map.h"
 #include "../dynamic_rhi/resource.h"
 
 namespace fantasy
@@ -36,8 +36,9 @@ namespace fantasy
             std::shared_ptr<ResourceInterface> resource;
         };
 
-        std::unordered_map<std::string, ResourceData> _resource_names;
-		std::unordered_map<std::string, std::pair<void*, uint64_t>> _data_names;
+        // 键的哈希支持异构查找, require 时不需要用 name 构造 std::string.
+        FlatHashMap<std::string, ResourceData> _resource_names;
+		FlatHashMap<std::string, std::pair<void*, uint64_t>> _data_names;
 
         World* _world;
     };
@@ -2,6 +2,7 @@
 #include "cluster_light_culling.h"
 #include "../../shader/shader_compiler.h"
 #include "../../core/tools/check_cast.h"
+#include "../../core/tools/frame_allocator.h"
 #include "../../scene/camera.h"
 #include <cstdint>
 #include <memory>
@@ -84,17 +85,20 @@ namespace fantasy
 		{
 			World* world = cache->get_world();
 
+			// 只在本帧使用, write_buffer 时已经复制到上传缓冲区.
+			FrameVector<PointLight> point_lights;
+			FrameVector<SpotLight> spot_lights;
 			ReturnIfFalse(world->each<PointLight>(
-				[this](Entity* entity, PointLight* light) -> bool
+				[&point_lights](Entity* entity, PointLight* light) -> bool
 				{
-					_point_lights.emplace_back(*light);
+					point_lights.emplace_back(*light);
 					return true;
 				}
 			));
 			ReturnIfFalse(world->each<SpotLight>(
-				[this](Entity* entity, SpotLight* light) -> bool
+				[&spot_lights](Entity* entity, SpotLight* light) -> bool
 				{
-					_spot_lights.emplace_back(*light);
+					spot_lights.emplace_back(*light);
 					return true;
 				}
 			));
@@ -103,8 +107,8 @@ namespace fantasy
 			_pass_constant.view_proj = camera->get_view_proj();
 			_pass_constant.half_fov_y = 0.5f * camera->get_fov_y();
 			_pass_constant.near_z = camera->get_near_z();
-			_pass_constant.point_light_count = static_cast<uint32_t>(_point_lights.size());
-			_pass_constant.spot_light_count = static_cast<uint32_t>(_spot_lights.size());
+			_pass_constant.point_light_count = static_cast<uint32_t>(point_lights.size());
+			_pass_constant.spot_light_count = static_cast<uint32_t>(spot_lights.size());
 			_pass_constant.divide_count = uint3(
 				_tile_count.x,
 				_tile_count.y,
@@ -118,25 +122,25 @@ namespace fantasy
 			{
 				ReturnIfFalse(_point_light_buffer = std::shared_ptr<BufferInterface>(device->create_buffer(
 					BufferDesc::create_read_write_structured_buffer(
-						sizeof(PointLight) * _point_lights.size(), 
+						sizeof(PointLight) * point_lights.size(), 
 						sizeof(PointLight),
 						"point_light_buffer"
 					)
 				)));
 				ReturnIfFalse(_spot_light_buffer = std::shared_ptr<BufferInterface>(device->create_buffer(
 					BufferDesc::create_read_write_structured_buffer(
-						sizeof(SpotLight) * _spot_lights.size(), 
+						sizeof(SpotLight) * spot_lights.size(), 
 						sizeof(SpotLight),
 						"spot_light_buffer"
 					)
 				)));
 
-				ReturnIfFalse(cmdlist->write_buffer(_point_light_buffer.get(), _point_lights.data(), _point_lights.size()));
-				ReturnIfFalse(cmdlist->write_buffer(_spot_light_buffer.get(), _spot_lights.data(), _spot_lights.size()));
+				ReturnIfFalse(cmdlist->write_buffer(_point_light_buffer.get(), point_lights.data(), sizeof(PointLight) * point_lights.size()));
+				ReturnIfFalse(cmdlist->write_buffer(_spot_light_buffer.get(), spot_lights.data(), sizeof(SpotLight) * spot_lights.size()));
 
 				ReturnIfFalse(_light_index_buffer = std::shared_ptr<BufferInterface>(device->create_buffer(
 					BufferDesc::create_read_write_structured_buffer(
-						sizeof(uint32_t) * (_point_lights.size() + _spot_lights.size()) * max_cluster_light_num, 
+						sizeof(uint32_t) * (point_lights.size() + spot_lights.size()) * max_cluster_light_num, 
 						sizeof(uint32_t),
 						"light_index_buffer"
 					)
@@ -173,12 +177,4 @@ namespace fantasy
 		ReturnIfFalse(cmdlist->close());
         return true;
 	}
-
-	bool ClusterLightCullingPass::finish_pass(RenderResourceCache* cache)
-	{
-		_point_lights.clear(); _point_lights.shrink_to_fit();
-		_spot_lights.clear(); _spot_lights.shrink_to_fit();
-		return true;
-	}
-
 }
\ No newline at end of file
@@ -31,7 +31,6 @@ namespace fantasy
 
 		bool compile(DeviceInterface* device, RenderResourceCache* cache) override;
 		bool execute(CommandListInterface* cmdlist, RenderResourceCache* cache) override;
-        bool finish_pass(RenderResourceCache* cache) override;
 
 		static const uint32_t max_cluster_light_num = 100u;
 	
@@ -40,9 +39,6 @@ namespace fantasy
 		uint2 _tile_count = { CLIENT_WIDTH / 64, CLIENT_HEIGHT / 32 };
 		constant::ClusterLightCullingPassConstant _pass_constant;
 
-		std::vector<PointLight> _point_lights;
-		std::vector<SpotLight> _spot_lights;
-
 		std::shared_ptr<BufferInterface> _point_light_buffer;
 		std::shared_ptr<BufferInterface> _spot_light_buffer;
 		std::shared_ptr<BufferInterface> _light_index_buffer;
@@ -11,14 +11,7 @@ namespace fantasy
  
 	bool MipmapGenerationPass::compile(DeviceInterface* device, RenderResourceCache* cache)
 	{
-        cache->get_world()->get_global_entity()->get_component<event::GenerateMipmap>()->add_event(
-            [this](Entity* entity) -> bool
-            {
-				recompute();
-				_current_model = entity; 
-				return true;
-            }
-        );
+        cache->get_world()->subscribe<event::GenerateMipmap>(this);
 
 		std::fill(_current_heap_offsets.begin(), _current_heap_offsets.end(), 0);
 
@@ -251,6 +244,13 @@ namespace fantasy
 	}
 #endif
 
+	bool MipmapGenerationPass::publish(World* world, const event::GenerateMipmap& event)
+	{
+		recompute();
+		_current_model = event.entity;
+		return true;
+	}
+
 	bool MipmapGenerationPass::finish_pass(RenderResourceCache* cache)
 	{
 #if !SINGLE_GEOMETRY_TEST
@@ -3,6 +3,7 @@
 
 #include "../../render_graph/render_pass.h"
 #include "../../scene/geometry.h"
+#include "../../scene/virtual_texture.h"
 #include <array>
 #include <memory>
 
@@ -19,7 +20,9 @@ namespace fantasy
 		};
 	}
 
-	class MipmapGenerationPass : public RenderPassInterface
+	class MipmapGenerationPass : 
+		public RenderPassInterface,
+		public EventSubscriber<event::GenerateMipmap>
 	{
 	public:
 		MipmapGenerationPass() { type = RenderPassType::Precompute | RenderPassType::Exclude; }
@@ -28,6 +31,8 @@ namespace fantasy
 		bool execute(CommandListInterface* cmdlist, RenderResourceCache* cache) override;
         bool finish_pass(RenderResourceCache* cache) override;
 
+		bool publish(World* world, const event::GenerateMipmap& event) override;
+
 	private:
 		Entity* _current_model = nullptr;
 
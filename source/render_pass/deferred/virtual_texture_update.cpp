@@ -1,8 +1,10 @@
 #include "virtual_texture_update.h"
 #include "../../shader/shader_compiler.h"
 #include "../../core/tools/check_cast.h"
+#include "../../core/tools/frame_allocator.h"
 #include "../../scene/light.h"
 #include "../../scene/scene.h"
+#include "../../core/parallel/algorithm.h"
 
 
 namespace fantasy
@@ -41,6 +43,8 @@ namespace fantasy
 		_vt_axis_shadow_tile_num = VT_VIRTUAL_SHADOW_RESOLUTION / VT_SHADOW_PAGE_SIZE;
 		_vt_feed_back_resolution = { CLIENT_WIDTH / VT_FEED_BACK_SCALE_FACTOR, CLIENT_HEIGHT / VT_FEED_BACK_SCALE_FACTOR };
 		_vt_feed_back_data.resize(_vt_feed_back_resolution.x * _vt_feed_back_resolution.y, uint3(INVALID_SIZE_32));
+		_vt_feed_back_page_keys.reserve(_vt_feed_back_data.size());
+		_vt_feed_back_shadow_keys.reserve(_vt_feed_back_data.size());
 		_vt_shadow_indirect_data.resize(_vt_axis_shadow_tile_num * _vt_axis_shadow_tile_num, uint2(INVALID_SIZE_32));
 
 		ReturnIfFalse(cache->collect_constants("vt_new_shadow_pages", &_vt_new_shadow_pages));
@@ -170,31 +174,56 @@ namespace fantasy
 			memcpy(_vt_feed_back_data.data(), mapped_data, static_cast<uint32_t>(_vt_feed_back_data.size()) * sizeof(uint3)); 
 			_vt_feed_back_read_back_buffer->unmap();
 
-			std::array<TextureTilesMapping, Material::TextureType_Num> tile_mappings;
+			// 反馈数据中同一个 page 会重复出现很多次, 排序去重后每个 page 只需查询一次 lru 表.
+			_vt_feed_back_page_keys.clear();
+			_vt_feed_back_shadow_keys.clear();
+			for (const auto& data : _vt_feed_back_data)
+			{
+				if (data.z != INVALID_SIZE_32) _vt_feed_back_shadow_keys.push_back(data.z);
+				if (data.x != INVALID_SIZE_32 && data.y != INVALID_SIZE_32)
+				{
+					_vt_feed_back_page_keys.push_back((uint64_t(data.x) << 32) | data.y);
+				}
+			}
+			{
+				// 当前帧必须完成, 优先于后台的资源加载任务.
+				TaskPriorityScope priority_scope(TaskPriority::Critical);
+				parallel::sort(_vt_feed_back_shadow_keys.begin(), _vt_feed_back_shadow_keys.end());
+				parallel::sort(_vt_feed_back_page_keys.begin(), _vt_feed_back_page_keys.end());
+			}
+			_vt_feed_back_shadow_keys.erase(
+				std::unique(_vt_feed_back_shadow_keys.begin(), _vt_feed_back_shadow_keys.end()), 
+				_vt_feed_back_shadow_keys.end()
+			);
+			_vt_feed_back_page_keys.erase(
+				std::unique(_vt_feed_back_page_keys.begin(), _vt_feed_back_page_keys.end()), 
+				_vt_feed_back_page_keys.end()
+			);
+
+			_vt_physical_shadow_table.begin_frame();
+			_vt_physical_table.begin_frame();
 
-			for (uint32_t ix = 0; ix < _vt_feed_back_data.size(); ++ix)
+			for (uint32_t shadow_key : _vt_feed_back_shadow_keys)
 			{
-				const auto& data = _vt_feed_back_data[ix];
+				VTShadowPage page;
+				page.tile_id = { shadow_key >> 16, shadow_key & 0xffff };
 
-				if (data.z != INVALID_SIZE_32)
+				if (!_vt_physical_shadow_table.check_page_loaded(page))
 				{
-					VTShadowPage page;
-					page.tile_id = { data.z >> 16, data.z & 0xffff };
-
-					if (!_vt_physical_shadow_table.check_page_loaded(page))
-					{
-						page.physical_position_in_page = _vt_physical_shadow_table.get_new_position();
-						_vt_new_shadow_pages.push_back(page);
-						_vt_physical_shadow_table.add_page(page);
-					}
-					_vt_shadow_indirect_data[page.tile_id.x + page.tile_id.y * _vt_axis_shadow_tile_num] = page.physical_position_in_page;
+					page.physical_position_in_page = _vt_physical_shadow_table.get_new_position();
+					_vt_new_shadow_pages.push_back(page);
+					_vt_physical_shadow_table.add_page(page);
 				}
+				_vt_shadow_indirect_data[page.tile_id.x + page.tile_id.y * _vt_axis_shadow_tile_num] = page.physical_position_in_page;
+			}
 
-				if (data.x == INVALID_SIZE_32 || data.y == INVALID_SIZE_32)  continue;
+			std::array<FrameVector<TextureTilesMapping::Region>, Material::TextureType_Num> tile_regions;
 
+			for (uint64_t page_key : _vt_feed_back_page_keys)
+			{
 				VTPage page;
-				page.geometry_id = data.x;
-				page.coordinate_mip_level = data.y;
+				page.geometry_id = static_cast<uint32_t>(page_key >> 32);
+				page.coordinate_mip_level = static_cast<uint32_t>(page_key);
 
 				if (!_vt_physical_table.check_page_loaded(page))
 				{
@@ -218,7 +247,7 @@ namespace fantasy
 						region.byte_offset += (coordinate.x + coordinate.y * row_page_num) * 
 											  VT_PAGE_SIZE * VT_PAGE_SIZE * pixel_size;
 					
-						tile_mappings[jx].regions.emplace_back(region);
+						tile_regions[jx].emplace_back(region);
 					}
 					_vt_physical_table.add_page(page);
 				}
@@ -236,13 +265,15 @@ namespace fantasy
 
 			for (uint32_t ix = 0; ix < Material::TextureType_Num; ++ix)
 			{
-				if (tile_mappings[ix].regions.empty()) continue;
+				if (tile_regions[ix].empty()) continue;
 
-				tile_mappings[ix].heap = _geometry_texture_heaps[ix].get();
+				TextureTilesMapping tile_mapping;
+				tile_mapping.regions = tile_regions[ix];
+				tile_mapping.heap = _geometry_texture_heaps[ix].get();
 
 				cmdlist->get_deivce()->update_texture_tile_mappings(
 					_vt_physical_textures[ix].get(), 
-					&tile_mappings[ix], 
+					&tile_mapping, 
 					1,
 					CommandQueueType::Compute 
 				);
@@ -4,10 +4,10 @@
 #include "../../render_graph/render_pass.h"
 #include "../../scene/virtual_texture.h"
 #include "../../scene/geometry.h"
+#include "../../core/tools/flat_hash_map.h"
 #include <array>
 #include <cstdint>
 #include <memory>
-#include <unordered_map>
 
 namespace fantasy
 {
@@ -53,7 +53,9 @@ namespace fantasy
 		uint2 _vt_feed_back_resolution;
 		uint32_t _vt_axis_shadow_tile_num = 0;
 		std::vector<uint3> _vt_feed_back_data;
-		std::unordered_map<uint64_t, std::pair<TextureTilesMapping::Region, uint32_t>> _geometry_texture_region_cache;
+		std::vector<uint64_t> _vt_feed_back_page_keys;
+		std::vector<uint32_t> _vt_feed_back_shadow_keys;
+		FlatHashMap<uint64_t, std::pair<TextureTilesMapping::Region, uint32_t>> _geometry_texture_region_cache;
 
 		std::array<std::shared_ptr<HeapInterface>, Material::TextureType_Num> _geometry_texture_heaps;
 		
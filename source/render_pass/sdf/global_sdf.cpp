@@ -38,8 +38,11 @@ namespace fantasy
 						if (crChunk.model_moved)
 						{
 							uint32_t dwCounter = 0;
-							for (const auto* cpModel : crChunk.model_entities)
+							for (const auto& model_handle : crChunk.model_entities)
 							{
+								const Entity* cpModel = cache->get_world()->get_entity(model_handle);
+								if (cpModel == nullptr) continue;
+
 								DistanceField* pDF = cpModel->get_component<DistanceField>();
 								for (const auto& crMeshDF : pDF->mesh_distance_fields)
 								{
@@ -81,8 +84,11 @@ namespace fantasy
 						if (chunk.model_moved)
 						{
 							uint32_t counter = 0;
-							for (const auto* model : chunk.model_entities)
+							for (const auto& model_handle : chunk.model_entities)
 							{
+								const Entity* model = cache->get_world()->get_entity(model_handle);
+								if (model == nullptr) continue;
+
 								DistanceField* distance_field = model->get_component<DistanceField>();
 								Transform* transform = model->get_component<Transform>();
 
@@ -200,8 +206,11 @@ namespace fantasy
 					if (chunk.model_moved)
 					{
 						uint32_t mesh_index_begin = mesh_index;
-						for (const auto* model : chunk.model_entities)
+						for (const auto& model_handle : chunk.model_entities)
 						{
+							const Entity* model = cache->get_world()->get_entity(model_handle);
+							if (model == nullptr) continue;
+
 							mesh_index += static_cast<uint32_t>(model->get_component<DistanceField>()->mesh_distance_fields.size());
 						}
 
@@ -10,26 +10,33 @@ namespace fantasy
 {
 #define THREAD_GROUP_SIZE_Y 8
 #define THREAD_GROUP_SIZE_Z 8
-#define BVH_STACK_SIZE 32
 #define UPPER_BOUND_ESTIMATE_PRESION 6
 #define X_SLICE_SIZE 8
 
     bool SdfGeneratePass::compile(DeviceInterface* device, RenderResourceCache* cache)
     {
-		cache->get_world()->get_global_entity()->get_component<event::GenerateSdf>()->add_event(
+		_world = cache->get_world();
+		_world->get_global_entity()->get_component<event::GenerateSdf>()->add_event(
 			[this](Entity* entity) 
 			{ 
 				recompute();
-				_modle_entity = entity;
-				_distance_field = entity->get_component<DistanceField>();
+				_model_entity = entity->get_handle();
 
-				ReturnIfFalse(_distance_field != nullptr);
+				DistanceField* distance_field = entity->get_component<DistanceField>();
+				ReturnIfFalse(distance_field != nullptr);
 
-				if (!_distance_field->check_sdf_cache_exist())
+				if (!distance_field->check_sdf_cache_exist())
 				{
-					const auto& crMeshDF = _distance_field->mesh_distance_fields[0];
+					// finish 会用新文件替换旧缓存, 先释放旧缓存的映射.
+					distance_field->sdf_cache_file.reset();
+
+					const auto& crMeshDF = distance_field->mesh_distance_fields[0];
 					std::string strSdfName = *entity->get_component<std::string>() + ".sdf";
-					_binary_output = std::make_unique<serialization::BinaryOutput>(std::string(PROJ_DIR) + "asset/cache/distance_field/" + strSdfName);
+					_binary_output = std::make_unique<serialization::BinaryOutput>(
+						std::string(PROJ_DIR) + "asset/cache/distance_field/" + strSdfName,
+						SDF_CACHE_VERSION,
+						serialization::hash_parameters(SDF_RESOLUTION)
+					);
 				}
 				return true;
 			}
@@ -57,7 +64,7 @@ namespace fantasy
 			cs_compile_desc.defines.push_back("GROUP_THREAD_NUM_Y=" + std::to_string(THREAD_GROUP_SIZE_Y));
 			cs_compile_desc.defines.push_back("GROUP_THREAD_NUM_Z=" + std::to_string(THREAD_GROUP_SIZE_Z));
 			cs_compile_desc.defines.push_back("UPPER_BOUND_ESTIMATE_PRECISON=" + std::to_string(UPPER_BOUND_ESTIMATE_PRESION));
-			cs_compile_desc.defines.push_back("BVH_STACK_SIZE=" + std::to_string(BVH_STACK_SIZE));
+			cs_compile_desc.defines.push_back("BVH_STACK_SIZE=" + std::to_string(SDF_BVH_STACK_SIZE));
 			ShaderData cs_data = compile_shader(cs_compile_desc);
 
 			ShaderDesc cs_desc;
@@ -85,9 +92,12 @@ namespace fantasy
 
     bool SdfGeneratePass::execute(CommandListInterface* cmdlist, RenderResourceCache* cache)
     {
+		DistanceField* distance_field = get_distance_field();
+		ReturnIfFalse(distance_field != nullptr);
+
 		ReturnIfFalse(cmdlist->open());
 		
-		const auto& mesh_df = _distance_field->mesh_distance_fields[_current_mesh_sdf_index];
+		const auto& mesh_df = distance_field->mesh_distance_fields[_current_mesh_sdf_index];
 
 		if (!_resource_writed)
         {
@@ -107,7 +117,7 @@ namespace fantasy
 				cache->collect(_sdf_output_texture, ResourceType::Texture);
 			}
 
-			if (!_distance_field->check_sdf_cache_exist())
+			if (!distance_field->check_sdf_cache_exist())
 			{
 				// Buffer.
 				{
@@ -171,7 +181,7 @@ namespace fantasy
 			_resource_writed = true;
         }
 
-		if (!_distance_field->check_sdf_cache_exist())
+		if (!distance_field->check_sdf_cache_exist())
 		{
 			_pass_constants.x_begin = _begin_x;
 			_pass_constants.x_end = _begin_x + X_SLICE_SIZE;
@@ -188,7 +198,7 @@ namespace fantasy
 			{
 				cmdlist->copy_texture(_read_back_texture.get(), TextureSlice{}, _sdf_output_texture.get(), TextureSlice{});
 
-				if (_current_mesh_sdf_index + 1 == static_cast<uint32_t>(_distance_field->mesh_distance_fields.size()))
+				if (_current_mesh_sdf_index + 1 == static_cast<uint32_t>(distance_field->mesh_distance_fields.size()))
 				{
 					ReturnIfFalse(cache->get_world()->get_global_entity()->get_component<event::UpdateGlobalSdf>()->broadcast());
 				}
@@ -205,7 +215,7 @@ namespace fantasy
 				mesh_df.sdf_data.size()
 			));
 
-			if (_current_mesh_sdf_index + 1 == static_cast<uint32_t>(_distance_field->mesh_distance_fields.size()))
+			if (_current_mesh_sdf_index + 1 == static_cast<uint32_t>(distance_field->mesh_distance_fields.size()))
 			{
 				ReturnIfFalse(cache->get_world()->get_global_entity()->get_component<event::UpdateGlobalSdf>()->broadcast());
 			}
@@ -217,9 +227,15 @@ namespace fantasy
 
 	bool SdfGeneratePass::finish_pass(RenderResourceCache* cache)
 	{
-		auto& mesh_df = _distance_field->mesh_distance_fields[_current_mesh_sdf_index];
+		Entity* model_entity = _world->get_entity(_model_entity, true);
+		ReturnIfFalse(model_entity != nullptr);
+
+		DistanceField* distance_field = model_entity->get_component<DistanceField>();
+		ReturnIfFalse(distance_field != nullptr);
 
-		if (!_distance_field->check_sdf_cache_exist())
+		auto& mesh_df = distance_field->mesh_distance_fields[_current_mesh_sdf_index];
+
+		if (!distance_field->check_sdf_cache_exist())
 		{
 			if (_begin_x < SDF_RESOLUTION)
 			{
@@ -248,28 +264,24 @@ namespace fantasy
 				mapped_data += row_pitch * SDF_RESOLUTION;
 			}
 
-			if (_current_mesh_sdf_index == 0) (*_binary_output)(SDF_RESOLUTION);
+			if (_current_mesh_sdf_index == 0) (*_binary_output)(static_cast<uint64_t>(distance_field->mesh_distance_fields.size()));
 
-			(*_binary_output)(
-				mesh_df.sdf_box._lower.x,
-				mesh_df.sdf_box._lower.y,
-				mesh_df.sdf_box._lower.z,
-				mesh_df.sdf_box._upper.x,
-				mesh_df.sdf_box._upper.y,
-				mesh_df.sdf_box._upper.z
-			);
-			_binary_output->save_binary_data(sdf_data.data(), sdf_data.size() * sizeof(float));
+			// 每个 mesh 的 SDF 单独一个 chunk, 读取时分别校验.
+			_binary_output->begin_chunk(serialization::make_chunk_tag('M', 'S', 'D', 'F'));
+			(*_binary_output)(mesh_df.sdf_box);
+			_binary_output->save_binary_data(sdf_data.data(), sdf_data.size() * sizeof(float), serialization::chunk_alignment);
 
 			_read_back_texture.reset();
 			_bvh_node_buffer.reset();
 			_bvh_vertex_buffer.reset();
 			mesh_df.bvh.clear();
 
-			if (++_current_mesh_sdf_index == static_cast<uint32_t>(_distance_field->mesh_distance_fields.size()))
+			if (++_current_mesh_sdf_index == static_cast<uint32_t>(distance_field->mesh_distance_fields.size()))
 			{
 				std::string sdf_name = mesh_df.sdf_texture_name.substr(0, mesh_df.sdf_texture_name.find("SdfTexture")) + ".sdf";
-				gui::notify_message(gui::ENotifyType::Info, sdf_name + " bake finished.");
-				_distance_field = nullptr;
+				if (_binary_output->finish()) gui::notify_message(gui::ENotifyType::Info, sdf_name + " bake finished.");
+				else gui::notify_message(gui::ENotifyType::Error, sdf_name + " bake failed to write the cache.");
+				_model_entity = EntityHandle{};
 				_binary_output.reset();
 				_current_mesh_sdf_index = 0;
 			}
@@ -280,17 +292,17 @@ namespace fantasy
 		}
 		else
 		{
-			if (++_current_mesh_sdf_index == static_cast<uint32_t>(_distance_field->mesh_distance_fields.size()))
+			if (++_current_mesh_sdf_index == static_cast<uint32_t>(distance_field->mesh_distance_fields.size()))
 			{
 				std::string sdf_name = mesh_df.sdf_texture_name.substr(0, mesh_df.sdf_texture_name.find("SdfTexture")) + ".sdf";
 				gui::notify_message(gui::ENotifyType::Info, sdf_name + " bake finished.");
 
 				// finished_task_num++;
-				(*_modle_entity->get_component<uint32_t>())++;
-				for (auto& df : _distance_field->mesh_distance_fields) df.sdf_data.clear();
+				(*model_entity->get_component<uint32_t>())++;
+				for (auto& df : distance_field->mesh_distance_fields) df.sdf_data = {};
+				distance_field->sdf_cache_file.reset();
 
-				_modle_entity = nullptr;
-				_distance_field = nullptr;
+				_model_entity = EntityHandle{};
 				_current_mesh_sdf_index = 0;
 			}
 			else
@@ -304,7 +316,11 @@ namespace fantasy
 		return true;
 	}
 
-}
-
-
+	DistanceField* SdfGeneratePass::get_distance_field() const
+	{
+		// 生成 SDF 时模型实体可能还没有加入 World.
+		Entity* entity = _world->get_entity(_model_entity, true);
+		return entity ? entity->get_component<DistanceField>() : nullptr;
+	}
 
+}
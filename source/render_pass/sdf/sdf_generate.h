@@ -38,12 +38,15 @@ namespace fantasy
     private:
         bool BuildBvh();
 
+        // Archetype 的增删会移动组件, 所以不保存组件指针, 每帧通过句柄重新获取.
+        DistanceField* get_distance_field() const;
+
     private:
         uint32_t _begin_x = 0;
         bool _resource_writed = false;
         uint32_t _current_mesh_sdf_index = 0;
-        Entity* _modle_entity = nullptr;
-        DistanceField* _distance_field = nullptr;
+        World* _world = nullptr;
+        EntityHandle _model_entity;
         std::unique_ptr<serialization::BinaryOutput> _binary_output;
 		constant::SdfGeneratePassConstants _pass_constants;
 
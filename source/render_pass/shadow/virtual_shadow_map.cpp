@@ -14,6 +14,9 @@ namespace fantasy
 
 	void VirtualShadowMapPass::recalculate_shadow_view_matrixs()
 	{
+		// 组件在 Archetype 中可能被移动, 不缓存组件指针.
+		_directional_light = _global_entity->get_component<DirectionalLight>();
+
 		uint32_t axis_tile_num = (VT_VIRTUAL_SHADOW_RESOLUTION / VT_SHADOW_PAGE_SIZE);
 		float3 tile_right = normalize(cross(float3(0.0f, 1.0f, 0.0f), _directional_light->direction));
 		float3 tile_up = normalize(cross(_directional_light->direction, tile_right));
@@ -76,7 +79,7 @@ namespace fantasy
 
 		ReturnIfFalse(cache->require_constants("vt_new_shadow_pages", (void**)&_vt_new_shadow_pages));
 		ReturnIfFalse(cache->require_constants("cluster_group_count", (void**)&_cluster_group_count));
-		_directional_light = cache->get_world()->get_global_entity()->get_component<DirectionalLight>();
+		_global_entity = cache->get_world()->get_global_entity();
 
 
 		
@@ -107,6 +110,7 @@ namespace fantasy
         
 		if (SceneSystem::loaded_submesh_count != 0 && _update_shadow_map)
 		{
+			_directional_light = _global_entity->get_component<DirectionalLight>();
 			_shadow_map_cull_constant.group_count = *_cluster_group_count;
 			_shadow_map_cull_constant.far_plane = _directional_light->far_plane;
 			_shadow_map_cull_constant.near_plane = _directional_light->near_plane;
@@ -60,6 +60,7 @@ namespace fantasy
 		bool _resource_writed = false;
 		bool _update_shadow_map = true;
 
+		Entity* _global_entity = nullptr;
 		DirectionalLight* _directional_light = nullptr;
 		uint32_t* _cluster_group_count = nullptr;
 
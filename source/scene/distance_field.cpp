@@ -1,5 +1,7 @@
 #include "distance_field.h"
+#include "../core/math/batch.h"
 #include "../core/tools/file.h"
+#include "../core/parallel/parallel.h"
 #include "../gui/gui_panel.h"
 #include "scene.h"
 
@@ -24,41 +26,17 @@ namespace fantasy
 					};
 					boxes[x + y * chunk_num_per_axis + z * chunk_num_per_axis * chunk_num_per_axis] = Bounds3F(Lower, Lower + chunk_size);
 				}
-		Bounds3F global_box(float3(-SDF_SCENE_GRID_SIZE * 0.5f), float3(SDF_SCENE_GRID_SIZE * 0.5f));
-		bvh.build(boxes, global_box);
+		bvh.build(boxes);
 	}
 
 	DistanceField::TransformData DistanceField::MeshDistanceField::get_transformed(const Transform* transform) const
 	{
-		TransformData ret;
-		ret.sdf_box = sdf_box;
-
 		float4x4 S = scale(transform->scale);
-		ret.sdf_box._lower = float3(mul(float4(ret.sdf_box._lower, 1.0f), S));
-		ret.sdf_box._upper = float3(mul(float4(ret.sdf_box._upper, 1.0f), S));
-
 		float4x4 R = rotate(transform->rotation);
-		std::array<float3, 8> box_vertices;
-		box_vertices[0] = ret.sdf_box._lower;
-		box_vertices[1] = float3(ret.sdf_box._lower.x, ret.sdf_box._upper.y, ret.sdf_box._lower.z);
-		box_vertices[2] = float3(ret.sdf_box._upper.x, ret.sdf_box._upper.y, ret.sdf_box._lower.z);
-		box_vertices[3] = float3(ret.sdf_box._upper.x, ret.sdf_box._lower.y, ret.sdf_box._lower.z);
-		box_vertices[4] = ret.sdf_box._upper;
-		box_vertices[7] = float3(ret.sdf_box._upper.x, ret.sdf_box._lower.y, ret.sdf_box._upper.z);
-		box_vertices[5] = float3(ret.sdf_box._lower.x, ret.sdf_box._lower.y, ret.sdf_box._upper.z);
-		box_vertices[6] = float3(ret.sdf_box._lower.x, ret.sdf_box._upper.y, ret.sdf_box._upper.z);
-
-		Bounds3F blank_box(0.0f, 0.0f);
-		for (const auto& crVertex : box_vertices)
-		{
-			blank_box = merge(blank_box, float3(mul(float4(crVertex, 1.0f), R)));
-		}
-
-		ret.sdf_box = blank_box;
-
 		float4x4 T = translate(transform->position);
-		ret.sdf_box._lower = float3(mul(float4(ret.sdf_box._lower, 1.0f), T));
-		ret.sdf_box._upper = float3(mul(float4(ret.sdf_box._upper, 1.0f), T));
+
+		TransformData ret;
+		ret.sdf_box = transform_bounds(sdf_box, mul(mul(S, R), T));
 
 		float3 sdf_extent = sdf_box._upper - sdf_box._lower;
 		ret.coord_matrix = mul(
@@ -85,32 +63,42 @@ namespace fantasy
 		bool loaded_from_cache = false;
 		if (is_file_exist(_sdf_data_path.c_str()))
 		{
-			serialization::BinaryInput input(_sdf_data_path);
-			uint32_t mesh_sdf_resolution = 0;
-			input(mesh_sdf_resolution);
+			serialization::BinaryInput input(_sdf_data_path, SDF_CACHE_VERSION, serialization::hash_parameters(SDF_RESOLUTION));
+			uint64_t mesh_df_num = 0;
+			input(mesh_df_num);
 			
-			if (mesh_sdf_resolution == SDF_RESOLUTION)
+			if (input.good() && mesh_df_num == distance_field->mesh_distance_fields.size())
 			{
+				bool chunk_found = true;
 				for (uint32_t ix = 0; ix < distance_field->mesh_distance_fields.size(); ++ix)
 				{
 					auto& mesh_df = distance_field->mesh_distance_fields[ix];
 					mesh_df.sdf_texture_name = *event.entity->get_component<std::string>() + "SdfTexture" + std::to_string(ix);
 
-					input(
-						mesh_df.sdf_box._lower.x,
-						mesh_df.sdf_box._lower.y,
-						mesh_df.sdf_box._lower.z,
-						mesh_df.sdf_box._upper.x,
-						mesh_df.sdf_box._upper.y,
-						mesh_df.sdf_box._upper.z
-					);
+					if (!input.next_chunk())
+					{
+						chunk_found = false;
+						break;
+					}
+					input(mesh_df.sdf_box);
 
+					// 直接使用文件映射中的数据, 上传之前不复制.
 					uint64_t data_size = static_cast<uint64_t>(SDF_RESOLUTION) * SDF_RESOLUTION * SDF_RESOLUTION * sizeof(float);
-					mesh_df.sdf_data.resize(data_size);
-					input.load_binary_data(mesh_df.sdf_data.data(), data_size);
+					const uint8_t* data = input.read_bytes(data_size, serialization::chunk_alignment);
+					if (data) mesh_df.sdf_data = std::span<const uint8_t>(data, data_size);
+				}
+
+				loaded_from_cache = chunk_found && input.good();
+				if (loaded_from_cache)
+				{
+					distance_field->sdf_cache_file = input.get_file();
+					gui::notify_message(gui::ENotifyType::Info, "Loaded " + _sdf_data_path.substr(_sdf_data_path.find("asset")));
+				}
+				else
+				{
+					// check_sdf_cache_exist 依据 sdf_data 判断, 读取失败时需要清空.
+					for (auto& mesh_df : distance_field->mesh_distance_fields) mesh_df.sdf_data = {};
 				}
-				gui::notify_message(gui::ENotifyType::Info, "Loaded " + _sdf_data_path.substr(_sdf_data_path.find("asset")));
-				loaded_from_cache = true;
 			}
 		}
 
@@ -123,18 +111,25 @@ namespace fantasy
 				const auto& submesh = mesh->submeshes[ix];
 				mesh_df.sdf_texture_name = model_name + "SdfTexture" + std::to_string(ix);
 
+				// 每个顶点只变换一次, 再按索引展开.
+				Float3SoA positions(submesh.vertices.size());
+				Float3SoA normals(submesh.vertices.size());
+				gather<Vertex>(submesh.vertices, &Vertex::position, positions.span());
+				gather<Vertex>(submesh.vertices, &Vertex::normal, normals.span());
+				transform_points(positions.view(), submesh.world_matrix, positions.span());
+				transform_normals(normals.view(), transpose(inverse(submesh.world_matrix)), normals.span());
+
 				uint64_t jx = 0;
 				std::vector<Bvh::Vertex> BvhVertices(submesh.indices.size());
 				for (auto VertexIndex : submesh.indices)
 				{
-					BvhVertices[jx++] = {
-						float3(mul(float4(submesh.vertices[VertexIndex].position, 1.0f), submesh.world_matrix)),
-						float3(mul(float4(submesh.vertices[VertexIndex].normal, 1.0f), transpose(inverse(submesh.world_matrix))))
-					};
+					BvhVertices[jx++] = { positions[VertexIndex], normals[VertexIndex] };
 				}
 
-				mesh_df.bvh.build(BvhVertices, static_cast<uint32_t>(submesh.indices.size() / 3));
+				mesh_df.bvh.build(BvhVertices, static_cast<uint32_t>(submesh.indices.size() / 3), SDF_BVH_STACK_SIZE - 1);
 				mesh_df.sdf_box = mesh_df.bvh.global_box;
+
+				parallel::yield();
 			}
 		}
 
@@ -165,7 +160,7 @@ namespace fantasy
 					{
 						uint32_t index = x + y * chunk_num_per_axis + z * chunk_num_per_axis * chunk_num_per_axis;
 						grid->chunks[index].model_moved = true;
-						grid->chunks[index].model_entities.insert(event.entity);
+						grid->chunks[index].model_entities.insert(event.entity->get_handle());
 					}
 				}
 			}
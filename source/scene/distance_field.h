@@ -6,7 +6,9 @@
 #include "../core/math/matrix.h"
 #include "../core/math/bvh.h"
 #include "../core/tools/ecs.h"
+#include "../core/tools/file.h"
 #include "transform.h"
+#include <span>
 #include <string>
 #include <unordered_set>
 
@@ -32,13 +34,14 @@ namespace fantasy
 			std::string sdf_texture_name;
 			Bounds3F sdf_box;
 
-			std::vector<uint8_t> sdf_data;
+			std::span<const uint8_t> sdf_data;	// 指向 sdf_cache_file 中的数据.
 			Bvh bvh;
 
 			TransformData get_transformed(const Transform* transform) const;
 		};
 
 		std::vector<MeshDistanceField> mesh_distance_fields;
+		std::shared_ptr<serialization::MappedFile> sdf_cache_file;	// 重新生成缓存之前需要释放.
 
 		bool check_sdf_cache_exist() const { return !mesh_distance_fields.empty() && !mesh_distance_fields[0].sdf_data.empty(); }
 	};
@@ -47,12 +50,14 @@ namespace fantasy
 	inline const uint32_t GLOBAL_SDF_RESOLUTION = 256u;
 	inline const uint32_t VOXEL_NUM_PER_CHUNK = 32u;
 	inline const uint32_t SDF_RESOLUTION = 64u;
+	inline const uint32_t SDF_BVH_STACK_SIZE = 32u;	// sdf_generate_cs.hlsl 中遍历 Bvh 的栈的大小, 两个子节点都入栈, 树的深度不能超过 SDF_BVH_STACK_SIZE - 1.
+	inline const uint32_t SDF_CACHE_VERSION = 1u;
 
 	struct SDFGrid
 	{
 		struct Chunk
 		{
-			std::unordered_set<Entity*> model_entities;
+			std::unordered_set<EntityHandle> model_entities;		// 实体被销毁后句柄会过期, 使用时需要检查.
 			bool model_moved = false;
 		};
 		
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "scene.h"
+#include "../core/math/batch.h"
 #include "assimp/mesh.h"
 #include "assimp/types.h"
 #include <assimp/scene.h>
@@ -71,41 +72,45 @@ namespace fantasy
 					}
 				}
 
-				std::vector<float3> positons(assimp_meshes[ix]->mNumVertices);
+				Float3SoA positions(assimp_meshes[ix]->mNumVertices);
 				submesh.vertices.resize(assimp_meshes[ix]->mNumVertices);
 
-				for(uint32_t jx = 0; jx < assimp_meshes[ix]->mNumVertices; jx++)
-				{
-					Vertex& vertex = submesh.vertices[jx];
-					
-					vertex.position.x = assimp_meshes[ix]->mVertices[jx].x;
-					vertex.position.y = assimp_meshes[ix]->mVertices[jx].y;
-					vertex.position.z = assimp_meshes[ix]->mVertices[jx].z;
-
-					positons[jx] = vertex.position;
-
-					if (assimp_meshes[ix]->HasNormals())
-					{
-						vertex.normal.x = assimp_meshes[ix]->mNormals[jx].x;
-						vertex.normal.y = assimp_meshes[ix]->mNormals[jx].y;
-						vertex.normal.z = assimp_meshes[ix]->mNormals[jx].z;
-					}
-
-					if (assimp_meshes[ix]->HasTangentsAndBitangents())
-					{
-						vertex.tangent.x = assimp_meshes[ix]->mTangents[jx].x;
-						vertex.tangent.y = assimp_meshes[ix]->mTangents[jx].y;
-						vertex.tangent.z = assimp_meshes[ix]->mTangents[jx].z;
-					}
-
-					if(assimp_meshes[ix]->HasTextureCoords(0))
+				// 嵌套的 parallel_for, 单个很大的 submesh 也能分到多个线程.
+				parallel::parallel_for(
+					[&](uint64_t jx)
 					{
-						vertex.uv.x = assimp_meshes[ix]->mTextureCoords[0][jx].x; 
-						vertex.uv.y = assimp_meshes[ix]->mTextureCoords[0][jx].y;
-					}
-				}
-
-				submesh.bounding_sphere = Sphere(positons);
+						Vertex& vertex = submesh.vertices[jx];
+					
+						vertex.position.x = assimp_meshes[ix]->mVertices[jx].x;
+						vertex.position.y = assimp_meshes[ix]->mVertices[jx].y;
+						vertex.position.z = assimp_meshes[ix]->mVertices[jx].z;
+
+						positions.set(jx, vertex.position);
+
+						if (assimp_meshes[ix]->HasNormals())
+						{
+							vertex.normal.x = assimp_meshes[ix]->mNormals[jx].x;
+							vertex.normal.y = assimp_meshes[ix]->mNormals[jx].y;
+							vertex.normal.z = assimp_meshes[ix]->mNormals[jx].z;
+						}
+
+						if (assimp_meshes[ix]->HasTangentsAndBitangents())
+						{
+							vertex.tangent.x = assimp_meshes[ix]->mTangents[jx].x;
+							vertex.tangent.y = assimp_meshes[ix]->mTangents[jx].y;
+							vertex.tangent.z = assimp_meshes[ix]->mTangents[jx].z;
+						}
+
+						if(assimp_meshes[ix]->HasTextureCoords(0))
+						{
+							vertex.uv.x = assimp_meshes[ix]->mTextureCoords[0][jx].x; 
+							vertex.uv.y = assimp_meshes[ix]->mTextureCoords[0][jx].y;
+						}
+					},
+					assimp_meshes[ix]->mNumVertices
+				);
+
+				submesh.bounding_sphere = compute_bounding_sphere(positions.view());
 			},
 			submeshes.size()
 		);
@@ -131,34 +136,40 @@ namespace fantasy
 
 		material->submaterials.resize(assimp_scene->mNumMaterials);
 		
-		parallel::parallel_for(
-			[&material, &file_path, this](uint64_t ix)
+		static const aiTextureType assimp_texture_types[Material::TextureType_Num] = {
+			aiTextureType_BASE_COLOR,
+			aiTextureType_NORMALS,
+			aiTextureType_METALNESS,
+			aiTextureType_EMISSIVE
+		};
+
+		// 每张纹理是一个任务, 同一个材质的多张纹理也能并行解码.
+		parallel::parallel_for_2d(
+			[&material, &file_path, this](uint64_t texture_type, uint64_t ix)
 			{
 				auto& submaterial = material->submaterials[ix];
 				aiMaterial* assimp_material = assimp_scene->mMaterials[ix];
 
-				aiColor4D ai_color;
-				if (assimp_material->Get(AI_MATKEY_BASE_COLOR, ai_color) == AI_SUCCESS) 
-					memcpy(submaterial.base_color_factor, &ai_color, sizeof(float) * 4);
-				if (assimp_material->Get(AI_MATKEY_COLOR_EMISSIVE, ai_color) == AI_SUCCESS) 
-					memcpy(submaterial.emissive_factor, &ai_color, sizeof(float) * 4);
-				
-				float ai_float;
-				if (assimp_material->Get(AI_MATKEY_METALLIC_FACTOR, ai_float) == AI_SUCCESS) 
-					submaterial.metallic_factor = ai_float;
-				if (assimp_material->Get(AI_MATKEY_ROUGHNESS_FACTOR, ai_float) == AI_SUCCESS) 
-					submaterial.roughness_factor = ai_float;
+				if (texture_type == Material::TextureType_BaseColor)
+				{
+					aiColor4D ai_color;
+					if (assimp_material->Get(AI_MATKEY_BASE_COLOR, ai_color) == AI_SUCCESS) 
+						memcpy(submaterial.base_color_factor, &ai_color, sizeof(float) * 4);
+					if (assimp_material->Get(AI_MATKEY_COLOR_EMISSIVE, ai_color) == AI_SUCCESS) 
+						memcpy(submaterial.emissive_factor, &ai_color, sizeof(float) * 4);
+					
+					float ai_float;
+					if (assimp_material->Get(AI_MATKEY_METALLIC_FACTOR, ai_float) == AI_SUCCESS) 
+						submaterial.metallic_factor = ai_float;
+					if (assimp_material->Get(AI_MATKEY_ROUGHNESS_FACTOR, ai_float) == AI_SUCCESS) 
+						submaterial.roughness_factor = ai_float;
+				}
 
 				aiString material_name;
-				if (assimp_material->GetTexture(aiTextureType_BASE_COLOR, 0, &material_name) == aiReturn_SUCCESS)
-					submaterial.images[Material::TextureType_BaseColor] = Image::load_image_from_file((file_path + material_name.C_Str()).c_str());
-				if (assimp_material->GetTexture(aiTextureType_NORMALS, 0, &material_name) == aiReturn_SUCCESS)
-					submaterial.images[Material::TextureType_Normal] = Image::load_image_from_file((file_path + material_name.C_Str()).c_str());
-				if (assimp_material->GetTexture(aiTextureType_METALNESS, 0, &material_name) == aiReturn_SUCCESS)
-					submaterial.images[Material::TextureType_PBR] = Image::load_image_from_file((file_path + material_name.C_Str()).c_str());
-				if (assimp_material->GetTexture(aiTextureType_EMISSIVE, 0, &material_name) == aiReturn_SUCCESS)
-					submaterial.images[Material::TextureType_Emissive] = Image::load_image_from_file((file_path + material_name.C_Str()).c_str());
+				if (assimp_material->GetTexture(assimp_texture_types[texture_type], 0, &material_name) == aiReturn_SUCCESS)
+					submaterial.images[texture_type] = Image::load_image_from_file((file_path + material_name.C_Str()).c_str());
 			},
+			Material::TextureType_Num,
 			material->submaterials.size()
 		);
 
@@ -31,12 +31,6 @@ namespace fantasy
         ret.format = Format::RGBA8_UNORM;
         ret.data = std::make_shared<uint8_t[]>(ret.size);
 
-        std::vector<uint8_t> tmp(ret.size);
-        for (uint32_t ix = 0; ix < ret.size; ++ix)
-        {
-            tmp[ix] = data[ix];
-        }
-
         memcpy(ret.data.get(), data, ret.size);
 
         stbi_image_free(data);
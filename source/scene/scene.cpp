@@ -32,7 +32,6 @@ namespace fantasy
 		// _global_entity->assign<event::GenerateSdf>();
 		// _global_entity->assign<event::AddSpotLight>();
 		// _global_entity->assign<event::AddPointLight>();
-		_global_entity->assign<event::GenerateMipmap>();
 		_global_entity->assign<event::UpdateShadowMap>();
 		// _global_entity->assign<event::UpdateGlobalSdf>();
 		// _global_entity->assign<event::GenerateSurfaceCache>();
@@ -53,29 +52,22 @@ namespace fantasy
 
 		_world->get_global_entity()->get_component<Camera>()->handle_input(delta);
 
-		static uint64_t thread_id = INVALID_SIZE_64;
-		static Entity* model_entity = nullptr;
-
 		if (gui::has_file_selected())
 		{
 			std::string file_path = gui::get_selected_file_path();
 			std::string model_name = file_path.substr(file_path.find("asset"));
 			replace_back_slashes(model_name);
 
-			if (model_entity == nullptr)
+			if (_loading_model_entity == nullptr)
 			{
 				if (!_loaded_model_names.contains(model_name))
 				{
-					model_entity = _world->create_entity_delay();
-					thread_id = parallel::begin_thread(
-						[this, model_name]() -> bool
-						{
-							return _world->broadcast(event::OnModelLoad{
-								.entity = model_entity,
-								.model_path = model_name
-							});
-						}
-					);
+					// 在下一次 World::flush_events 时开始加载.
+					_loading_model_entity = _world->create_entity_delay();
+					_world->publish(event::OnModelLoad{
+						.entity = _loading_model_entity,
+						.model_path = model_name
+					});
 				}
 				else
 				{
@@ -88,16 +80,16 @@ namespace fantasy
 			}
 		}
 
-		if (model_entity && parallel::thread_finished(thread_id) && parallel::thread_success(thread_id))
+		if (_loading_model_entity && parallel::thread_finished(_loading_thread_id) && parallel::thread_success(_loading_thread_id))
 		{
-			_world->add_delay_entity(model_entity);
+			_world->add_delay_entity(_loading_model_entity);
 			ReturnIfFalse(_global_entity->get_component<event::AddModel>()->broadcast());
 
 			ReturnIfFalse(_current_submesh_count <= Mesh::max_submesh_num);
 
 			loaded_submesh_count = _current_submesh_count;
-			thread_id = INVALID_SIZE_64;
-			model_entity = nullptr;
+			_loading_thread_id = INVALID_SIZE_64;
+			_loading_model_entity = nullptr;
 		}
 		return true;
 	}
@@ -156,7 +148,7 @@ namespace fantasy
 			
 			uint32_t* available_task_num = entity->assign<uint32_t>(1);
 			// ReturnIfFalse(_global_entity->get_component<event::GenerateSdf>()->broadcast(entity));
-			ReturnIfFalse(_global_entity->get_component<event::GenerateMipmap>()->broadcast(entity));
+			_world->publish(event::GenerateMipmap{ .entity = entity });
 		}
 
 		loaded_submesh_count = _current_submesh_count;
@@ -167,13 +159,25 @@ namespace fantasy
 	}
 	
 	bool SceneSystem::publish(World* world, const event::OnModelLoad& event)
+	{
+		// 在调用 World::tick 的线程上收到加载请求, 模型在后台线程中加载.
+		_loading_thread_id = parallel::begin_thread(
+			[this, event]() -> bool
+			{
+				return load_model(event.entity, event.model_path);
+			}
+		);
+		return true;
+	}
+
+	bool SceneSystem::load_model(Entity* entity, const std::string& model_path)
 	{
 		std::string proj_dir = PROJ_DIR;
 
 		Assimp::Importer assimp_importer;
 
         assimp_scene = assimp_importer.ReadFile(
-			proj_dir + event.model_path, 
+			proj_dir + model_path, 
 			aiProcess_Triangulate | 
 			aiProcess_GenSmoothNormals | 
 			aiProcess_CalcTangentSpace | 
@@ -187,37 +191,41 @@ namespace fantasy
 			return false;
         }
 
-		_model_directory = event.model_path.substr(0, event.model_path.find_last_of('/'));
+		_model_directory = model_path.substr(0, model_path.find_last_of('/'));
 		std::string model_name = _model_directory.substr(_model_directory.find_last_of('/') + 1);
 		_model_directory += "/";
 		
 		_sdf_data_path = proj_dir + "asset/cache/distance_field/" + model_name + ".sdf";
 		_surface_cache_path = proj_dir + "asset/cache/surface_cache/" + model_name + ".sc";
 		
-		event.entity->assign<std::string>(model_name);
-		event.entity->assign<Mesh>();
-		event.entity->assign<Material>();
-		event.entity->assign<Transform>();
-		event.entity->assign<VirtualMesh>();
-		// event.entity->assign<SurfaceCache>();
-		// event.entity->assign<DistanceField>();
+		entity->assign<std::string>(model_name);
+		entity->assign<Mesh>();
+		entity->assign<Material>();
+		entity->assign<Transform>();
+		entity->assign<VirtualMesh>();
+		// entity->assign<SurfaceCache>();
+		// entity->assign<DistanceField>();
 		
-		_loaded_model_names.insert(event.model_path);
+		_loaded_model_names.insert(model_path);
 		
 		DirectionalLight* light = _world->get_global_entity()->get_component<DirectionalLight>();
 		light->direction_offset = (_scene_sphere.radius);
 		light->update_direction_view_proj();
 
 		
-		uint32_t* available_task_num = event.entity->assign<uint32_t>(1);
-		// ReturnIfFalse(_global_entity->get_component<event::GenerateSdf>()->broadcast(event.entity));
-		ReturnIfFalse(_global_entity->get_component<event::GenerateMipmap>()->broadcast(event.entity));
-		// ReturnIfFalse(_global_entity->get_component<event::GenerateSurfaceCache>()->broadcast(event.entity));
+		uint32_t* available_task_num = entity->assign<uint32_t>(1);
+		// ReturnIfFalse(_global_entity->get_component<event::GenerateSdf>()->broadcast(entity));
+		_world->publish(event::GenerateMipmap{ .entity = entity });
+		// ReturnIfFalse(_global_entity->get_component<event::GenerateSurfaceCache>()->broadcast(entity));
 
-		while (*available_task_num > 0) std::this_thread::yield();
-		gui::notify_message(gui::ENotifyType::Info, "Loaded " + event.model_path);
+		while (*available_task_num > 0) 
+		{
+			parallel::yield();
+			std::this_thread::yield();
+		}
+		gui::notify_message(gui::ENotifyType::Info, "Loaded " + model_path);
 
-		// Entity* tmp_model_entity = event.entity;
+		// Entity* tmp_model_entity = entity;
 		// gui::add(
 		// 	[tmp_model_entity, this]()
 		// 	{
@@ -275,9 +283,9 @@ namespace fantasy
 						uint32_t index = x + y * chunk_num_per_axis + z * chunk_num_per_axis * chunk_num_per_axis;
 						grid->chunks[index].model_moved = true;
 						if (insert_or_erase) 
-							grid->chunks[index].model_entities.insert(event.entity);
+							grid->chunks[index].model_entities.insert(event.entity->get_handle());
 						else				
-							grid->chunks[index].model_entities.erase(event.entity);
+							grid->chunks[index].model_entities.erase(event.entity->get_handle());
 					}
 				}
 			}
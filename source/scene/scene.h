@@ -39,6 +39,9 @@ namespace fantasy
 	private:
 		bool load_init_scene();
 
+		// 在 begin_thread 的线程中执行, 纹理的 mipmap 生成完成后返回.
+		bool load_model(Entity* entity, const std::string& model_path);
+
 		bool _init_scene_loaded = false;
 		std::vector<std::string> _init_models;
 
@@ -53,6 +56,9 @@ namespace fantasy
 		std::string _surface_cache_path;
 		uint32_t _current_submesh_count = 0;
 
+		Entity* _loading_model_entity = nullptr;
+		uint64_t _loading_thread_id = INVALID_SIZE_64;
+
 		Sphere _scene_sphere;
 		std::unordered_set<std::string> _loaded_model_names;
 
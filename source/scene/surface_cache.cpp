@@ -15,15 +15,15 @@ namespace fantasy
 		bool load_from_file = false;
 		if (is_file_exist(_surface_cache_path.c_str()))
 		{
-			serialization::BinaryInput input(_surface_cache_path);
-			uint32_t card_resolution = 0;
-			uint32_t surface_resolution = 0;
-			input(card_resolution);
-			input(surface_resolution);
+			FormatInfo FormaInfo = get_format_info(surface_cache->format);
+			serialization::BinaryInput input(
+				_surface_cache_path, 
+				SURFACE_CACHE_VERSION, 
+				serialization::hash_parameters(CARD_RESOLUTION, SURFACE_RESOLUTION, FormaInfo.size)
+			);
 
-			if (card_resolution == CARD_RESOLUTION && surface_resolution == SURFACE_RESOLUTION)
+			if (input.is_valid())
 			{
-				FormatInfo FormaInfo = get_format_info(surface_cache->format);
 				uint64_t data_size = static_cast<uint64_t>(SURFACE_RESOLUTION) * SURFACE_RESOLUTION * FormaInfo.size;
 
 				for (uint32_t ix = 0; ix < surface_cache->mesh_surface_caches.size(); ++ix)
@@ -33,12 +33,25 @@ namespace fantasy
 					{
 						mesh_surface_cache.surfaces[ix].surface_texture_name = 
 							*event.entity->get_component<std::string>() + "surface_texture" + std::to_string(ix);
-						mesh_surface_cache.surfaces[ix].data.resize(data_size);
-						input.load_binary_data(mesh_surface_cache.surfaces[ix].data.data(), data_size);
+
+						const uint8_t* data = input.read_bytes(data_size, serialization::chunk_alignment);
+						if (data) mesh_surface_cache.surfaces[ix].data = std::span<const uint8_t>(data, data_size);
+					}
+				}
+
+				load_from_file = input.good();
+				if (load_from_file)
+				{
+					surface_cache->cache_file = input.get_file();
+					gui::notify_message(gui::ENotifyType::Info, "Loaded " + _surface_cache_path.substr(_surface_cache_path.find("asset")));
+				}
+				else
+				{
+					for (auto& mesh_surface_cache : surface_cache->mesh_surface_caches)
+					{
+						for (auto& surface : mesh_surface_cache.surfaces) surface.data = {};
 					}
 				}
-				gui::notify_message(gui::ENotifyType::Info, "Loaded " + _sdf_data_path.substr(_sdf_data_path.find("asset")));
-				load_from_file = true;
 			}
 		}
 
@@ -4,6 +4,8 @@
 #include "../dynamic_rhi/format.h"
 #include "../core/tools/delegate.h"
 #include "../core/tools/ecs.h"
+#include "../core/tools/file.h"
+#include <span>
 #include <string>
 #include <vector>
 #include <array>
@@ -19,12 +21,13 @@ namespace fantasy
 	inline const uint32_t CARD_RESOLUTION = 32u;
 	inline const uint32_t SURFACE_RESOLUTION = 128u;
 	inline const uint32_t SURFACE_ATLAS_RESOLUTION = 4096u;
+	inline const uint32_t SURFACE_CACHE_VERSION = 1u;
 
 	struct SurfaceCache
 	{
 		struct Surface
 		{
-			std::vector<uint8_t> data;
+			std::span<const uint8_t> data;	// 指向 cache_file 中的数据.
 			std::string surface_texture_name;
 		};
 
@@ -46,6 +49,7 @@ namespace fantasy
 
 		Format format = Format::RGBA8_UNORM;
 		std::vector<MeshSurfaceCache> mesh_surface_caches;
+		std::shared_ptr<serialization::MappedFile> cache_file;	// 重新生成缓存之前需要释放.
 
 		bool check_surface_cache_exist() const { return !mesh_surface_caches.empty() && !mesh_surface_caches[0].surfaces[0].data.empty(); }
 	};
@@ -2,10 +2,14 @@
 #include "geometry.h"
 #include "scene.h"
 #include "../core/tools/file.h"
+#include "../core/tools/flat_hash_map.h"
+#include "../core/parallel/algorithm.h"
 #include <cstdint>
 
 namespace fantasy
 {
+	static const uint32_t virtual_mesh_cache_version = 1;
+
 #if NANITE
 	void MeshOptimizer::BinaryHeap::resize(uint32_t index_count)
 	{
@@ -656,6 +660,8 @@ namespace fantasy
 
 			_indices.clear();
 			_vertices.clear();
+
+			parallel::yield();
 		}
 		_indices.shrink_to_fit();
 		_vertices.shrink_to_fit();
@@ -734,7 +740,8 @@ namespace fantasy
 
 			// key: 在 _indices 中该 vertex 的 index 值; 
 			// hash value: 在 cluster.vertices 中该 vertex 所在的位置序号.
-			std::unordered_map<uint32_t, uint32_t> cluster_vertex_index_map;
+			FlatHashMap<uint32_t, uint32_t> cluster_vertex_index_map;
+			cluster_vertex_index_map.reserve((end - start) * 3);
 			for (uint32_t ix = start; ix < end; ++ix)
 			{
 				uint32_t triangle_index = partitionar.node_indices[ix];
@@ -958,7 +965,8 @@ namespace fantasy
 			auto& cluster = submesh.clusters.emplace_back();
 
 			// Map the vertices in _vertices to the _clusters.
-			std::unordered_map<uint32_t, uint32_t> cluster_vertex_index_map;
+			FlatHashMap<uint32_t, uint32_t> cluster_vertex_index_map;
+			cluster_vertex_index_map.reserve((end - start) * 3);
 			for (uint32_t ix = start; ix < end; ++ix)
 			{
 				uint32_t triangle_index = partitionar.node_indices[ix];
@@ -1053,6 +1061,8 @@ namespace fantasy
 			
 			_indices.clear();
 			_vertices.clear();
+
+			parallel::yield();
 		}
 		_indices.shrink_to_fit();
 		_vertices.shrink_to_fit();
@@ -1086,7 +1096,7 @@ namespace fantasy
 		{
 			float3 center = quads[0].get_center();
 			
-			std::sort(
+			parallel::sort(
 				quads.begin(), 
 				quads.end(),
 				[&center](const Quad& q0, const Quad& q1)
@@ -1232,172 +1242,105 @@ namespace fantasy
 		cache_path += ".vm";
 #endif
 
+		// 顶点布局和簇的划分参数改变后旧缓存失效.
+		const uint64_t parameter_hash = serialization::hash_parameters(
+			MeshCluster::cluster_tirangle_num, 
+			MeshClusterGroup::group_size, 
+			static_cast<uint64_t>(sizeof(Vertex))
+		);
+
 		bool loaded_from_cache = false;
 
 		if (is_file_exist(cache_path.c_str()))
 		{
-			serialization::BinaryInput input(cache_path);
-			
-			uint32_t cluster_tirangle_num = 0, group_size = 0;
-			input(cluster_tirangle_num, group_size);
+			serialization::BinaryInput input(cache_path, virtual_mesh_cache_version, parameter_hash);
 			
-			if (cluster_tirangle_num == MeshCluster::cluster_tirangle_num && group_size == MeshClusterGroup::group_size)
+			if (input.is_valid())
 			{
 				uint64_t submesh_size = 0;
 				input(submesh_size);
-				virtual_mesh->_submeshes.resize(submesh_size);
+				virtual_mesh->_submeshes.resize(input.good() ? submesh_size : 0);
 
 				for (auto& virtual_submesh : virtual_mesh->_submeshes)
 				{
-					uint64_t cluster_tirangle_num = 0, cluster_group_size = 0;
-					input(virtual_submesh.mip_levels, cluster_tirangle_num, cluster_group_size);
+					uint64_t cluster_size = 0, cluster_group_size = 0;
+					input(virtual_submesh.mip_levels, cluster_size, cluster_group_size);
+					if (!input.good()) break;
 
-					virtual_submesh.clusters.resize(cluster_tirangle_num);
+					virtual_submesh.clusters.resize(cluster_size);
 					virtual_submesh.cluster_groups.resize(cluster_group_size);
 
 					for (auto& cluster : virtual_submesh.clusters)
 					{
-						uint64_t vertex_count = 0;
-						input(vertex_count);
-						cluster.vertices.resize(vertex_count);
-						for (auto& vertex : cluster.vertices)
-						{
-							input(
-								vertex.position.x,
-								vertex.position.y,
-								vertex.position.z,
-								vertex.normal.x,
-								vertex.normal.y,
-								vertex.normal.z,
-								vertex.tangent.x,
-								vertex.tangent.y,
-								vertex.tangent.z,
-								vertex.uv.x,
-								vertex.uv.y
-							);
-						}
-
 						input(
+							cluster.vertices,
 							cluster.indices,
 							cluster.external_edges,
 							cluster.group_id,
 							cluster.mip_level,
 							cluster.lod_error,
-							cluster.bounding_sphere.center.x,
-							cluster.bounding_sphere.center.y,
-							cluster.bounding_sphere.center.z,
-							cluster.bounding_sphere.radius,
-							cluster.lod_bounding_sphere.center.x,
-							cluster.lod_bounding_sphere.center.y,
-							cluster.lod_bounding_sphere.center.z,
-							cluster.lod_bounding_sphere.radius
+							cluster.bounding_sphere,
+							cluster.lod_bounding_sphere
 						);
 					}
 					for (auto& cluster_group : virtual_submesh.cluster_groups)
 					{
-						input(cluster_group.mip_level, cluster_group.cluster_count, cluster_group.cluster_indices);
-
-						uint64_t external_edge_count = 0;
-						input(external_edge_count);
-						cluster_group.external_edges.resize(external_edge_count);
-						for (auto& external_edge : cluster_group.external_edges)
-						{
-							input(external_edge.first, external_edge.second);
-						}
-
 						input(
-							cluster_group.bounding_sphere.center.x,
-							cluster_group.bounding_sphere.center.y,
-							cluster_group.bounding_sphere.center.z,
-							cluster_group.bounding_sphere.radius,
+							cluster_group.mip_level, 
+							cluster_group.cluster_count, 
+							cluster_group.cluster_indices,
+							cluster_group.external_edges,
+							cluster_group.bounding_sphere,
 							cluster_group.parent_lod_error
 						);
 					}
 				}
-				loaded_from_cache = true;
+				loaded_from_cache = input.good();
 			}
 		}
 
 		if (!loaded_from_cache)
 		{
+			virtual_mesh->_submeshes.clear();
 			ReturnIfFalse(virtual_mesh->build(mesh));
 			
-			serialization::BinaryOutput output(cache_path);
-
-			output(
-				MeshCluster::cluster_tirangle_num, 
-				MeshClusterGroup::group_size,
-				virtual_mesh->_submeshes.size()
-			);
+			serialization::BinaryOutput output(cache_path, virtual_mesh_cache_version, parameter_hash);
+			output(static_cast<uint64_t>(virtual_mesh->_submeshes.size()));
 
 			for (const auto& virtual_submesh : virtual_mesh->_submeshes)
 			{
 				output(
 					virtual_submesh.mip_levels, 
-					virtual_submesh.clusters.size(), 
-					virtual_submesh.cluster_groups.size()
+					static_cast<uint64_t>(virtual_submesh.clusters.size()), 
+					static_cast<uint64_t>(virtual_submesh.cluster_groups.size())
 				);
 
 				for (const auto& cluster : virtual_submesh.clusters)
 				{
-					output(cluster.vertices.size());
-
-					for (const auto& vertex : cluster.vertices)
-					{
-						output(
-							vertex.position.x,
-							vertex.position.y,
-							vertex.position.z,
-							vertex.normal.x,
-							vertex.normal.y,
-							vertex.normal.z,
-							vertex.tangent.x,
-							vertex.tangent.y,
-							vertex.tangent.z,
-							vertex.uv.x,
-							vertex.uv.y
-						);
-					}
-
 					output(
+						cluster.vertices,
 						cluster.indices,
 						cluster.external_edges,
 						cluster.group_id,
 						cluster.mip_level,
 						cluster.lod_error,
-						cluster.bounding_sphere.center.x,
-						cluster.bounding_sphere.center.y,
-						cluster.bounding_sphere.center.z,
-						cluster.bounding_sphere.radius,
-						cluster.lod_bounding_sphere.center.x,
-						cluster.lod_bounding_sphere.center.y,
-						cluster.lod_bounding_sphere.center.z,
-						cluster.lod_bounding_sphere.radius
+						cluster.bounding_sphere,
+						cluster.lod_bounding_sphere
 					);
 				}
-				for (auto& cluster_group : virtual_submesh.cluster_groups)
+				for (const auto& cluster_group : virtual_submesh.cluster_groups)
 				{
 					output(
 						cluster_group.mip_level, 
 						cluster_group.cluster_count, 
 						cluster_group.cluster_indices,
-						cluster_group.external_edges.size()
-					);
-
-					for (const auto& external_edge : cluster_group.external_edges)
-					{
-						output(external_edge.first, external_edge.second);
-					}
-
-					output(
-						cluster_group.bounding_sphere.center.x,
-						cluster_group.bounding_sphere.center.y,
-						cluster_group.bounding_sphere.center.z,
-						cluster_group.bounding_sphere.radius,
+						cluster_group.external_edges,
+						cluster_group.bounding_sphere,
 						cluster_group.parent_lod_error
 					);
 				}
 			}
+			ReturnIfFalse(output.finish());
 		}
 
 		ReturnIfFalse(virtual_mesh->_submeshes.size() == mesh->submeshes.size());
@@ -46,6 +46,7 @@ namespace fantasy
         _pages(_resolution_in_page * _resolution_in_page)
     {
         assert(is_power_of_2(_resolution_in_page));
+        _pages.set_protected_frame_num(1);
         reset();
     }
 
@@ -56,7 +57,9 @@ namespace fantasy
 
     uint2 VTPhysicalTable::get_new_position()
     {
-        return _pages.evict().physical_position_in_page;
+        VTPage page;
+        if (!_pages.evict(page)) assert(!"All pages in VT physical table are pinned.");
+        return page.physical_position_in_page;
     }
 
     void VTPhysicalTable::add_page(const VTPage& page)
@@ -119,6 +122,7 @@ namespace fantasy
         _pages(_resolution_in_page * _resolution_in_page)
     {
         assert(is_power_of_2(_resolution_in_page));
+        _pages.set_protected_frame_num(1);
         reset();
     }
 
@@ -129,7 +133,9 @@ namespace fantasy
 
     uint2 VTPhysicalShadowTable::get_new_position()
     {
-        return _pages.evict().physical_position_in_page;
+        VTShadowPage page;
+        if (!_pages.evict(page)) assert(!"All pages in VT physical shadow table are pinned.");
+        return page.physical_position_in_page;
     }
 
     void VTPhysicalShadowTable::add_pages(std::span<VTShadowPage> pages)
@@ -26,7 +26,11 @@ namespace fantasy
 
     namespace event
 	{
-		DELCARE_DELEGATE_EVENT(GenerateMipmap, Entity*);
+		// 通过 World::publish 发送, 在调用 World::tick 的线程上交给 MipmapGenerationPass.
+		struct GenerateMipmap
+		{
+			Entity* entity = nullptr;
+		};
 	};
 
     struct VTPage
@@ -96,6 +100,9 @@ namespace fantasy
         bool check_page_loaded(VTPage& page);
         uint2 get_new_position();
 
+        // 每帧处理反馈前调用, 当前帧使用的 page 不会被之后的新 page 替换.
+        void begin_frame() { _pages.begin_frame(); }
+
         void add_pages(std::span<VTPage> pages);
         void add_page(const VTPage& page);
         void reset();
@@ -138,6 +145,8 @@ namespace fantasy
         bool check_page_loaded(VTShadowPage& page);
         uint2 get_new_position();
 
+        void begin_frame() { _pages.begin_frame(); }
+
         void add_pages(std::span<VTShadowPage> pages);
         void add_page(const VTShadowPage& page);
         void reset();
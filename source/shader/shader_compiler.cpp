@@ -17,6 +17,8 @@
 
 namespace fantasy 
 {
+    static const uint32_t shader_cache_version = 1;
+
     bool check_cache(const char* cache_path, const char* shader_path)
     {
         if (!is_file_exist(cache_path)) return false;
@@ -32,34 +34,23 @@ namespace fantasy
             return;
         }
 
-        serialization::BinaryOutput output(cache_path);
-        output(desc.defines.size());
-        for (const auto& define : desc.defines) output(define);
-        output(data._data.size());
-        output.save_binary_data(data._data.data(), data._data.size());
+        serialization::BinaryOutput output(cache_path, shader_cache_version);
+        output(desc.defines, data._data);
+        output.finish();
     }
 
     ShaderData load_from_cache(const ShaderCompileDesc& desc, const char* cache_path)
     {
         ShaderData shader_data;
         
-        serialization::BinaryInput input(cache_path);
-
-        uint64_t size;
-        input(size);
+        serialization::BinaryInput input(cache_path, shader_cache_version);
 
-        if (desc.defines.size() != size) return ShaderData{};
-        for (uint32_t ix = 0; ix < size; ++ix)
-        {
-            std::string cache_define;
-            input(cache_define);
-            if (cache_define != desc.defines[ix]) return ShaderData{};
-        }
+        std::vector<std::string> cache_defines;
+        input(cache_defines);
+        if (!input.good() || cache_defines != desc.defines) return ShaderData{};
 
-        uint64_t byte_code_size = 0;
-        input(byte_code_size);
-        shader_data._data.resize(byte_code_size);
-        input.load_binary_data(shader_data._data.data(), byte_code_size);
+        input(shader_data._data);
+        if (!input.good()) return ShaderData{};
 
         return shader_data;
     }
@@ -176,13 +176,14 @@ namespace fantasy
 		sky_pass->precede(sun_disk_pass);
 
 		World* world = render_graph->get_resource_cache()->get_world();
-		constant::AtmosphereProperties* properties = world->get_global_entity()->assign<constant::AtmosphereProperties>();
-
-		DirectionalLight* light = world->get_global_entity()->get_component<DirectionalLight>();
+		world->get_global_entity()->assign<constant::AtmosphereProperties>();
 
 		gui::add(
-			[this, properties, light, world]()
+			[this, world]()
 			{
+				// 组件在 Archetype 中可能被移动, 每帧重新获取.
+				DirectionalLight* light = world->get_global_entity()->get_component<DirectionalLight>();
+
 				if (ImGui::TreeNode("Sun"))
 				{
 					bool dirty = ImGui::SliderFloat("Intensity", &light->intensity, 0.0f, 20.0f);
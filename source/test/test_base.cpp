@@ -2,6 +2,7 @@
 
 #include "test_base.h"
 #include "../core/tools/log.h"
+#include "../core/tools/frame_allocator.h"
 #include "../dynamic_rhi/dynamic_rhi.h"
 #include "../dynamic_rhi/resource.h"
 #include "../shader/shader_compiler.h"
@@ -91,16 +92,36 @@ namespace fantasy
 		_world.register_system(system);
 
 		system->confirm_init_models(_init_model_paths);
-		auto* camera = _world.get_global_entity()->assign<Camera>(_window);
+		Entity* global_entity = _world.get_global_entity();
+		global_entity->assign<Camera>(_window);
         gui::add(
-            [camera]()
+            [global_entity]()
             {
+				// 组件在 Archetype 中可能被移动, 每帧重新获取.
+				Camera* camera = global_entity->get_component<Camera>();
 				ImGui::Text("Camera Position: (%.2f, %.2f, %.2f)", camera->position.x, camera->position.y, camera->position.z);
 				ImGui::Text("Camera Direction: (%.2f, %.2f, %.2f)", camera->direction.x, camera->direction.y, camera->direction.z);
 				ImGui::SliderInt("Camera Speed", &camera->speed, 1, 30);
                 ImGui::Separator();
             }
         );
+        gui::add(
+            []()
+            {
+                if (ImGui::CollapsingHeader("Frame Allocator"))
+				{
+					// 上一个完整帧的统计, 分配次数需要打开计数.
+					FrameAllocator& allocator = get_frame_allocator();
+					bool counter_enabled = allocator.counter_enabled();
+					if (ImGui::Checkbox("Count Allocations", &counter_enabled)) allocator.set_counter_enabled(counter_enabled);
+
+					const ArenaStats& stats = allocator.get_last_frame_stats();
+					if (counter_enabled) ImGui::Text("Heap Allocations Saved: %llu", static_cast<unsigned long long>(stats.allocation_num));
+					ImGui::Text("Bytes Served: %.1f KB / %.1f KB", stats.used_bytes / 1024.0f, stats.capacity / 1024.0f);
+					ImGui::Text("Arena Heap Allocations: %llu", static_cast<unsigned long long>(stats.heap_allocation_num));
+				}
+            }
+        );
         return true;
     }
 
@@ -0,0 +1,70 @@
+#include "unit_test.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "../core/parallel/parallel.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy::unit_test
+{
+    static uint32_t failure_num = 0;
+
+    std::vector<TestCase>& get_test_cases()
+    {
+        static std::vector<TestCase> test_cases;
+        return test_cases;
+    }
+
+    void report_failure(const char* expression, const char* file, uint32_t line)
+    {
+        failure_num++;
+        std::printf("    FAILED: %s [File: %s(%u)]\n", expression, file, line);
+    }
+}
+
+// unit_test [--benchmark] [name ...], 只运行名字包含其中任意一个字符串的用例.
+int main(int argc, char** argv)
+{
+    using namespace fantasy;
+
+    // 测试卡住时也能看到已经输出的结果.
+    std::setvbuf(stdout, nullptr, _IONBF, 0);
+
+    bool benchmark = false;
+    std::vector<std::string> filters;
+    for (int ix = 1; ix < argc; ++ix)
+    {
+        if (std::strcmp(argv[ix], "--benchmark") == 0) benchmark = true;
+        else filters.emplace_back(argv[ix]);
+    }
+
+    parallel::initialize();
+
+    uint32_t failed_case_num = 0;
+    uint32_t run_case_num = 0;
+    for (const auto& test_case : unit_test::get_test_cases())
+    {
+        if (test_case.benchmark != benchmark) continue;
+
+        bool selected = filters.empty();
+        for (const auto& filter : filters) selected |= std::string(test_case.name).find(filter) != std::string::npos;
+        if (!selected) continue;
+
+        std::printf("[ RUN  ] %s\n", test_case.name);
+        const uint32_t last_failure_num = unit_test::failure_num;
+
+        Timer timer;
+        test_case.func();
+        const float elapsed = timer.elapsed() * 1000.0f;
+
+        const bool success = unit_test::failure_num == last_failure_num;
+        std::printf("[ %s ] %s (%.1f ms)\n", success ? " OK " : "FAIL", test_case.name, elapsed);
+        failed_case_num += success ? 0 : 1;
+        run_case_num++;
+    }
+
+    parallel::destroy();
+
+    std::printf("%u / %u passed.\n", run_case_num - failed_case_num, run_case_num);
+    return failed_case_num == 0 ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../core/math/batch.h"
+#include "../core/parallel/parallel.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    static std::vector<float3> create_random_points(uint64_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> value(-100.0f, 100.0f);
+
+        std::vector<float3> points(count);
+        for (auto& point : points) point = float3(value(random), value(random), value(random));
+        return points;
+    }
+
+    static Float3SoA to_soa(const std::vector<float3>& points)
+    {
+        Float3SoA ret(points.size());
+        gather(points.data(), sizeof(float3), ret.span());
+        return ret;
+    }
+
+    static float4x4 create_trs_matrix()
+    {
+        return mul<float>(mul<float>(scale(float3(2.0f, 0.5f, 3.0f)), rotate(37.0f, float3(1.0f, 2.0f, 3.0f))), translate(float3(10.0f, -20.0f, 5.0f)));
+    }
+
+    static bool nearly_equal(const float3& a, const float3& b, float epsilon)
+    {
+        for (uint32_t ix = 0; ix < 3; ++ix)
+        {
+            if (std::abs(a[ix] - b[ix]) > epsilon * std::max(1.0f, std::abs(b[ix]))) return false;
+        }
+        return true;
+    }
+
+    // 包含剩余部分的各种长度, 与逐个用 float4 和矩阵相乘的结果相同 (FMA 只有舍入误差).
+    TEST_CASE(batch_transform_matches_scalar)
+    {
+        const float4x4 matrix = create_trs_matrix();
+        for (uint64_t count : { 0ull, 1ull, 7ull, 8ull, 9ull, 1027ull })
+        {
+            const auto points = create_random_points(count, 1);
+            Float3SoA soa = to_soa(points);
+            for (uint64_t ix = 0; ix < count; ++ix) CHECK(soa[ix] == points[ix]);
+
+            Float3SoA transformed(count), normals(count);
+            transform_points(soa.view(), matrix, transformed.span());
+            transform_normals(soa.view(), matrix, normals.span());
+            for (uint64_t ix = 0; ix < count; ++ix)
+            {
+                CHECK(nearly_equal(transformed[ix], float3(mul(float4(points[ix], 1.0f), matrix)), 1e-5f));
+                CHECK(nearly_equal(normals[ix], float3(mul(float4(points[ix], 0.0f), matrix)), 1e-5f));
+            }
+
+            // in 和 out 是同一块内存.
+            transform_points(soa.view(), matrix, soa.span());
+            for (uint64_t ix = 0; ix < count; ++ix) CHECK(soa[ix] == transformed[ix]);
+        }
+    }
+
+    TEST_CASE(batch_bounds_matches_scalar)
+    {
+        for (uint64_t count : { 1ull, 7ull, 8ull, 9ull, 1027ull, 100000ull })
+        {
+            const auto points = create_random_points(count, 2);
+            const Float3SoA soa = to_soa(points);
+
+            Bounds3F expected;
+            for (const auto& point : points) expected = merge(expected, point);
+            CHECK(compute_bounds(soa.view()) == expected);
+
+            // 分块数不是线程数整数倍, 最后一块不满.
+            CHECK(parallel_compute_bounds(soa.view(), 1000) == expected);
+            CHECK(parallel_compute_bounds(soa.view()) == expected);
+
+            // 三角形 (p[i], p[i + 1], p[i + 2]).
+            if (count >= 3)
+            {
+                const uint64_t triangle_num = count - 2;
+                Float3SoA lower(triangle_num), upper(triangle_num);
+                compute_triangle_bounds(
+                    soa.view().sub(0, triangle_num), soa.view().sub(1, triangle_num), soa.view().sub(2, triangle_num),
+                    lower.span(), upper.span()
+                );
+
+                std::vector<Bounds3F> boxes(triangle_num);
+                for (uint64_t ix = 0; ix < triangle_num; ++ix)
+                {
+                    const Bounds3F box = merge(merge(Bounds3F(points[ix]), points[ix + 1]), points[ix + 2]);
+                    CHECK(lower[ix] == box._lower && upper[ix] == box._upper);
+                    boxes[ix] = box;
+                }
+                CHECK(merge_bounds(boxes) == expected);
+            }
+        }
+        CHECK(compute_bounds(Float3View{}) == Bounds3F());
+    }
+
+    // 没有线程池时 parallel_compute_bounds 串行计算, 测试结束后恢复线程池.
+    TEST_CASE(batch_bounds_without_thread_pool)
+    {
+        const auto points = create_random_points(100000, 6);
+        const Float3SoA soa = to_soa(points);
+        const Bounds3F expected = compute_bounds(soa.view());
+
+        parallel::destroy();
+        CHECK(parallel::get_thread_pool() == nullptr);
+        CHECK(parallel_compute_bounds(soa.view(), 1000) == expected);
+        parallel::initialize();
+    }
+
+    // 变换后的包围盒与变换 8 个顶点再求包围盒的结果相同.
+    TEST_CASE(batch_transform_bounds)
+    {
+        const float4x4 matrix = create_trs_matrix();
+        const auto points = create_random_points(2000, 3);
+
+        std::vector<Bounds3F> boxes;
+        for (uint32_t ix = 0; ix + 1 < points.size(); ix += 2) boxes.push_back(merge(Bounds3F(points[ix]), points[ix + 1]));
+
+        std::vector<Bounds3F> transformed(boxes.size());
+        transform_bounds(boxes, matrix, transformed);
+        for (uint32_t ix = 0; ix < boxes.size(); ++ix)
+        {
+            Bounds3F expected;
+            for (uint32_t corner = 0; corner < 8; ++corner)
+            {
+                const float3 point(
+                    corner & 1 ? boxes[ix]._upper.x : boxes[ix]._lower.x,
+                    corner & 2 ? boxes[ix]._upper.y : boxes[ix]._lower.y,
+                    corner & 4 ? boxes[ix]._upper.z : boxes[ix]._lower.z
+                );
+                expected = merge(expected, float3(mul(float4(point, 1.0f), matrix)));
+            }
+            CHECK(nearly_equal(transformed[ix]._lower, expected._lower, 1e-5f));
+            CHECK(nearly_equal(transformed[ix]._upper, expected._upper, 1e-5f));
+        }
+    }
+
+    // 与 Sphere(const std::vector<float3>&) 相同, 并且包含所有点.
+    TEST_CASE(batch_bounding_sphere)
+    {
+        for (uint64_t count : { 1ull, 2ull, 9ull, 1027ull, 100000ull })
+        {
+            const auto points = create_random_points(count, 4);
+            const Sphere sphere = compute_bounding_sphere(to_soa(points).view());
+            const Sphere expected(points);
+
+            CHECK(nearly_equal(sphere.center, expected.center, 1e-5f));
+            CHECK(std::abs(sphere.radius - expected.radius) <= 1e-5f * expected.radius);
+            for (const auto& point : points)
+            {
+                CHECK(float3(point - sphere.center).length() <= sphere.radius * (1.0f + 1e-5f));
+            }
+        }
+        CHECK(compute_bounding_sphere(Float3View{}).radius == 0.0f);
+    }
+
+    // 1000 万个点, SoA 的批量版本与逐个处理 AoS 数组的耗时.
+    BENCHMARK_CASE(batch_kernels_10m)
+    {
+        constexpr uint64_t count = 10'000'000;
+        const auto points = create_random_points(count, 5);
+        const Float3SoA soa = to_soa(points);
+        const float4x4 matrix = create_trs_matrix();
+
+        auto report = [](const char* name, float batch_time, float scalar_time)
+        {
+            std::printf(
+                "    %-24s batch %7.2f ms, scalar %7.2f ms, %.1fx\n",
+                name, batch_time * 1000.0f, scalar_time * 1000.0f, scalar_time / batch_time
+            );
+        };
+
+        Timer timer;
+        Bounds3F bounds = compute_bounds(soa.view());
+        const float bounds_time = timer.tick();
+        Bounds3F scalar_bounds;
+        for (const auto& point : points) scalar_bounds = merge(scalar_bounds, point);
+        const float scalar_bounds_time = timer.tick();
+        CHECK(bounds == scalar_bounds);
+        report("compute_bounds", bounds_time, scalar_bounds_time);
+
+        timer.tick();
+        bounds = parallel_compute_bounds(soa.view());
+        const float parallel_bounds_time = timer.tick();
+        CHECK(bounds == scalar_bounds);
+        report("parallel_compute_bounds", parallel_bounds_time, scalar_bounds_time);
+
+        Float3SoA transformed(count);
+        std::vector<float3> scalar_transformed(count);
+        timer.tick();
+        transform_points(soa.view(), matrix, transformed.span());
+        const float transform_time = timer.tick();
+        for (uint64_t ix = 0; ix < count; ++ix) scalar_transformed[ix] = float3(mul(float4(points[ix], 1.0f), matrix));
+        report("transform_points", transform_time, timer.tick());
+
+        // 三角形 (p[i], p[i + 1], p[i + 2]), 下界写入 transformed, 减少内存占用.
+        const uint64_t triangle_num = count - 2;
+        Float3SoA upper(triangle_num);
+        timer.tick();
+        compute_triangle_bounds(
+            soa.view().sub(0, triangle_num), soa.view().sub(1, triangle_num), soa.view().sub(2, triangle_num),
+            transformed.span().sub(0, triangle_num), upper.span()
+        );
+        const float triangle_time = timer.tick();
+        std::vector<Bounds3F> scalar_boxes(triangle_num);
+        for (uint64_t ix = 0; ix < triangle_num; ++ix)
+        {
+            scalar_boxes[ix] = merge(merge(Bounds3F(points[ix]), points[ix + 1]), points[ix + 2]);
+        }
+        report("compute_triangle_bounds", triangle_time, timer.tick());
+
+        timer.tick();
+        const Sphere sphere = compute_bounding_sphere(soa.view());
+        const float sphere_time = timer.tick();
+        const Sphere scalar_sphere(points);
+        report("compute_bounding_sphere", sphere_time, timer.tick());
+        CHECK(std::abs(sphere.radius - scalar_sphere.radius) <= 1e-5f * scalar_sphere.radius);
+    }
+}
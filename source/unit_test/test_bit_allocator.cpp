@@ -0,0 +1,184 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../core/math/common.h"
+#include "../core/tools/bit_allocator.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    // 第一个长度为 count 的空闲区间.
+    static uint32_t find_first_free_range(const std::vector<char>& bits, uint32_t count)
+    {
+        uint32_t run_length = 0;
+        for (uint32_t ix = 0; ix < bits.size(); ++ix)
+        {
+            run_length = bits[ix] ? 0 : run_length + 1;
+            if (run_length == count) return ix + 1 - count;
+        }
+        return INVALID_SIZE_32;
+    }
+
+    // 单线程时与 std::vector<char> 逐步比较, allocate 和 allocate_range 都返回第一个满足的位置.
+    TEST_CASE(bit_allocator_matches_reference)
+    {
+        std::mt19937 random(1);
+        for (uint32_t size : { 1u, 63u, 64u, 65u, 4097u, 300000u })
+        {
+            BitSetAllocator allocator(size, false);
+            std::vector<char> bits(size, 0);
+
+            for (uint32_t ix = 0; ix < 20000; ++ix)
+            {
+                const uint32_t operation = random() % 8;
+                if (operation < 3)
+                {
+                    const uint32_t index = allocator.allocate();
+                    CHECK(index == find_first_free_range(bits, 1));
+                    if (index != INVALID_SIZE_32) bits[index] = 1;
+                }
+                else if (operation < 5)
+                {
+                    const uint32_t count = 1 + random() % 100;
+                    const uint32_t index = allocator.allocate_range(count);
+                    CHECK(index == find_first_free_range(bits, count));
+                    if (index != INVALID_SIZE_32) std::fill_n(bits.begin() + index, count, 1);
+                }
+                else
+                {
+                    const uint32_t index = random() % size;
+                    const uint32_t count = std::min<uint32_t>(1 + random() % 8, size - index);
+                    const bool all_set = std::all_of(bits.begin() + index, bits.begin() + index + count, [](char bit) { return bit != 0; });
+                    CHECK(allocator.release_range(index, count) == all_set);
+                    std::fill_n(bits.begin() + index, count, 0);
+                }
+            }
+
+            for (uint32_t ix = 0; ix < size; ++ix) CHECK(allocator[ix] == (bits[ix] != 0));
+
+            // 扩容保留已分配的位, 新增的位都是空闲的.
+            allocator.resize(size * 2 + 1);
+            bits.resize(size * 2 + 1, 0);
+            const uint32_t index = allocator.allocate_range(size);
+            CHECK(index == find_first_free_range(bits, size));
+            if (index != INVALID_SIZE_32) std::fill_n(bits.begin() + index, size, 1);
+            for (uint32_t ix = 0; ix < size * 2 + 1; ++ix) CHECK(allocator[ix] == (bits[ix] != 0));
+        }
+    }
+
+    // 多个线程同时分配和释放, 每个槽位用 owner 记录持有的线程, 不能被重复分配. 结束后全部释放再重新分配满.
+    TEST_CASE(bit_allocator_multithread_stress)
+    {
+        constexpr uint32_t size = 4096 + 17;
+        constexpr uint32_t thread_num = 8;
+        constexpr uint32_t iteration_num = 50000;
+
+        BitSetAllocator allocator(size, true);
+        std::vector<std::atomic<uint32_t>> owners(size);
+        std::atomic<uint32_t> error_num = 0;
+
+        std::vector<std::thread> threads;
+        for (uint32_t thread = 0; thread < thread_num; ++thread)
+        {
+            threads.emplace_back(
+                [&, thread]()
+                {
+                    std::mt19937 random(thread + 100);
+                    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+                    for (uint32_t ix = 0; ix < iteration_num; ++ix)
+                    {
+                        if (ranges.size() < 64 && random() % 2 == 0)
+                        {
+                            const uint32_t count = random() % 4 == 0 ? 1 + random() % 16 : 1;
+                            const uint32_t index = count == 1 ? allocator.allocate() : allocator.allocate_range(count);
+                            if (index == INVALID_SIZE_32) continue;
+
+                            for (uint32_t jx = index; jx < index + count; ++jx)
+                            {
+                                uint32_t expected = 0;
+                                if (!owners[jx].compare_exchange_strong(expected, thread + 1)) error_num++;
+                            }
+                            ranges.emplace_back(index, count);
+                        }
+                        else if (!ranges.empty())
+                        {
+                            const uint32_t pick = random() % ranges.size();
+                            const auto [index, count] = ranges[pick];
+                            ranges[pick] = ranges.back();
+                            ranges.pop_back();
+
+                            // 先清除 owner 再释放, 释放之后其它线程可能立即分配到.
+                            for (uint32_t jx = index; jx < index + count; ++jx)
+                            {
+                                uint32_t expected = thread + 1;
+                                if (!owners[jx].compare_exchange_strong(expected, 0)) error_num++;
+                            }
+                            if (!allocator.release_range(index, count)) error_num++;
+                        }
+                    }
+                    for (const auto& [index, count] : ranges)
+                    {
+                        for (uint32_t jx = index; jx < index + count; ++jx) owners[jx].store(0);
+                        if (!allocator.release_range(index, count)) error_num++;
+                    }
+                }
+            );
+        }
+        for (auto& thread : threads) thread.join();
+        CHECK(error_num.load() == 0);
+
+        // 上层的已满标记都已修正, 所有位都能重新分配.
+        for (uint32_t ix = 0; ix < size; ++ix) CHECK(!allocator[ix]);
+        std::vector<char> allocated(size, 0);
+        for (uint32_t ix = 0; ix < size; ++ix)
+        {
+            const uint32_t index = allocator.allocate();
+            CHECK(index < size && !allocated[index]);
+            if (index < size) allocated[index] = 1;
+        }
+        CHECK(allocator.allocate() == INVALID_SIZE_32);
+    }
+
+    // 在 10%, 50%, 95% 的占用率下, 稳定状态的一次释放加一次分配的耗时.
+    BENCHMARK_CASE(bit_allocator_occupancy)
+    {
+        constexpr uint32_t iteration_num = 1 << 20;
+        for (uint32_t size : { 16384u, 1u << 20 })
+        {
+            for (uint32_t occupancy : { 10u, 50u, 95u })
+            {
+                for (uint32_t count : { 1u, 8u })
+                {
+                    BitSetAllocator allocator(size, true);
+                    std::mt19937 random(2);
+
+                    // 按 count 对齐的区间随机占用, 释放后留下的空洞大小相同.
+                    std::vector<uint32_t> ranges;
+                    for (uint32_t ix = 0; ix + count <= size; ix += count) ranges.push_back(ix);
+                    std::shuffle(ranges.begin(), ranges.end(), random);
+                    ranges.resize(static_cast<uint64_t>(ranges.size()) * occupancy / 100);
+                    for (uint32_t index : ranges)
+                    {
+                        for (uint32_t jx = index; jx < index + count; ++jx) allocator.set_true(jx);
+                    }
+
+                    Timer timer;
+                    for (uint32_t ix = 0; ix < iteration_num; ++ix)
+                    {
+                        const uint32_t pick = random() % ranges.size();
+                        allocator.release_range(ranges[pick], count);
+                        ranges[pick] = count == 1 ? allocator.allocate() : allocator.allocate_range(count);
+                    }
+                    std::printf(
+                        "    %7u slots, %2u%% occupied, %u slot(s): %.1f ns per release + allocate\n",
+                        size, occupancy, count, timer.elapsed() / iteration_num * 1e9f
+                    );
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,502 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <span>
+#include <vector>
+#include "../core/math/bvh.h"
+#include "../core/math/bvh_builder.h"
+#include "../core/math/bvh_traversal.h"
+#include "../core/parallel/parallel.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    // 随机分布的三角形, 边长不超过 triangle_size.
+    static std::vector<Bvh::Vertex> create_random_triangles(uint32_t triangle_num, float triangle_size, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+
+        std::vector<Bvh::Vertex> vertices(uint64_t(triangle_num) * 3);
+        for (uint32_t ix = 0; ix < triangle_num; ++ix)
+        {
+            const float3 center(position(random), position(random), position(random));
+            for (uint32_t jx = 0; jx < 3; ++jx)
+            {
+                const float3 offset(position(random), position(random), position(random));
+                vertices[ix * 3 + jx].position = center + offset * triangle_size;
+            }
+        }
+        return vertices;
+    }
+
+    class BvhTest
+    {
+    public:
+        // 每个内部节点的第一个子节点是只有一个三角形的叶子, 第二个子节点包含剩下的三角形, 树的深度为 triangle_num - 1.
+        // 内部节点 k 为 nodes[2k], 三角形 k 的叶子为 nodes[2k + 1], 最后一个三角形的叶子为 nodes[2 * triangle_num - 2].
+        static void build_chain(Bvh& bvh, std::span<const Bvh::Vertex> vertices, uint32_t triangle_num)
+        {
+            bvh._vertices.assign(vertices.begin(), vertices.end());
+            bvh._nodes.resize(uint64_t(triangle_num) * 2 - 1);
+            bvh.triangle_num = triangle_num;
+
+            for (uint32_t ix = 0; ix < triangle_num; ++ix)
+            {
+                Bvh::Node& leaf = bvh._nodes[ix + 1 == triangle_num ? ix * 2 : ix * 2 + 1];
+                leaf.box = merge(Bounds3F(vertices[ix * 3].position, vertices[ix * 3 + 1].position), vertices[ix * 3 + 2].position);
+                leaf.child_index = ix;
+                leaf.child_num = 1;
+            }
+            for (uint32_t ix = triangle_num - 1; ix-- > 0;)
+            {
+                Bvh::Node& node = bvh._nodes[ix * 2];
+                node.box = merge(bvh._nodes[ix * 2 + 1].box, bvh._nodes[ix * 2 + 2].box);
+                node.child_index = ix * 2 + 1;
+                node.child_num = 0;
+            }
+            bvh.global_box = bvh._nodes[0].box;
+        }
+    };
+
+    static uint32_t get_bvh_depth(const Bvh& bvh, uint32_t node_index = 0)
+    {
+        const Bvh::Node& node = bvh.GetNodes()[node_index];
+        if (node.child_num > 0) return 0;
+        return 1 + std::max(get_bvh_depth(bvh, node.child_index), get_bvh_depth(bvh, node.child_index + 1));
+    }
+
+    // 与 bvh_traversal.cpp 中的实现无关的暴力求交, 用于对照.
+    static bool brute_force_intersect(const std::vector<Bvh::Vertex>& vertices, const Ray& ray, float* distance)
+    {
+        *distance = INFINITY;
+        for (uint64_t ix = 0; ix < vertices.size(); ix += 3)
+        {
+            const float3 p0 = vertices[ix].position;
+            const float3 normal = cross(vertices[ix + 1].position - p0, vertices[ix + 2].position - p0);
+            const float denominator = dot(normal, ray.dir);
+            if (denominator == 0.0f) continue;
+
+            const float t = dot(normal, p0 - ray.ori) / denominator;
+            if (t < 0.0f || t > ray.max || t >= *distance) continue;
+
+            // 交点在三条边的同一侧.
+            const float3 point = ray(t);
+            bool inside = true;
+            for (uint32_t edge = 0; edge < 3 && inside; ++edge)
+            {
+                const float3 a = vertices[ix + edge].position;
+                const float3 b = vertices[ix + (edge + 1) % 3].position;
+                inside = dot(cross(b - a, point - a), normal) >= 0.0f;
+            }
+            if (inside) *distance = t;
+        }
+        return *distance != INFINITY;
+    }
+
+    static float3 brute_force_closest_point(const float3& point, const float3& p0, const float3& p1, const float3& p2)
+    {
+        const float3 normal = normalize(cross(p1 - p0, p2 - p0));
+        const float3 projected = point - normal * dot(point - p0, normal);
+
+        const float3 corners[3] = { p0, p1, p2 };
+        bool inside = true;
+        for (uint32_t edge = 0; edge < 3; ++edge)
+        {
+            inside &= dot(cross(corners[(edge + 1) % 3] - corners[edge], projected - corners[edge]), normal) >= 0.0f;
+        }
+        if (inside) return projected;
+
+        // 在三角形外时最近点在某条边上.
+        float3 closest;
+        float closest_distance = INFINITY;
+        for (uint32_t edge = 0; edge < 3; ++edge)
+        {
+            const float3 a = corners[edge];
+            const float3 ab = corners[(edge + 1) % 3] - a;
+            const float t = std::clamp(dot(point - a, ab) / dot(ab, ab), 0.0f, 1.0f);
+            const float3 candidate = a + ab * t;
+            const float distance = (candidate - point).length_squared();
+            if (distance < closest_distance)
+            {
+                closest_distance = distance;
+                closest = candidate;
+            }
+        }
+        return closest;
+    }
+
+    static float brute_force_closest_distance(const std::vector<Bvh::Vertex>& vertices, const float3& point)
+    {
+        float result = INFINITY;
+        for (uint64_t ix = 0; ix < vertices.size(); ix += 3)
+        {
+            const float3 closest = brute_force_closest_point(point, vertices[ix].position, vertices[ix + 1].position, vertices[ix + 2].position);
+            result = std::min(result, (closest - point).length());
+        }
+        return result;
+    }
+
+    static Ray create_random_ray(std::mt19937& random, float origin_range)
+    {
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+        const float3 origin = float3(distribution(random), distribution(random), distribution(random)) * origin_range;
+        const float3 target = float3(distribution(random), distribution(random), distribution(random)) * 0.5f;
+        return Ray(origin, normalize(target - origin));
+    }
+
+    // 最近交点, 任意交点和最近点与暴力遍历所有三角形的结果一致.
+    static void check_bvh_queries(const Bvh& bvh, std::mt19937& random, float origin_range, uint32_t query_num)
+    {
+        const std::vector<Bvh::Vertex> vertices(bvh.GetVertices().begin(), bvh.GetVertices().end());
+
+        uint32_t hit_num = 0;
+        uint32_t mismatch_num = 0;
+        for (uint32_t ix = 0; ix < query_num; ++ix)
+        {
+            Ray ray = create_random_ray(random, origin_range);
+            if (ix % 2 == 1) ray.max = std::uniform_real_distribution<float>(0.0f, 2.0f * origin_range)(random);
+
+            float expected;
+            const bool expected_hit = brute_force_intersect(vertices, ray, &expected);
+
+            BvhRayHit hit;
+            const bool closest_hit = intersect_closest(bvh, ray, &hit);
+            const bool any_hit = intersect_any(bvh, ray);
+
+            // 三角形的边上两种算法的判断可能不同, 只比较距离.
+            const float tolerance = 1e-4f * std::max(1.0f, expected);
+            if (closest_hit != expected_hit || any_hit != expected_hit) mismatch_num++;
+            else if (expected_hit && std::abs(hit.distance - expected) > tolerance) mismatch_num++;
+            hit_num += expected_hit ? 1 : 0;
+
+            const float3 point = ray.ori;
+            BvhClosestPoint closest;
+            const float expected_distance = brute_force_closest_distance(vertices, point);
+            if (!find_closest_point(bvh, point, &closest) || std::abs(closest.distance - expected_distance) > 1e-4f * std::max(1.0f, expected_distance))
+            {
+                mismatch_num++;
+            }
+        }
+        CHECK(hit_num > 0 && hit_num < query_num);
+        CHECK(mismatch_num == 0);
+    }
+
+    // 与球相交的三角形与暴力遍历相比不遗漏, 也不多出.
+    static void check_bvh_sphere_queries(const Bvh& bvh, std::mt19937& random, uint32_t query_num)
+    {
+        const std::vector<Bvh::Vertex> vertices(bvh.GetVertices().begin(), bvh.GetVertices().end());
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+        uint32_t mismatch_num = 0;
+        for (uint32_t ix = 0; ix < query_num; ++ix)
+        {
+            const Sphere sphere(float3(distribution(random), distribution(random), distribution(random)), 0.2f);
+            std::vector<uint32_t> triangle_indices;
+            overlap_sphere(bvh, sphere, triangle_indices);
+            std::sort(triangle_indices.begin(), triangle_indices.end());
+
+            std::vector<uint32_t> expected;
+            for (uint32_t jx = 0; jx < vertices.size() / 3; ++jx)
+            {
+                const float3 closest = brute_force_closest_point(
+                    sphere.center,
+                    vertices[jx * 3].position,
+                    vertices[jx * 3 + 1].position,
+                    vertices[jx * 3 + 2].position
+                );
+                const float distance = (closest - sphere.center).length();
+
+                // 与球面距离很近的三角形两种算法的判断可能不同, 不参与比较.
+                if (std::abs(distance - sphere.radius) < 1e-5f)
+                {
+                    triangle_indices.erase(std::remove(triangle_indices.begin(), triangle_indices.end(), jx), triangle_indices.end());
+                    continue;
+                }
+                if (distance <= sphere.radius) expected.push_back(jx);
+            }
+            if (triangle_indices != expected) mismatch_num++;
+        }
+        CHECK(mismatch_num == 0);
+    }
+
+    TEST_CASE(bvh_traversal_brute_force)
+    {
+        std::mt19937 random(7);
+        std::vector<Bvh::Vertex> vertices = create_random_triangles(2000, 0.05f, 1);
+
+        Bvh bvh;
+        bvh.build(vertices, 2000);
+        check_bvh_queries(bvh, random, 2.0f, 1000);
+        check_bvh_sphere_queries(bvh, random, 200);
+
+        // 由包围盒构建的 Bvh 返回相交的包围盒的序号.
+        std::vector<Bounds3F> boxes(2000);
+        Bounds3F global_box;
+        for (uint32_t ix = 0; ix < 2000; ++ix)
+        {
+            boxes[ix] = Bounds3F(vertices[ix * 3].position, vertices[ix * 3 + 1].position);
+            global_box = merge(global_box, boxes[ix]);
+        }
+        Bvh box_bvh;
+        box_bvh.build(boxes);
+        CHECK(box_bvh.global_box == global_box);
+        CHECK(bvh.global_box == bvh.GetNodes()[0].box);
+
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+        uint32_t mismatch_num = 0;
+        for (uint32_t ix = 0; ix < 200; ++ix)
+        {
+            const float3 center(distribution(random), distribution(random), distribution(random));
+            const Bounds3F query(center - float3(0.1f, 0.1f, 0.1f), center + float3(0.1f, 0.1f, 0.1f));
+            std::vector<uint32_t> box_indices;
+            overlap_box(box_bvh, query, box_indices);
+            std::sort(box_indices.begin(), box_indices.end());
+
+            std::vector<uint32_t> expected;
+            for (uint32_t jx = 0; jx < boxes.size(); ++jx)
+            {
+                const Bounds3F& box = boxes[jx];
+                if (box._lower.x <= query._upper.x && box._upper.x >= query._lower.x &&
+                    box._lower.y <= query._upper.y && box._upper.y >= query._lower.y &&
+                    box._lower.z <= query._upper.z && box._upper.z >= query._lower.z)
+                {
+                    expected.push_back(jx);
+                }
+            }
+            if (box_indices != expected) mismatch_num++;
+        }
+        CHECK(mismatch_num == 0);
+    }
+
+    // 树的深度远超遍历栈的大小时, 查询结果仍与暴力遍历一致.
+    TEST_CASE(bvh_traversal_deep_tree)
+    {
+        constexpr uint32_t triangle_num = 500;
+        std::vector<Bvh::Vertex> vertices = create_random_triangles(triangle_num, 0.2f, 2);
+
+        Bvh bvh;
+        BvhTest::build_chain(bvh, vertices, triangle_num);
+        CHECK(get_bvh_depth(bvh) == triangle_num - 1);
+
+        std::mt19937 random(11);
+        check_bvh_queries(bvh, random, 2.0f, 300);
+        check_bvh_sphere_queries(bvh, random, 100);
+
+        std::vector<uint32_t> triangle_indices;
+        overlap_box(bvh, bvh.global_box, triangle_indices);
+        CHECK(triangle_indices.size() == triangle_num);
+    }
+
+    // 三角形沿 x 轴按 2^0.25 倍的间隔排列, 分桶只能分出最远的少数几个, 不限制深度时树的深度约为 40.
+    static std::vector<Bvh::Vertex> create_exponential_triangles(uint32_t triangle_num)
+    {
+        std::vector<Bvh::Vertex> vertices(uint64_t(triangle_num) * 3);
+        for (uint32_t ix = 0; ix < triangle_num; ++ix)
+        {
+            const float x = std::exp2((static_cast<float>(ix) - static_cast<float>(triangle_num / 2)) * 0.25f);
+            const float size = x * 0.25f;
+            vertices[ix * 3].position = float3(x, -size, -size);
+            vertices[ix * 3 + 1].position = float3(x, size, -size);
+            vertices[ix * 3 + 2].position = float3(x, 0.0f, size);
+        }
+        return vertices;
+    }
+
+    static BvhBuildResult build_triangle_bvh(const std::vector<Bvh::Vertex>& vertices, const BvhBuildDesc& desc)
+    {
+        const uint64_t triangle_num = vertices.size() / 3;
+        Float3SoA lower(triangle_num);
+        Float3SoA upper(triangle_num);
+        for (uint64_t ix = 0; ix < triangle_num; ++ix)
+        {
+            const float3 p0 = vertices[ix * 3].position;
+            const float3 p1 = vertices[ix * 3 + 1].position;
+            const float3 p2 = vertices[ix * 3 + 2].position;
+            lower.set(ix, min(min(p0, p1), p2));
+            upper.set(ix, max(max(p0, p1), p2));
+        }
+        return build_binned_sah_bvh(lower.view(), upper.view(), desc);
+    }
+
+    static bool box_contains(const Bounds3F& outer, const Bounds3F& inner)
+    {
+        return outer._lower.x <= inner._lower.x && outer._lower.y <= inner._lower.y && outer._lower.z <= inner._lower.z &&
+               outer._upper.x >= inner._upper.x && outer._upper.y >= inner._upper.y && outer._upper.z >= inner._upper.z;
+    }
+
+    // 每个图元恰好在一个叶子中, 叶子不超过 max_leaf_size, 包围盒包含子节点和图元, 深度不超过 max_depth 且与 stats 一致.
+    static void check_bvh_build_result(const BvhBuildResult& result, const std::vector<Bvh::Vertex>& vertices, const BvhBuildDesc& desc)
+    {
+        const uint64_t triangle_num = vertices.size() / 3;
+        std::vector<uint32_t> counts(triangle_num, 0);
+        uint32_t error_num = 0;
+        uint32_t max_depth = 0;
+        uint32_t leaf_num = 0;
+
+        std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+        while (!stack.empty())
+        {
+            const auto [node_index, depth] = stack.back();
+            stack.pop_back();
+
+            const Bvh::Node& node = result.nodes[node_index];
+            if (node.child_num > 0)
+            {
+                leaf_num++;
+                max_depth = std::max(max_depth, depth);
+                if (node.child_num > desc.max_leaf_size) error_num++;
+                for (uint32_t ix = node.child_index; ix < node.child_index + node.child_num; ++ix)
+                {
+                    const uint32_t primitive = result.primitive_indices[ix];
+                    counts[primitive]++;
+                    const Bounds3F box = merge(
+                        Bounds3F(vertices[primitive * 3].position, vertices[primitive * 3 + 1].position),
+                        vertices[primitive * 3 + 2].position
+                    );
+                    if (!box_contains(node.box, box)) error_num++;
+                }
+                continue;
+            }
+
+            for (uint32_t ix = 0; ix < 2; ++ix)
+            {
+                if (!box_contains(node.box, result.nodes[node.child_index + ix].box)) error_num++;
+                stack.push_back({ node.child_index + ix, depth + 1 });
+            }
+        }
+
+        CHECK(error_num == 0);
+        CHECK(std::all_of(counts.begin(), counts.end(), [](uint32_t count) { return count == 1; }));
+        CHECK(max_depth <= desc.max_depth);
+        CHECK(max_depth == result.stats.max_depth);
+        CHECK(leaf_num == result.stats.leaf_num);
+        CHECK(result.nodes.size() == result.stats.node_num);
+    }
+
+    // 深度限制: 按 SAH 划分会超过 max_depth 的子树改为按数量对半分.
+    TEST_CASE(bvh_builder_depth_limit)
+    {
+        std::vector<Bvh::Vertex> vertices = create_exponential_triangles(240);
+
+        BvhBuildDesc desc;
+        const BvhBuildResult unlimited = build_triangle_bvh(vertices, desc);
+        check_bvh_build_result(unlimited, vertices, desc);
+        CHECK(unlimited.stats.max_depth > 16);
+
+        desc.max_depth = 16;
+        const BvhBuildResult limited = build_triangle_bvh(vertices, desc);
+        check_bvh_build_result(limited, vertices, desc);
+        CHECK(limited.stats.median_split_num > 0);
+
+        // 每个叶子一个图元时, 深度限制至少为 log2(图元数).
+        desc.max_leaf_size = 1;
+        desc.max_depth = 8;
+        check_bvh_build_result(build_triangle_bvh(vertices, desc), vertices, desc);
+
+        // 限制深度的树查询结果不变, Bvh::build 的三角形顺序由 primitive_indices 决定, 只比较距离.
+        Bvh bvh;
+        bvh.build(vertices, 240, 12);
+        CHECK(get_bvh_depth(bvh) <= 12);
+        for (uint32_t ix = 0; ix < 240; ++ix)
+        {
+            const float x = vertices[ix * 3].position.x;
+            BvhRayHit hit;
+            CHECK(intersect_closest(bvh, Ray(float3(x * 0.95f, 0.0f, 0.0f), float3(1.0f, 0.0f, 0.0f)), &hit));
+            CHECK(std::abs(hit.distance - x * 0.05f) <= x * 1e-5f);
+        }
+    }
+
+    // 质心重合或质心范围为非规格化数时无法分桶, 按数量对半分, 不会得到空的子节点.
+    TEST_CASE(bvh_builder_degenerate_centroids)
+    {
+        constexpr uint32_t triangle_num = 1000;
+        BvhBuildDesc desc;
+
+        std::vector<Bvh::Vertex> vertices(triangle_num * 3);
+        for (uint32_t ix = 0; ix < triangle_num; ++ix)
+        {
+            vertices[ix * 3].position = float3(-1.0f, -1.0f, 0.0f);
+            vertices[ix * 3 + 1].position = float3(1.0f, -1.0f, 0.0f);
+            vertices[ix * 3 + 2].position = float3(0.0f, 2.0f, 0.0f);
+        }
+        BvhBuildResult result = build_triangle_bvh(vertices, desc);
+        check_bvh_build_result(result, vertices, desc);
+        CHECK(result.stats.median_split_num == result.stats.node_num / 2);
+
+        // 质心之间只差非规格化数.
+        for (uint32_t ix = 0; ix < triangle_num; ++ix)
+        {
+            const float offset = std::numeric_limits<float>::denorm_min() * static_cast<float>(ix % 7);
+            for (uint32_t jx = 0; jx < 3; ++jx)
+            {
+                vertices[ix * 3 + jx].position = float3(offset, offset, offset) + float3(jx == 0 ? 1e-30f : 0.0f, jx == 1 ? 1e-30f : 0.0f, 0.0f);
+            }
+        }
+        result = build_triangle_bvh(vertices, desc);
+        check_bvh_build_result(result, vertices, desc);
+        CHECK(result.stats.median_split_num > 0);
+    }
+
+    // 不同规模的随机网格的构建耗时和 BvhBuildStats.
+    BENCHMARK_CASE(bvh_builder_stats)
+    {
+        for (uint32_t triangle_num : { 10000u, 100000u, 1000000u })
+        {
+            std::vector<Bvh::Vertex> vertices = create_random_triangles(triangle_num, 0.5f / std::cbrt(static_cast<float>(triangle_num)), 1);
+            for (uint32_t max_depth : { 63u, 31u })
+            {
+                BvhBuildDesc desc;
+                desc.max_depth = max_depth;
+                const BvhBuildStats stats = build_triangle_bvh(vertices, desc).stats;
+                std::printf(
+                    "    %u triangles, max_depth %u: %.2f ms, sah %.2f, %u nodes, %u leaves, depth %u, %u median splits, %.1f MB\n",
+                    triangle_num, max_depth, stats.build_time * 1e3f, stats.sah_cost, stats.node_num, stats.leaf_num,
+                    stats.max_depth, stats.median_split_num, stats.memory_bytes / (1024.0f * 1024.0f)
+                );
+            }
+        }
+    }
+
+    // 单线程和多线程每秒的最近交点查询数.
+    BENCHMARK_CASE(bvh_traversal_rays_per_second)
+    {
+        for (uint32_t triangle_num : { 10000u, 1000000u })
+        {
+            std::vector<Bvh::Vertex> vertices = create_random_triangles(triangle_num, 0.5f / std::cbrt(static_cast<float>(triangle_num)), 1);
+            Bvh bvh;
+            bvh.build(vertices, triangle_num);
+
+            constexpr uint32_t ray_num = 1 << 18;
+            std::mt19937 random(3);
+            std::vector<Ray> rays(ray_num);
+            for (auto& ray : rays) ray = create_random_ray(random, 2.0f);
+
+            Timer timer;
+            uint32_t hit_num = 0;
+            for (const auto& ray : rays) hit_num += intersect_closest(bvh, ray, nullptr) ? 1 : 0;
+            const float single_time = timer.elapsed();
+
+            Timer parallel_timer;
+            std::atomic<uint32_t> parallel_hit_num = 0;
+            auto func = [&](uint64_t begin, uint64_t end)
+            {
+                uint32_t local_hit_num = 0;
+                for (uint64_t ix = begin; ix < end; ++ix) local_hit_num += intersect_closest(bvh, rays[ix], nullptr) ? 1 : 0;
+                parallel_hit_num += local_hit_num;
+            };
+            parallel::parallel_for_range(func, ray_num);
+            const float parallel_time = parallel_timer.elapsed();
+
+            std::printf(
+                "    %u triangles: 1 thread %.2f Mrays/s, %u threads %.2f Mrays/s (hit %u/%u)\n",
+                triangle_num, ray_num / single_time * 1e-6f,
+                parallel::get_thread_num(), ray_num / parallel_time * 1e-6f,
+                hit_num, parallel_hit_num.load()
+            );
+        }
+    }
+}
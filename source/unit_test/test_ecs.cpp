@@ -0,0 +1,560 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "../core/parallel/parallel.h"
+#include "../core/tools/ecs.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    struct TestEvent
+    {
+        uint32_t producer = 0;
+        uint32_t sequence = 0;
+        std::string payload;
+    };
+
+    // 记录收到的事件和批次数, 检查每个生产者的事件按顺序且只收到一次.
+    struct TestEventSubscriber : public EventSubscriber<TestEvent>
+    {
+        std::vector<uint32_t> next_sequences;
+        uint32_t order_error_num = 0;
+        uint64_t event_num = 0;
+        uint32_t batch_num = 0;
+
+        explicit TestEventSubscriber(uint32_t producer_num) : next_sequences(producer_num, 0) {}
+
+        bool publish(World*, const TestEvent& event) override
+        {
+            if (event.sequence != next_sequences[event.producer]) order_error_num++;
+            if (event.payload != std::to_string(event.sequence)) order_error_num++;
+            next_sequences[event.producer] = event.sequence + 1;
+            event_num++;
+            return true;
+        }
+
+        bool publish_batch(World* world, std::span<const TestEvent> events) override
+        {
+            batch_num++;
+            return EventSubscriber<TestEvent>::publish_batch(world, events);
+        }
+    };
+
+    // 多个线程在 flush 的同时 publish, 所有事件都按每个生产者的顺序送达一次.
+    TEST_CASE(world_event_queue_concurrent_publish)
+    {
+        constexpr uint32_t producer_num = 4;
+        constexpr uint32_t event_num = 50000;
+
+        World world;
+        TestEventSubscriber subscriber(producer_num);
+        world.subscribe<TestEvent>(&subscriber);
+
+        std::atomic<uint32_t> finished_producer_num = 0;
+        std::vector<std::thread> producers;
+        for (uint32_t producer = 0; producer < producer_num; ++producer)
+        {
+            producers.emplace_back(
+                [&, producer]()
+                {
+                    for (uint32_t ix = 0; ix < event_num; ++ix)
+                    {
+                        world.publish(TestEvent{ .producer = producer, .sequence = ix, .payload = std::to_string(ix) });
+                    }
+                    finished_producer_num++;
+                }
+            );
+        }
+
+        uint32_t flush_num = 0;
+        while (finished_producer_num.load() != producer_num)
+        {
+            CHECK(world.flush_events());
+            flush_num++;
+        }
+        for (auto& producer : producers) producer.join();
+        CHECK(world.flush_events());
+
+        CHECK(subscriber.order_error_num == 0);
+        CHECK(subscriber.event_num == uint64_t(producer_num) * event_num);
+        CHECK(subscriber.batch_num <= flush_num + 1);
+
+        // 队列为空时 flush 不调用订阅者.
+        const uint32_t batch_num = subscriber.batch_num;
+        CHECK(world.flush_events());
+        CHECK(subscriber.batch_num == batch_num);
+    }
+
+    struct TestPosition
+    {
+        float x = 0.0f;
+    };
+
+    struct TestVelocity
+    {
+        float x = 0.0f;
+    };
+
+    // each 和 parallel_each 通过 Write<T> 修改的组件能被之后的 Changed<T> 遍历到, Read<T> 不记录修改.
+    TEST_CASE(world_write_marks_changed)
+    {
+        constexpr uint32_t entity_num = 5000;
+
+        World world;
+        for (uint32_t ix = 0; ix < entity_num; ++ix)
+        {
+            Entity* entity = world.create_entity();
+            entity->assign<TestPosition>();
+            if (ix % 2 == 0) entity->assign<TestVelocity>(TestVelocity{ 1.0f });
+        }
+
+        auto get_changed_num = [&](uint32_t last_tick)
+        {
+            uint32_t changed_num = 0;
+            world.each<Changed<TestPosition>>([&](Entity*, TestPosition*) { changed_num++; return true; }, last_tick);
+            return changed_num;
+        };
+
+        uint32_t last_tick = world.advance_change_tick();
+        CHECK(get_changed_num(0) == entity_num);
+        CHECK(get_changed_num(last_tick) == 0);
+
+        float sum = 0.0f;
+        world.each<Read<TestPosition>>([&](Entity*, const TestPosition* position) { sum += position->x; return true; });
+        world.parallel_each<Read<TestPosition>>([&](Entity*, const TestPosition*) { return true; });
+        CHECK(get_changed_num(last_tick) == 0);
+
+        // 只有带 TestVelocity 的一半实体被修改.
+        world.each<Write<TestPosition>, Read<TestVelocity>>(
+            [](Entity*, TestPosition* position, const TestVelocity* velocity) { position->x += velocity->x; return true; }
+        );
+        CHECK(get_changed_num(last_tick) == entity_num / 2);
+
+        last_tick = world.advance_change_tick();
+        CHECK(get_changed_num(last_tick) == 0);
+        CHECK(world.parallel_each<Write<TestPosition>>([](Entity*, TestPosition* position) { position->x += 1.0f; return true; }));
+        CHECK(get_changed_num(last_tick) == entity_num);
+
+        // 在遍历 Changed<T> 时修改的组件使用更大的 tick, 下一次遍历能看到.
+        last_tick = world.advance_change_tick();
+        world.parallel_each<Write<TestPosition>, Read<TestVelocity>>([](Entity*, TestPosition*, const TestVelocity*) { return true; });
+        const uint32_t tick = world.advance_change_tick();
+        uint32_t visited_num = 0;
+        world.each<Changed<TestPosition>, Write<TestPosition>>(
+            [&](Entity*, TestPosition*, TestPosition*) { visited_num++; return true; }, 
+            last_tick
+        );
+        CHECK(visited_num == entity_num / 2);
+        CHECK(get_changed_num(tick) == entity_num / 2);
+        CHECK(sum == 0.0f);
+    }
+
+    // 实体销毁后旧句柄失效, 复用的 slot 的 generation 加一.
+    TEST_CASE(world_generational_handle)
+    {
+        World world;
+        Entity* entity = world.create_entity();
+        entity->assign<TestPosition>(TestPosition{ 1.0f });
+        const EntityHandle handle = entity->get_handle();
+        const EntityHandle32 handle32 = entity->get_handle<EntityHandle32>();
+        CHECK(world.get_entity(handle) == entity && world.get_entity(handle32) == entity);
+        CHECK(world.is_alive(handle));
+
+        // 延迟销毁在 cleanup 之前仍然能通过句柄找到.
+        CHECK(world.destroy_entity(handle));
+        CHECK(world.get_entity(handle) == entity && entity->is_pending_destroy());
+        world.cleanup();
+        CHECK(world.get_entity(handle) == nullptr && world.get_entity(handle32) == nullptr);
+        CHECK(!world.is_alive(handle) && !world.destroy_entity(handle));
+
+        // 空闲链表优先复用刚释放的 slot.
+        Entity* reused = world.create_entity();
+        const EntityHandle reused_handle = reused->get_handle();
+        CHECK(reused_handle.get_index() == handle.get_index());
+        CHECK(reused_handle.get_generation() == handle.get_generation() + 1);
+        CHECK(world.get_entity(handle) == nullptr && world.get_entity(reused_handle) == reused);
+        CHECK(!reused->contain<TestPosition>());
+
+        // 立即销毁, 旧句柄同样失效, 之后的 cleanup 跳过已经过期的句柄.
+        CHECK(world.destroy_entity(reused));
+        CHECK(world.destroy_entity(reused, true));
+        CHECK(world.get_entity(reused_handle) == nullptr);
+        world.cleanup();
+
+        // EntityHandle32 只有 12 位 generation, 比较时只取低位.
+        Entity* last = nullptr;
+        for (uint32_t ix = 0; ix < 5000; ++ix)
+        {
+            if (last) world.destroy_entity(last, true);
+            last = world.create_entity();
+            CHECK(last->get_handle().get_index() == handle.get_index());
+        }
+        CHECK(last->get_handle().get_generation() == handle.get_generation() + 5001);
+        CHECK(world.get_entity(last->get_handle<EntityHandle32>()) == last);
+        CHECK(world.get_entity(last->get_handle()) == last);
+
+        CHECK(world.get_entity(EntityHandle()) == nullptr);
+        CHECK(world.get_entity(EntityHandle(1000000, 0)) == nullptr);
+    }
+
+    // create_entity_delay 创建的实体在 add_delay_entity 之前只能通过 include_delay 找到, 也不会被遍历到.
+    TEST_CASE(world_generational_handle_delay)
+    {
+        World world;
+        Entity* entity = world.create_entity_delay();
+        entity->assign<TestPosition>(TestPosition{ 2.0f });
+        const EntityHandle handle = entity->get_handle();
+
+        CHECK(world.get_entity(handle) == nullptr && !world.is_alive(handle));
+        CHECK(world.get_entity(handle, true) == entity);
+        CHECK(world.get_entity(entity->get_handle<EntityHandle32>(), true) == entity);
+
+        uint32_t count = 0;
+        world.each<TestPosition>([&](Entity*, TestPosition*) { count++; return true; });
+        CHECK(count == 0);
+
+        // 先创建的延迟实体占用 slot, 之后创建的实体不会复用它.
+        Entity* other = world.create_entity();
+        CHECK(other->get_handle().get_index() != handle.get_index());
+
+        world.add_delay_entity(entity);
+        CHECK(world.get_entity(handle) == entity && world.get_entity(handle, true) == entity);
+        world.each<TestPosition>([&](Entity*, TestPosition* position) { count++; return position->x == 2.0f; });
+        CHECK(count == 1);
+
+        // 过期的句柄即使 include_delay 也找不到.
+        CHECK(world.destroy_entity(entity, true));
+        Entity* reused = world.create_entity_delay();
+        CHECK(reused->get_handle().get_index() == handle.get_index());
+        CHECK(world.get_entity(handle, true) == nullptr);
+        CHECK(world.get_entity(reused->get_handle(), true) == reused);
+        world.add_delay_entity(reused);
+    }
+
+    // tick 时调用 func, 访问声明由构造时传入.
+    struct TestSystem : public EntitySystemInterface
+    {
+        SystemAccess access;
+        std::function<void()> func;
+
+        TestSystem(const SystemAccess& access_, std::function<void()> func_) : access(access_), func(std::move(func_)) {}
+
+        bool initialize(World*) override { return true; }
+        bool destroy() override { return true; }
+        bool tick(float) override { func(); return true; }
+        SystemAccess get_access() const override { return access; }
+    };
+
+    // 记录每个 system 开始和结束的顺序.
+    struct SystemScheduleLog
+    {
+        std::mutex mutex;
+        std::vector<std::pair<uint32_t, bool>> events;
+
+        void record(uint32_t system, bool begin)
+        {
+            std::lock_guard lock(mutex);
+            events.emplace_back(system, begin);
+        }
+
+        uint32_t find(uint32_t system, bool begin) const
+        {
+            for (uint32_t ix = 0; ix < events.size(); ++ix)
+            {
+                if (events[ix] == std::make_pair(system, begin)) return ix;
+            }
+            return INVALID_SIZE_32;
+        }
+    };
+
+    // 互相冲突的 system 按注册顺序串行执行, 不冲突的 system 在同一批中并行执行, 独占的 system 单独作为一个阶段.
+    TEST_CASE(world_system_schedule)
+    {
+        World world;
+        SystemScheduleLog log;
+        std::atomic<uint32_t> arrived_num = 0;
+        std::atomic<uint32_t> met_num = 0;
+
+        auto timed_system = [&](uint32_t index)
+        {
+            return [&, index]()
+            {
+                log.record(index, true);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                log.record(index, false);
+            };
+        };
+
+        // 2 和 3 只读 TestVelocity, 互相等待对方开始, 串行执行时会超时.
+        auto barrier_system = [&](uint32_t index)
+        {
+            return [&, index]()
+            {
+                log.record(index, true);
+                arrived_num++;
+                Timer timer;
+                while (arrived_num.load() < 2 && timer.elapsed() < 5.0f) std::this_thread::yield();
+                if (arrived_num.load() >= 2) met_num++;
+                log.record(index, false);
+            };
+        };
+
+        world.register_system(new TestSystem(SystemAccess::create<Write<TestPosition>>(), timed_system(0)));
+        world.register_system(new TestSystem(SystemAccess::create<Read<TestPosition>>(), timed_system(1)));
+        world.register_system(new TestSystem(SystemAccess::create<Read<TestVelocity>>(), barrier_system(2)));
+        world.register_system(new TestSystem(SystemAccess::create<Read<TestVelocity>>(), barrier_system(3)));
+        world.register_system(new TestSystem(SystemAccess{ .exclusive = true }, timed_system(4)));
+        world.register_system(new TestSystem(SystemAccess::create<Write<TestPosition>>(), timed_system(5)));
+
+        CHECK(parallel::get_thread_pool() != nullptr);
+        CHECK(world.tick(0.0f));
+        CHECK(log.events.size() == 12);
+
+        // 写后读冲突: 1 在 0 结束之后开始.
+        CHECK(log.find(0, false) < log.find(1, true));
+
+        // 只读同一组件不冲突, 两者同时执行.
+        CHECK(met_num.load() == 2);
+
+        // 独占的 system 在之前的批次全部结束后开始, 之后的批次在它结束后开始.
+        for (uint32_t system = 0; system < 4; ++system) CHECK(log.find(system, false) < log.find(4, true));
+        CHECK(log.find(4, false) < log.find(5, true));
+    }
+
+    // system 中的 parallel_each 只能访问 get_access() 中声明的组件, Write 包含 Read. 没有线程池时串行执行也同样检查.
+    TEST_CASE(world_system_access_check)
+    {
+        World world;
+        for (uint32_t ix = 0; ix < 100; ++ix)
+        {
+            Entity* entity = world.create_entity();
+            entity->assign<TestPosition>();
+            entity->assign<TestVelocity>();
+        }
+
+        auto noop = [](Entity*, auto*...) { return true; };
+        std::vector<bool> results;
+        std::mutex mutex;
+        auto record = [&](bool result)
+        {
+            std::lock_guard lock(mutex);
+            results.push_back(result);
+        };
+
+        world.register_system(new TestSystem(
+            SystemAccess::create<Read<TestPosition>>(),
+            [&]()
+            {
+                record(world.parallel_each<Read<TestPosition>>(noop));
+                record(!world.parallel_each<Write<TestPosition>>(noop));
+                record(!world.parallel_each<Read<TestPosition>, Read<TestVelocity>>(noop));
+            }
+        ));
+        world.register_system(new TestSystem(
+            SystemAccess::create<Write<TestPosition>, Read<TestVelocity>>(),
+            [&]()
+            {
+                record(world.parallel_each<Read<TestPosition>>(noop));
+                record(world.parallel_each<Write<TestPosition>, Read<TestVelocity>>(noop));
+                record(!world.parallel_each<Write<TestVelocity>>(noop));
+            }
+        ));
+
+        // 独占的 system 和 system 之外的调用不受限制.
+        world.register_system(new TestSystem(
+            SystemAccess{ .exclusive = true },
+            [&]() { record(world.parallel_each<Write<TestPosition>, Write<TestVelocity>>(noop)); }
+        ));
+        CHECK(world.parallel_each<Write<TestVelocity>>(noop));
+
+        CHECK(world.tick(0.0f));
+        CHECK(results.size() == 7);
+        for (bool result : results) CHECK(result);
+
+        results.clear();
+        parallel::destroy();
+        CHECK(world.tick(0.0f));
+        parallel::initialize();
+        CHECK(results.size() == 7);
+        for (bool result : results) CHECK(result);
+    }
+
+    // 原来的 each: 遍历所有 slot, 逐个实体通过 std::function 调用, 组件用 get_component 查找.
+    template <typename... ComponentTypes>
+    static bool each_per_entity(World& world, const std::type_identity_t<std::function<bool(Entity*, ComponentTypes*...)>>& func)
+    {
+        for (Entity* entity : world.get_entity_view<ComponentTypes...>())
+        {
+            if (!func(entity, entity->template get_component<ComponentTypes>()...)) return false;
+        }
+        return true;
+    }
+
+    // 1K 到 1M 个实体时 each<Write<T>, Read<U>> 按 Archetype chunk 遍历与逐个实体遍历每个实体的耗时.
+    // 另有 1/4 的实体只有 TestPosition, 位于另一个 Archetype, 两种遍历都需要跳过.
+    BENCHMARK_CASE(world_each_archetype_iteration)
+    {
+        for (uint32_t entity_num : { 1000u, 10000u, 100000u, 1000000u })
+        {
+            World world;
+            for (uint32_t ix = 0; ix < entity_num; ++ix)
+            {
+                Entity* entity = world.create_entity();
+                entity->assign<TestPosition>();
+                entity->assign<TestVelocity>(TestVelocity{ 1.0f });
+                if (ix % 3 == 0) world.create_entity()->assign<TestPosition>();
+            }
+
+            const uint32_t round_num = std::max(3u, 4000000u / entity_num);
+            Timer timer;
+            for (uint32_t round = 0; round < round_num; ++round)
+            {
+                world.each<Write<TestPosition>, Read<TestVelocity>>(
+                    [](Entity*, TestPosition* position, const TestVelocity* velocity) { position->x += velocity->x; return true; }
+                );
+            }
+            const float each_time = timer.tick();
+            for (uint32_t round = 0; round < round_num; ++round)
+            {
+                each_per_entity<TestPosition, TestVelocity>(
+                    world, 
+                    [](Entity*, TestPosition* position, TestVelocity* velocity) { position->x += velocity->x; return true; }
+                );
+            }
+            const float per_entity_time = timer.tick();
+
+            float sum = 0.0f;
+            world.each<Read<TestPosition>>([&](Entity*, const TestPosition* position) { sum += position->x; return true; });
+            CHECK(sum == static_cast<float>(entity_num) * round_num * 2.0f);
+
+            const uint64_t visit_num = uint64_t(entity_num) * round_num;
+            std::printf(
+                "    %7u entities: each %6.2f ns, per entity %6.2f ns, %.1fx\n",
+                entity_num, each_time / visit_num * 1e9f, per_entity_time / visit_num * 1e9f, per_entity_time / each_time
+            );
+        }
+    }
+
+    // 1M 个实体中修改 0.1%, 1%, 10%, 100% 后, each<Changed<T>> 与遍历全部实体的 each 的耗时.
+    // 连续修改时没有变化的 chunk 整体跳过, 耗时与修改的数量成正比; 分散修改时每个 chunk 都要逐行检查 tick.
+    BENCHMARK_CASE(world_changed_iteration_scaling)
+    {
+        constexpr uint32_t entity_num = 1000000;
+
+        World world;
+        std::vector<Entity*> entities(entity_num);
+        for (auto& entity : entities)
+        {
+            entity = world.create_entity();
+            entity->assign<TestPosition>();
+        }
+
+        // 预热一次, 取之后 3 次的平均.
+        float sum = 0.0f;
+        auto full_each = [&]() { world.each<Read<TestPosition>>([&](Entity*, const TestPosition* position) { sum += position->x; return true; }); };
+        full_each();
+        Timer timer;
+        for (uint32_t round = 0; round < 3; ++round) full_each();
+        const float full_time = timer.elapsed() / 3;
+        std::printf("    full each: %.2f ms\n", full_time * 1e3f);
+
+        for (uint32_t changed_num : { entity_num / 1000, entity_num / 100, entity_num / 10, entity_num })
+        {
+            for (bool scattered : { false, true })
+            {
+                const uint32_t last_tick = world.advance_change_tick();
+                const uint32_t stride = scattered ? entity_num / changed_num : 1;
+                for (uint32_t ix = 0; ix < changed_num; ++ix) entities[ix * stride]->mark_changed<TestPosition>();
+
+                uint32_t visited_num = 0;
+                timer.tick();
+                world.each<Changed<TestPosition>>([&](Entity*, TestPosition* position) { sum += position->x; visited_num++; return true; }, last_tick);
+                const float changed_time = timer.tick();
+                CHECK(visited_num == changed_num);
+
+                std::printf(
+                    "    %7u changed (%5.1f%%, %s): %8.3f ms, %5.1f%% of full each\n",
+                    changed_num, 100.0f * changed_num / entity_num, scattered ? "scattered " : "contiguous",
+                    changed_time * 1e3f, 100.0f * changed_time / full_time
+                );
+                if (changed_num == entity_num) break;
+            }
+        }
+        CHECK(sum == 0.0f);
+    }
+
+    struct BenchmarkEvent
+    {
+        uint32_t value = 0;
+    };
+
+    struct BenchmarkEventSubscriber : public EventSubscriber<BenchmarkEvent>
+    {
+        uint64_t sum = 0;
+
+        bool publish(World*, const BenchmarkEvent& event) override
+        {
+            sum += event.value;
+            return true;
+        }
+    };
+
+    // publish 的单线程和多线程开销, flush 每个事件的开销, 与同步 broadcast 对比.
+    BENCHMARK_CASE(world_event_publish_and_flush)
+    {
+        constexpr uint32_t event_num = 1 << 20;
+
+        World world;
+        BenchmarkEventSubscriber subscriber;
+        world.subscribe<BenchmarkEvent>(&subscriber);
+
+        // 第一轮让队列分配好块, 之后的轮次不再分配内存.
+        for (uint32_t round = 0; round < 2; ++round)
+        {
+            Timer timer;
+            for (uint32_t ix = 0; ix < event_num; ++ix) world.publish(BenchmarkEvent{ ix });
+            const float publish_time = timer.elapsed();
+
+            Timer flush_timer;
+            world.flush_events();
+            const float flush_time = flush_timer.elapsed();
+
+            std::printf(
+                "    round %u, 1 producer: publish %.1f ns, flush %.1f ns per event\n",
+                round, publish_time / event_num * 1e9f, flush_time / event_num * 1e9f
+            );
+        }
+
+        for (uint32_t producer_num : { 2u, 4u, 8u })
+        {
+            Timer timer;
+            std::vector<std::thread> producers;
+            for (uint32_t producer = 0; producer < producer_num; ++producer)
+            {
+                producers.emplace_back(
+                    [&]()
+                    {
+                        for (uint32_t ix = 0; ix < event_num / producer_num; ++ix) world.publish(BenchmarkEvent{ ix });
+                    }
+                );
+            }
+            for (auto& producer : producers) producer.join();
+            const float publish_time = timer.elapsed();
+            world.flush_events();
+
+            std::printf("    %u producers: publish %.1f ns per event\n", producer_num, publish_time / event_num * 1e9f);
+        }
+
+        Timer timer;
+        for (uint32_t ix = 0; ix < event_num; ++ix) world.broadcast(BenchmarkEvent{ ix });
+        std::printf("    broadcast: %.1f ns per event (sum %llu)\n", timer.elapsed() / event_num * 1e9f, static_cast<unsigned long long>(subscriber.sum));
+    }
+}
@@ -0,0 +1,486 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../core/tools/file.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    static std::string get_test_file_name(const char* name)
+    {
+        return (std::filesystem::temp_directory_path() / name).string();
+    }
+
+    // 修改文件中一个字节.
+    static void flip_file_byte(const std::string& file_name, uint64_t offset)
+    {
+        std::fstream file(file_name, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(static_cast<std::streamoff>(offset));
+        char value = 0;
+        file.read(&value, 1);
+        value = static_cast<char>(value ^ 0x5a);
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(&value, 1);
+    }
+
+    // 写入两个 chunk 并返回第二个 chunk 的数据在文件中的位置.
+    static uint64_t write_two_chunk_archive(const std::string& file_name, const std::vector<float>& data0, const std::vector<float>& data1)
+    {
+        serialization::BinaryOutput output(file_name, 1, 2);
+        output.begin_chunk(serialization::make_chunk_tag('T', 'S', 'T', '0'));
+        output(data0);
+        output.begin_chunk(serialization::make_chunk_tag('T', 'S', 'T', '1'));
+        output(data1);
+        output.finish();
+
+        const uint64_t chunk0_end = sizeof(serialization::ArchiveHeader) + sizeof(serialization::ChunkHeader) +
+                                    sizeof(uint64_t) + data0.size() * sizeof(float);
+        const uint64_t chunk1_begin = (chunk0_end + serialization::chunk_alignment - 1) & ~(serialization::chunk_alignment - 1);
+        return chunk1_begin + sizeof(serialization::ChunkHeader);
+    }
+
+    struct TestArchiveElement
+    {
+        uint32_t id = 0;
+        float value = 0.0f;
+        double weight = 0.0;
+
+        bool operator==(const TestArchiveElement&) const = default;
+    };
+
+    // 各种类型写入后原样读出, 按 tag 和按顺序定位 chunk 都能读到对应的数据.
+    TEST_CASE(binary_archive_round_trip)
+    {
+        const std::string file_name = get_test_file_name("fantasy_round_trip.bin");
+
+        const uint32_t u32_value = 0x12345678u;
+        const double f64_value = 3.25;
+        const std::string string_value = "fantasy";
+        const std::vector<TestArchiveElement> elements = { { 1, 2.0f, 3.0 }, { 4, 5.0f, 6.0 }, { 7, 8.0f, 9.0 } };
+        const std::vector<std::string> strings = { "a", "", "bcd" };
+        const std::vector<std::pair<uint32_t, float>> pairs = { { 1, 0.5f }, { 2, 1.5f } };
+        std::vector<uint8_t> bytes(4097);
+        for (uint32_t ix = 0; ix < bytes.size(); ++ix) bytes[ix] = static_cast<uint8_t>(ix * 7);
+
+        {
+            serialization::BinaryOutput output(file_name, 3, serialization::hash_parameters(64u, 1.0f));
+            output(u32_value, f64_value, string_value);
+            output.begin_chunk(serialization::make_chunk_tag('E', 'L', 'E', 'M'));
+            output(elements, strings, pairs);
+            output.begin_chunk(serialization::make_chunk_tag('B', 'Y', 'T', 'E'));
+            output.save_binary_data(bytes.data(), bytes.size(), serialization::chunk_alignment);
+            CHECK(output.finish());
+        }
+        CHECK(!std::filesystem::exists(file_name + ".tmp"));
+
+        serialization::BinaryInput input(file_name, 3, serialization::hash_parameters(64u, 1.0f));
+        CHECK(input.good());
+
+        uint32_t u32_result = 0;
+        double f64_result = 0.0;
+        std::string string_result;
+        input(u32_result, f64_result, string_result);
+        CHECK(u32_result == u32_value && f64_result == f64_value && string_result == string_value);
+
+        // 先跳到最后一个 chunk, 再按 tag 回到中间的 chunk.
+        CHECK(input.open_chunk(serialization::make_chunk_tag('B', 'Y', 'T', 'E')));
+        const uint8_t* byte_data = input.read_bytes(bytes.size(), serialization::chunk_alignment);
+        CHECK(byte_data != nullptr);
+        CHECK(byte_data && reinterpret_cast<uintptr_t>(byte_data) % serialization::chunk_alignment == 0);
+        CHECK(byte_data && std::equal(bytes.begin(), bytes.end(), byte_data));
+        CHECK(!input.next_chunk());
+
+        CHECK(input.open_chunk(serialization::make_chunk_tag('E', 'L', 'E', 'M')));
+        std::span<const TestArchiveElement> element_result;
+        std::vector<std::string> strings_result;
+        std::vector<std::pair<uint32_t, float>> pairs_result;
+        input(element_result, strings_result, pairs_result);
+        CHECK(std::equal(elements.begin(), elements.end(), element_result.begin(), element_result.end()));
+        CHECK(strings_result == strings && pairs_result == pairs);
+        CHECK(!input.open_chunk(serialization::make_chunk_tag('N', 'O', 'N', 'E')));
+        CHECK(input.good());
+
+        // 读取越过 chunk 末尾时失败, 之后的读取都返回 0.
+        uint64_t overflow = 1;
+        input(overflow);
+        CHECK(!input.good() && overflow == 0);
+
+        // 版本或构建参数不同时缓存无效.
+        CHECK(!serialization::BinaryInput(file_name, 4, serialization::hash_parameters(64u, 1.0f)).is_valid());
+        CHECK(!serialization::BinaryInput(file_name, 3, serialization::hash_parameters(32u, 1.0f)).is_valid());
+
+        std::filesystem::remove(file_name);
+    }
+
+    // 文件被修改时, 打开或读取失败, 不会返回错误的数据.
+    TEST_CASE(binary_archive_corruption)
+    {
+        const std::string file_name = get_test_file_name("fantasy_corruption.bin");
+        std::vector<float> data0(1000, 1.0f);
+        std::vector<float> data1(1000, 2.0f);
+        const uint64_t data1_offset = write_two_chunk_archive(file_name, data0, data1);
+        const uint64_t file_size = std::filesystem::file_size(file_name);
+
+        uint32_t wrong_data_num = 0;
+        uint32_t detected_num = 0;
+        uint32_t flip_num = 0;
+        for (uint64_t offset = 0; offset < file_size; offset += 13)
+        {
+            write_two_chunk_archive(file_name, data0, data1);
+            flip_file_byte(file_name, offset);
+            flip_num++;
+
+            serialization::BinaryInput input(file_name, 1, 2);
+            std::vector<float> result0;
+            std::vector<float> result1;
+            input(result0);
+            input.next_chunk();
+            input(result1);
+            if (input.good() && (result0 != data0 || result1 != data1)) wrong_data_num++;
+            if (!input.good()) detected_num++;
+        }
+        CHECK(wrong_data_num == 0);
+
+        // 只有 ArchiveHeader 的保留字节和 chunk 之间的对齐填充不受校验, 它们不影响读出的数据.
+        CHECK(detected_num + 2 >= flip_num);
+
+        // 只修改 chunk 头也会在打开时检测到.
+        write_two_chunk_archive(file_name, data0, data1);
+        flip_file_byte(file_name, data1_offset - sizeof(serialization::ChunkHeader) + offsetof(serialization::ChunkHeader, checksum));
+        CHECK(!serialization::BinaryInput(file_name, 1, 2).is_valid());
+
+        std::filesystem::remove(file_name);
+    }
+
+    // 文件被截断到任何长度时都视为无效.
+    TEST_CASE(binary_archive_truncation)
+    {
+        const std::string file_name = get_test_file_name("fantasy_truncation.bin");
+        std::vector<float> data0(1000, 1.0f);
+        std::vector<float> data1(1000, 2.0f);
+        write_two_chunk_archive(file_name, data0, data1);
+        const uint64_t file_size = std::filesystem::file_size(file_name);
+
+        uint32_t valid_num = 0;
+        for (uint64_t size = 0; size < file_size; size += 61)
+        {
+            write_two_chunk_archive(file_name, data0, data1);
+            std::filesystem::resize_file(file_name, size);
+            if (serialization::BinaryInput(file_name, 1, 2).is_valid()) valid_num++;
+        }
+        CHECK(valid_num == 0);
+
+        // 在末尾追加数据同样无效.
+        write_two_chunk_archive(file_name, data0, data1);
+        std::filesystem::resize_file(file_name, file_size + 16);
+        CHECK(!serialization::BinaryInput(file_name, 1, 2).is_valid());
+
+        std::filesystem::remove(file_name);
+    }
+
+    // 持有旧文件的映射时重新生成缓存, 新文件替换旧文件, 旧映射中的数据不变.
+    TEST_CASE(binary_archive_rewrite_while_mapped)
+    {
+        const std::string file_name = get_test_file_name("fantasy_rewrite.bin");
+        std::vector<float> data0(1000, 1.0f);
+        std::vector<float> data1(1000, 2.0f);
+        write_two_chunk_archive(file_name, data0, data1);
+
+        serialization::BinaryInput old_input(file_name, 1, 2);
+        std::span<const float> old_data;
+        old_input(old_data);
+        std::shared_ptr<serialization::MappedFile> old_file = old_input.get_file();
+
+        std::vector<float> new_data0(1000, 3.0f);
+        write_two_chunk_archive(file_name, new_data0, data1);
+
+        serialization::BinaryInput new_input(file_name, 1, 2);
+        std::vector<float> result;
+        new_input(result);
+        CHECK(new_input.good() && result == new_data0);
+        CHECK(std::equal(data0.begin(), data0.end(), old_data.begin(), old_data.end()));
+
+        std::filesystem::remove(file_name);
+    }
+
+    // chunk 数据只在第一次读取时校验: 损坏的 chunk 不影响打开文件和读取其它 chunk, Full 模式在打开时拒绝文件.
+    TEST_CASE(binary_archive_lazy_chunk_checksum)
+    {
+        const std::string file_name = get_test_file_name("fantasy_lazy_checksum.bin");
+        std::vector<float> data0(1000, 1.0f);
+        std::vector<float> data1(1000, 2.0f);
+        const uint64_t data1_offset = write_two_chunk_archive(file_name, data0, data1);
+
+        {
+            serialization::BinaryInput input(file_name, 1, 2, serialization::ChecksumMode::Full);
+            CHECK(input.good());
+        }
+
+        flip_file_byte(file_name, data1_offset + 100);
+
+        {
+            serialization::BinaryInput input(file_name, 1, 2);
+            CHECK(input.is_valid());
+
+            std::vector<float> result0;
+            input(result0);
+            CHECK(input.good() && result0 == data0);
+
+            CHECK(input.next_chunk());
+            std::vector<float> result1;
+            input(result1);
+            CHECK(!input.good() && result1.empty());
+        }
+
+        {
+            serialization::BinaryInput input(file_name, 1, 2, serialization::ChecksumMode::Full);
+            CHECK(!input.is_valid());
+        }
+
+        std::filesystem::remove(file_name);
+    }
+
+    // 没有调用 finish 就析构时丢弃数据, 已有的缓存不变, 不存在的缓存也不会被创建.
+    TEST_CASE(binary_archive_discard_without_finish)
+    {
+        const std::string file_name = get_test_file_name("fantasy_discard.bin");
+        std::filesystem::remove(file_name);
+        {
+            serialization::BinaryOutput output(file_name);
+            output(std::vector<float>(100, 1.0f));
+        }
+        CHECK(!std::filesystem::exists(file_name));
+        CHECK(!std::filesystem::exists(file_name + ".tmp"));
+
+        const std::vector<float> data = { 1.0f, 2.0f, 3.0f };
+        {
+            serialization::BinaryOutput output(file_name, 1);
+            output(data);
+            CHECK(output.finish());
+            CHECK(output.finish());
+        }
+        {
+            serialization::BinaryOutput output(file_name, 2);
+            output(std::vector<float>(100, 4.0f));
+        }
+        CHECK(!std::filesystem::exists(file_name + ".tmp"));
+
+        serialization::BinaryInput input(file_name, 1);
+        std::vector<float> loaded;
+        input(loaded);
+        CHECK(input.good() && loaded == data);
+        CHECK(!serialization::BinaryInput(file_name, 2).is_valid());
+
+        std::filesystem::remove(file_name);
+    }
+
+    // 原来的格式: 每个值单独写入并在后面加一个换行符, 数组逐个元素读写, 没有 checksum.
+    class LegacyBinaryOutput
+    {
+    public:
+        explicit LegacyBinaryOutput(const std::string& file_name) : _output(file_name, std::ios::binary) {}
+
+        void save_binary_data(const void* data, int64_t size)
+        {
+            _output.write(static_cast<const char*>(data), size);
+            _output.write("\n", 1);
+        }
+
+        void process(float value) { save_binary_data(&value, sizeof(float)); }
+        void process(uint64_t value) { save_binary_data(&value, sizeof(uint64_t)); }
+        void process(const std::vector<float>& value)
+        {
+            process(static_cast<uint64_t>(value.size()));
+            for (float element : value) process(element);
+        }
+
+    private:
+        std::ofstream _output;
+    };
+
+    class LegacyBinaryInput
+    {
+    public:
+        explicit LegacyBinaryInput(const std::string& file_name) : _input(file_name, std::ios::binary) {}
+
+        void load_binary_data(void* out_data, int64_t size)
+        {
+            _input.read(static_cast<char*>(out_data), size);
+            char new_line;
+            _input.read(&new_line, 1);
+        }
+
+        void process(float& value) { load_binary_data(&value, sizeof(float)); }
+        void process(uint64_t& value) { load_binary_data(&value, sizeof(uint64_t)); }
+        void process(std::vector<float>& out)
+        {
+            uint64_t size = 0;
+            process(size);
+            out.resize(size);
+            for (float& element : out) process(element);
+        }
+
+        bool good() const { return _input.good(); }
+
+    private:
+        std::ifstream _input;
+    };
+
+    // 与 SDF 缓存相同的布局: 16 个 mesh, 每个 mesh 一个包围盒和 64^3 个 float.
+    // 原来的格式每个 float 两次 ifstream::read, 新格式每个 mesh 一个 chunk, 整块复制或直接返回映射中的数据.
+    BENCHMARK_CASE(binary_archive_load_legacy_format)
+    {
+        const std::string legacy_file_name = get_test_file_name("fantasy_legacy_benchmark.bin");
+        const std::string file_name = get_test_file_name("fantasy_archive_benchmark.bin");
+        constexpr uint32_t mesh_num = 16;
+        constexpr uint64_t sdf_size = 64 * 64 * 64;
+
+        std::vector<std::vector<float>> sdfs(mesh_num, std::vector<float>(sdf_size));
+        for (uint32_t mesh = 0; mesh < mesh_num; ++mesh)
+        {
+            for (uint64_t ix = 0; ix < sdf_size; ++ix) sdfs[mesh][ix] = static_cast<float>(mesh * 1000 + ix % 1000);
+        }
+        const float box[6] = { -1.0f, -2.0f, -3.0f, 1.0f, 2.0f, 3.0f };
+
+        Timer timer;
+        {
+            LegacyBinaryOutput output(legacy_file_name);
+            output.process(static_cast<uint64_t>(mesh_num));
+            for (const auto& sdf : sdfs)
+            {
+                for (float value : box) output.process(value);
+                output.process(sdf);
+            }
+        }
+        const float legacy_save_time = timer.tick();
+        {
+            serialization::BinaryOutput output(file_name);
+            output(static_cast<uint64_t>(mesh_num));
+            for (const auto& sdf : sdfs)
+            {
+                output.begin_chunk(serialization::make_chunk_tag('M', 'S', 'D', 'F'));
+                output(box);
+                output(sdf);
+            }
+            output.finish();
+        }
+        const float save_time = timer.tick();
+
+        // 各读一次预热文件缓存.
+        auto load_legacy = [&]()
+        {
+            LegacyBinaryInput input(legacy_file_name);
+            uint64_t loaded_mesh_num = 0;
+            input.process(loaded_mesh_num);
+
+            double sum = 0.0;
+            std::vector<float> sdf;
+            for (uint64_t mesh = 0; mesh < loaded_mesh_num; ++mesh)
+            {
+                float loaded_box[6];
+                for (float& value : loaded_box) input.process(value);
+                input.process(sdf);
+                sum += sdf.back() + loaded_box[0];
+            }
+            return input.good() ? sum : -1.0;
+        };
+        auto load = [&](bool zero_copy)
+        {
+            serialization::BinaryInput input(file_name);
+            uint64_t loaded_mesh_num = 0;
+            input(loaded_mesh_num);
+
+            double sum = 0.0;
+            std::vector<float> sdf;
+            std::span<const float> sdf_span;
+            for (uint64_t mesh = 0; mesh < loaded_mesh_num; ++mesh)
+            {
+                input.next_chunk();
+                float loaded_box[6];
+                input(loaded_box);
+                if (zero_copy) input(sdf_span);
+                else input(sdf);
+                if (!input.good()) return -1.0;
+                sum += (zero_copy ? sdf_span.back() : sdf.back()) + loaded_box[0];
+            }
+            return input.good() ? sum : -1.0;
+        };
+
+        const double expected = load_legacy();
+        CHECK(expected > 0.0 && load(false) == expected && load(true) == expected);
+
+        timer.tick();
+        load_legacy();
+        const float legacy_load_time = timer.tick();
+        load(false);
+        const float load_time = timer.tick();
+        load(true);
+        const float span_load_time = timer.tick();
+
+        std::printf(
+            "    %.1f MB, save: legacy %.2f ms, archive %.2f ms\n",
+            static_cast<double>(std::filesystem::file_size(file_name)) / (1 << 20), legacy_save_time * 1e3f, save_time * 1e3f
+        );
+        std::printf(
+            "    load: legacy %.2f ms, archive (vector) %.2f ms, %.1fx, archive (span) %.2f ms, %.1fx\n",
+            legacy_load_time * 1e3f, load_time * 1e3f, legacy_load_time / load_time, span_load_time * 1e3f, legacy_load_time / span_load_time
+        );
+
+        std::filesystem::remove(legacy_file_name);
+        std::filesystem::remove(file_name);
+    }
+
+    // 每个 chunk 16 MB, 只读取第一个 chunk 与读取所有 chunk 的耗时, 与 ifstream 读入内存对比.
+    BENCHMARK_CASE(binary_archive_load)
+    {
+        const std::string file_name = get_test_file_name("fantasy_load_benchmark.bin");
+        constexpr uint32_t chunk_num = 16;
+        constexpr uint64_t chunk_size = 16ull << 20;
+
+        {
+            std::vector<uint8_t> data(chunk_size);
+            serialization::BinaryOutput output(file_name);
+            for (uint32_t ix = 0; ix < chunk_num; ++ix)
+            {
+                std::fill(data.begin(), data.end(), static_cast<uint8_t>(ix));
+                output.begin_chunk(serialization::make_chunk_tag('B', 'E', 'N', 'C'));
+                output.save_binary_data(data.data(), data.size(), serialization::chunk_alignment);
+            }
+            output.finish();
+        }
+
+        auto measure = [&](const char* name, serialization::ChecksumMode checksum_mode, uint32_t read_chunk_num)
+        {
+            Timer timer;
+            serialization::BinaryInput input(file_name, 0, 0, checksum_mode);
+            uint64_t sum = 0;
+            for (uint32_t ix = 0; ix < read_chunk_num; ++ix)
+            {
+                if (ix > 0) input.next_chunk();
+                const uint8_t* data = input.read_bytes(chunk_size, serialization::chunk_alignment);
+                if (data) sum += data[chunk_size - 1];
+            }
+            std::printf("    %s: %.2f ms (good %d, sum %llu)\n", name, timer.elapsed() * 1e3f, input.good(), static_cast<unsigned long long>(sum));
+        };
+
+        measure("lazy, first chunk", serialization::ChecksumMode::Lazy, 1);
+        measure("full, first chunk", serialization::ChecksumMode::Full, 1);
+        measure("lazy, all chunks", serialization::ChecksumMode::Lazy, chunk_num);
+        measure("full, all chunks", serialization::ChecksumMode::Full, chunk_num);
+
+        {
+            Timer timer;
+            std::ifstream file(file_name, std::ios::binary);
+            std::vector<uint8_t> data(std::filesystem::file_size(file_name));
+            file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            std::printf("    ifstream, whole file: %.2f ms\n", timer.elapsed() * 1e3f);
+        }
+
+        std::filesystem::remove(file_name);
+    }
+}
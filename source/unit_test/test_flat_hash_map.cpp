@@ -0,0 +1,158 @@
+#include "unit_test.h"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../core/tools/flat_hash_map.h"
+#include "../core/tools/hash_table.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    // 随机的插入, 删除和查找与 std::unordered_map 逐步比较, 包括删除标记较多时的原容量 rehash.
+    TEST_CASE(flat_hash_map_matches_unordered_map)
+    {
+        FlatHashMap<uint64_t, uint64_t> map;
+        std::unordered_map<uint64_t, uint64_t> reference;
+
+        std::mt19937_64 random(1);
+        for (uint32_t ix = 0; ix < 300000; ++ix)
+        {
+            // 键的范围随时间变化, 表会先增长再大量删除.
+            const uint64_t key_range = ix < 150000 ? 20000 : 2000;
+            const uint64_t key = (random() % key_range) * 0x9e3779b97f4a7c15ull;
+            switch (random() % 4)
+            {
+            case 0:
+            case 1:
+            {
+                const bool inserted = map.try_emplace(key, ix).second;
+                CHECK(inserted == reference.try_emplace(key, ix).second);
+                break;
+            }
+            case 2:
+                CHECK(map.erase(key) == reference.erase(key));
+                break;
+            default:
+            {
+                auto iter = map.find(key);
+                auto reference_iter = reference.find(key);
+                CHECK((iter == map.end()) == (reference_iter == reference.end()));
+                if (iter != map.end()) CHECK(iter->second == reference_iter->second);
+                break;
+            }
+            }
+            CHECK(map.size() == reference.size());
+        }
+
+        uint64_t sum = 0, reference_sum = 0;
+        for (const auto& [key, value] : map) sum += key ^ value;
+        for (const auto& [key, value] : reference) reference_sum += key ^ value;
+        CHECK(sum == reference_sum);
+
+        FlatHashMap<std::string, uint32_t> names;
+        for (uint32_t ix = 0; ix < 1000; ++ix) names[std::to_string(ix)] = ix;
+        CHECK(names.size() == 1000);
+        CHECK(names.at(std::string_view("123")) == 123);
+        CHECK(names.contains("999") && !names.contains("1000"));
+    }
+
+    // FlatHashTable 用 hash >> 7 定位分组, 整数键的哈希值高 32 位也要分布均匀.
+    TEST_CASE(flat_hash_map_hash_bits)
+    {
+        std::unordered_set<uint32_t> high_bits;
+        for (uint32_t key = 0; key < 65536; ++key)
+        {
+            high_bits.insert(static_cast<uint32_t>(MurmurHash<uint32_t>()(key) >> 32));
+        }
+        CHECK(high_bits.size() > 65000);
+
+        high_bits.clear();
+        for (uint64_t key = 0; key < 65536; ++key)
+        {
+            high_bits.insert(static_cast<uint32_t>(MurmurHash<uint64_t>()(key << 32) >> 32));
+        }
+        CHECK(high_bits.size() > 65000);
+    }
+
+    // 原来的 HashTable 只保存下标, 键放在单独的数组中, 查找时沿链表比较键.
+    struct IndexHashTable
+    {
+        HashTable table;
+        std::vector<uint64_t> keys;
+
+        explicit IndexHashTable(uint32_t count) : table(count) { keys.reserve(count); }
+
+        static uint32_t hash_key(uint64_t key) { return murmur_mix(murmur_add(static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32))); }
+
+        void insert(uint64_t key)
+        {
+            table.insert(hash_key(key), static_cast<uint32_t>(keys.size()));
+            keys.push_back(key);
+        }
+
+        bool contains(uint64_t key)
+        {
+            for (uint32_t index : table[hash_key(key)])
+            {
+                if (keys[index] == key) return true;
+            }
+            return false;
+        }
+    };
+
+    // 插入, 命中和未命中查找每个元素的耗时, 与 std::unordered_map 和 HashTable 对比.
+    BENCHMARK_CASE(flat_hash_map_compare)
+    {
+        for (uint32_t count : { 1u << 12, 1u << 16, 1u << 20, 1u << 22 })
+        {
+            std::mt19937_64 random(2);
+            std::vector<uint64_t> keys(count), missing_keys(count);
+            for (auto& key : keys) key = random();
+            for (auto& key : missing_keys) key = random();
+
+            uint64_t found_num = 0;
+            auto report = [&](const char* name, float insert_time, float hit_time, float miss_time)
+            {
+                std::printf(
+                    "    %7u keys, %-15s insert %6.1f ns, hit %6.1f ns, miss %6.1f ns\n",
+                    count, name, insert_time / count * 1e9f, hit_time / count * 1e9f, miss_time / count * 1e9f
+                );
+            };
+
+            {
+                Timer timer;
+                FlatHashMap<uint64_t, uint32_t> map;
+                for (uint32_t ix = 0; ix < count; ++ix) map.try_emplace(keys[ix], ix);
+                const float insert_time = timer.tick();
+                for (uint64_t key : keys) found_num += map.contains(key);
+                const float hit_time = timer.tick();
+                for (uint64_t key : missing_keys) found_num += map.contains(key);
+                report("FlatHashMap", insert_time, hit_time, timer.tick());
+            }
+            {
+                Timer timer;
+                std::unordered_map<uint64_t, uint32_t> map;
+                for (uint32_t ix = 0; ix < count; ++ix) map.try_emplace(keys[ix], ix);
+                const float insert_time = timer.tick();
+                for (uint64_t key : keys) found_num += map.contains(key);
+                const float hit_time = timer.tick();
+                for (uint64_t key : missing_keys) found_num += map.contains(key);
+                report("unordered_map", insert_time, hit_time, timer.tick());
+            }
+            {
+                Timer timer;
+                IndexHashTable table(count);
+                for (uint64_t key : keys) table.insert(key);
+                const float insert_time = timer.tick();
+                for (uint64_t key : keys) found_num += table.contains(key);
+                const float hit_time = timer.tick();
+                for (uint64_t key : missing_keys) found_num += table.contains(key);
+                report("HashTable", insert_time, hit_time, timer.tick());
+            }
+            CHECK(found_num == uint64_t(count) * 3);
+        }
+    }
+}
@@ -0,0 +1,256 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../core/tools/frame_allocator.h"
+
+namespace fantasy
+{
+    struct FrameAllocation
+    {
+        uint8_t* data = nullptr;
+        uint64_t size = 0;
+        uint8_t value = 0;
+    };
+
+    // 整块内存都是 value 时说明没有和其它分配重叠, 也没有被提前回收.
+    static bool check_allocation(const FrameAllocation& allocation)
+    {
+        for (uint64_t ix = 0; ix < allocation.size; ++ix)
+        {
+            if (allocation.data[ix] != allocation.value) return false;
+        }
+        return true;
+    }
+
+    static bool is_aligned(const void* data, uint64_t alignment)
+    {
+        return reinterpret_cast<uintptr_t>(data) % alignment == 0;
+    }
+
+    // 多个线程同时分配, 块很小所以分配过程中多次换块, 每次分配的内存都不重叠并且满足对齐.
+    TEST_CASE(frame_allocator_concurrent_growth)
+    {
+        constexpr uint32_t thread_num = 8;
+        constexpr uint32_t allocation_num = 2000;
+
+        FrameAllocator allocator(1024);
+        allocator.set_counter_enabled(true);
+
+        std::atomic<bool> start = false;
+        std::vector<std::vector<FrameAllocation>> allocations(thread_num);
+        std::vector<std::thread> threads;
+        for (uint32_t thread = 0; thread < thread_num; ++thread)
+        {
+            threads.emplace_back(
+                [&, thread]()
+                {
+                    std::mt19937 random(thread);
+                    while (!start.load()) std::this_thread::yield();
+                    for (uint32_t ix = 0; ix < allocation_num; ++ix)
+                    {
+                        const uint64_t size = 1 + random() % 200;
+                        const uint64_t alignment = 1ull << (random() % 7);
+                        uint8_t* data = static_cast<uint8_t*>(allocator.allocate(size, alignment));
+                        if (!is_aligned(data, alignment)) data = nullptr;
+
+                        const uint8_t value = static_cast<uint8_t>(thread * 31 + ix);
+                        if (data) std::memset(data, value, size);
+                        allocations[thread].push_back(FrameAllocation{ data, size, value });
+                    }
+                }
+            );
+        }
+        start.store(true);
+        for (auto& thread : threads) thread.join();
+
+        uint64_t total_size = 0;
+        for (const auto& thread_allocations : allocations)
+        {
+            for (const auto& allocation : thread_allocations)
+            {
+                CHECK(allocation.data != nullptr && check_allocation(allocation));
+                total_size += allocation.size;
+            }
+        }
+
+        const ArenaStats stats = allocator.get_frame_stats();
+        CHECK(stats.allocation_num == thread_num * allocation_num);
+        CHECK(stats.used_bytes >= total_size);
+        CHECK(stats.heap_allocation_num > 0);
+        CHECK(stats.capacity >= stats.used_bytes);
+    }
+
+    // FLIGHT_FRAME_NUM 个 arena 轮流使用: 分配的内存在之后 FLIGHT_FRAME_NUM - 1 帧内保持不变,
+    // 轮回同一个 arena 时从头开始, 上次用到的块合并为一个, 同样的负载不再申请新块.
+    TEST_CASE(frame_allocator_ring_reuse)
+    {
+        FrameAllocator allocator(256);
+        allocator.set_counter_enabled(true);
+
+        auto allocate_frame = [&](uint64_t frame)
+        {
+            std::vector<FrameAllocation> allocations;
+            for (uint32_t ix = 0; ix < 64; ++ix)
+            {
+                FrameAllocation allocation{ static_cast<uint8_t*>(allocator.allocate(48, 16)), 48, static_cast<uint8_t>(frame * 7 + ix) };
+                std::memset(allocation.data, allocation.value, allocation.size);
+                allocations.push_back(allocation);
+            }
+            return allocations;
+        };
+
+        std::vector<std::vector<FrameAllocation>> frames;
+        std::vector<ArenaStats> frame_stats;
+        for (uint64_t frame = 0; frame < 3 * FLIGHT_FRAME_NUM; ++frame)
+        {
+            CHECK(allocator.get_frame_index() == frame);
+            frames.push_back(allocate_frame(frame));
+            frame_stats.push_back(allocator.get_frame_stats());
+
+            // 之前 FLIGHT_FRAME_NUM - 1 帧的分配仍然有效.
+            for (uint64_t last = frame >= FLIGHT_FRAME_NUM ? frame - FLIGHT_FRAME_NUM + 1 : 0; last <= frame; ++last)
+            {
+                for (const auto& allocation : frames[last]) CHECK(check_allocation(allocation));
+            }
+
+            allocator.begin_frame();
+            CHECK(allocator.get_last_frame_stats().allocation_num == 64);
+            CHECK(allocator.get_last_frame_stats().used_bytes == frame_stats.back().used_bytes);
+        }
+
+        for (uint64_t frame = FLIGHT_FRAME_NUM; frame < frames.size(); ++frame)
+        {
+            CHECK(frame_stats[frame].capacity >= frame_stats[frame - FLIGHT_FRAME_NUM].used_bytes);
+        }
+
+        // 合并之后块不再改变, 同一个 arena 每次都从头开始分配.
+        for (uint64_t frame = 2 * FLIGHT_FRAME_NUM; frame < frames.size(); ++frame)
+        {
+            CHECK(frames[frame][0].data == frames[frame - FLIGHT_FRAME_NUM][0].data);
+        }
+
+        // 第一轮需要多次换块, 第二轮只有 reset 时合并的一次, 之后不再访问全局堆.
+        for (uint64_t frame = 0; frame < FLIGHT_FRAME_NUM; ++frame)
+        {
+            CHECK(frame_stats[frame].heap_allocation_num > 1);
+            CHECK(frame_stats[frame + FLIGHT_FRAME_NUM].heap_allocation_num == 1);
+            CHECK(frame_stats[frame + 2 * FLIGHT_FRAME_NUM].heap_allocation_num == 0);
+        }
+
+        // 新的一帧统计从 0 开始.
+        const ArenaStats stats = allocator.get_frame_stats();
+        CHECK(stats.allocation_num == 0 && stats.used_bytes == 0);
+    }
+
+    // 回退到 marker 之后重新分配得到同样的地址, 回退到起点或 reset 时合并块.
+    TEST_CASE(linear_arena_rewind)
+    {
+        LinearArena arena(128);
+        CHECK(arena.get_stats().capacity == 0);
+
+        CHECK(arena.allocate(16) != nullptr);
+        const LinearArena::Marker marker = arena.get_marker();
+        void* second = arena.allocate(32, 32);
+        CHECK(is_aligned(second, 32));
+
+        // 超出当前块时申请新块, 大于块大小的分配直接使用一个足够大的块.
+        void* large = arena.allocate(1000, 64);
+        CHECK(is_aligned(large, 64));
+        CHECK(arena.get_stats().heap_allocation_num == 2);
+        CHECK(arena.get_marker().block == 1);
+
+        arena.rewind(marker);
+        CHECK(arena.allocate(32, 32) == second);
+        CHECK(arena.allocate(1000, 64) == large);
+        CHECK(arena.get_stats().heap_allocation_num == 2);
+
+        arena.rewind(LinearArena::Marker{});
+        CHECK(arena.allocate(16) != nullptr);
+        CHECK(arena.get_stats().heap_allocation_num == 3);
+
+        // reset 之后只有一个块, 同样的分配不再申请新块.
+        arena.reset();
+        CHECK(arena.get_stats().allocation_num == 0 && arena.get_stats().used_bytes == 0);
+        CHECK(arena.get_stats().capacity >= 128 + 1000);
+        void* first = arena.allocate(16);
+        arena.allocate(32, 32);
+        arena.allocate(1000, 64);
+        CHECK(arena.get_stats().heap_allocation_num == 0);
+        CHECK(arena.get_stats().allocation_num == 3);
+        CHECK(arena.get_marker().block == 0);
+        CHECK(first != nullptr);
+
+        // 各种对齐.
+        std::mt19937 random(1);
+        for (uint32_t ix = 0; ix < 1000; ++ix)
+        {
+            const uint64_t alignment = 1ull << (random() % 7);
+            CHECK(is_aligned(arena.allocate(1 + random() % 100, alignment), alignment));
+        }
+    }
+
+    // 嵌套的 ScratchScope 结束时回退到进入时的位置, 每个线程有自己的 scratch arena.
+    TEST_CASE(scratch_scope_rewind)
+    {
+        LinearArena& arena = get_scratch_arena();
+        const LinearArena::Marker begin = arena.get_marker();
+        {
+            ScratchScope scope;
+            ScratchVector<uint32_t> values(scope.get_arena());
+            for (uint32_t ix = 0; ix < 10000; ++ix) values.push_back(ix);
+
+            const LinearArena::Marker outer = arena.get_marker();
+            {
+                ScratchScope inner;
+                ScratchVector<uint64_t> inner_values(inner.get_arena());
+                inner_values.resize(5000, 1);
+            }
+            CHECK(arena.get_marker().block == outer.block && arena.get_marker().offset == outer.offset);
+
+            bool correct = true;
+            for (uint32_t ix = 0; ix < values.size(); ++ix) correct &= values[ix] == ix;
+            CHECK(correct);
+        }
+        CHECK(arena.get_marker().block == begin.block && arena.get_marker().offset == begin.offset);
+
+        LinearArena* other_arena = nullptr;
+        std::thread([&]() { other_arena = &get_scratch_arena(); }).join();
+        CHECK(other_arena != &arena);
+    }
+
+    // 在一个线程上分配的帧内存交给其它线程读写, FrameVector 使用全局的 FrameAllocator.
+    TEST_CASE(frame_allocator_cross_thread)
+    {
+        FrameAllocator allocator(4096);
+        std::vector<FrameAllocation> allocations;
+        for (uint32_t ix = 0; ix < 256; ++ix)
+        {
+            allocations.push_back(FrameAllocation{ static_cast<uint8_t*>(allocator.allocate(64, 64)), 64, static_cast<uint8_t>(ix) });
+            CHECK(is_aligned(allocations.back().data, 64));
+        }
+
+        std::vector<std::thread> threads;
+        for (uint32_t thread = 0; thread < 4; ++thread)
+        {
+            threads.emplace_back(
+                [&, thread]()
+                {
+                    for (uint32_t ix = thread; ix < allocations.size(); ix += 4)
+                    {
+                        std::memset(allocations[ix].data, allocations[ix].value, allocations[ix].size);
+                    }
+                }
+            );
+        }
+        for (auto& thread : threads) thread.join();
+        for (const auto& allocation : allocations) CHECK(check_allocation(allocation));
+
+        FrameVector<uint64_t> values;
+        std::thread([&]() { for (uint64_t ix = 0; ix < 1000; ++ix) values.push_back(ix * ix); }).join();
+        CHECK(values.size() == 1000 && values[999] == 999ull * 999ull);
+    }
+}
@@ -0,0 +1,197 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <list>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "../core/tools/lru_cache.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    // 没有 pin 和保护帧时与 std::list 实现的 LRU 逐步比较.
+    TEST_CASE(lru_cache_matches_reference)
+    {
+        constexpr uint32_t capacity = 64;
+        LruCache<uint64_t> cache(capacity);
+
+        std::list<uint64_t> order;
+        std::unordered_map<uint64_t, std::list<uint64_t>::iterator> positions;
+
+        std::mt19937 random(1);
+        std::uniform_int_distribution<uint64_t> key_distribution(0, capacity * 3);
+        for (uint32_t ix = 0; ix < 200000; ++ix)
+        {
+            const uint64_t key = key_distribution(random) << 20;
+            const uint32_t operation = random() % 8;
+
+            auto iter = positions.find(key);
+            if (operation == 0)
+            {
+                CHECK(cache.remove(key) == (iter != positions.end()));
+                if (iter != positions.end())
+                {
+                    order.erase(iter->second);
+                    positions.erase(iter);
+                }
+                continue;
+            }
+
+            uint64_t value = 0;
+            const bool hit = cache.check_cache(key, value);
+            CHECK(hit == (iter != positions.end()));
+            if (hit)
+            {
+                CHECK(value == key + 1);
+                order.splice(order.begin(), order, iter->second);
+                continue;
+            }
+
+            CHECK(cache.insert(key, key + 1));
+            if (order.size() == capacity)
+            {
+                positions.erase(order.back());
+                order.pop_back();
+            }
+            order.push_front(key);
+            positions[key] = order.begin();
+            CHECK(cache.size() == order.size());
+        }
+    }
+
+    // 每种策略都不超过容量, 命中时返回插入的值, pin 的元素不会被淘汰.
+    template <typename Policy>
+    static void check_lru_policy()
+    {
+        constexpr uint32_t capacity = 100;
+        LruCache<uint64_t, Policy> cache(capacity);
+        cache.set_protected_frame_num(1);
+
+        CHECK(cache.insert(~0ull, 0));
+        CHECK(cache.pin(~0ull));
+
+        std::mt19937 random(2);
+        std::uniform_int_distribution<uint64_t> key_distribution(0, capacity * 4);
+        for (uint32_t ix = 0; ix < 100000; ++ix)
+        {
+            if (ix % 37 == 0) cache.begin_frame();
+
+            const uint64_t key = key_distribution(random);
+            uint64_t value = 0;
+            if (cache.check_cache(key, value))
+            {
+                CHECK(value == key * 3);
+            }
+            else
+            {
+                CHECK(cache.insert(key, key * 3));
+            }
+            CHECK(cache.size() <= capacity);
+        }
+        CHECK(cache.find(~0ull) != nullptr);
+    }
+
+    TEST_CASE(lru_cache_policies)
+    {
+        check_lru_policy<LruPolicy>();
+        check_lru_policy<ClockPolicy>();
+        check_lru_policy<TwoQueuePolicy>();
+    }
+
+    // 虚拟纹理的页请求序列: 相机沿路径移动, 每帧请求相机周围每一级 mip 的页.
+    // 每隔一段时间相机转向另一片区域几帧 (只访问一次的扫描), 之后回到原来的路径.
+    static std::vector<std::vector<uint64_t>> create_virtual_texture_trace(uint32_t frame_num, uint32_t scan_interval, uint32_t seed)
+    {
+        constexpr uint32_t mip_num = 8;
+        constexpr int32_t page_num = 256;       // mip 0 每个方向的页数.
+        constexpr int32_t radius = 4;
+
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> position(0.0f, static_cast<float>(page_num));
+
+        std::vector<std::vector<uint64_t>> frames(frame_num);
+        float camera_x = page_num * 0.25f, camera_y = page_num * 0.5f;
+        for (uint32_t frame = 0; frame < frame_num; ++frame)
+        {
+            float x = camera_x, y = camera_y;
+            if (scan_interval != 0 && frame % scan_interval < 4)
+            {
+                x = position(random);
+                y = position(random);
+            }
+            else
+            {
+                camera_x = std::fmod(camera_x + 0.3f, static_cast<float>(page_num));
+                camera_y = page_num * 0.5f + std::sin(frame * 0.01f) * page_num * 0.25f;
+            }
+
+            for (uint32_t mip = 0; mip < mip_num; ++mip)
+            {
+                const int32_t mip_page_num = page_num >> mip;
+                const int32_t center_x = static_cast<int32_t>(x) >> mip;
+                const int32_t center_y = static_cast<int32_t>(y) >> mip;
+                for (int32_t py = std::max(center_y - radius, 0); py <= std::min(center_y + radius, mip_page_num - 1); ++py)
+                {
+                    for (int32_t px = std::max(center_x - radius, 0); px <= std::min(center_x + radius, mip_page_num - 1); ++px)
+                    {
+                        frames[frame].push_back((uint64_t(mip) << 32) | (uint64_t(py) << 16) | uint64_t(px));
+                    }
+                }
+            }
+        }
+        return frames;
+    }
+
+    template <typename Policy>
+    static void replay_virtual_texture_trace(const char* name, const std::vector<std::vector<uint64_t>>& frames, uint32_t capacity)
+    {
+        // 与 VTPhysicalTable 相同, 保护当前帧, 未命中时插入 (缓存已满时淘汰).
+        LruCache<uint32_t, Policy> cache(capacity);
+        cache.set_protected_frame_num(1);
+
+        uint64_t access_num = 0, hit_num = 0;
+        Timer timer;
+        for (const auto& keys : frames)
+        {
+            cache.begin_frame();
+            for (uint64_t key : keys)
+            {
+                uint32_t page = 0;
+                if (cache.check_cache(key, page)) hit_num++;
+                else cache.insert(key, static_cast<uint32_t>(access_num));
+                access_num++;
+            }
+        }
+        const float time = timer.elapsed();
+
+        std::printf(
+            "    %-5s capacity %5u: hit rate %5.2f%%, %.1f ns per request\n",
+            name, capacity, 100.0 * hit_num / access_num, time / access_num * 1e9f
+        );
+    }
+
+    // LRU, CLOCK 和 2Q 在虚拟纹理页请求序列上的命中率和每次请求的耗时.
+    BENCHMARK_CASE(lru_cache_virtual_texture_replay)
+    {
+        for (uint32_t scan_interval : { 0u, 60u })
+        {
+            const auto frames = create_virtual_texture_trace(3000, scan_interval, 3);
+            uint64_t request_num = 0;
+            for (const auto& keys : frames) request_num += keys.size();
+            std::printf("  %s: %llu requests, %.0f per frame\n",
+                scan_interval == 0 ? "camera path" : "camera path with scans",
+                static_cast<unsigned long long>(request_num),
+                static_cast<double>(request_num) / frames.size()
+            );
+
+            for (uint32_t capacity : { 512u, 768u, 1024u, 2048u })
+            {
+                replay_virtual_texture_trace<LruPolicy>("lru", frames, capacity);
+                replay_virtual_texture_trace<ClockPolicy>("clock", frames, capacity);
+                replay_virtual_texture_trace<TwoQueuePolicy>("2q", frames, capacity);
+            }
+        }
+    }
+}
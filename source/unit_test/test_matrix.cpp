@@ -0,0 +1,244 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../core/math/matrix.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    // 非模板的 float4x4 重载走 SIMD 路径, 显式指定 <float> 的模板为标量路径.
+
+    static std::vector<float4x4> create_random_matrices(uint32_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+
+        std::vector<float4x4> matrices(count);
+        for (auto& matrix : matrices)
+        {
+            for (uint32_t ix = 0; ix < 4; ++ix)
+                for (uint32_t jx = 0; jx < 4; ++jx)
+                    matrix[ix][jx] = value(random);
+        }
+        return matrices;
+    }
+
+    // 缩放, 旋转, 平移组合的变换矩阵.
+    static std::vector<float4x4> create_trs_matrices(uint32_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> scale_value(0.1f, 10.0f);
+
+        std::vector<float4x4> matrices(count);
+        for (auto& matrix : matrices)
+        {
+            const float3 axis(value(random), value(random), value(random) + 2.0f);
+            matrix = mul<float>(
+                mul<float>(scale(float3(scale_value(random), scale_value(random), scale_value(random))), rotate(value(random) * 180.0f, axis)),
+                translate(float3(value(random), value(random), value(random)) * 100.0f)
+            );
+        }
+        return matrices;
+    }
+
+    static std::vector<float4> create_random_vectors(uint32_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+
+        std::vector<float4> vectors(count);
+        for (auto& vec : vectors) vec = float4(value(random), value(random), value(random), value(random));
+        return vectors;
+    }
+
+    static float max_abs(const float4x4& matrix)
+    {
+        float ret = 0.0f;
+        for (uint32_t ix = 0; ix < 4; ++ix)
+            for (uint32_t jx = 0; jx < 4; ++jx)
+                ret = std::max(ret, std::abs(matrix[ix][jx]));
+        return ret;
+    }
+
+    // 最大元素差除以两者中最大的元素.
+    static float relative_error(const float4x4& matrix1, const float4x4& matrix2)
+    {
+        float error = 0.0f;
+        for (uint32_t ix = 0; ix < 4; ++ix)
+            for (uint32_t jx = 0; jx < 4; ++jx)
+                error = std::max(error, std::abs(matrix1[ix][jx] - matrix2[ix][jx]));
+        return error / std::max({ max_abs(matrix1), max_abs(matrix2), 1e-30f });
+    }
+
+    static float relative_error(const float4& vec1, const float4& vec2)
+    {
+        const float error = std::max({ std::abs(vec1.x - vec2.x), std::abs(vec1.y - vec2.y), std::abs(vec1.z - vec2.z), std::abs(vec1.w - vec2.w) });
+        const float magnitude = std::max({ std::abs(vec1.x), std::abs(vec1.y), std::abs(vec1.z), std::abs(vec1.w), 1e-30f });
+        return error / magnitude;
+    }
+
+    // 用 double 计算 max|matrix * inverse - I|, 衡量求逆本身的误差.
+    static double inverse_residual(const float4x4& matrix, const float4x4& inverse_matrix)
+    {
+        double residual = 0.0;
+        for (uint32_t ix = 0; ix < 4; ++ix)
+        {
+            for (uint32_t jx = 0; jx < 4; ++jx)
+            {
+                double value = ix == jx ? -1.0 : 0.0;
+                for (uint32_t kx = 0; kx < 4; ++kx) value += double(matrix[ix][kx]) * double(inverse_matrix[kx][jx]);
+                residual = std::max(residual, std::abs(value));
+            }
+        }
+        return residual;
+    }
+
+    TEST_CASE(matrix_simd_mul)
+    {
+        const auto matrices = create_random_matrices(10001, 1);
+        for (uint32_t ix = 0; ix + 1 < matrices.size(); ++ix)
+        {
+            CHECK(relative_error(mul(matrices[ix], matrices[ix + 1]), mul<float>(matrices[ix], matrices[ix + 1])) < 1e-5f);
+        }
+
+        const auto trs = create_trs_matrices(1001, 2);
+        for (uint32_t ix = 0; ix + 1 < trs.size(); ++ix)
+        {
+            CHECK(relative_error(mul(trs[ix], trs[ix + 1]), mul<float>(trs[ix], trs[ix + 1])) < 1e-5f);
+        }
+    }
+
+    TEST_CASE(matrix_simd_transpose)
+    {
+        const auto matrices = create_random_matrices(1000, 3);
+        for (const auto& matrix : matrices)
+        {
+            CHECK(transpose(matrix) == transpose<float>(matrix));
+            CHECK(transpose(transpose(matrix)) == matrix);
+        }
+    }
+
+    TEST_CASE(matrix_simd_vector_mul)
+    {
+        const auto matrices = create_random_matrices(10000, 4);
+        const auto vectors = create_random_vectors(10000, 5);
+        for (uint32_t ix = 0; ix < matrices.size(); ++ix)
+        {
+            // 有抵消时结果可能很小, 按输入的量级比较.
+            const float4 row = mul(vectors[ix], matrices[ix]);
+            const float4 row_scalar = mul<float>(vectors[ix], matrices[ix]);
+            CHECK(relative_error(row, row_scalar) < 1e-5f || relative_error(row + float4(4.0f), row_scalar + float4(4.0f)) < 1e-6f);
+
+            const float4 column = mul(matrices[ix], vectors[ix]);
+            const float4 column_scalar = mul<float>(matrices[ix], vectors[ix]);
+            CHECK(relative_error(column, column_scalar) < 1e-5f || relative_error(column + float4(4.0f), column_scalar + float4(4.0f)) < 1e-6f);
+        }
+    }
+
+    TEST_CASE(matrix_simd_inverse)
+    {
+        // 分块伴随矩阵和标量的 Gauss-Jordan 的误差来源不同, 比较两者 matrix * inverse - I 的残差而不是逐元素比较.
+        double residual = 0.0, scalar_residual = 0.0;
+        for (const auto& matrix : create_trs_matrices(10000, 6))
+        {
+            const float4x4 inverse_matrix = inverse(matrix);
+            residual = std::max(residual, inverse_residual(matrix, inverse_matrix));
+            scalar_residual = std::max(scalar_residual, inverse_residual(matrix, inverse<float>(matrix)));
+            CHECK(relative_error(mul(inverse_matrix, matrix), float4x4()) < 1e-4f);
+        }
+        CHECK(residual <= 4.0 * scalar_residual);
+
+        // 随机矩阵可能接近奇异, 只要求残差和标量路径相当.
+        residual = 0.0;
+        scalar_residual = 0.0;
+        for (const auto& matrix : create_random_matrices(10000, 7))
+        {
+            residual = std::max(residual, inverse_residual(matrix, inverse(matrix)));
+            scalar_residual = std::max(scalar_residual, inverse_residual(matrix, inverse<float>(matrix)));
+        }
+        CHECK(residual <= 4.0 * scalar_residual);
+    }
+
+    TEST_CASE(matrix_look_at)
+    {
+        std::mt19937 random(8);
+        std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+        for (uint32_t ix = 0; ix < 1000; ++ix)
+        {
+            const float3 pos(value(random), value(random), value(random));
+            const float3 look = pos + float3(value(random), value(random), value(random));
+            const float3 up(0.0f, 1.0f, 0.0f);
+
+            // 相机矩阵的通用求逆为原来的实现.
+            const float3 L = normalize(look - pos);
+            const float3 R = normalize(cross(up, L));
+            const float3 U = cross(L, R);
+            const float4x4 camera(
+                R.x,   R.y,   R.z,   0.0f,
+                U.x,   U.y,   U.z,   0.0f,
+                L.x,   L.y,   L.z,   0.0f,
+                pos.x, pos.y, pos.z, 1.0f
+            );
+            CHECK(relative_error(look_at_left_hand(pos, look, up), inverse<float>(camera)) < 1e-5f);
+        }
+    }
+
+    // 每个操作对 4096 个独立输入的平均耗时, SIMD 和标量模板.
+    BENCHMARK_CASE(matrix_simd_throughput)
+    {
+        constexpr uint32_t count = 4096;
+        constexpr uint32_t repeat = 256;
+        const auto matrices = create_trs_matrices(count + 1, 9);
+        const auto vectors = create_random_vectors(count, 10);
+
+        float sink = 0.0f;
+        auto run = [&](const char* name, auto&& simd_func, auto&& scalar_func)
+        {
+            float times[2];
+            for (uint32_t kx = 0; kx < 2; ++kx)
+            {
+                Timer timer;
+                for (uint32_t jx = 0; jx < repeat; ++jx)
+                {
+                    for (uint32_t ix = 0; ix < count; ++ix) sink += kx == 0 ? simd_func(ix) : scalar_func(ix);
+                }
+                times[kx] = timer.elapsed() / (count * repeat) * 1e9f;
+            }
+            std::printf("    %-10s simd %6.2f ns, scalar %6.2f ns\n", name, times[0], times[1]);
+        };
+
+        run("mul",
+            [&](uint32_t ix) { return mul(matrices[ix], matrices[ix + 1])[3][3]; },
+            [&](uint32_t ix) { return mul<float>(matrices[ix], matrices[ix + 1])[3][3]; });
+        run("transpose",
+            [&](uint32_t ix) { return transpose(matrices[ix])[3][0]; },
+            [&](uint32_t ix) { return transpose<float>(matrices[ix])[3][0]; });
+        run("inverse",
+            [&](uint32_t ix) { return inverse(matrices[ix])[3][0]; },
+            [&](uint32_t ix) { return inverse<float>(matrices[ix])[3][0]; });
+        run("vec*mat",
+            [&](uint32_t ix) { return mul(vectors[ix], matrices[ix]).w; },
+            [&](uint32_t ix) { return mul<float>(vectors[ix], matrices[ix]).w; });
+        run("mat*vec",
+            [&](uint32_t ix) { return mul(matrices[ix], vectors[ix]).w; },
+            [&](uint32_t ix) { return mul<float>(matrices[ix], vectors[ix]).w; });
+
+        // 同时打印两条路径的求逆残差.
+        for (uint32_t kx = 0; kx < 2; ++kx)
+        {
+            const auto inputs = kx == 0 ? create_trs_matrices(count, 11) : create_random_matrices(count, 11);
+            double residual = 0.0, scalar_residual = 0.0;
+            for (const auto& matrix : inputs)
+            {
+                residual = std::max(residual, inverse_residual(matrix, inverse(matrix)));
+                scalar_residual = std::max(scalar_residual, inverse_residual(matrix, inverse<float>(matrix)));
+            }
+            std::printf("    inverse residual (%s): simd %.3g, scalar %.3g\n", kx == 0 ? "trs" : "random", residual, scalar_residual);
+        }
+        std::printf("    (sink %g)\n", sink);
+    }
+}
@@ -0,0 +1,172 @@
+#include "unit_test.h"
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+#include "../core/tools/morton_code.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    // 逐位交错的参考实现, 第 ix 个坐标的第 bit 位放在结果的 bit * dim + ix 位.
+    static uint64_t reference_morton_encode(std::initializer_list<uint32_t> values, uint32_t bits)
+    {
+        const uint32_t dim = static_cast<uint32_t>(values.size());
+        uint64_t ret = 0;
+        uint32_t ix = 0;
+        for (uint32_t value : values)
+        {
+            for (uint32_t bit = 0; bit < bits; ++bit)
+            {
+                ret |= static_cast<uint64_t>((value >> bit) & 1) << (bit * dim + ix);
+            }
+            ix++;
+        }
+        return ret;
+    }
+
+    TEST_CASE(morton_code_reference_values)
+    {
+        CHECK(morton_encode(1, 0) == 1 && morton_encode(0, 1) == 2 && morton_encode(3, 3) == 15);
+        CHECK(morton_encode(0xffff, 0xffff) == 0xffffffffu);
+        CHECK(morton_encode_64(0xffffffffu, 0) == 0x5555555555555555ull);
+        CHECK(morton_encode_3d(1, 0, 0) == 1 && morton_encode_3d(0, 1, 0) == 2 && morton_encode_3d(0, 0, 1) == 4);
+        CHECK(morton_encode_3d(0x1fffff, 0x1fffff, 0x1fffff) == 0x7fffffffffffffffull);
+        CHECK(morton_encode_3d_30(0x3ff, 0x3ff, 0x3ff) == 0x3fffffffu);
+        CHECK(morton_encode_3d_30(5, 3, 1) == 0b001'010'111u);
+
+        std::mt19937 random(1);
+        for (uint32_t ix = 0; ix < 100000; ++ix)
+        {
+            const uint32_t x = random(), y = random(), z = random();
+
+            CHECK(morton_encode(x & 0xffff, y & 0xffff) == reference_morton_encode({ x & 0xffff, y & 0xffff }, 16));
+            CHECK(morton_decode(morton_encode(x & 0xffff, y & 0xffff)) == uint2(x & 0xffff, y & 0xffff));
+
+            CHECK(morton_encode_64(x, y) == reference_morton_encode({ x, y }, 32));
+            CHECK(morton_decode_64(morton_encode_64(x, y)) == uint2(x, y));
+
+            const uint3 v21(x & 0x1fffff, y & 0x1fffff, z & 0x1fffff);
+            CHECK(morton_encode_3d(v21) == reference_morton_encode({ v21.x, v21.y, v21.z }, 21));
+            CHECK(morton_decode_3d(morton_encode_3d(v21)) == v21);
+
+            const uint3 v10(x & 0x3ff, y & 0x3ff, z & 0x3ff);
+            CHECK(morton_encode_3d_30(v10) == reference_morton_encode({ v10.x, v10.y, v10.z }, 10));
+            CHECK(morton_decode_3d_30(morton_encode_3d_30(v10)) == v10);
+
+            CHECK(hilbert_decode_3d(hilbert_encode_3d(v21)) == v21);
+            CHECK(hilbert_decode_3d_30(hilbert_encode_3d_30(v10)) == v10);
+        }
+    }
+
+    // hilbert 曲线上相邻的两个序号对应的单元格只在一个轴上相差 1.
+    TEST_CASE(hilbert_code_adjacency)
+    {
+        auto distance = [](const uint3& a, const uint3& b)
+        {
+            return (a.x > b.x ? a.x - b.x : b.x - a.x) + (a.y > b.y ? a.y - b.y : b.y - a.y) + (a.z > b.z ? a.z - b.z : b.z - a.z);
+        };
+
+        CHECK(hilbert_decode_3d_30(0) == uint3(0, 0, 0));
+        uint3 prev = hilbert_decode_3d_30(0);
+        for (uint32_t code = 1; code < (1u << 18); ++code)
+        {
+            const uint3 cell = hilbert_decode_3d_30(code);
+            CHECK(distance(prev, cell) == 1);
+            prev = cell;
+        }
+
+        std::mt19937_64 random(2);
+        for (uint32_t ix = 0; ix < 10000; ++ix)
+        {
+            const uint64_t code = random() % ((1ull << 63) - 1);
+            CHECK(distance(hilbert_decode_3d(code), hilbert_decode_3d(code + 1)) == 1);
+        }
+    }
+
+    // 批量编码与 MortonQuantizer 加标量编码逐个相同, 包括 bounds 之外的点, NaN 和不是 SIMD 宽度整数倍的剩余部分.
+    TEST_CASE(morton_code_batch_matches_scalar)
+    {
+        const Bounds3F bounds(float3(-1.0f, 0.0f, 2.0f), float3(3.0f, 0.5f, 10.0f));
+
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> position(-5.0f, 12.0f);
+        std::vector<float3> points(1027);
+        for (auto& point : points) point = float3(position(random), position(random), position(random));
+        points[5] = bounds._lower;
+        points[6] = bounds._upper;
+        points[7].y = std::numeric_limits<float>::quiet_NaN();
+
+        const MortonQuantizer quantizer_21(bounds, 21);
+        const MortonQuantizer quantizer_10(bounds, 10);
+        for (uint32_t count : { 0u, 1u, 7u, 8u, 9u, 1027u })
+        {
+            const std::span<const float3> input(points.data(), count);
+            std::vector<uint64_t> codes_64(count);
+            std::vector<uint32_t> codes_32(count);
+
+            morton_encode_3d(input, bounds, codes_64);
+            for (uint32_t ix = 0; ix < count; ++ix) CHECK(codes_64[ix] == morton_encode_3d(quantizer_21(points[ix])));
+
+            morton_encode_3d_30(input, bounds, codes_32);
+            for (uint32_t ix = 0; ix < count; ++ix) CHECK(codes_32[ix] == morton_encode_3d_30(quantizer_10(points[ix])));
+
+            hilbert_encode_3d(input, bounds, codes_64);
+            for (uint32_t ix = 0; ix < count; ++ix) CHECK(codes_64[ix] == hilbert_encode_3d(quantizer_21(points[ix])));
+
+            hilbert_encode_3d_30(input, bounds, codes_32);
+            for (uint32_t ix = 0; ix < count; ++ix) CHECK(codes_32[ix] == hilbert_encode_3d_30(quantizer_10(points[ix])));
+        }
+    }
+
+    // 标量编码和解码每次的耗时, 以及批量编码和逐个量化再编码每个点的耗时.
+    BENCHMARK_CASE(morton_code_encode_decode)
+    {
+        constexpr uint32_t count = 1 << 20;
+        std::mt19937 random(4);
+        std::vector<uint3> cells(count);
+        for (auto& cell : cells) cell = uint3(random() & 0x1fffff, random() & 0x1fffff, random() & 0x1fffff);
+
+        uint64_t sink = 0;
+        auto run = [&](const char* name, auto&& func)
+        {
+            Timer timer;
+            for (uint32_t ix = 0; ix < count; ++ix) sink += func(cells[ix]);
+            std::printf("    %-22s %.2f ns\n", name, timer.elapsed() / count * 1e9f);
+        };
+
+        run("morton_encode_64", [](const uint3& v) { return morton_encode_64(v.x, v.y); });
+        run("morton_decode_64", [](const uint3& v) { return morton_decode_64((uint64_t(v.x) << 32) | v.y).x; });
+        run("morton_encode_3d", [](const uint3& v) { return morton_encode_3d(v); });
+        run("morton_decode_3d", [](const uint3& v) { return morton_decode_3d((uint64_t(v.x) << 42) | (uint64_t(v.y) << 21) | v.z).x; });
+        run("morton_encode_3d_30", [](const uint3& v) { return morton_encode_3d_30(v.x & 0x3ff, v.y & 0x3ff, v.z & 0x3ff); });
+        run("morton_decode_3d_30", [](const uint3& v) { return morton_decode_3d_30(v.x | (v.y << 21)).x; });
+        run("hilbert_encode_3d", [](const uint3& v) { return hilbert_encode_3d(v); });
+        run("hilbert_decode_3d", [](const uint3& v) { return hilbert_decode_3d((uint64_t(v.x) << 42) | (uint64_t(v.y) << 21) | v.z).x; });
+        run("hilbert_encode_3d_30", [](const uint3& v) { return hilbert_encode_3d_30(uint3(v.x & 0x3ff, v.y & 0x3ff, v.z & 0x3ff)); });
+
+        const Bounds3F bounds(float3(0.0f), float3(1.0f));
+        std::uniform_real_distribution<float> position(0.0f, 1.0f);
+        std::vector<float3> points(count);
+        for (auto& point : points) point = float3(position(random), position(random), position(random));
+        std::vector<uint64_t> codes(count);
+
+        // 各跑一次预热, 取后面 4 次的平均.
+        const MortonQuantizer quantizer(bounds, 21);
+        float batch_time = 0.0f, scalar_time = 0.0f;
+        for (uint32_t round = 0; round < 5; ++round)
+        {
+            Timer timer;
+            morton_encode_3d(points, bounds, codes);
+            const float time = timer.tick();
+            if (round > 0) batch_time += time;
+            for (uint32_t ix = 0; ix < count; ++ix) codes[ix] = morton_encode_3d(quantizer(points[ix]));
+            if (round > 0) scalar_time += timer.tick();
+        }
+        std::printf(
+            "    points -> morton 3d    batch %.2f ns, scalar %.2f ns (sink %llu)\n",
+            batch_time / 4 / count * 1e9f, scalar_time / 4 / count * 1e9f, static_cast<unsigned long long>(sink + codes[count / 2])
+        );
+    }
+}
@@ -0,0 +1,161 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <deque>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "../core/parallel/algorithm.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    // 覆盖串行阈值两侧以及不能整除块数的长度.
+    static const uint64_t algorithm_test_sizes[] = { 0, 1, 1000, parallel::algorithm_serial_threshold - 1, parallel::algorithm_serial_threshold, 100003, 1000000 };
+
+    static std::vector<uint32_t> make_random_values(uint64_t count, uint32_t seed, uint32_t max_value = UINT32_MAX)
+    {
+        std::mt19937 random(seed);
+        std::uniform_int_distribution<uint32_t> distribution(0, max_value);
+        std::vector<uint32_t> values(count);
+        for (auto& value : values) value = distribution(random);
+        return values;
+    }
+
+    TEST_CASE(parallel_radix_sort)
+    {
+        for (uint64_t count : algorithm_test_sizes)
+        {
+            auto values = make_random_values(count, 1);
+            auto expected = values;
+            std::sort(expected.begin(), expected.end());
+            parallel::sort(values.begin(), values.end());
+            CHECK(values == expected);
+        }
+
+        // 30 位 Morton 码, 高位全为 0 的趟会被跳过.
+        auto values = make_random_values(200000, 2, (1u << 30) - 1);
+        auto expected = values;
+        std::sort(expected.begin(), expected.end());
+        parallel::radix_sort(values.begin(), values.end(), [](uint32_t value) { return value; }, 30);
+        CHECK(values == expected);
+
+        // 非连续迭代器.
+        std::deque<uint64_t> deque_values(values.begin(), values.end());
+        std::reverse(deque_values.begin(), deque_values.end());
+        parallel::sort(deque_values.begin(), deque_values.end());
+        CHECK(std::equal(deque_values.begin(), deque_values.end(), expected.begin(), expected.end()));
+    }
+
+    // 基数排序是稳定的, 和 std::stable_sort 的结果完全相同.
+    TEST_CASE(parallel_radix_sort_stable)
+    {
+        auto keys = make_random_values(300000, 3, 255);
+        std::vector<std::pair<uint32_t, uint32_t>> values(keys.size());
+        for (uint32_t ix = 0; ix < keys.size(); ++ix) values[ix] = { keys[ix], ix };
+
+        auto expected = values;
+        std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        parallel::radix_sort(values.begin(), values.end(), [](const std::pair<uint32_t, uint32_t>& value) { return value.first; }, 8);
+        CHECK(values == expected);
+    }
+
+    TEST_CASE(parallel_comparison_sort)
+    {
+        for (uint64_t count : algorithm_test_sizes)
+        {
+            auto keys = make_random_values(count, 4, 1000);
+            std::vector<float> values(keys.begin(), keys.end());
+            auto expected = values;
+            std::sort(expected.begin(), expected.end(), std::greater<>());
+            parallel::sort(values.begin(), values.end(), std::greater<>());
+            CHECK(values == expected);
+        }
+    }
+
+    TEST_CASE(parallel_reduce_and_scan)
+    {
+        for (uint64_t count : algorithm_test_sizes)
+        {
+            auto values = make_random_values(count, 5, 1000);
+            std::vector<uint64_t> wide_values(values.begin(), values.end());
+
+            CHECK(parallel::reduce(wide_values.begin(), wide_values.end(), uint64_t(7)) == std::reduce(wide_values.begin(), wide_values.end(), uint64_t(7)));
+            CHECK(
+                parallel::reduce(values.begin(), values.end(), 0u, [](uint32_t a, uint32_t b) { return std::max(a, b); }) ==
+                std::reduce(values.begin(), values.end(), 0u, [](uint32_t a, uint32_t b) { return std::max(a, b); })
+            );
+
+            std::vector<uint64_t> result(count);
+            std::vector<uint64_t> expected(count);
+
+            parallel::inclusive_scan(wide_values.begin(), wide_values.end(), result.begin(), uint64_t(3));
+            std::inclusive_scan(wide_values.begin(), wide_values.end(), expected.begin(), std::plus<>(), uint64_t(3));
+            CHECK(result == expected);
+
+            parallel::exclusive_scan(wide_values.begin(), wide_values.end(), result.begin(), uint64_t(3));
+            std::exclusive_scan(wide_values.begin(), wide_values.end(), expected.begin(), uint64_t(3));
+            CHECK(result == expected);
+
+            // 原地扫描.
+            std::exclusive_scan(wide_values.begin(), wide_values.end(), expected.begin(), uint64_t(0));
+            parallel::exclusive_scan(wide_values.begin(), wide_values.end(), wide_values.begin(), uint64_t(0));
+            CHECK(wide_values == expected);
+        }
+    }
+
+    TEST_CASE(parallel_partition)
+    {
+        auto is_even = [](uint32_t value) { return value % 2 == 0; };
+        for (uint64_t count : algorithm_test_sizes)
+        {
+            auto values = make_random_values(count, 6);
+            auto expected = values;
+            const auto expected_middle = std::stable_partition(expected.begin(), expected.end(), is_even);
+            const auto middle = parallel::stable_partition(values.begin(), values.end(), is_even);
+            CHECK(values == expected);
+            CHECK(middle - values.begin() == expected_middle - expected.begin());
+
+            // partition() 在数量较少时不稳定, 只检查划分结果和元素集合.
+            auto unstable_values = make_random_values(count, 6);
+            const auto unstable_middle = parallel::partition(unstable_values.begin(), unstable_values.end(), is_even);
+            CHECK(std::all_of(unstable_values.begin(), unstable_middle, is_even));
+            CHECK(std::none_of(unstable_middle, unstable_values.end(), is_even));
+            std::sort(unstable_values.begin(), unstable_values.end());
+            std::sort(expected.begin(), expected.end());
+            CHECK(unstable_values == expected);
+        }
+    }
+
+    BENCHMARK_CASE(parallel_algorithm_scaling)
+    {
+        for (uint64_t count : { 1000000ull, 10000000ull, 100000000ull })
+        {
+            auto values = make_random_values(count, 7);
+            auto copy = values;
+
+            Timer timer;
+            std::sort(copy.begin(), copy.end());
+            const float std_sort_time = timer.tick();
+            parallel::sort(values.begin(), values.end());
+            const float radix_sort_time = timer.tick();
+
+            copy = make_random_values(count, 7);
+            timer.tick();
+            parallel::sort(copy.begin(), copy.end(), std::less<>());
+            const float comparison_sort_time = timer.tick();
+
+            const uint64_t sum = parallel::reduce(values.begin(), values.end(), uint64_t(0));
+            const float reduce_time = timer.tick();
+            parallel::inclusive_scan(values.begin(), values.end(), copy.begin(), 0u);
+            const float scan_time = timer.tick();
+            parallel::stable_partition(values.begin(), values.end(), [](uint32_t value) { return value % 2 == 0; });
+            const float partition_time = timer.tick();
+
+            std::printf(
+                "    %llu: std::sort %.0f ms, radix sort %.0f ms, comparison sort %.0f ms, reduce %.1f ms, scan %.1f ms, stable_partition %.1f ms (sum %llu)\n",
+                static_cast<unsigned long long>(count), std_sort_time * 1e3f, radix_sort_time * 1e3f, comparison_sort_time * 1e3f,
+                reduce_time * 1e3f, scan_time * 1e3f, partition_time * 1e3f, static_cast<unsigned long long>(sum)
+            );
+        }
+    }
+}
@@ -0,0 +1,352 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "../core/math/matrix.h"
+#include "../core/tools/quad_tree.h"
+
+namespace fantasy
+{
+    template <uint32_t Dim>
+    using TestTree = LinearTree<uint32_t, Dim>;
+
+    // 闭区间相交, 与 LinearTree 的查询一致 (接触也算相交).
+    template <typename BoundsType, uint32_t Dim>
+    static bool overlap_closed(const BoundsType& bounds0, const BoundsType& bounds1)
+    {
+        for (uint32_t ix = 0; ix < Dim; ++ix)
+        {
+            if (bounds0._lower[ix] > bounds1._upper[ix] || bounds0._upper[ix] < bounds1._lower[ix]) return false;
+        }
+        return true;
+    }
+
+    // 世界范围为 [0, 100], 对象的尺寸从远小于最小单元格到接近整个世界, 少部分超出世界范围.
+    template <uint32_t Dim>
+    static typename TestTree<Dim>::BoundsType create_random_box(std::mt19937& random)
+    {
+        std::uniform_real_distribution<float> position(-10.0f, 110.0f);
+        std::uniform_real_distribution<float> exponent(-3.0f, 1.8f);
+
+        typename TestTree<Dim>::BoundsType box;
+        const float size = std::pow(10.0f, exponent(random));
+        for (uint32_t ix = 0; ix < Dim; ++ix)
+        {
+            box._lower[ix] = position(random);
+            box._upper[ix] = box._lower[ix] + size * (0.5f + (random() % 100) / 100.0f);
+        }
+        return box;
+    }
+
+    template <uint32_t Dim>
+    static typename TestTree<Dim>::BoundsType create_world_bounds()
+    {
+        typename TestTree<Dim>::BoundsType bounds;
+        for (uint32_t ix = 0; ix < Dim; ++ix)
+        {
+            bounds._lower[ix] = 0.0f;
+            bounds._upper[ix] = 100.0f;
+        }
+        return bounds;
+    }
+
+    // 树的查询结果与遍历 reference 中所有对象的结果相同, reference 为 handle 到对象的映射.
+    template <uint32_t Dim>
+    static void check_tree_queries(
+        const TestTree<Dim>& tree,
+        const std::unordered_map<uint32_t, typename TestTree<Dim>::Item>& reference,
+        std::mt19937& random
+    )
+    {
+        using BoundsType = typename TestTree<Dim>::BoundsType;
+
+        CHECK(tree.size() == reference.size());
+        for (const auto& [handle, item] : reference)
+        {
+            CHECK(tree.get(handle) == item.value);
+            CHECK(tree.get_bounds(handle) == item.bounds);
+        }
+
+        std::vector<BoundsType> queries;
+        for (uint32_t ix = 0; ix < 200; ++ix) queries.push_back(create_random_box<Dim>(random));
+        for (uint32_t ix = 0; ix < 100; ++ix)
+        {
+            // 点查询.
+            BoundsType box = create_random_box<Dim>(random);
+            box._upper = box._lower;
+            queries.push_back(box);
+        }
+        for (uint32_t ix = 0; ix < 20 && !reference.empty(); ++ix)
+        {
+            // 正好是某个对象的包围盒, 检查边界接触的情况.
+            auto iter = reference.begin();
+            std::advance(iter, random() % reference.size());
+            queries.push_back(iter->second.bounds);
+        }
+
+        for (const auto& query : queries)
+        {
+            std::vector<uint32_t> handles;
+            tree.query(query, [&](const uint32_t& value, uint32_t handle) { CHECK(tree.get(handle) == value); handles.push_back(handle); });
+            std::sort(handles.begin(), handles.end());
+
+            std::vector<uint32_t> expected;
+            for (const auto& [handle, item] : reference)
+            {
+                if (overlap_closed<BoundsType, Dim>(item.bounds, query)) expected.push_back(handle);
+            }
+            std::sort(expected.begin(), expected.end());
+            CHECK(handles == expected);
+        }
+
+        // 批量查询与逐个查询的结果相同.
+        std::vector<uint32_t> values;
+        std::vector<uint2> ranges;
+        tree.query(std::span<const BoundsType>(queries), values, ranges);
+        for (uint32_t ix = 0; ix < queries.size(); ++ix)
+        {
+            std::vector<uint32_t> batch(values.begin() + ranges[ix].x, values.begin() + ranges[ix].x + ranges[ix].y);
+            std::vector<uint32_t> single = tree.query(queries[ix]);
+            std::sort(batch.begin(), batch.end());
+            std::sort(single.begin(), single.end());
+            CHECK(batch == single);
+        }
+    }
+
+    template <uint32_t Dim>
+    static void check_linear_tree()
+    {
+        using Item = typename TestTree<Dim>::Item;
+
+        std::mt19937 random(Dim);
+        TestTree<Dim> tree(create_world_bounds<Dim>(), Dim == 2 ? 10 : 6);
+
+        std::vector<Item> items(2000);
+        for (uint32_t ix = 0; ix < items.size(); ++ix) items[ix] = Item{ create_random_box<Dim>(random), ix };
+
+        std::vector<uint32_t> handles;
+        tree.build(items, &handles);
+
+        std::unordered_map<uint32_t, Item> reference;
+        for (uint32_t ix = 0; ix < items.size(); ++ix) reference[handles[ix]] = items[ix];
+        CHECK(reference.size() == items.size());
+        check_tree_queries<Dim>(tree, reference, random);
+
+        // 增量的插入, 删除和更新.
+        uint32_t next_value = static_cast<uint32_t>(items.size());
+        for (uint32_t round = 0; round < 5; ++round)
+        {
+            for (uint32_t ix = 0; ix < 500; ++ix)
+            {
+                const uint32_t operation = random() % 3;
+                if (operation == 0 || reference.empty())
+                {
+                    const Item item{ create_random_box<Dim>(random), next_value++ };
+                    const uint32_t handle = tree.insert(item.bounds, item.value);
+                    CHECK(reference.find(handle) == reference.end());
+                    reference[handle] = item;
+                    continue;
+                }
+
+                auto iter = reference.begin();
+                std::advance(iter, random() % reference.size());
+                const uint32_t handle = iter->first;
+                if (operation == 1)
+                {
+                    CHECK(tree.remove(handle));
+                    CHECK(!tree.remove(handle));
+                    reference.erase(iter);
+                }
+                else
+                {
+                    Item item = iter->second;
+                    item.bounds = create_random_box<Dim>(random);
+                    reference.erase(iter);
+
+                    const uint32_t new_handle = tree.update(handle, item.bounds);
+                    CHECK(reference.find(new_handle) == reference.end());
+                    reference[new_handle] = item;
+                }
+            }
+            check_tree_queries<Dim>(tree, reference, random);
+        }
+
+        // query_cell 返回定位码位于该单元格子树中的对象.
+        for (uint32_t depth : { 0u, 1u, 3u, tree.get_max_depth() })
+        {
+            for (uint32_t ix = 0; ix < 20; ++ix)
+            {
+                typename TestTree<Dim>::CellType cell;
+                for (uint32_t jx = 0; jx < Dim; ++jx) cell[jx] = random() % (1u << depth);
+
+                std::vector<uint32_t> handles;
+                tree.query_cell(depth, cell, [&](const uint32_t&, uint32_t handle) { handles.push_back(handle); });
+                std::sort(handles.begin(), handles.end());
+
+                // 祖先的定位码为子孙的定位码右移.
+                std::vector<uint32_t> expected;
+                for (const auto& [handle, item] : reference)
+                {
+                    const uint64_t key = tree.get_key(item.bounds);
+                    const uint32_t key_depth = TestTree<Dim>::get_depth(key);
+                    if (key_depth < depth) continue;
+
+                    const uint64_t ancestor = key >> (Dim * (key_depth - depth));
+                    typename TestTree<Dim>::CellType ancestor_cell;
+                    if constexpr (Dim == 2) ancestor_cell = morton_decode_64(ancestor ^ (1ull << (Dim * depth)));
+                    else ancestor_cell = morton_decode_3d(ancestor ^ (1ull << (Dim * depth)));
+                    if (ancestor_cell == cell) expected.push_back(handle);
+                }
+                std::sort(expected.begin(), expected.end());
+                CHECK(handles == expected);
+            }
+        }
+
+        // 全部删除后只剩根节点.
+        for (const auto& [handle, item] : reference) CHECK(tree.remove(handle));
+        CHECK(tree.size() == 0);
+        CHECK(tree.get_node_count() == 1);
+        CHECK(tree.query(create_world_bounds<Dim>()).empty());
+    }
+
+    TEST_CASE(quadtree_brute_force)
+    {
+        check_linear_tree<2>();
+    }
+
+    TEST_CASE(octree_brute_force)
+    {
+        check_linear_tree<3>();
+    }
+
+    // 与 cull 中只取沿法线最远和最近的顶点不同, 逐个比较 8 个顶点.
+    static FrustumCull cull_corners(const Frustum& frustum, const Bounds3F& bounds)
+    {
+        FrustumCull ret = FrustumCull::Inside;
+        for (const auto& plane : frustum.planes)
+        {
+            uint32_t inside_num = 0;
+            for (uint32_t corner = 0; corner < 8; ++corner)
+            {
+                const float3 point(
+                    corner & 1 ? bounds._upper.x : bounds._lower.x,
+                    corner & 2 ? bounds._upper.y : bounds._lower.y,
+                    corner & 4 ? bounds._upper.z : bounds._lower.z
+                );
+                if (dot(float3(plane.x, plane.y, plane.z), point) + plane.w >= 0.0f) inside_num++;
+            }
+            if (inside_num == 0) return FrustumCull::Outside;
+            if (inside_num < 8) ret = FrustumCull::Intersect;
+        }
+        return ret;
+    }
+
+    // 透视, reverse z 和正交投影, 相机在世界范围之外或之内.
+    static std::vector<Frustum> create_test_frustums()
+    {
+        const float4x4 views[] = {
+            look_at_left_hand(float3(-20.0f, 50.0f, 50.0f), float3(50.0f, 50.0f, 50.0f), float3(0.0f, 1.0f, 0.0f)),
+            look_at_left_hand(float3(50.0f, 60.0f, 40.0f), float3(80.0f, 30.0f, 90.0f), float3(0.0f, 1.0f, 0.0f)),
+            look_at_left_hand(float3(120.0f, 130.0f, -10.0f), float3(40.0f, 20.0f, 60.0f), float3(0.0f, 1.0f, 0.0f))
+        };
+        const float4x4 projections[] = {
+            perspective_left_hand(60.0f, 1.5f, 1.0f, 150.0f),
+            perspective_left_hand_reverse_z(45.0f, 1.0f, 5.0f, 80.0f),
+            orthographic_left_hand(60.0f, 40.0f, 1.0f, 120.0f)
+        };
+
+        std::vector<Frustum> frustums;
+        for (const auto& view : views)
+        {
+            for (const auto& projection : projections) frustums.emplace_back(mul(view, projection));
+        }
+        return frustums;
+    }
+
+    // 平面与裁剪空间 -w <= x, y <= w, 0 <= z <= w 一致, cull 与逐个比较顶点的结果相同.
+    TEST_CASE(frustum_cull_brute_force)
+    {
+        const float4x4 view = look_at_left_hand(float3(-20.0f, 50.0f, 50.0f), float3(50.0f, 50.0f, 50.0f), float3(0.0f, 1.0f, 0.0f));
+        const float4x4 view_projs[] = {
+            mul(view, perspective_left_hand(60.0f, 1.5f, 1.0f, 150.0f)),
+            mul(view, perspective_left_hand_reverse_z(45.0f, 1.0f, 5.0f, 80.0f)),
+            mul(view, orthographic_left_hand(60.0f, 40.0f, 1.0f, 120.0f))
+        };
+
+        std::mt19937 random(4);
+        std::uniform_real_distribution<float> position(-50.0f, 200.0f);
+        for (const auto& view_proj : view_projs)
+        {
+            const Frustum frustum(view_proj);
+
+            uint32_t inside_point_num = 0;
+            for (uint32_t ix = 0; ix < 10000; ++ix)
+            {
+                const float3 point(position(random), position(random), position(random));
+                const float4 clip = mul(float4(point, 1.0f), view_proj);
+
+                // 离边界太近时浮点误差可能使两者不同.
+                const float margin = std::min({ clip.w - std::abs(clip.x), clip.w - std::abs(clip.y), clip.z, clip.w - clip.z });
+                if (std::abs(margin) < 1e-3f * std::max(std::abs(clip.w), 1.0f)) continue;
+
+                bool inside_planes = true;
+                for (const auto& plane : frustum.planes)
+                {
+                    inside_planes &= dot(float3(plane.x, plane.y, plane.z), point) + plane.w >= 0.0f;
+                }
+                CHECK(inside_planes == (margin > 0.0f));
+                if (inside_planes) inside_point_num++;
+            }
+            CHECK(inside_point_num > 0);
+
+            uint32_t result_nums[3] = {};
+            for (uint32_t ix = 0; ix < 10000; ++ix)
+            {
+                const Bounds3F box = create_random_box<3>(random);
+                const FrustumCull result = cull(frustum, box);
+                CHECK(result == cull_corners(frustum, box));
+                result_nums[static_cast<uint32_t>(result)]++;
+            }
+            CHECK(result_nums[0] > 0 && result_nums[1] > 0 && result_nums[2] > 0);
+        }
+    }
+
+    // 八叉树的视锥体查询和批量查询与逐个对象 cull 的结果相同.
+    TEST_CASE(octree_frustum_query_brute_force)
+    {
+        std::mt19937 random(5);
+        TestTree<3> tree(create_world_bounds<3>(), 6);
+
+        std::vector<TestTree<3>::Item> items(5000);
+        for (uint32_t ix = 0; ix < items.size(); ++ix) items[ix] = TestTree<3>::Item{ create_random_box<3>(random), ix };
+        tree.build(items);
+
+        const std::vector<Frustum> frustums = create_test_frustums();
+        std::vector<std::vector<uint32_t>> expected(frustums.size());
+        for (uint32_t ix = 0; ix < frustums.size(); ++ix)
+        {
+            for (const auto& item : items)
+            {
+                if (cull(frustums[ix], item.bounds) != FrustumCull::Outside) expected[ix].push_back(item.value);
+            }
+            CHECK(!expected[ix].empty() && expected[ix].size() < items.size());
+
+            std::vector<uint32_t> values = tree.query(frustums[ix]);
+            std::sort(values.begin(), values.end());
+            CHECK(values == expected[ix]);
+        }
+
+        std::vector<uint32_t> values;
+        std::vector<uint2> ranges;
+        tree.query(std::span<const Frustum>(frustums), values, ranges);
+        CHECK(ranges.size() == frustums.size());
+        for (uint32_t ix = 0; ix < frustums.size(); ++ix)
+        {
+            std::vector<uint32_t> batch(values.begin() + ranges[ix].x, values.begin() + ranges[ix].x + ranges[ix].y);
+            std::sort(batch.begin(), batch.end());
+            CHECK(batch == expected[ix]);
+        }
+    }
+}
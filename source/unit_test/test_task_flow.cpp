@@ -0,0 +1,180 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <vector>
+#include "../core/parallel/parallel.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    // 随机 DAG, 节点只依赖序号更小的节点. 每个节点执行时检查所有前驱都已完成, 并记录执行次数.
+    struct RandomTaskGraph
+    {
+        TaskFlow flow;
+        std::vector<std::vector<uint32_t>> predecessors;
+        std::unique_ptr<std::atomic<uint32_t>[]> run_counts;
+        std::atomic<uint32_t> order_error_num = 0;
+
+        RandomTaskGraph(uint32_t node_num, uint32_t max_predecessor_num, uint32_t seed) :
+            predecessors(node_num),
+            run_counts(std::make_unique<std::atomic<uint32_t>[]>(node_num))
+        {
+            std::mt19937 random(seed);
+            std::vector<Task> tasks;
+            for (uint32_t ix = 0; ix < node_num; ++ix)
+            {
+                tasks.push_back(flow.Emplace(
+                    [this, ix]() -> bool
+                    {
+                        const uint32_t run_count = run_counts[ix].load(std::memory_order_acquire);
+                        for (uint32_t predecessor : predecessors[ix])
+                        {
+                            if (run_counts[predecessor].load(std::memory_order_acquire) != run_count + 1) order_error_num++;
+                        }
+                        run_counts[ix].fetch_add(1, std::memory_order_release);
+                        return true;
+                    }
+                ));
+
+                if (ix == 0) continue;
+                const uint32_t predecessor_num = random() % (max_predecessor_num + 1);
+                for (uint32_t jx = 0; jx < predecessor_num; ++jx)
+                {
+                    const uint32_t predecessor = random() % ix;
+                    if (std::find(predecessors[ix].begin(), predecessors[ix].end(), predecessor) != predecessors[ix].end()) continue;
+                    predecessors[ix].push_back(predecessor);
+                    tasks[ix].succeed(tasks[predecessor]);
+                }
+            }
+        }
+    };
+
+    TEST_CASE(task_flow_dependency_order)
+    {
+        RandomTaskGraph graph(2000, 4, 1);
+        CHECK(parallel::run(graph.flow));
+        CHECK(graph.order_error_num.load() == 0);
+
+        bool all_once = true;
+        for (uint32_t ix = 0; ix < 2000; ++ix) all_once &= graph.run_counts[ix].load() == 1;
+        CHECK(all_once);
+    }
+
+    // 同一个 TaskFlow 重复运行, 每次运行前恢复前驱计数, 每个节点每次只执行一次.
+    TEST_CASE(task_flow_rerun)
+    {
+        RandomTaskGraph graph(500, 3, 2);
+        for (uint32_t ix = 0; ix < 20; ++ix)
+        {
+            CHECK(parallel::run(graph.flow));
+        }
+        CHECK(graph.order_error_num.load() == 0);
+
+        bool all_twenty = true;
+        for (uint32_t ix = 0; ix < 500; ++ix) all_twenty &= graph.run_counts[ix].load() == 20;
+        CHECK(all_twenty);
+    }
+
+    TEST_CASE(task_flow_diamond_join_count)
+    {
+        // a -> (b0 ... b63) -> c, c 只能在所有 b 完成后执行一次.
+        TaskFlow flow;
+        std::atomic<uint32_t> finished_num = 0;
+        std::atomic<uint32_t> join_run_num = 0;
+        uint32_t finished_num_at_join = 0;
+
+        Task source = flow.Emplace([]() { return true; });
+        Task join = flow.Emplace(
+            [&]()
+            {
+                finished_num_at_join = finished_num.load();
+                join_run_num++;
+                return true;
+            }
+        );
+        for (uint32_t ix = 0; ix < 64; ++ix)
+        {
+            Task middle = flow.Emplace([&]() { finished_num++; return true; });
+            middle.succeed(source);
+            middle.precede(join);
+        }
+
+        CHECK(parallel::run(flow));
+        CHECK(join_run_num.load() == 1);
+        CHECK(finished_num_at_join == 64);
+    }
+
+    // 失败的节点不会启动后继, run() 返回 false.
+    TEST_CASE(task_flow_failure)
+    {
+        TaskFlow flow;
+        std::atomic<bool> successor_run = false;
+
+        Task failed = flow.Emplace([]() { return false; });
+        Task successor = flow.Emplace([&]() { successor_run = true; return true; });
+        successor.succeed(failed);
+        flow.Emplace([]() { return true; });
+
+        CHECK(!parallel::run(flow));
+        CHECK(!successor_run.load());
+    }
+
+    BENCHMARK_CASE(task_flow_wide_and_deep)
+    {
+        constexpr uint32_t node_num = 10000;
+        constexpr uint32_t run_num = 20;
+
+        // 一个源节点, node_num 个并列节点, 一个汇合节点.
+        TaskFlow wide_flow;
+        {
+            Task source = wide_flow.Emplace([]() { return true; });
+            Task sink = wide_flow.Emplace([]() { return true; });
+            for (uint32_t ix = 0; ix < node_num; ++ix)
+            {
+                Task task = wide_flow.Emplace([]() { return true; });
+                task.succeed(source);
+                task.precede(sink);
+            }
+        }
+
+        // 长度为 node_num 的链.
+        TaskFlow deep_flow;
+        {
+            Task last = deep_flow.Emplace([]() { return true; });
+            for (uint32_t ix = 1; ix < node_num; ++ix)
+            {
+                Task task = deep_flow.Emplace([]() { return true; });
+                task.succeed(last);
+                last = task;
+            }
+        }
+
+        // 每层 64 个节点, 相邻两层全连接.
+        TaskFlow layered_flow;
+        {
+            std::vector<Task> last_layer;
+            for (uint32_t layer = 0; layer < node_num / 64; ++layer)
+            {
+                std::vector<Task> current_layer;
+                for (uint32_t ix = 0; ix < 64; ++ix)
+                {
+                    Task task = layered_flow.Emplace([]() { return true; });
+                    for (Task& predecessor : last_layer) task.succeed(predecessor);
+                    current_layer.push_back(task);
+                }
+                last_layer = std::move(current_layer);
+            }
+        }
+
+        const std::pair<const char*, TaskFlow*> flows[] = { { "wide", &wide_flow }, { "deep", &deep_flow }, { "layered", &layered_flow } };
+        for (const auto& [name, flow] : flows)
+        {
+            Timer timer;
+            for (uint32_t ix = 0; ix < run_num; ++ix) CHECK(parallel::run(*flow));
+            const float node_time = timer.elapsed() / (run_num * flow->TotalTaskNum) * 1e9f;
+            std::printf("    %-8s %u nodes: %.0f ns / node\n", name, flow->TotalTaskNum, node_time);
+        }
+    }
+}
@@ -0,0 +1,689 @@
+#include "unit_test.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../core/parallel/parallel.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    static uint64_t get_executed_job_num(ThreadPool& pool)
+    {
+        uint64_t job_num = 0;
+        for (const auto& counters : pool.get_profiler().get_counters()) job_num += counters.executed_job_num;
+        return job_num;
+    }
+
+    static bool wait_for_counter(const std::atomic<uint32_t>& counter, float timeout_seconds)
+    {
+        Timer timer;
+        while (counter.load() != 0)
+        {
+            if (timer.elapsed() > timeout_seconds) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    // 只用于检查 export_chrome_trace 的输出, 不处理转义字符和 unicode.
+    struct JsonValue
+    {
+        enum class Type { Null, Bool, Number, String, Array, Object } type = Type::Null;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> array;
+        std::vector<std::pair<std::string, JsonValue>> object;
+
+        const JsonValue* find(const std::string& key) const
+        {
+            for (const auto& [name, value] : object)
+            {
+                if (name == key) return &value;
+            }
+            return nullptr;
+        }
+    };
+
+    class JsonParser
+    {
+    public:
+        explicit JsonParser(const std::string& text) : _text(text) {}
+
+        // 整个文本是一个合法的 JSON 值时返回 true.
+        bool parse(JsonValue& value)
+        {
+            if (!parse_value(value)) return false;
+            skip_space();
+            return _pos == _text.size();
+        }
+
+    private:
+        void skip_space()
+        {
+            while (_pos < _text.size() && std::isspace(static_cast<unsigned char>(_text[_pos]))) _pos++;
+        }
+
+        bool consume(char c)
+        {
+            skip_space();
+            if (_pos >= _text.size() || _text[_pos] != c) return false;
+            _pos++;
+            return true;
+        }
+
+        bool parse_string(std::string& string)
+        {
+            if (!consume('"')) return false;
+            const uint64_t end = _text.find('"', _pos);
+            if (end == std::string::npos) return false;
+            string = _text.substr(_pos, end - _pos);
+            _pos = end + 1;
+            return string.find('\\') == std::string::npos;
+        }
+
+        bool parse_value(JsonValue& value)
+        {
+            skip_space();
+            if (_pos >= _text.size()) return false;
+
+            const char c = _text[_pos];
+            if (c == '"')
+            {
+                value.type = JsonValue::Type::String;
+                return parse_string(value.string);
+            }
+            if (c == '[')
+            {
+                value.type = JsonValue::Type::Array;
+                _pos++;
+                if (consume(']')) return true;
+                do
+                {
+                    if (!parse_value(value.array.emplace_back())) return false;
+                } while (consume(','));
+                return consume(']');
+            }
+            if (c == '{')
+            {
+                value.type = JsonValue::Type::Object;
+                _pos++;
+                if (consume('}')) return true;
+                do
+                {
+                    auto& [name, member] = value.object.emplace_back();
+                    if (!parse_string(name) || !consume(':') || !parse_value(member)) return false;
+                } while (consume(','));
+                return consume('}');
+            }
+            for (const char* literal : { "true", "false", "null" })
+            {
+                if (_text.compare(_pos, std::strlen(literal), literal) == 0)
+                {
+                    value.type = literal[0] == 'n' ? JsonValue::Type::Null : JsonValue::Type::Bool;
+                    _pos += std::strlen(literal);
+                    return true;
+                }
+            }
+
+            char* end = nullptr;
+            value.type = JsonValue::Type::Number;
+            value.number = std::strtod(_text.c_str() + _pos, &end);
+            if (end == _text.c_str() + _pos) return false;
+            _pos = static_cast<uint64_t>(end - _text.c_str());
+            return true;
+        }
+
+    private:
+        const std::string& _text;
+        uint64_t _pos = 0;
+    };
+
+    // 已知数量的 Job 由当前线程提交, 工作线程只能通过窃取拿到, 所以各线程执行数之和等于 Job 数,
+    // 工作线程的执行数等于窃取成功数. 导出的 chrome trace 是合法的 JSON, 每个 Job 一个 "ph": "X" 事件, tid 与执行它的线程一致.
+    TEST_CASE(thread_pool_profiler_counters_and_trace)
+    {
+        constexpr uint32_t thread_num = 2;
+        constexpr uint32_t job_num = 500;
+
+        ThreadPool pool(ThreadPoolDesc{ .thread_num = thread_num, .reserved_thread_num = 0 });
+        pool.get_profiler().set_counter_enabled(true);
+        pool.get_profiler().set_event_enabled(true);
+
+        std::atomic<uint32_t> run_num = 0;
+        std::atomic<uint32_t> counter = 0;
+        for (uint32_t ix = 0; ix < job_num; ++ix)
+        {
+            pool.submit(
+                pool.create_job(
+                    [&]()
+                    {
+                        const auto begin = std::chrono::steady_clock::now();
+                        while (std::chrono::steady_clock::now() - begin < std::chrono::microseconds(20)) {}
+                        run_num++;
+                    }
+                ),
+                &counter
+            );
+        }
+        pool.wait(counter);
+        CHECK(run_num.load() == job_num);
+
+        // 第一个非工作线程的队列序号为 thread_num, 最后一个是 "Other Threads".
+        const auto counters = pool.get_profiler().get_counters();
+        CHECK(counters.size() == thread_num + ThreadPool::external_thread_capacity + 1);
+
+        uint64_t executed_num = 0, worker_executed_num = 0, steal_success_num = 0;
+        for (uint32_t ix = 0; ix < counters.size(); ++ix)
+        {
+            executed_num += counters[ix].executed_job_num;
+            steal_success_num += counters[ix].steal_success_num;
+            CHECK(counters[ix].steal_success_num <= counters[ix].steal_attempt_num);
+            if (ix < thread_num)
+            {
+                worker_executed_num += counters[ix].executed_job_num;
+                CHECK(counters[ix].executed_job_num == counters[ix].steal_success_num);
+            }
+            else if (ix != thread_num)
+            {
+                CHECK(counters[ix].executed_job_num == 0);
+            }
+        }
+        CHECK(executed_num == job_num);
+        CHECK(steal_success_num == worker_executed_num);
+        CHECK(counters[thread_num].queue_high_water_mark > 0);
+
+        const std::string path = (std::filesystem::temp_directory_path() / "thread_pool_trace.json").string();
+        CHECK(pool.export_chrome_trace(path));
+
+        std::ifstream input(path);
+        std::stringstream stream;
+        stream << input.rdbuf();
+        input.close();
+        std::filesystem::remove(path);
+
+        const std::string text = stream.str();
+        JsonValue root;
+        CHECK(JsonParser(text).parse(root));
+
+        const JsonValue* events = root.find("traceEvents");
+        CHECK(events && events->type == JsonValue::Type::Array);
+        CHECK(root.find("otherData") && root.find("otherData")->object.size() == counters.size());
+
+        std::vector<uint64_t> event_nums(counters.size(), 0);
+        uint32_t metadata_num = 0;
+        bool valid_event = true;
+        for (const auto& event : events ? events->array : std::vector<JsonValue>{})
+        {
+            const JsonValue* phase = event.find("ph");
+            const JsonValue* tid = event.find("tid");
+            if (!phase || !tid || tid->number >= counters.size())
+            {
+                valid_event = false;
+                continue;
+            }
+            if (phase->string == "M") metadata_num++;
+            if (phase->string != "X") continue;
+
+            const JsonValue* name = event.find("name");
+            const JsonValue* duration = event.find("dur");
+            valid_event &= name && name->string == "Job" && event.find("ts") && duration && duration->number >= 0.0;
+            event_nums[static_cast<uint32_t>(tid->number)]++;
+        }
+        CHECK(valid_event);
+        CHECK(metadata_num == counters.size());
+        for (uint32_t ix = 0; ix < counters.size(); ++ix) CHECK(event_nums[ix] == counters[ix].executed_job_num);
+    }
+
+    // 各个优先级的 parallel_for 和 TaskGroup 互相嵌套, 所有 Job 都执行且只执行一次.
+    TEST_CASE(thread_pool_nested_priority_stress)
+    {
+        ThreadPool pool(ThreadPoolDesc{ .thread_num = 4, .reserved_thread_num = 1 });
+
+        constexpr uint64_t outer_num = 64;
+        constexpr uint64_t inner_num = 256;
+        std::vector<std::atomic<uint32_t>> counts(outer_num * inner_num * 3);
+
+        auto run_nested = [&](uint64_t base)
+        {
+            auto outer_func = [&, base](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t outer = begin; outer < end; ++outer)
+                {
+                    auto inner_func = [&, base, outer](uint64_t inner_begin, uint64_t inner_end)
+                    {
+                        for (uint64_t inner = inner_begin; inner < inner_end; ++inner)
+                        {
+                            counts[base + outer * inner_num + inner].fetch_add(1, std::memory_order_relaxed);
+                        }
+                    };
+                    pool.parallel_for(inner_func, inner_num, 8);
+                }
+            };
+            pool.parallel_for(outer_func, outer_num, 1);
+        };
+
+        std::atomic<uint32_t> background_counter = 0;
+        pool.submit(
+            pool.create_job(
+                [&]()
+                {
+                    run_nested(0);
+                    pool.yield();
+                }
+            ),
+            &background_counter,
+            TaskPriority::Background
+        );
+
+        {
+            TaskPriorityScope scope(TaskPriority::Critical);
+            run_nested(outer_num * inner_num);
+        }
+        run_nested(2 * outer_num * inner_num);
+        pool.wait(background_counter);
+
+        bool all_once = true;
+        for (const auto& count : counts) all_once &= count.load() == 1;
+        CHECK(all_once);
+    }
+
+    // 后台任务中的 parallel_for 也按 lazy binary splitting 拆分, 本线程后台队列非空时不再拆出新的 Job.
+    TEST_CASE(thread_pool_background_lazy_splitting)
+    {
+        ThreadPool pool(ThreadPoolDesc{ .thread_num = 2, .reserved_thread_num = 0 });
+        pool.get_profiler().set_counter_enabled(true);
+
+        constexpr uint64_t count = 1 << 16;
+        std::vector<std::atomic<uint32_t>> counts(count);
+
+        std::atomic<uint32_t> counter = 0;
+        pool.submit(
+            pool.create_job(
+                [&]()
+                {
+                    auto func = [&](uint64_t begin, uint64_t end)
+                    {
+                        for (uint64_t ix = begin; ix < end; ++ix) counts[ix].fetch_add(1, std::memory_order_relaxed);
+                    };
+                    pool.parallel_for(func, count, 1);
+                }
+            ),
+            &counter,
+            TaskPriority::Background
+        );
+        CHECK(wait_for_counter(counter, 30.0f));
+
+        bool all_once = true;
+        for (const auto& count : counts) all_once &= count.load() == 1;
+        CHECK(all_once);
+
+        // 每次拆分都提交一个 Job 时约为 count 个.
+        const uint64_t job_num = get_executed_job_num(pool);
+        CHECK(job_num < count / 16);
+    }
+
+    // 保留的工作线程不执行后台任务: 后台任务占满其它工作线程时, Normal Job 仍然能执行.
+    TEST_CASE(thread_pool_reserved_worker)
+    {
+        ThreadPool pool(ThreadPoolDesc{ .thread_num = 2, .reserved_thread_num = 1 });
+
+        std::atomic<bool> release = false;
+        std::atomic<uint32_t> background_counter = 0;
+        for (uint32_t ix = 0; ix < 2; ++ix)
+        {
+            pool.submit(
+                pool.create_job([&]() { while (!release.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1)); }),
+                &background_counter,
+                TaskPriority::Background
+            );
+        }
+
+        // 当前线程不参与执行, 只能由保留的工作线程完成.
+        std::atomic<uint32_t> normal_counter = 0;
+        std::atomic<uint32_t> normal_run_num = 0;
+        for (uint32_t ix = 0; ix < 16; ++ix)
+        {
+            pool.submit(pool.create_job([&]() { normal_run_num++; }), &normal_counter, TaskPriority::Normal);
+        }
+        CHECK(wait_for_counter(normal_counter, 10.0f));
+        CHECK(normal_run_num.load() == 16);
+
+        release.store(true);
+        CHECK(wait_for_counter(background_counter, 10.0f));
+    }
+
+    // 等待 Critical 任务的工作线程不会去执行后台队列中的 Job, 否则要等后台 Job 执行完才能返回.
+    TEST_CASE(thread_pool_critical_wait_latency)
+    {
+        ThreadPool pool(ThreadPoolDesc{ .thread_num = 2, .reserved_thread_num = 0 });
+
+        std::atomic<uint32_t> wait_counter = 1;
+        std::atomic<bool> waiting = false;
+        std::atomic<bool> critical_done = false;
+        std::atomic<uint32_t> critical_counter = 0;
+        pool.submit(
+            pool.create_job(
+                [&]()
+                {
+                    waiting.store(true);
+                    pool.wait(wait_counter);
+                    critical_done.store(true);
+                }
+            ),
+            &critical_counter,
+            TaskPriority::Critical
+        );
+        while (!waiting.load()) std::this_thread::yield();
+
+        // 后台 Job 比工作线程多, 全局后台队列中一直有 Job.
+        std::atomic<bool> release = false;
+        std::atomic<uint32_t> background_counter = 0;
+        for (uint32_t ix = 0; ix < 8; ++ix)
+        {
+            pool.submit(
+                pool.create_job([&]() { while (!release.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1)); }),
+                &background_counter,
+                TaskPriority::Background
+            );
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        Timer timer;
+        wait_counter.store(0);
+        while (!critical_done.load() && timer.elapsed() < 1.0f) std::this_thread::yield();
+        const float latency = timer.elapsed();
+        CHECK(critical_done.load());
+        CHECK(latency < 0.05f);
+
+        release.store(true);
+        CHECK(wait_for_counter(critical_counter, 10.0f));
+        CHECK(wait_for_counter(background_counter, 10.0f));
+    }
+
+    // 非工作线程提交 Job 后直接退出, Job 的内存属于线程池, 之后仍然能执行. 退出的线程归还队列序号,
+    // 之后的线程 (包括超出 external_thread_capacity 个的) 仍然有自己的队列.
+    TEST_CASE(thread_pool_short_lived_external_threads)
+    {
+        ThreadPool pool(ThreadPoolDesc{ .thread_num = 1, .reserved_thread_num = 0 });
+        pool.get_profiler().set_counter_enabled(true);
+
+        // 占住唯一的工作线程, 短生命周期线程提交的 Job 在它们退出后才会执行.
+        std::atomic<bool> blocking = false;
+        std::atomic<bool> release = false;
+        std::atomic<uint32_t> block_counter = 0;
+        auto block_worker = [&]()
+        {
+            blocking.store(false);
+            release.store(false);
+            pool.submit(
+                pool.create_job(
+                    [&]()
+                    {
+                        blocking.store(true);
+                        while (!release.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                ),
+                &block_counter
+            );
+            while (!blocking.load()) std::this_thread::yield();
+        };
+
+        // 同时存在的线程多于 external_thread_capacity, 多出的线程使用全局队列和共用的 Job 块.
+        constexpr uint32_t thread_num = 16;
+        constexpr uint32_t job_num = 64;
+        std::atomic<uint32_t> done_num = 0;
+        block_worker();
+        {
+            std::vector<std::thread> threads;
+            for (uint32_t ix = 0; ix < thread_num; ++ix)
+            {
+                threads.emplace_back(
+                    [&]()
+                    {
+                        for (uint32_t jx = 0; jx < job_num; ++jx)
+                        {
+                            pool.submit(pool.create_job([&]() { done_num.fetch_add(1); }));
+                        }
+                    }
+                );
+            }
+            for (auto& thread : threads) thread.join();
+        }
+        CHECK(done_num.load() == 0);
+        release.store(true);
+        CHECK(wait_for_counter(block_counter, 10.0f));
+
+        Timer timer;
+        while (done_num.load() < thread_num * job_num && timer.elapsed() < 10.0f) std::this_thread::yield();
+        CHECK(done_num.load() == thread_num * job_num);
+
+        // 依次创建的线程数是 external_thread_capacity 的两倍, 工作线程被占住, 每个线程在 wait() 中执行自己的 Job.
+        // 序号没有归还时, 后面的线程执行的 Job 记在 "Other Threads" 上.
+        const auto counters = pool.get_profiler().get_counters();
+        const uint64_t other_job_num = counters.back().executed_job_num;
+        block_worker();
+        for (uint32_t ix = 0; ix < 2 * ThreadPool::external_thread_capacity; ++ix)
+        {
+            std::thread thread(
+                [&]()
+                {
+                    std::atomic<uint32_t> counter = 0;
+                    for (uint32_t jx = 0; jx < 8; ++jx) pool.submit(pool.create_job([&]() { done_num.fetch_add(1); }), &counter);
+                    pool.wait(counter);
+                }
+            );
+            thread.join();
+        }
+        release.store(true);
+        CHECK(wait_for_counter(block_counter, 10.0f));
+        CHECK(done_num.load() == thread_num * job_num + 16 * ThreadPool::external_thread_capacity);
+        CHECK(pool.get_profiler().get_counters().back().executed_job_num == other_job_num);
+    }
+
+    // 原来的单队列线程池: 每个任务一个 packaged_task 和 future, 所有线程共用一个加锁的队列, 调用线程只等待.
+    // 原实现的工作线程在局部 mutex 上等待, 可能丢失唤醒, 这里改为在队列的 mutex 上等待.
+    // 原来的 ConcurrentQueue 每次 push 还要分配链表节点和 shared_ptr, std::queue 的开销更小, 对比结果偏向旧实现.
+    class LegacyThreadPool
+    {
+    public:
+        explicit LegacyThreadPool(uint32_t thread_num)
+        {
+            for (uint32_t ix = 0; ix < thread_num; ++ix) _threads.emplace_back([this]() { worker_thread(); });
+        }
+
+        ~LegacyThreadPool()
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _done = true;
+            }
+            _condition.notify_all();
+            for (auto& thread : _threads) thread.join();
+        }
+
+        std::future<bool> submit(std::function<bool()> func)
+        {
+            auto task = std::make_shared<std::packaged_task<bool()>>(std::move(func));
+            std::future<bool> future = task->get_future();
+            {
+                std::lock_guard lock(_mutex);
+                _tasks.push([task]() { (*task)(); });
+            }
+            _condition.notify_one();
+            return future;
+        }
+
+        void parallel_for(const std::function<void(uint64_t)>& func, uint64_t count, uint64_t chunk_size)
+        {
+            std::vector<std::future<bool>> futures;
+            for (uint64_t ix = 0; ix < count; ix += chunk_size)
+            {
+                futures.push_back(
+                    submit(
+                        [&func, ix, count, chunk_size]()
+                        {
+                            for (uint64_t jx = ix; jx < std::min(ix + chunk_size, count); ++jx) func(jx);
+                            return true;
+                        }
+                    )
+                );
+            }
+            for (auto& future : futures) future.get();
+        }
+
+    private:
+        void worker_thread()
+        {
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock lock(_mutex);
+                    _condition.wait(lock, [this]() { return _done || !_tasks.empty(); });
+                    if (_tasks.empty()) return;
+                    task = std::move(_tasks.front());
+                    _tasks.pop();
+                }
+                task();
+            }
+        }
+
+    private:
+        bool _done = false;
+        std::vector<std::thread> _threads;
+        std::queue<std::function<void()>> _tasks;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+    };
+
+    // 细粒度任务 (每个任务只有几十纳秒的计算) 的调度开销, 与原来的单队列线程池对比, 两者的工作线程数相同.
+    BENCHMARK_CASE(thread_pool_fine_grained_tasks)
+    {
+        ThreadPool pool;
+        LegacyThreadPool legacy_pool(pool.get_thread_num());
+        std::printf("    %u worker threads\n", pool.get_thread_num());
+
+        constexpr uint32_t round_num = 5;
+        auto report = [](const char* name, uint64_t task_num, float time, float legacy_time)
+        {
+            std::printf(
+                "    %-30s %7llu tasks: %8.1f ns per task, legacy %8.1f ns, %.1fx\n",
+                name, static_cast<unsigned long long>(task_num), time / round_num / task_num * 1e9f,
+                legacy_time / round_num / task_num * 1e9f, legacy_time / time
+            );
+        };
+
+        for (uint64_t count : { 1ull << 10, 1ull << 14, 1ull << 17 })
+        {
+            std::vector<float> values(count, 1.0f);
+            auto work = [&values](uint64_t ix)
+            {
+                float value = values[ix];
+                for (uint32_t jx = 0; jx < 16; ++jx) value = value * 0.5f + 0.5f;
+                values[ix] = value;
+            };
+
+            // 每个元素一个任务的 parallel_for.
+            auto range_work = [&work](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t ix = begin; ix < end; ++ix) work(ix);
+            };
+            Timer timer;
+            for (uint32_t round = 0; round < round_num; ++round) pool.parallel_for(range_work, count, 1);
+            const float parallel_for_time = timer.tick();
+            for (uint32_t round = 0; round < round_num; ++round) legacy_pool.parallel_for(work, count, 1);
+            report("parallel_for (grain 1)", count, parallel_for_time, timer.tick());
+
+            // 逐个提交相互独立的任务, 全部提交后等待.
+            for (uint32_t round = 0; round < round_num; ++round)
+            {
+                std::atomic<uint32_t> counter = 0;
+                for (uint64_t ix = 0; ix < count; ++ix) pool.submit(pool.create_job([&work, ix]() { work(ix); }), &counter);
+                pool.wait(counter);
+            }
+            const float submit_time = timer.tick();
+            for (uint32_t round = 0; round < round_num; ++round)
+            {
+                std::vector<std::future<bool>> futures;
+                futures.reserve(count);
+                for (uint64_t ix = 0; ix < count; ++ix) futures.push_back(legacy_pool.submit([&work, ix]() { work(ix); return true; }));
+                for (auto& future : futures) future.get();
+            }
+            report("submit + wait", count, submit_time, timer.tick());
+        }
+    }
+
+    // 后台任务占满可以执行后台任务的工作线程时, 前台 parallel_for 的延迟.
+    BENCHMARK_CASE(thread_pool_foreground_latency)
+    {
+        ThreadPool pool;
+
+        auto measure = [&pool](const char* name)
+        {
+            std::vector<float> values(1 << 16, 1.0f);
+            auto func = [&values](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t ix = begin; ix < end; ++ix) values[ix] = values[ix] * 0.5f + 0.5f;
+            };
+
+            float total_time = 0.0f;
+            float max_time = 0.0f;
+            constexpr uint32_t frame_num = 200;
+            for (uint32_t ix = 0; ix < frame_num; ++ix)
+            {
+                Timer timer;
+                pool.parallel_for(func, values.size());
+                const float time = timer.elapsed();
+                total_time += time;
+                max_time = std::max(max_time, time);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            std::printf("    %s: average %.3f ms, max %.3f ms\n", name, total_time / frame_num * 1e3f, max_time * 1e3f);
+        };
+
+        measure("idle");
+
+        // 每个后台任务反复执行一段计算, 在安全点调用 yield().
+        std::atomic<bool> stop = false;
+        std::atomic<uint32_t> background_counter = 0;
+        for (uint32_t ix = 0; ix < pool.get_thread_num() * 2; ++ix)
+        {
+            pool.submit(
+                pool.create_job(
+                    [&]()
+                    {
+                        volatile float value = 0.0f;
+                        while (!stop.load(std::memory_order_relaxed))
+                        {
+                            for (uint32_t jx = 0; jx < 10000; ++jx) value = value + 1.0f;
+                            pool.yield();
+                        }
+                    }
+                ),
+                &background_counter,
+                TaskPriority::Background
+            );
+        }
+
+        measure("background saturated");
+
+        stop.store(true);
+        pool.wait(background_counter);
+    }
+}
@@ -0,0 +1,233 @@
+#include "unit_test.h"
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "../core/parallel/thread_queue.h"
+#include "../core/tools/timer.h"
+
+namespace fantasy
+{
+    // 值的高 32 位为生产者序号, 低 32 位为该生产者内的序号.
+    static uint64_t make_queue_value(uint64_t producer, uint64_t sequence) { return (producer << 32) | sequence; }
+
+    TEST_CASE(bounded_queue_full_and_empty)
+    {
+        BoundedQueue<uint32_t, 4> queue;
+        uint32_t value = 0;
+        CHECK(!queue.try_pop(value));
+
+        for (uint32_t ix = 0; ix < 4; ++ix) CHECK(queue.try_push(ix));
+        CHECK(!queue.try_push(4u));
+        CHECK(queue.size() == 4);
+
+        for (uint32_t ix = 0; ix < 4; ++ix)
+        {
+            CHECK(queue.try_pop(value));
+            CHECK(value == ix);
+        }
+        CHECK(!queue.try_pop(value));
+        CHECK(queue.empty());
+
+        BoundedQueue<uint32_t, 4, true> spsc_queue;
+        for (uint32_t ix = 0; ix < 4; ++ix) CHECK(spsc_queue.try_push(ix));
+        CHECK(!spsc_queue.try_push(4u));
+        for (uint32_t ix = 0; ix < 4; ++ix)
+        {
+            CHECK(spsc_queue.try_pop(value));
+            CHECK(value == ix);
+        }
+        CHECK(!spsc_queue.try_pop(value));
+    }
+
+    // 容量很小, 生产者和消费者经常在 wait_push()/wait_pop() 中阻塞.
+    TEST_CASE(bounded_queue_mpmc_stress)
+    {
+        constexpr uint32_t producer_num = 4;
+        constexpr uint32_t consumer_num = 4;
+        constexpr uint32_t value_num = 50000;
+
+        BoundedQueue<uint64_t, 16> queue;
+        std::vector<std::vector<uint64_t>> consumed(consumer_num);
+
+        std::vector<std::thread> threads;
+        for (uint32_t producer = 0; producer < producer_num; ++producer)
+        {
+            threads.emplace_back(
+                [&queue, producer]()
+                {
+                    for (uint32_t ix = 0; ix < value_num; ++ix) queue.wait_push(make_queue_value(producer, ix));
+                }
+            );
+        }
+        for (uint32_t consumer = 0; consumer < consumer_num; ++consumer)
+        {
+            threads.emplace_back(
+                [&queue, &consumed, consumer]()
+                {
+                    for (uint32_t ix = 0; ix < producer_num * value_num / consumer_num; ++ix)
+                    {
+                        uint64_t value = 0;
+                        queue.wait_pop(value);
+                        consumed[consumer].push_back(value);
+                    }
+                }
+            );
+        }
+        for (auto& thread : threads) thread.join();
+
+        // 每个值只出队一次, 同一个消费者看到的同一生产者的值保持入队顺序.
+        std::vector<uint32_t> counts(producer_num * value_num, 0);
+        for (const auto& values : consumed)
+        {
+            std::vector<int64_t> last_sequences(producer_num, -1);
+            for (uint64_t value : values)
+            {
+                const uint32_t producer = static_cast<uint32_t>(value >> 32);
+                const uint32_t sequence = static_cast<uint32_t>(value);
+                CHECK(producer < producer_num && sequence < value_num);
+                CHECK(static_cast<int64_t>(sequence) > last_sequences[producer]);
+                last_sequences[producer] = sequence;
+                counts[producer * value_num + sequence]++;
+            }
+        }
+        bool all_once = true;
+        for (uint32_t count : counts) all_once &= count == 1;
+        CHECK(all_once);
+        CHECK(queue.empty());
+    }
+
+    TEST_CASE(bounded_queue_spsc_stress)
+    {
+        constexpr uint32_t value_num = 200000;
+
+        BoundedQueue<uint32_t, 64, true> queue;
+        std::thread producer(
+            [&queue]()
+            {
+                for (uint32_t ix = 0; ix < value_num; ++ix) queue.wait_push(ix);
+            }
+        );
+
+        bool in_order = true;
+        for (uint32_t ix = 0; ix < value_num; ++ix)
+        {
+            uint32_t value = 0;
+            queue.wait_pop(value);
+            in_order &= value == ix;
+        }
+        producer.join();
+
+        CHECK(in_order);
+        CHECK(queue.empty());
+    }
+
+    // 拥有者线程交替 push()/pop(), 其它线程不停 steal(), 每个值只能被取走一次.
+    TEST_CASE(work_stealing_queue_stress)
+    {
+        constexpr uint32_t thief_num = 3;
+        constexpr uint32_t value_num = 200000;
+
+        WorkStealingQueue<uint32_t, 256> queue;
+        std::vector<std::atomic<uint32_t>> counts(value_num);
+        std::atomic<bool> done = false;
+
+        std::vector<std::thread> thieves;
+        for (uint32_t ix = 0; ix < thief_num; ++ix)
+        {
+            thieves.emplace_back(
+                [&]()
+                {
+                    uint32_t value = 0;
+                    while (!done.load(std::memory_order_acquire) || !queue.empty())
+                    {
+                        if (queue.steal(value)) counts[value].fetch_add(1, std::memory_order_relaxed);
+                        else std::this_thread::yield();
+                    }
+                }
+            );
+        }
+
+        uint32_t value = 0;
+        for (uint32_t ix = 0; ix < value_num; ++ix)
+        {
+            while (!queue.push(ix))
+            {
+                if (queue.pop(value)) counts[value].fetch_add(1, std::memory_order_relaxed);
+            }
+            if (ix % 3 == 0 && queue.pop(value)) counts[value].fetch_add(1, std::memory_order_relaxed);
+        }
+        while (queue.pop(value)) counts[value].fetch_add(1, std::memory_order_relaxed);
+
+        done.store(true, std::memory_order_release);
+        for (auto& thief : thieves) thief.join();
+
+        bool all_once = true;
+        for (const auto& count : counts) all_once &= count.load() == 1;
+        CHECK(all_once);
+    }
+
+    // 对比 std::mutex + std::queue, 线程对数增加时的吞吐量.
+    BENCHMARK_CASE(bounded_queue_contention)
+    {
+        constexpr uint32_t value_num = 1000000;
+
+        for (uint32_t pair_num = 1; pair_num <= 4; pair_num *= 2)
+        {
+            const uint32_t per_thread_num = value_num / pair_num;
+
+            BoundedQueue<uint64_t, 1024> queue;
+            Timer queue_timer;
+            {
+                std::vector<std::thread> threads;
+                for (uint32_t ix = 0; ix < pair_num; ++ix)
+                {
+                    threads.emplace_back([&]() { for (uint32_t jx = 0; jx < per_thread_num; ++jx) queue.wait_push(uint64_t(jx)); });
+                    threads.emplace_back([&]() { uint64_t value; for (uint32_t jx = 0; jx < per_thread_num; ++jx) queue.wait_pop(value); });
+                }
+                for (auto& thread : threads) thread.join();
+            }
+            const float queue_time = queue_timer.elapsed();
+
+            std::mutex mutex;
+            std::queue<uint64_t> locked_queue;
+            Timer locked_timer;
+            {
+                std::vector<std::thread> threads;
+                for (uint32_t ix = 0; ix < pair_num; ++ix)
+                {
+                    threads.emplace_back(
+                        [&]()
+                        {
+                            for (uint32_t jx = 0; jx < per_thread_num; ++jx)
+                            {
+                                std::lock_guard lock(mutex);
+                                locked_queue.push(jx);
+                            }
+                        }
+                    );
+                    threads.emplace_back(
+                        [&]()
+                        {
+                            for (uint32_t jx = 0; jx < per_thread_num;)
+                            {
+                                std::lock_guard lock(mutex);
+                                if (locked_queue.empty()) continue;
+                                locked_queue.pop();
+                                ++jx;
+                            }
+                        }
+                    );
+                }
+                for (auto& thread : threads) thread.join();
+            }
+            const float locked_time = locked_timer.elapsed();
+
+            std::printf(
+                "    %u producer / %u consumer: BoundedQueue %.1f Mops/s, mutex queue %.1f Mops/s\n",
+                pair_num, pair_num, value_num / queue_time * 1e-6f, value_num / locked_time * 1e-6f
+            );
+        }
+    }
+}
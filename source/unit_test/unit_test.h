@@ -0,0 +1,43 @@
+#ifndef UNIT_TEST_H
+#define UNIT_TEST_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace fantasy::unit_test
+{
+    struct TestCase
+    {
+        const char* name = nullptr;
+        void (*func)() = nullptr;
+        bool benchmark = false;
+    };
+
+    std::vector<TestCase>& get_test_cases();
+    void report_failure(const char* expression, const char* file, uint32_t line);
+
+    struct TestRegistrar
+    {
+        TestRegistrar(const char* name, void (*func)(), bool benchmark)
+        {
+            get_test_cases().push_back(TestCase{ name, func, benchmark });
+        }
+    };
+}
+
+#define TEST_CASE(name)                                                                                 \
+    static void name();                                                                                 \
+    static fantasy::unit_test::TestRegistrar name##_registrar(#name, name, false);                     \
+    static void name()
+
+// 只在命令行带 --benchmark 时运行.
+#define BENCHMARK_CASE(name)                                                                            \
+    static void name();                                                                                 \
+    static fantasy::unit_test::TestRegistrar name##_registrar(#name, name, true);                      \
+    static void name()
+
+#define CHECK(expression)                                                                               \
+    do { if (!(expression)) fantasy::unit_test::report_failure(#expression, __FILE__, __LINE__); } while (0)
+
+#endif
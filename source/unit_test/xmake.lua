@@ -0,0 +1,13 @@
+
+
+target("unit_test")
+    set_kind("binary")
+    set_languages("c99", "c++20")
+    set_default(false)
+    add_files("**.cpp")
+
+    add_deps("core")
+
+    -- xmake test 只运行测试, 基准测试通过 xmake run unit_test --benchmark 运行.
+    add_tests("default")
+target_end()
@@ -27,3 +27,4 @@ includes("source/render_pass")
 includes("source/scene")
 includes("source/shader")
 includes("source/test")
+includes("source/unit_test")